@@ -3395,6 +3395,85 @@ static void test_delete_value(void)
     ok(res == ERROR_FILE_NOT_FOUND, "expected ERROR_FILE_NOT_FOUND, got %d\n", res);
 }
 
+static void test_large_key(void)
+{
+    unsigned int i, count = 500;
+    char name[32], prev[32];
+    DWORD size, subkeys, values;
+    HKEY key, subkey;
+    LONG ret;
+
+    ret = RegCreateKeyA( hkey_main, "LargeKey", &key );
+    ok( !ret, "RegCreateKey failed: %d\n", ret );
+
+    /* create the entries in a scrambled order */
+    for (i = 0; i < count; i++)
+    {
+        sprintf( name, "Key%05u", (i * 7919) % count );
+        ret = RegCreateKeyA( key, name, &subkey );
+        if (ret) break;
+        RegCloseKey( subkey );
+        sprintf( name, "Value%05u", (i * 7919) % count );
+        ret = RegSetValueExA( key, name, 0, REG_DWORD, (const BYTE *)&i, sizeof(i) );
+        if (ret) break;
+    }
+    ok( !ret, "%u: failed to create entry: %d\n", i, ret );
+
+    ret = RegQueryInfoKeyA( key, NULL, NULL, NULL, &subkeys, NULL, NULL, &values, NULL, NULL, NULL, NULL );
+    ok( !ret, "RegQueryInfoKey failed: %d\n", ret );
+    ok( subkeys == count, "got %u subkeys\n", subkeys );
+    ok( values == count, "got %u values\n", values );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( name, "KEY%05u", i );
+        ret = RegOpenKeyA( key, name, &subkey );
+        if (ret) break;
+        RegCloseKey( subkey );
+        sprintf( name, "VALUE%05u", i );
+        ret = RegQueryValueExA( key, name, NULL, NULL, NULL, NULL );
+        if (ret) break;
+    }
+    ok( !ret, "%u: failed to find entry: %d\n", i, ret );
+
+    /* subkeys are enumerated in sorted order */
+    prev[0] = 0;
+    for (i = 0; i < count; i++)
+    {
+        size = sizeof(name);
+        ret = RegEnumKeyExA( key, i, name, &size, NULL, NULL, NULL, NULL );
+        if (ret || strcmp( prev, name ) >= 0) break;
+        strcpy( prev, name );
+    }
+    ok( i == count, "%u: got %d %s after %s\n", i, ret, name, prev );
+
+    for (i = 0; i < count; i += 2)
+    {
+        sprintf( name, "Key%05u", i );
+        ret = RegDeleteKeyA( key, name );
+        if (ret) break;
+        sprintf( name, "Value%05u", i );
+        ret = RegDeleteValueA( key, name );
+        if (ret) break;
+    }
+    ok( !ret, "%u: failed to delete entry: %d\n", i, ret );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( name, "Key%05u", i );
+        ret = RegOpenKeyA( key, name, &subkey );
+        if (ret != ((i & 1) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND)) break;
+        if (!ret) RegCloseKey( subkey );
+        sprintf( name, "Value%05u", i );
+        ret = RegQueryValueExA( key, name, NULL, NULL, NULL, NULL );
+        if (ret != ((i & 1) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND)) break;
+    }
+    ok( i == count, "%u: got %d\n", i, ret );
+
+    delete_key( key );
+    RegCloseKey( key );
+}
+
 static void test_delete_key_value(void)
 {
     HKEY subkey;
@@ -4205,6 +4284,7 @@ START_TEST(registry)
     test_deleted_key();
     test_delete_value();
     test_delete_key_value();
+    test_large_key();
     test_RegOpenCurrentUser();
     test_RegNotifyChangeKeyValue();
     test_RegQueryValueExPerformanceData();
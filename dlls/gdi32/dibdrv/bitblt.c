@@ -581,6 +581,136 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     }
 }
 
+/* Large operations can be split in horizontal bands that are processed in parallel by
+ * the thread pool.  This is disabled unless WINEDIBTHREADS is set to the number of
+ * threads to use; the result is the same as when processing the bands sequentially. */
+
+#define MAX_DIB_THREADS  64
+#define MIN_BAND_PIXELS  (128 * 1024)
+
+struct band_job
+{
+    void  (*func)( void *ctx, int band );
+    void   *ctx;
+    int     count;
+    LONG    next;    /* next band to process */
+    LONG    done;    /* number of bands processed */
+    LONG    refs;
+    HANDLE  event;   /* signaled once all the bands have been processed */
+};
+
+/* the setting is read on each call, only for rectangles large enough to be split,
+ * where the lookup is negligible next to the work, so that it can be changed at run time */
+static int get_band_count( int width, int height )
+{
+    ULONGLONG count = (ULONGLONG)width * height / MIN_BAND_PIXELS;
+    DWORD err = GetLastError();
+    char buffer[16];
+    int threads = 1;
+
+    if (count < 2) return 1;
+
+    if (GetEnvironmentVariableA( "WINEDIBTHREADS", buffer, sizeof(buffer) )) threads = atoi( buffer );
+    SetLastError( err );
+    threads = max( 1, min( threads, MAX_DIB_THREADS ));
+    if (count > threads) count = threads;
+    return min( count, height );
+}
+
+static void release_band_job( struct band_job *job )
+{
+    if (InterlockedDecrement( &job->refs )) return;
+    CloseHandle( job->event );
+    HeapFree( GetProcessHeap(), 0, job );
+}
+
+static void process_bands( struct band_job *job )
+{
+    int band;
+
+    while ((band = InterlockedIncrement( &job->next ) - 1) < job->count)
+    {
+        job->func( job->ctx, band );
+        if (InterlockedIncrement( &job->done ) == job->count) SetEvent( job->event );
+    }
+}
+
+static void CALLBACK band_worker( TP_CALLBACK_INSTANCE *instance, void *arg )
+{
+    struct band_job *job = arg;
+
+    process_bands( job );
+    release_band_job( job );
+}
+
+/* run func for bands 0 to count - 1, the calling thread also takes its share of the work */
+static void run_bands( void (*func)( void *ctx, int band ), void *ctx, int count )
+{
+    struct band_job *job;
+    int i;
+
+    if (count > 1 && (job = HeapAlloc( GetProcessHeap(), 0, sizeof(*job) )))
+    {
+        if ((job->event = CreateEventW( NULL, TRUE, FALSE, NULL )))
+        {
+            job->func  = func;
+            job->ctx   = ctx;
+            job->count = count;
+            job->next  = 0;
+            job->done  = 0;
+            job->refs  = 1;
+
+            for (i = 1; i < count; i++)
+            {
+                InterlockedIncrement( &job->refs );
+                if (TrySubmitThreadpoolCallback( band_worker, job, NULL )) continue;
+                InterlockedDecrement( &job->refs );
+                break;
+            }
+            process_bands( job );
+            WaitForSingleObject( job->event, INFINITE );
+            release_band_job( job );
+            return;
+        }
+        HeapFree( GetProcessHeap(), 0, job );
+    }
+
+    for (i = 0; i < count; i++) func( ctx, i );
+}
+
+/* compute the rows of a band */
+static void get_band_rect( const RECT *rect, int band, int count, RECT *rc )
+{
+    int height = rect->bottom - rect->top;
+
+    rc->left   = rect->left;
+    rc->right  = rect->right;
+    rc->top    = rect->top + (LONGLONG)height * band / count;
+    rc->bottom = rect->top + (LONGLONG)height * (band + 1) / count;
+}
+
+struct blend_job
+{
+    dib_info      *dst;
+    const RECT    *rect;
+    const dib_info *src;
+    POINT          origin;
+    BLENDFUNCTION  blend;
+    int            count;
+};
+
+static void blend_band( void *arg, int band )
+{
+    const struct blend_job *job = arg;
+    POINT origin;
+    RECT rc;
+
+    get_band_rect( job->rect, band, job->count, &rc );
+    origin.x = job->origin.x;
+    origin.y = job->origin.y + rc.top - job->rect->top;
+    job->dst->funcs->blend_rect( job->dst, &rc, job->src, &origin, job->blend );
+}
+
 static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                          HRGN clip, BLENDFUNCTION blend )
 {
@@ -591,9 +721,17 @@ static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *sr
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
     for (i = 0; i < clipped_rects.count; i++)
     {
-        origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
-        origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
-        dst->funcs->blend_rect( dst, &clipped_rects.rects[i], src, &origin, blend );
+        const RECT *rc = &clipped_rects.rects[i];
+        int count = get_band_count( rc->right - rc->left, rc->bottom - rc->top );
+
+        origin.x = src_rect->left + rc->left - dst_rect->left;
+        origin.y = src_rect->top  + rc->top  - dst_rect->top;
+        if (count > 1)
+        {
+            struct blend_job job = { dst, rc, src, origin, blend, count };
+            run_bands( blend_band, &job, count );
+        }
+        else dst->funcs->blend_rect( dst, rc, src, &origin, blend );
     }
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
@@ -678,16 +816,44 @@ static void get_gradient_triangle_vertices( const GRADIENT_TRIANGLE *tri, const
     bounds->bottom = v[2].y;
 }
 
+struct gradient_job
+{
+    const dib_info *dib;
+    const RECT     *rect;
+    const TRIVERTEX *v;
+    int             mode;
+    int             count;
+    BOOL            ret;
+};
+
+static void gradient_band( void *arg, int band )
+{
+    struct gradient_job *job = arg;
+    RECT rc;
+
+    get_band_rect( job->rect, band, job->count, &rc );
+    if (!job->dib->funcs->gradient_rect( job->dib, &rc, job->v, job->mode )) job->ret = FALSE;
+}
+
 static BOOL gradient_rect( dib_info *dib, TRIVERTEX *v, int mode, HRGN clip, const RECT *bounds )
 {
-    int i;
+    int i, count;
     struct clipped_rects clipped_rects;
     BOOL ret = TRUE;
 
     if (!get_clipped_rects( dib, bounds, clip, &clipped_rects )) return TRUE;
     for (i = 0; i < clipped_rects.count; i++)
     {
-        if (!(ret = dib->funcs->gradient_rect( dib, &clipped_rects.rects[i], v, mode ))) break;
+        const RECT *rc = &clipped_rects.rects[i];
+
+        if ((count = get_band_count( rc->right - rc->left, rc->bottom - rc->top )) > 1)
+        {
+            struct gradient_job job = { dib, rc, v, mode, count, TRUE };
+            run_bands( gradient_band, &job, count );
+            ret = job.ret;
+        }
+        else ret = dib->funcs->gradient_rect( dib, rc, v, mode );
+        if (!ret) break;
     }
     free_clipped_rects( &clipped_rects );
     return ret;
@@ -1196,6 +1362,131 @@ static DWORD calc_1d_stretch_params( INT dst_start, INT dst_length, INT dst_vis_
 }
 
 
+struct stretch_band
+{
+    POINT dst_start;
+    POINT src_start;
+    int   err;
+    int   length;
+};
+
+struct stretch_job
+{
+    dib_info                    *dst_dib;
+    const dib_info              *src_dib;
+    void (* row_fn)(const dib_info *dst_dib, const POINT *dst_start,
+                    const dib_info *src_dib, const POINT *src_start,
+                    const struct stretch_params *params, int mode, BOOL keep_dst);
+    const struct stretch_params *h_params;
+    const struct stretch_params *v_params;
+    int                          mode;
+    BOOL                         vstretch;
+    int                          width;
+    struct stretch_band          bands[MAX_DIB_THREADS];
+};
+
+static void stretch_band( void *arg, int index )
+{
+    struct stretch_job *job = arg;
+    const struct stretch_params *v_params = job->v_params;
+    const struct stretch_band *band = &job->bands[index];
+    POINT dst_start = band->dst_start, src_start = band->src_start;
+    int err = band->err, length = band->length;
+
+    if (job->vstretch)
+    {
+        BOOL need_row = TRUE;
+        RECT last_row, this_row;
+        last_row.left = 0;
+        last_row.right = job->width;
+
+        while (length--)
+        {
+            if (need_row)
+            {
+                job->row_fn( job->dst_dib, &dst_start, job->src_dib, &src_start, job->h_params, job->mode, FALSE );
+                need_row = FALSE;
+            }
+            else
+            {
+                last_row.top = dst_start.y - v_params->dst_inc;
+                last_row.bottom = last_row.top + 1;
+                this_row = last_row;
+                offset_rect( &this_row, 0, v_params->dst_inc );
+                copy_rect( job->dst_dib, &this_row, job->dst_dib, &last_row, NULL, R2_COPYPEN );
+            }
+
+            if (err > 0)
+            {
+                src_start.y += v_params->src_inc;
+                need_row = TRUE;
+                err += v_params->err_add_1;
+            }
+            else err += v_params->err_add_2;
+            dst_start.y += v_params->dst_inc;
+        }
+    }
+    else
+    {
+        int merged_rows = 0;
+
+        while (length--)
+        {
+            if (job->mode != STRETCH_DELETESCANS || !merged_rows)
+                job->row_fn( job->dst_dib, &dst_start, job->src_dib, &src_start, job->h_params, job->mode,
+                             merged_rows != 0 );
+            merged_rows++;
+
+            if (err > 0)
+            {
+                dst_start.y += v_params->dst_inc;
+                merged_rows = 0;
+                err += v_params->err_add_1;
+            }
+            else err += v_params->err_add_2;
+            src_start.y += v_params->src_inc;
+        }
+    }
+}
+
+/* split the rows in bands that start on a new destination row, returns the number of bands */
+static int split_stretch_bands( struct stretch_job *job, int count )
+{
+    const struct stretch_params *v_params = job->v_params;
+    struct stretch_band *band = job->bands;
+    POINT dst_start = band->dst_start, src_start = band->src_start;
+    int i, first = 0, err = band->err, length = band->length, bands = 1;
+    BOOL new_row = TRUE;
+
+    for (i = 0; i < length && bands < count; i++)
+    {
+        if (new_row && i >= (LONGLONG)length * bands / count)
+        {
+            band[bands - 1].length = i - first;
+            band[bands].dst_start = dst_start;
+            band[bands].src_start = src_start;
+            band[bands].err = err;
+            first = i;
+            bands++;
+        }
+
+        if (job->vstretch)
+        {
+            if (err > 0) src_start.y += v_params->src_inc;
+            dst_start.y += v_params->dst_inc;
+        }
+        else
+        {
+            new_row = err > 0;
+            if (err > 0) dst_start.y += v_params->dst_inc;
+            src_start.y += v_params->src_inc;
+        }
+        err += err > 0 ? v_params->err_add_1 : v_params->err_add_2;
+    }
+    band[bands - 1].length = length - first;
+    return bands;
+}
+
 DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bitblt_coords *src,
                           const BITMAPINFO *dst_info, void *dst_bits, struct bitblt_coords *dst,
                           INT mode )
@@ -1205,11 +1496,9 @@ DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bit
     RECT rect;
     BOOL hstretch, vstretch;
     struct stretch_params v_params, h_params;
-    int err;
+    struct stretch_job job;
+    int count;
     DWORD ret;
-    void (* row_fn)(const dib_info *dst_dib, const POINT *dst_start,
-                    const dib_info *src_dib, const POINT *src_start,
-                    const struct stretch_params *params, int mode, BOOL keep_dst);
 
     TRACE("dst %d, %d - %d x %d visrect %s src %d, %d - %d x %d visrect %s\n",
           dst->x, dst->y, dst->width, dst->height, wine_dbgstr_rect(&dst->visrect),
@@ -1243,64 +1532,22 @@ DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bit
     dst_start.x -= dst->visrect.left;
     dst_start.y -= dst->visrect.top;
 
-    err = v_params.err_start;
-
-    row_fn = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
-
-    if (vstretch)
-    {
-        BOOL need_row = TRUE;
-        RECT last_row, this_row;
-        if (hstretch) mode = STRETCH_DELETESCANS;
-        last_row.left = 0;
-        last_row.right = dst->visrect.right - dst->visrect.left;
-
-        while (v_params.length--)
-        {
-            if (need_row)
-            {
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, FALSE );
-                need_row = FALSE;
-            }
-            else
-            {
-                last_row.top = dst_start.y - v_params.dst_inc;
-                last_row.bottom = last_row.top + 1;
-                this_row = last_row;
-                offset_rect( &this_row, 0, v_params.dst_inc );
-                copy_rect( &dst_dib, &this_row, &dst_dib, &last_row, NULL, R2_COPYPEN );
-            }
-
-            if (err > 0)
-            {
-                src_start.y += v_params.src_inc;
-                need_row = TRUE;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            dst_start.y += v_params.dst_inc;
-        }
-    }
-    else
-    {
-        int merged_rows = 0;
-
-        while (v_params.length--)
-        {
-            if (mode != STRETCH_DELETESCANS || !merged_rows)
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, merged_rows != 0 );
-            merged_rows++;
-
-            if (err > 0)
-            {
-                dst_start.y += v_params.dst_inc;
-                merged_rows = 0;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            src_start.y += v_params.src_inc;
-        }
-    }
+    job.dst_dib  = &dst_dib;
+    job.src_dib  = &src_dib;
+    job.row_fn   = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
+    job.h_params = &h_params;
+    job.v_params = &v_params;
+    job.mode     = vstretch && hstretch ? STRETCH_DELETESCANS : mode;
+    job.vstretch = vstretch;
+    job.width    = dst->visrect.right - dst->visrect.left;
+    job.bands[0].dst_start = dst_start;
+    job.bands[0].src_start = src_start;
+    job.bands[0].err       = v_params.err_start;
+    job.bands[0].length    = v_params.length;
+
+    count = get_band_count( h_params.length, v_params.length );
+    if (count > 1) count = split_stretch_bands( &job, count );
+    run_bands( stretch_band, &job, count );
 
     /* update coordinates, the destination rectangle is always stored at 0,0 */
     *src = *dst;
@@ -214,9 +214,10 @@ typedef struct primitive_funcs
                                     const struct stretch_params *params, int mode, BOOL keep_dst);
 } primitive_funcs;
 
-extern const primitive_funcs funcs_8888 DECLSPEC_HIDDEN;
-extern const primitive_funcs funcs_32   DECLSPEC_HIDDEN;
-extern const primitive_funcs funcs_24   DECLSPEC_HIDDEN;
+/* the tables that can be updated by init_dib_primitives() */
+extern primitive_funcs       funcs_8888 DECLSPEC_HIDDEN;
+extern primitive_funcs       funcs_32   DECLSPEC_HIDDEN;
+extern primitive_funcs       funcs_24   DECLSPEC_HIDDEN;
 extern const primitive_funcs funcs_555  DECLSPEC_HIDDEN;
 extern const primitive_funcs funcs_16   DECLSPEC_HIDDEN;
 extern const primitive_funcs funcs_8    DECLSPEC_HIDDEN;
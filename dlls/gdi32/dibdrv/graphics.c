@@ -43,18 +43,27 @@ enum glyph_type
 #define GLYPH_CACHE_PAGE_SIZE  0x100
 #define GLYPH_CACHE_PAGES      (0x10000 / GLYPH_CACHE_PAGE_SIZE)
 
+struct shared_font_key;
+
 struct cached_font
 {
-    struct list           entry;
-    LONG                  ref;
-    DWORD                 hash;
-    LOGFONTW              lf;
-    XFORM                 xform;
-    UINT                  aa_flags;
-    struct cached_glyph **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
+    struct list             entry;
+    struct cached_font     *next_hash;   /* next font in the same hash bucket */
+    LONG                    ref;
+    DWORD                   hash;
+    LOGFONTW                lf;
+    XFORM                   xform;
+    UINT                    aa_flags;
+    struct shared_font_key *shared_key;  /* key in the shared glyph cache, NULL if not computed yet */
+    DWORD                   shared_slot;
+    DWORD                   shared_generation;
+    struct cached_glyph   **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
 };
 
-static struct list font_cache = LIST_INIT( font_cache );
+#define FONT_CACHE_BUCKETS 64
+
+static struct list font_cache = LIST_INIT( font_cache );  /* most recently used first */
+static struct cached_font *font_cache_buckets[FONT_CACHE_BUCKETS];
 
 static CRITICAL_SECTION font_cache_cs;
 static CRITICAL_SECTION_DEBUG critsect_debug =
@@ -634,9 +643,18 @@ static int font_cache_cmp( const struct cached_font *p1, const struct cached_fon
     return ret;
 }
 
+static inline UINT font_cache_bucket( DWORD hash )
+{
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return hash % FONT_CACHE_BUCKETS;
+}
+
+static void free_shared_font_key( struct shared_font_key *key );
+
 static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 {
-    struct cached_font font, *ptr, *last_unused = NULL;
+    struct cached_font font, *ptr, *last_unused = NULL, **bucket;
     UINT i = 0, j, k;
 
     GetObjectW( hfont, sizeof(font.lf), &font.lf );
@@ -651,9 +669,11 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     font.lf.lfWidth = abs( font.lf.lfWidth );
     font.aa_flags = aa_flags;
     font.hash = font_cache_hash( &font );
+    font.shared_key = NULL;
+    font.shared_slot = font.shared_generation = 0;
 
     EnterCriticalSection( &font_cache_cs );
-    LIST_FOR_EACH_ENTRY( ptr, &font_cache, struct cached_font, entry )
+    for (ptr = font_cache_buckets[font_cache_bucket( font.hash )]; ptr; ptr = ptr->next_hash)
     {
         if (!font_cache_cmp( &font, ptr ))
         {
@@ -661,6 +681,10 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
             list_remove( &ptr->entry );
             goto done;
         }
+    }
+
+    LIST_FOR_EACH_ENTRY( ptr, &font_cache, struct cached_font, entry )
+    {
         if (!ptr->ref)
         {
             i++;
@@ -681,7 +705,11 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
                 HeapFree( GetProcessHeap(), 0, ptr->glyphs[i][j] );
             }
         }
+        if (ptr->shared_key) free_shared_font_key( ptr->shared_key );
         list_remove( &ptr->entry );
+        for (bucket = &font_cache_buckets[font_cache_bucket( ptr->hash )]; *bucket != ptr;
+             bucket = &(*bucket)->next_hash) ;
+        *bucket = ptr->next_hash;
     }
     else if (!(ptr = HeapAlloc( GetProcessHeap(), 0, sizeof(*ptr) )))
     {
@@ -692,6 +720,9 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     *ptr = font;
     ptr->ref = 1;
     memset( ptr->glyphs, 0, sizeof(ptr->glyphs) );
+    bucket = &font_cache_buckets[font_cache_bucket( ptr->hash )];
+    ptr->next_hash = *bucket;
+    *bucket = ptr;
 done:
     list_add_head( &font_cache, &ptr->entry );
     LeaveCriticalSection( &font_cache_cs );
@@ -814,6 +845,496 @@ static int get_glyph_depth( UINT aa_flags )
     }
 }
 
+/*
+ * Shared glyph cache
+ *
+ * When WINEGLYPHCACHE is set to a size in megabytes, the rendered glyphs are also
+ * stored in a section shared by all the processes of the session, so that a process
+ * selecting a font that another one already used copies the glyphs instead of
+ * rendering them again.  The fonts are identified by their logical font, transform
+ * and antialiasing mode, and by the file and face of the realized font; memory fonts
+ * are never shared.  The glyphs are stored in a ring that evicts the oldest entries,
+ * the entries that are found in its older half are moved back to the front so that
+ * the glyphs still in use survive.  The section is protected by a spin lock, a
+ * process that can't get it simply renders its glyphs itself.
+ */
+
+#define SHARED_GLYPH_MAGIC       0x68706c67  /* "glph" */
+#define SHARED_GLYPH_FONTS       256
+#define SHARED_GLYPH_MAX_SIZE    1024        /* in megabytes */
+
+/* the layouts are the same for 32-bit and 64-bit processes */
+struct shared_font_key
+{
+    ULONGLONG file_size;
+    ULONGLONG file_time;
+    ULONGLONG path_hash;
+    LOGFONTW  lf;           /* with an upper case face name */
+    XFORM     xform;
+    UINT      aa_flags;
+    DWORD     face;         /* face index and simulations of the realized font */
+    DWORD     reserved;
+};
+
+struct shared_font
+{
+    struct shared_font_key key;
+    DWORD                  generation;  /* changed when the slot is reused, 0 if unused */
+    DWORD                  last_used;
+};
+
+#define SHARED_GLYPH_PADDING  0x01  /* unused space at the end of the ring */
+#define SHARED_GLYPH_DEAD     0x02  /* replaced by a newer copy */
+#define SHARED_GLYPH_INDEX    0x04  /* ETO_GLYPH_INDEX */
+
+struct shared_glyph
+{
+    DWORD        size;        /* size of the whole entry */
+    DWORD        flags;
+    DWORD        next;        /* next entry in the same bucket */
+    DWORD        font;
+    DWORD        generation;
+    DWORD        index;
+    GLYPHMETRICS metrics;
+    BYTE         bits[1];
+};
+
+struct shared_glyph_cache
+{
+    LONG  magic;
+    LONG  lock;               /* id of the owner thread, 0 if free */
+    DWORD size;
+    DWORD fonts;              /* offset of the font slots */
+    DWORD buckets;            /* offset of the hash buckets */
+    DWORD bucket_count;
+    DWORD ring;               /* offset and size of the glyph ring */
+    DWORD ring_size;
+    DWORD head;               /* where the next glyph is stored, relative to the ring */
+    DWORD tail;               /* oldest glyph */
+    DWORD used;
+    DWORD reserved;
+};
+
+C_ASSERT( sizeof(struct shared_font_key) == 152 );
+C_ASSERT( sizeof(struct shared_font) == 160 );
+C_ASSERT( FIELD_OFFSET( struct shared_glyph, bits ) == 44 );
+C_ASSERT( sizeof(struct shared_glyph_cache) == 48 );
+
+static struct shared_glyph_cache *shared_glyphs;  /* NULL if disabled */
+static DWORD shared_ring_start, shared_ring_end;  /* ring bounds, checked when the cache is opened */
+static struct shared_font_key no_shared_key;      /* the font can't be shared */
+
+static DWORD WINAPI init_shared_glyphs( RTL_RUN_ONCE *once, void *param, void **context )
+{
+    static const WCHAR nameW[] = {'_','_','W','I','N','E','_','G','L','Y','P','H','_','C','A','C','H','E','_','_',0};
+    struct shared_glyph_cache *cache;
+    MEMORY_BASIC_INFORMATION info;
+    HANDLE mapping;
+    DWORD size, fonts_size;
+    char buffer[16];
+    BOOL exists;
+    int i;
+
+    if (!GetEnvironmentVariableA( "WINEGLYPHCACHE", buffer, sizeof(buffer) )) return TRUE;
+    size = min( max( atoi( buffer ), 0 ), SHARED_GLYPH_MAX_SIZE ) * 1024 * 1024;
+    if (!size) return TRUE;
+
+    if (!(mapping = CreateFileMappingW( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, nameW )))
+        return TRUE;
+    exists = GetLastError() == ERROR_ALREADY_EXISTS;
+    cache = MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, 0 );
+    CloseHandle( mapping );
+    if (!cache) return TRUE;
+
+    if (!exists)
+    {
+        fonts_size = SHARED_GLYPH_FONTS * sizeof(struct shared_font);
+        cache->size = size;
+        cache->fonts = sizeof(*cache);
+        cache->buckets = cache->fonts + fonts_size;
+        for (cache->bucket_count = 1024; cache->bucket_count * 1024 < size; cache->bucket_count *= 2) ;
+        cache->ring = cache->buckets + cache->bucket_count * sizeof(DWORD);
+        cache->ring_size = (size - cache->ring) & ~7;
+        InterlockedExchange( &cache->magic, SHARED_GLYPH_MAGIC );
+    }
+    else  /* the creator may still be initializing it */
+    {
+        for (i = 0; i < 100 && cache->magic != SHARED_GLYPH_MAGIC; i++) Sleep( 1 );
+    }
+
+    if (cache->magic != SHARED_GLYPH_MAGIC || !VirtualQuery( cache, &info, sizeof(info) ) ||
+        info.RegionSize < cache->size || cache->fonts < sizeof(*cache) || cache->fonts > cache->size ||
+        cache->buckets < cache->fonts + SHARED_GLYPH_FONTS * sizeof(struct shared_font) ||
+        cache->buckets > cache->size || cache->bucket_count > cache->size / sizeof(DWORD) ||
+        !cache->bucket_count || (cache->bucket_count & (cache->bucket_count - 1)) ||
+        cache->ring < cache->buckets + cache->bucket_count * sizeof(DWORD) || (cache->ring & 7) ||
+        cache->ring > cache->size || cache->ring_size > cache->size - cache->ring)
+    {
+        WARN( "can't use the shared glyph cache\n" );
+        UnmapViewOfFile( cache );
+        return TRUE;
+    }
+
+    TRACE( "using %u bytes of shared glyph cache\n", cache->size );
+    shared_ring_start = cache->ring;
+    shared_ring_end = cache->ring + cache->ring_size;
+    shared_glyphs = cache;
+    return TRUE;
+}
+
+static inline void *shared_glyphs_ptr( DWORD offset )
+{
+    return (char *)shared_glyphs + offset;
+}
+
+static BOOL is_thread_alive( DWORD tid )
+{
+    DWORD err = GetLastError(), ret;
+    HANDLE thread;
+
+    if (!(thread = OpenThread( SYNCHRONIZE, FALSE, tid )))
+    {
+        ret = GetLastError() != ERROR_INVALID_PARAMETER;
+        SetLastError( err );
+        return ret;
+    }
+    ret = WaitForSingleObject( thread, 0 ) != WAIT_OBJECT_0;
+    CloseHandle( thread );
+    SetLastError( err );
+    return ret;
+}
+
+/* drop all the glyphs after the owner of the lock died, possibly in the middle of an update,
+ * or after finding the ring in an inconsistent state */
+static void reset_shared_glyphs(void)
+{
+    struct shared_font *fonts = shared_glyphs_ptr( shared_glyphs->fonts );
+    DWORD i;
+
+    for (i = 0; i < SHARED_GLYPH_FONTS; i++) memset( &fonts[i].key, 0, sizeof(fonts[i].key) );
+    memset( shared_glyphs_ptr( shared_glyphs->buckets ), 0, shared_glyphs->bucket_count * sizeof(DWORD) );
+    shared_glyphs->head = shared_glyphs->tail = shared_glyphs->used = 0;
+}
+
+static BOOL lock_shared_glyphs(void)
+{
+    static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
+    static DWORD retry_time;
+    LONG tid, owner;
+    int i;
+
+    RtlRunOnceExecuteOnce( &init_once, init_shared_glyphs, NULL, NULL );
+    if (!shared_glyphs) return FALSE;
+
+    /* after a timeout, render locally for a while instead of waiting again */
+    if (retry_time && (int)(GetTickCount() - retry_time) < 0) return FALSE;
+
+    tid = GetCurrentThreadId();
+    for (i = 0; i < 1000; i++)
+    {
+        if (!(owner = InterlockedCompareExchange( &shared_glyphs->lock, tid, 0 ))) return TRUE;
+        if (i >= 100) Sleep( 0 );
+    }
+
+    if (!is_thread_alive( owner ) && InterlockedCompareExchange( &shared_glyphs->lock, tid, owner ) == owner)
+    {
+        WARN( "owner %04x of the shared glyph cache died, resetting it\n", owner );
+        reset_shared_glyphs();
+        return TRUE;
+    }
+
+    WARN( "timed out waiting for the shared glyph cache, owner %04x\n", owner );
+    retry_time = GetTickCount() + 1000;
+    return FALSE;
+}
+
+static inline void unlock_shared_glyphs(void)
+{
+    InterlockedExchange( &shared_glyphs->lock, 0 );
+}
+
+static BOOL get_shared_font_key( DC *dc, const struct cached_font *font, struct shared_font_key *key )
+{
+    struct font_realization_info info;
+    union
+    {
+        struct font_fileinfo file;
+        BYTE                 buffer[FIELD_OFFSET( struct font_fileinfo, path[MAX_PATH] )];
+    } file_info;
+    ULONGLONG hash = 0xcbf29ce484222325;
+    const WCHAR *p;
+
+    info.size = sizeof(info);
+    if (!GetFontRealizationInfo( dc->hSelf, &info )) return FALSE;
+    if (!GetFontFileInfo( info.instance_id, 0, &file_info.file, sizeof(file_info), NULL )) return FALSE;
+    if (!file_info.file.path[0]) return FALSE;  /* memory font */
+
+    for (p = file_info.file.path; *p; p++) hash = (hash ^ *p) * 0x100000001b3;
+
+    memset( key, 0, sizeof(*key) );
+    key->file_size = file_info.file.size.QuadPart;
+    key->file_time = ((ULONGLONG)file_info.file.writetime.dwHighDateTime << 32) |
+                     file_info.file.writetime.dwLowDateTime;
+    key->path_hash = hash;
+    memcpy( &key->lf, &font->lf, FIELD_OFFSET( LOGFONTW, lfFaceName ));
+    lstrcpynW( key->lf.lfFaceName, font->lf.lfFaceName, LF_FACESIZE );
+    struprW( key->lf.lfFaceName );
+    key->xform = font->xform;
+    key->aa_flags = font->aa_flags;
+    key->face = info.face_index | (info.simulations << 16);
+    return TRUE;
+}
+
+/* find or allocate the slot of a font, the cache must be locked */
+static void get_shared_font( struct cached_font *font )
+{
+    struct shared_font *fonts = shared_glyphs_ptr( shared_glyphs->fonts );
+    DWORD i, now = GetTickCount(), oldest = 0;
+
+    if (font->shared_generation && fonts[font->shared_slot].generation == font->shared_generation)
+    {
+        fonts[font->shared_slot].last_used = now;
+        return;
+    }
+
+    for (i = 0; i < SHARED_GLYPH_FONTS; i++)
+    {
+        if (fonts[i].generation && !memcmp( &fonts[i].key, font->shared_key, sizeof(*font->shared_key) ))
+            goto done;
+        if (!fonts[oldest].generation) continue;
+        if (!fonts[i].generation || now - fonts[i].last_used > now - fonts[oldest].last_used) oldest = i;
+    }
+
+    /* the glyphs of the previous font become unreachable and are evicted with time */
+    i = oldest;
+    fonts[i].key = *font->shared_key;
+    if (!++fonts[i].generation) fonts[i].generation = 1;
+
+done:
+    fonts[i].last_used = now;
+    font->shared_slot = i;
+    font->shared_generation = fonts[i].generation;
+}
+
+static inline DWORD *get_shared_bucket( const struct cached_font *font, UINT index, DWORD flags )
+{
+    DWORD *buckets = shared_glyphs_ptr( shared_glyphs->buckets );
+    DWORD hash = (index * 0x9e3779b1) ^ (font->shared_slot * 0x85ebca6b) ^ (font->shared_generation << 8) ^ flags;
+
+    return &buckets[(hash ^ (hash >> 15)) & (shared_glyphs->bucket_count - 1)];
+}
+
+/* the cache is shared with other processes, don't trust what it contains */
+static inline struct shared_glyph *get_shared_glyph_entry( DWORD offset )
+{
+    struct shared_glyph *entry;
+
+    if ((offset & 7) || offset < shared_ring_start ||
+        shared_ring_end - offset < FIELD_OFFSET( struct shared_glyph, bits ))
+        return NULL;
+    entry = shared_glyphs_ptr( offset );
+    if (entry->size < FIELD_OFFSET( struct shared_glyph, bits ) || entry->size > shared_ring_end - offset)
+        return NULL;
+    return entry;
+}
+
+static struct shared_glyph *find_shared_glyph( const struct cached_font *font, UINT index, DWORD flags )
+{
+    struct shared_glyph *entry;
+    DWORD offset, count = 0;
+
+    /* the length check stops on loops in a corrupted bucket */
+    for (offset = *get_shared_bucket( font, index, flags ); offset && count++ < 1024; offset = entry->next)
+    {
+        if (!(entry = get_shared_glyph_entry( offset )))
+        {
+            WARN( "invalid shared glyph offset %x\n", offset );
+            return NULL;
+        }
+        if (entry->index == index && entry->font == font->shared_slot &&
+            entry->generation == font->shared_generation &&
+            (entry->flags & SHARED_GLYPH_INDEX) == flags)
+            return entry;
+    }
+    return NULL;
+}
+
+static void unlink_shared_glyph( struct shared_glyph *entry )
+{
+    DWORD offset = (char *)entry - (char *)shared_glyphs;
+    DWORD hash = (entry->index * 0x9e3779b1) ^ (entry->font * 0x85ebca6b) ^ (entry->generation << 8) ^
+                 (entry->flags & SHARED_GLYPH_INDEX);
+    DWORD *ptr = shared_glyphs_ptr( shared_glyphs->buckets );
+    DWORD count = 0;
+
+    ptr += (hash ^ (hash >> 15)) & (shared_glyphs->bucket_count - 1);
+    while (*ptr && count++ < 1024)
+    {
+        struct shared_glyph *cur = get_shared_glyph_entry( *ptr );
+        if (!cur) break;
+        if (*ptr == offset)
+        {
+            *ptr = cur->next;
+            break;
+        }
+        ptr = &cur->next;
+    }
+    entry->flags |= SHARED_GLYPH_DEAD;
+}
+
+/* allocate an entry at the head of the ring, evicting the oldest ones */
+static struct shared_glyph *alloc_shared_glyph( DWORD size )
+{
+    struct shared_glyph_cache *cache = shared_glyphs;
+    struct shared_glyph *entry;
+
+    if (size > cache->ring_size / 8) return NULL;  /* don't flush the cache for a huge glyph */
+
+    for (;;)
+    {
+        if (!cache->used) cache->head = cache->tail = 0;
+        if (cache->head >= cache->ring_size || cache->tail >= cache->ring_size) reset_shared_glyphs();
+
+        if (cache->head > cache->tail || !cache->used)
+        {
+            if (cache->ring_size - cache->head >= size) break;
+            /* skip the end of the ring */
+            entry = shared_glyphs_ptr( cache->ring + cache->head );
+            entry->size = cache->ring_size - cache->head;
+            entry->flags = SHARED_GLYPH_PADDING;
+            cache->used += entry->size;
+            cache->head = 0;
+            continue;
+        }
+        if (cache->tail - cache->head >= size) break;
+
+        entry = shared_glyphs_ptr( cache->ring + cache->tail );
+        if (!entry->size || (entry->size & 7) || entry->size > cache->ring_size - cache->tail)
+        {
+            WARN( "invalid shared glyph size %u, resetting the cache\n", entry->size );
+            reset_shared_glyphs();
+            continue;
+        }
+        if (!(entry->flags & (SHARED_GLYPH_PADDING | SHARED_GLYPH_DEAD))) unlink_shared_glyph( entry );
+        cache->tail += entry->size;
+        cache->used -= entry->size;
+        if (cache->tail == cache->ring_size) cache->tail = 0;
+    }
+
+    entry = shared_glyphs_ptr( cache->ring + cache->head );
+    cache->head += size;
+    cache->used += size;
+    if (cache->head == cache->ring_size) cache->head = 0;
+    return entry;
+}
+
+static void store_shared_glyph( const struct cached_font *font, UINT index, DWORD flags,
+                                const struct cached_glyph *glyph, DWORD bits_size )
+{
+    struct shared_glyph *entry;
+    DWORD *bucket;
+
+    if ((entry = find_shared_glyph( font, index, flags ))) unlink_shared_glyph( entry );
+
+    if (!(entry = alloc_shared_glyph( (FIELD_OFFSET( struct shared_glyph, bits[bits_size] ) + 7) & ~7 )))
+        return;
+    entry->size = (FIELD_OFFSET( struct shared_glyph, bits[bits_size] ) + 7) & ~7;
+    entry->flags = flags;
+    entry->font = font->shared_slot;
+    entry->generation = font->shared_generation;
+    entry->index = index;
+    entry->metrics = glyph->metrics;
+    memcpy( entry->bits, glyph->bits, bits_size );
+
+    bucket = get_shared_bucket( font, index, flags );
+    entry->next = *bucket;
+    *bucket = (char *)entry - (char *)shared_glyphs;
+}
+
+static inline DWORD get_glyph_bits_size( const GLYPHMETRICS *metrics, UINT aa_flags )
+{
+    return metrics->gmBlackBoxY * get_dib_stride( metrics->gmBlackBoxX, get_glyph_depth( aa_flags ));
+}
+
+/* the metrics come from another process, check that the bits fit in the entry */
+static BOOL get_shared_glyph_bits_size( const struct shared_glyph *entry, UINT aa_flags, DWORD *size )
+{
+    int depth = get_glyph_depth( aa_flags );
+    ULONGLONG bits_size;
+
+    /* alloc_shared_glyph never hands out more, this also keeps the stride from overflowing */
+    if (entry->size > (shared_ring_end - shared_ring_start) / 8) return FALSE;
+    if (entry->metrics.gmBlackBoxX > entry->size / (depth / 8) || entry->metrics.gmBlackBoxY > entry->size)
+        return FALSE;
+    bits_size = (ULONGLONG)entry->metrics.gmBlackBoxY * get_dib_stride( entry->metrics.gmBlackBoxX, depth );
+    if (FIELD_OFFSET( struct shared_glyph, bits[bits_size] ) > entry->size) return FALSE;
+    *size = bits_size;
+    return TRUE;
+}
+
+/* copy a glyph rendered by another process */
+static struct cached_glyph *get_shared_glyph( DC *dc, struct cached_font *font, UINT index, UINT flags )
+{
+    struct shared_font_key *key;
+    struct shared_glyph *entry;
+    struct cached_glyph *glyph = NULL;
+    DWORD size, age;
+
+    if (!font->shared_key)
+    {
+        if (!(key = HeapAlloc( GetProcessHeap(), 0, sizeof(*key) ))) return NULL;
+        if (!get_shared_font_key( dc, font, key ))
+        {
+            HeapFree( GetProcessHeap(), 0, key );
+            key = &no_shared_key;
+        }
+        if (InterlockedCompareExchangePointer( (void **)&font->shared_key, key, NULL ) && key != &no_shared_key)
+            HeapFree( GetProcessHeap(), 0, key );
+    }
+    if (font->shared_key == &no_shared_key) return NULL;
+
+    flags = (flags & ETO_GLYPH_INDEX) ? SHARED_GLYPH_INDEX : 0;
+    if (!lock_shared_glyphs()) return NULL;
+
+    get_shared_font( font );
+    if ((entry = find_shared_glyph( font, index, flags )))
+    {
+        if (!get_shared_glyph_bits_size( entry, font->aa_flags, &size ))
+            WARN( "invalid shared glyph %ux%u size %u\n", entry->metrics.gmBlackBoxX,
+                  entry->metrics.gmBlackBoxY, entry->size );
+        else if ((glyph = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET( struct cached_glyph, bits[size] ))))
+        {
+            glyph->metrics = entry->metrics;
+            memcpy( glyph->bits, entry->bits, size );
+
+            /* keep the glyphs that are still used away from the tail */
+            age = (shared_glyphs->head + shared_glyphs->ring_size - ((char *)entry - (char *)shared_glyphs) +
+                   shared_glyphs->ring) % shared_glyphs->ring_size;
+            if (age > shared_glyphs->ring_size / 2) store_shared_glyph( font, index, flags, glyph, size );
+        }
+    }
+
+    unlock_shared_glyphs();
+    return glyph;
+}
+
+static void free_shared_font_key( struct shared_font_key *key )
+{
+    if (key != &no_shared_key) HeapFree( GetProcessHeap(), 0, key );
+}
+
+static void put_shared_glyph( struct cached_font *font, UINT index, UINT flags, const struct cached_glyph *glyph )
+{
+    if (!font->shared_key || font->shared_key == &no_shared_key) return;
+
+    flags = (flags & ETO_GLYPH_INDEX) ? SHARED_GLYPH_INDEX : 0;
+    if (!lock_shared_glyphs()) return;
+
+    get_shared_font( font );
+    store_shared_glyph( font, index, flags, glyph, get_glyph_bits_size( &glyph->metrics, font->aa_flags ));
+    unlock_shared_glyphs();
+}
+
 static const BYTE masks[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 static const int padding[4] = {0, 3, 2, 1};
 
@@ -837,6 +1358,9 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
     GLYPHMETRICS metrics;
     struct cached_glyph *glyph;
 
+    if ((glyph = get_shared_glyph( dc, font, index, flags )))
+        return add_cached_glyph( font, index, flags, glyph );
+
     if (flags & ETO_GLYPH_INDEX) ggo_flags |= GGO_GLYPH_INDEX;
     indices[0] = index;
     for (i = 0; i < ARRAY_SIZE( indices ); i++)
@@ -885,6 +1409,7 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
 
 done:
     glyph->metrics = metrics;
+    put_shared_glyph( font, indices[0], flags, glyph );
     return add_cached_glyph( font, index, flags, glyph );
 }
 
@@ -7367,7 +7367,287 @@ static void shrink_row_null(const dib_info *dst_dib, const POINT *dst_start,
     return;
 }
 
-const primitive_funcs funcs_8888 =
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__i386__) || defined(__x86_64__))
+
+/* SSE2/SSSE3/AVX2 versions of the hottest 32 and 24-bpp primitives. They are
+ * plugged into the tables by init_dib_primitives() when the CPU supports them, and
+ * must produce exactly the same pixels as the generic versions above. */
+
+#include <immintrin.h>
+
+#define SSE2_FUNC  __attribute__((target("sse2")))
+#define SSSE3_FUNC __attribute__((target("ssse3")))
+#define AVX2_FUNC  __attribute__((target("avx2")))
+
+enum blend_mode
+{
+    BLEND_SRC_ALPHA,        /* blend_argb */
+    BLEND_SRC_ALPHA_CONST,  /* blend_argb_alpha */
+    BLEND_CONST             /* blend_argb_constant_alpha and blend_argb_no_src_alpha */
+};
+
+static inline DWORD blend_pixel_8888( DWORD dst, DWORD src, enum blend_mode mode, DWORD alpha, BOOL no_src_alpha )
+{
+    switch (mode)
+    {
+    case BLEND_SRC_ALPHA:       return blend_argb( dst, src );
+    case BLEND_SRC_ALPHA_CONST: return blend_argb_alpha( dst, src, alpha );
+    default: break;
+    }
+    if (no_src_alpha) return blend_argb_no_src_alpha( dst, src, alpha );
+    return blend_argb_constant_alpha( dst, src, alpha );
+}
+
+/* (v + 127) / 255 for the 16-bit products, computed as (v + 1 + (v >> 8)) >> 8 */
+static inline __m128i SSE2_FUNC div255_round_sse2( __m128i v )
+{
+    v = _mm_add_epi16( v, _mm_set1_epi16( 127 ));
+    return _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( v, _mm_set1_epi16( 1 )), _mm_srli_epi16( v, 8 )), 8 );
+}
+
+/* blend two pixels unpacked to 16-bit channels */
+static inline __m128i SSE2_FUNC blend_pixels_sse2( __m128i dst, __m128i src, enum blend_mode mode, __m128i alpha )
+{
+    const __m128i c255 = _mm_set1_epi16( 255 );
+    __m128i res;
+
+    if (mode == BLEND_CONST)
+        return div255_round_sse2( _mm_add_epi16( _mm_mullo_epi16( src, alpha ),
+                                                 _mm_mullo_epi16( dst, _mm_sub_epi16( c255, alpha ))));
+
+    if (mode == BLEND_SRC_ALPHA_CONST) src = div255_round_sse2( _mm_mullo_epi16( src, alpha ));
+    alpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, 0xff ), 0xff );
+    res = _mm_add_epi16( src, div255_round_sse2( _mm_mullo_epi16( dst, _mm_sub_epi16( c255, alpha ))));
+
+    /* the generic code doesn't saturate, a carry out of a channel ends up in the next one */
+    return _mm_or_si128( _mm_and_si128( res, _mm_set1_epi16( 0xff )),
+                         _mm_slli_epi64( _mm_srli_epi16( res, 8 ), 16 ));
+}
+
+static void SSE2_FUNC blend_rect_8888_sse2( const dib_info *dst, const RECT *rc,
+                                            const dib_info *src, const POINT *origin, BLENDFUNCTION blend )
+{
+    DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
+    DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32( 0xff000000 );
+    __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha ), or_mask = zero;
+    __m128i s, d, lo, hi;
+    int x, y, width = rc->right - rc->left, mask;
+    BOOL no_src_alpha = FALSE;
+    enum blend_mode mode;
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+        mode = blend.SourceConstantAlpha == 255 ? BLEND_SRC_ALPHA : BLEND_SRC_ALPHA_CONST;
+    else
+    {
+        mode = BLEND_CONST;
+        no_src_alpha = src->compression != BI_RGB;
+        if (no_src_alpha) or_mask = opaque;
+    }
+
+    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+    {
+        for (x = 0; x + 4 <= width; x += 4)
+        {
+            s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src_ptr + x) ), or_mask );
+            if (mode == BLEND_SRC_ALPHA)
+            {
+                /* fully opaque and fully transparent black pixels are common */
+                mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( s, opaque ), opaque ));
+                if ((mask & 0x8888) == 0x8888)
+                {
+                    _mm_storeu_si128( (__m128i *)(dst_ptr + x), s );
+                    continue;
+                }
+                if (_mm_movemask_epi8( _mm_cmpeq_epi8( s, zero )) == 0xffff) continue;
+            }
+            d = _mm_loadu_si128( (const __m128i *)(dst_ptr + x) );
+            lo = blend_pixels_sse2( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( s, zero ), mode, alpha );
+            hi = blend_pixels_sse2( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( s, zero ), mode, alpha );
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x), _mm_packus_epi16( lo, hi ));
+        }
+        for (; x < width; x++)
+            dst_ptr[x] = blend_pixel_8888( dst_ptr[x], src_ptr[x], mode, blend.SourceConstantAlpha, no_src_alpha );
+    }
+}
+
+static inline __m256i AVX2_FUNC div255_round_avx2( __m256i v )
+{
+    v = _mm256_add_epi16( v, _mm256_set1_epi16( 127 ));
+    return _mm256_srli_epi16( _mm256_add_epi16( _mm256_add_epi16( v, _mm256_set1_epi16( 1 )),
+                                                _mm256_srli_epi16( v, 8 )), 8 );
+}
+
+static inline __m256i AVX2_FUNC blend_pixels_avx2( __m256i dst, __m256i src, enum blend_mode mode, __m256i alpha )
+{
+    const __m256i c255 = _mm256_set1_epi16( 255 );
+    __m256i res;
+
+    if (mode == BLEND_CONST)
+        return div255_round_avx2( _mm256_add_epi16( _mm256_mullo_epi16( src, alpha ),
+                                                    _mm256_mullo_epi16( dst, _mm256_sub_epi16( c255, alpha ))));
+
+    if (mode == BLEND_SRC_ALPHA_CONST) src = div255_round_avx2( _mm256_mullo_epi16( src, alpha ));
+    alpha = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( src, 0xff ), 0xff );
+    res = _mm256_add_epi16( src, div255_round_avx2( _mm256_mullo_epi16( dst, _mm256_sub_epi16( c255, alpha ))));
+    return _mm256_or_si256( _mm256_and_si256( res, _mm256_set1_epi16( 0xff )),
+                            _mm256_slli_epi64( _mm256_srli_epi16( res, 8 ), 16 ));
+}
+
+static void AVX2_FUNC blend_rect_8888_avx2( const dib_info *dst, const RECT *rc,
+                                            const dib_info *src, const POINT *origin, BLENDFUNCTION blend )
+{
+    DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
+    DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
+    const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32( 0xff000000 );
+    __m256i alpha = _mm256_set1_epi16( blend.SourceConstantAlpha ), or_mask = zero;
+    __m256i s, d, lo, hi;
+    int x, y, width = rc->right - rc->left;
+    BOOL no_src_alpha = FALSE;
+    enum blend_mode mode;
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+        mode = blend.SourceConstantAlpha == 255 ? BLEND_SRC_ALPHA : BLEND_SRC_ALPHA_CONST;
+    else
+    {
+        mode = BLEND_CONST;
+        no_src_alpha = src->compression != BI_RGB;
+        if (no_src_alpha) or_mask = opaque;
+    }
+
+    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+    {
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            s = _mm256_or_si256( _mm256_loadu_si256( (const __m256i *)(src_ptr + x) ), or_mask );
+            if (mode == BLEND_SRC_ALPHA)
+            {
+                if (_mm256_testc_si256( s, opaque ))
+                {
+                    _mm256_storeu_si256( (__m256i *)(dst_ptr + x), s );
+                    continue;
+                }
+                if (_mm256_testz_si256( s, s )) continue;
+            }
+            d = _mm256_loadu_si256( (const __m256i *)(dst_ptr + x) );
+            lo = blend_pixels_avx2( _mm256_unpacklo_epi8( d, zero ), _mm256_unpacklo_epi8( s, zero ), mode, alpha );
+            hi = blend_pixels_avx2( _mm256_unpackhi_epi8( d, zero ), _mm256_unpackhi_epi8( s, zero ), mode, alpha );
+            _mm256_storeu_si256( (__m256i *)(dst_ptr + x), _mm256_packus_epi16( lo, hi ));
+        }
+        for (; x < width; x++)
+            dst_ptr[x] = blend_pixel_8888( dst_ptr[x], src_ptr[x], mode, blend.SourceConstantAlpha, no_src_alpha );
+    }
+}
+
+/* expand 4 packed 24-bpp pixels per 128-bit lane */
+#define SHUFFLE_24_TO_32 0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11, 0x80
+/* and the reverse */
+#define SHUFFLE_32_TO_24 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80
+
+static void SSSE3_FUNC convert_row_24_to_8888_ssse3( DWORD *dst, const BYTE *src, int width )
+{
+    const __m128i shuffle = _mm_setr_epi8( SHUFFLE_24_TO_32 );
+    int x;
+
+    /* 16 bytes are loaded for 4 pixels, stay within the row */
+    for (x = 0; x + 6 <= width; x += 4)
+        _mm_storeu_si128( (__m128i *)(dst + x),
+                          _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(src + x * 3) ), shuffle ));
+    for (; x < width; x++)
+        dst[x] = src[x * 3] | (src[x * 3 + 1] << 8) | (src[x * 3 + 2] << 16);
+}
+
+static void SSSE3_FUNC convert_row_8888_to_24_ssse3( BYTE *dst, const DWORD *src, int width )
+{
+    const __m128i shuffle = _mm_setr_epi8( SHUFFLE_32_TO_24 );
+    int x;
+
+    /* 16 bytes are stored for 4 pixels, the extra ones are overwritten by the next pixels */
+    for (x = 0; x + 6 <= width; x += 4)
+        _mm_storeu_si128( (__m128i *)(dst + x * 3),
+                          _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(src + x) ), shuffle ));
+    for (; x < width; x++)
+    {
+        dst[x * 3]     = src[x];
+        dst[x * 3 + 1] = src[x] >> 8;
+        dst[x * 3 + 2] = src[x] >> 16;
+    }
+}
+
+static void SSSE3_FUNC convert_to_8888_ssse3( dib_info *dst, const dib_info *src, const RECT *src_rect, BOOL dither )
+{
+    DWORD *dst_start = get_pixel_ptr_32( dst, 0, 0 );
+    int y, width = src_rect->right - src_rect->left, pad_size = (dst->width - width) * 4;
+
+    if (src->bit_count == 24)
+    {
+        BYTE *src_start = get_pixel_ptr_24( src, src_rect->left, src_rect->top );
+
+        for (y = src_rect->top; y < src_rect->bottom; y++)
+        {
+            convert_row_24_to_8888_ssse3( dst_start, src_start, width );
+            if (pad_size) memset( dst_start + width, 0, pad_size );
+            dst_start += dst->stride / 4;
+            src_start += src->stride;
+        }
+    }
+    else convert_to_8888( dst, src, src_rect, dither );
+}
+
+static void SSSE3_FUNC convert_to_24_ssse3( dib_info *dst, const dib_info *src, const RECT *src_rect, BOOL dither )
+{
+    BYTE *dst_start = get_pixel_ptr_24( dst, 0, 0 );
+    int y, width = src_rect->right - src_rect->left;
+    int pad_size = ((dst->width * 3 + 3) & ~3) - width * 3;
+
+    if (src->funcs == &funcs_8888)
+    {
+        DWORD *src_start = get_pixel_ptr_32( src, src_rect->left, src_rect->top );
+
+        for (y = src_rect->top; y < src_rect->bottom; y++)
+        {
+            convert_row_8888_to_24_ssse3( dst_start, src_start, width );
+            if (pad_size) memset( dst_start + width * 3, 0, pad_size );
+            dst_start += dst->stride;
+            src_start += src->stride / 4;
+        }
+    }
+    else convert_to_24( dst, src, src_rect, dither );
+}
+
+static void SSE2_FUNC solid_rects_32_sse2( const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor )
+{
+    __m128i vand = _mm_set1_epi32( and ), vxor = _mm_set1_epi32( xor );
+    DWORD *start;
+    int x, y, i, width;
+
+    if (!and)
+    {
+        solid_rects_32( dib, num, rc, and, xor );
+        return;
+    }
+
+    for (i = 0; i < num; i++, rc++)
+    {
+        assert( !is_rect_empty( rc ));
+
+        start = get_pixel_ptr_32( dib, rc->left, rc->top );
+        width = rc->right - rc->left;
+        for (y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
+        {
+            for (x = 0; x + 4 <= width; x += 4)
+                _mm_storeu_si128( (__m128i *)(start + x),
+                                  _mm_xor_si128( _mm_and_si128( _mm_loadu_si128( (const __m128i *)(start + x) ),
+                                                                vand ), vxor ));
+            for (; x < width; x++) do_rop_32( start + x, and, xor );
+        }
+    }
+}
+
+#endif /* __GNUC__ && (__i386__ || __x86_64__) */
+
+primitive_funcs funcs_8888 =
 {
     solid_rects_32,
     solid_line_32,
@@ -7388,7 +7668,7 @@ const primitive_funcs funcs_8888 =
     shrink_row_32
 };
 
-const primitive_funcs funcs_32 =
+primitive_funcs funcs_32 =
 {
     solid_rects_32,
     solid_line_32,
@@ -7409,7 +7689,7 @@ const primitive_funcs funcs_32 =
     shrink_row_32
 };
 
-const primitive_funcs funcs_24 =
+primitive_funcs funcs_24 =
 {
     solid_rects_24,
     solid_line_24,
@@ -7555,3 +7835,32 @@ const primitive_funcs funcs_null =
     stretch_row_null,
     shrink_row_null
 };
+
+/***********************************************************************
+ *           init_dib_primitives
+ *
+ * Select the vectorized primitives supported by the CPU.
+ */
+void init_dib_primitives(void)
+{
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__i386__) || defined(__x86_64__))
+    BOOL ssse3, avx2;
+
+    if (!IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE )) return;
+
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports( "avx2" );
+
+    funcs_8888.solid_rects = funcs_32.solid_rects = solid_rects_32_sse2;
+    funcs_8888.blend_rect = avx2 ? blend_rect_8888_avx2 : blend_rect_8888_sse2;
+
+    if ((ssse3 = __builtin_cpu_supports( "ssse3" )))
+    {
+        funcs_8888.convert_to = convert_to_8888_ssse3;
+        funcs_24.convert_to = convert_to_24_ssse3;
+    }
+
+    TRACE( "using SSE2%s%s primitives\n", ssse3 ? ", SSSE3" : "", avx2 ? ", AVX2" : "" );
+#endif
+}
@@ -103,6 +103,7 @@
 #include "wine/unicode.h"
 #include "wine/debug.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 
 #include "resource.h"
 
@@ -291,6 +292,38 @@ typedef struct tagFace {
     struct enum_data *cached_enum_data;
 } Face;
 
+/* attributes of a face as found by FreeType, or read from the font index */
+struct index_face
+{
+    const WCHAR  *family_name;
+    const WCHAR  *second_name;  /* NULL if the face has no other family name */
+    const WCHAR  *style_name;
+    const WCHAR  *full_name;
+    FT_Long       face_index;
+    FONTSIGNATURE fs;
+    DWORD         ntm_flags;
+    FT_Fixed      font_version;
+    BOOL          scalable;
+    BOOL          sfnt;
+    Bitmap_Size   size;         /* set if face is a bitmap */
+};
+
+/* faces of a font file, the file attributes are only set for files */
+struct index_file
+{
+    struct wine_rb_entry entry;
+    const char          *path;
+    ULONGLONG            size;
+    LONGLONG             mtime;
+    dev_t                dev;
+    ino_t                ino;
+    BOOL                 truncated;   /* loading stopped on a face that can't be used */
+    BOOL                 mapped;      /* the strings point into the mapped index */
+    unsigned int         face_count;
+    struct index_face   *faces;
+    DWORD                index;       /* position in the index being written */
+};
+
 #define FS_DBCS_MASK (FS_JISJAPAN|FS_CHINESESIMP|FS_WANSUNG|FS_CHINESETRAD|FS_JOHAB)
 
 #define ADDFONT_EXTERNAL_FONT 0x01
@@ -397,12 +430,6 @@ typedef struct {
     GdiFont *font;
 } CHILD_FONT;
 
-struct font_fileinfo {
-    FILETIME writetime;
-    LARGE_INTEGER size;
-    WCHAR path[1];
-};
-
 struct tagGdiFont {
     struct list entry;
     struct list unused_entry;
@@ -591,6 +618,7 @@ static const WCHAR face_internal_leading_value[] = {'I','n','t','e','r','n','a',
 static const WCHAR face_font_sig_value[] = {'F','o','n','t',' ','S','i','g','n','a','t','u','r','e',0};
 static const WCHAR face_file_name_value[] = {'F','i','l','e',' ','N','a','m','e','\0'};
 static const WCHAR face_full_name_value[] = {'F','u','l','l',' ','N','a','m','e','\0'};
+static const WCHAR font_index_serial_value[] = {'I','n','d','e','x',' ','S','e','r','i','a','l',0};
 
 
 struct font_mapping
@@ -607,6 +635,8 @@ static struct list mappings_list = LIST_INIT( mappings_list );
 
 static UINT default_aa_flags;
 static HKEY hkey_font_cache;
+static BOOL font_index_recording;  /* the first process is building the font list */
+static BOOL font_index_replaying;  /* the font list is loaded from the index, the registry cache is up to date */
 static BOOL antialias_fakes = TRUE;
 
 static CRITICAL_SECTION freetype_cs;
@@ -1866,11 +1896,20 @@ static LONG create_font_cache_key(HKEY *hkey, DWORD *disposition)
     return ret;
 }
 
+/* the font list of the other processes can no longer be loaded from the index */
+static void invalidate_font_index(void)
+{
+    if (!font_index_recording) RegDeleteValueW( hkey_font_cache, font_index_serial_value );
+}
+
 static void add_face_to_cache(Face *face)
 {
     HKEY hkey_family, hkey_face;
     WCHAR *face_key_name;
 
+    if (font_index_replaying) return;
+    invalidate_font_index();
+
     RegCreateKeyExW( hkey_font_cache, face->family->family_name, 0, NULL, REG_OPTION_VOLATILE,
                      KEY_ALL_ACCESS, NULL, &hkey_family, NULL );
     if (face->family->second_name[0])
@@ -1918,6 +1957,9 @@ static void remove_face_from_cache( Face *face )
 {
     HKEY hkey_family;
 
+    if (font_index_replaying) return;
+    invalidate_font_index();
+
     RegOpenKeyExW( hkey_font_cache, face->family->family_name, 0, KEY_ALL_ACCESS, &hkey_family );
 
     if (face->scalable)
@@ -1948,26 +1990,13 @@ static WCHAR *get_vertical_name( WCHAR *name )
     return name;
 }
 
-static Family *get_family( FT_Face ft_face, BOOL vertical )
+static Family *get_family( const struct index_face *info, BOOL vertical )
 {
     Family *family;
-    WCHAR *family_name, *second_name;
-
-    family_name = ft_face_get_family_name( ft_face, GetSystemDefaultLCID() );
-    second_name = ft_face_get_family_name( ft_face, MAKELANGID(LANG_ENGLISH, SUBLANG_DEFAULT) );
-
-    /* try to find another secondary name, preferring the lowest langids */
-    if (!strcmpiW( family_name, second_name ))
-    {
-        HeapFree( GetProcessHeap(), 0, second_name );
-        second_name = ft_face_get_family_name( ft_face, MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL) );
-    }
+    WCHAR *family_name, *second_name = NULL;
 
-    if (!strcmpiW( family_name, second_name ))
-    {
-        HeapFree( GetProcessHeap(), 0, second_name );
-        second_name = NULL;
-    }
+    family_name = strdupW( info->family_name );
+    if (info->second_name) second_name = strdupW( info->second_name );
 
     if (vertical)
     {
@@ -2112,52 +2141,80 @@ static inline void get_fontsig( FT_Face ft_face, FONTSIGNATURE *fs )
     }
 }
 
-static Face *create_face( FT_Face ft_face, FT_Long face_index, const char *file, void *font_data_ptr, DWORD font_data_size,
-                          DWORD flags )
+static void get_index_face( FT_Face ft_face, FT_Long face_index, struct index_face *info )
+{
+    WCHAR *second_name;
+
+    info->family_name = ft_face_get_family_name( ft_face, GetSystemDefaultLCID() );
+    second_name = ft_face_get_family_name( ft_face, MAKELANGID(LANG_ENGLISH, SUBLANG_DEFAULT) );
+
+    /* try to find another secondary name, preferring the lowest langids */
+    if (!strcmpiW( info->family_name, second_name ))
+    {
+        HeapFree( GetProcessHeap(), 0, second_name );
+        second_name = ft_face_get_family_name( ft_face, MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL) );
+    }
+
+    if (!strcmpiW( info->family_name, second_name ))
+    {
+        HeapFree( GetProcessHeap(), 0, second_name );
+        second_name = NULL;
+    }
+    info->second_name = second_name;
+
+    info->style_name = ft_face_get_style_name( ft_face, GetSystemDefaultLangID() );
+    info->full_name = ft_face_get_full_name( ft_face, GetSystemDefaultLangID() );
+    info->face_index = face_index;
+    get_fontsig( ft_face, &info->fs );
+    info->ntm_flags = get_ntm_flags( ft_face );
+    info->font_version = get_font_version( ft_face );
+    info->sfnt = FT_IS_SFNT( ft_face );
+
+    if (FT_IS_SCALABLE( ft_face ))
+    {
+        memset( &info->size, 0, sizeof(info->size) );
+        info->scalable = TRUE;
+    }
+    else
+    {
+        get_bitmap_size( ft_face, &info->size );
+        info->scalable = FALSE;
+    }
+}
+
+static Face *create_face( const struct index_face *info, const struct index_file *file,
+                          void *font_data_ptr, DWORD font_data_size, DWORD flags )
 {
-    struct stat st;
     Face *face = HeapAlloc( GetProcessHeap(), 0, sizeof(*face) );
 
     face->refcount = 1;
-    face->style_name = ft_face_get_style_name( ft_face, GetSystemDefaultLangID() );
-    face->full_name = ft_face_get_full_name( ft_face, GetSystemDefaultLangID() );
+    face->style_name = strdupW( info->style_name );
+    face->full_name = strdupW( info->full_name );
     if (flags & ADDFONT_VERTICAL_FONT) face->full_name = get_vertical_name( face->full_name );
 
-    face->dev = 0;
-    face->ino = 0;
-    if (file)
+    if (file->path)
     {
-        face->file = towstr( CP_UNIXCP, file );
+        face->file = towstr( CP_UNIXCP, file->path );
+        face->dev = file->dev;
+        face->ino = file->ino;
         face->font_data_ptr = NULL;
         face->font_data_size = 0;
-        if (!stat( file, &st ))
-        {
-            face->dev = st.st_dev;
-            face->ino = st.st_ino;
-        }
     }
     else
     {
         face->file = NULL;
+        face->dev = 0;
+        face->ino = 0;
         face->font_data_ptr = font_data_ptr;
         face->font_data_size = font_data_size;
     }
 
-    face->face_index = face_index;
-    get_fontsig( ft_face, &face->fs );
-    face->ntmFlags = get_ntm_flags( ft_face );
-    face->font_version = get_font_version( ft_face );
-
-    if (FT_IS_SCALABLE( ft_face ))
-    {
-        memset( &face->size, 0, sizeof(face->size) );
-        face->scalable = TRUE;
-    }
-    else
-    {
-        get_bitmap_size( ft_face, &face->size );
-        face->scalable = FALSE;
-    }
+    face->face_index = info->face_index;
+    face->fs = info->fs;
+    face->ntmFlags = info->ntm_flags;
+    face->font_version = info->font_version;
+    face->scalable = info->scalable;
+    face->size = info->size;
 
     if (!HIWORD( flags )) flags |= ADDFONT_AA_FLAGS( default_aa_flags );
     face->flags  = flags;
@@ -2172,14 +2229,14 @@ static Face *create_face( FT_Face ft_face, FT_Long face_index, const char *file,
     return face;
 }
 
-static void AddFaceToList(FT_Face ft_face, const char *file, void *font_data_ptr, DWORD font_data_size,
-                          FT_Long face_index, DWORD flags )
+static void AddFaceToList( const struct index_face *info, const struct index_file *file,
+                           void *font_data_ptr, DWORD font_data_size, DWORD flags )
 {
     Face *face;
     Family *family;
 
-    face = create_face( ft_face, face_index, file, font_data_ptr, font_data_size, flags );
-    family = get_family( ft_face, flags & ADDFONT_VERTICAL_FONT );
+    face = create_face( info, file, font_data_ptr, font_data_size, flags );
+    family = get_family( info, flags & ADDFONT_VERTICAL_FONT );
 
     if (insert_face_in_family_list( face, family ))
     {
@@ -2267,12 +2324,639 @@ fail:
     return NULL;
 }
 
-static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_size, DWORD flags)
+/*************************************************************
+ * Font index
+ *
+ * Loading every font file with FreeType to find out its names and attributes is
+ * the slowest part of building the font list.  The results are saved to an index
+ * file in the Windows directory that all the processes of the prefix map read-only,
+ * so that a file with the same size, inode and modification time doesn't need to be
+ * loaded again.  The first process of a session rebuilds the index from the files it
+ * finds, which drops the fonts that have been removed, and only writes it when
+ * something has changed.  The index also lists the fonts loaded by that process; the
+ * other processes replay that list instead of reading the registry font cache, as
+ * long as no face has been added to or removed from the cache since then.
+ */
+
+#define FONT_INDEX_MAGIC    0x78646966  /* "fidx" */
+#define FONT_INDEX_VERSION  1
+
+/* the layout is the same for 32-bit and 64-bit processes */
+struct font_index_header
+{
+    ULONGLONG serial;       /* changed every time the contents change */
+    DWORD     magic;
+    DWORD     version;
+    DWORD     ft_version;   /* FreeType version that loaded the fonts */
+    LCID      lcid;         /* the names depend on the locale */
+    UINT      acp;
+    DWORD     size;         /* total size of the index */
+    DWORD     file_count;
+    DWORD     files;        /* offset of the file entries, sorted by path */
+    DWORD     face_count;
+    DWORD     faces;        /* offset of the face entries */
+    DWORD     load_count;
+    DWORD     loads;        /* offset of the fonts loaded by the first process */
+};
+
+#define FONT_INDEX_TRUNCATED  0x01
+
+struct font_index_file
 {
-    FT_Face ft_face;
+    ULONGLONG size;
+    LONGLONG  mtime;        /* in nanoseconds */
+    ULONGLONG dev;
+    ULONGLONG ino;
+    DWORD     path;         /* offset of the Unix file name */
+    DWORD     flags;
+    DWORD     first_face;
+    DWORD     face_count;
+};
+
+#define FONT_INDEX_SCALABLE   0x01
+#define FONT_INDEX_SFNT       0x02
+
+struct font_index_face
+{
+    LONGLONG      font_version;
+    LONGLONG      size;
+    LONGLONG      x_ppem;
+    LONGLONG      y_ppem;
+    FONTSIGNATURE fs;
+    DWORD         family_name;  /* offsets of the names, 0 if not present */
+    DWORD         second_name;
+    DWORD         style_name;
+    DWORD         full_name;
+    DWORD         face_index;
+    DWORD         ntm_flags;
+    DWORD         flags;
+    SHORT         height;
+    SHORT         width;
+    SHORT         internal_leading;
+    SHORT         reserved[3];
+};
+
+struct font_index_load
+{
+    DWORD file;
+    DWORD flags;            /* ADDFONT flags */
+};
+
+C_ASSERT( sizeof(struct font_index_header) == 56 );
+C_ASSERT( sizeof(struct font_index_file) == 48 );
+C_ASSERT( sizeof(struct font_index_face) == 96 );
+
+struct index_load
+{
+    struct index_file *file;
+    DWORD              flags;
+};
+
+static const struct font_index_header *font_index;  /* the mapped index, NULL if there is none */
+static struct wine_rb_tree font_index_files;         /* files found while building the font list */
+static struct index_load *font_index_loads;
+static unsigned int font_index_load_count, font_index_load_size;
+
+static inline const void *font_index_ptr( DWORD offset )
+{
+    return (const char *)font_index + offset;
+}
+
+static inline LONGLONG get_mtime( const struct stat *st )
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return st->st_mtime * (LONGLONG)1000000000 + st->st_mtim.tv_nsec;
+#else
+    return st->st_mtime * (LONGLONG)1000000000;
+#endif
+}
+
+static char *get_font_index_path(void)
+{
+    static const WCHAR font_indexW[] = {'\\','f','o','n','t','i','n','d','e','x','.','d','a','t',0};
+    WCHAR path[MAX_PATH];
+
+    GetWindowsDirectoryW( path, ARRAY_SIZE(path) );
+    strcatW( path, font_indexW );
+    return wine_get_unix_file_name( path );
+}
+
+static BOOL check_index_array( const struct font_index_header *header, DWORD offset, DWORD count, DWORD size )
+{
+    if (offset < sizeof(*header) || offset % sizeof(ULONGLONG)) return FALSE;
+    return offset + (ULONGLONG)count * size <= header->size;
+}
+
+static BOOL check_index_string( const struct font_index_header *header, DWORD offset, DWORD char_size )
+{
+    const char *base = (const char *)header;
+
+    if (offset < sizeof(*header) || offset >= header->size || offset % char_size) return FALSE;
+    if (char_size == sizeof(WCHAR))
+    {
+        const WCHAR *str = (const WCHAR *)(base + offset), *end = (const WCHAR *)(base + (header->size & ~1));
+        while (str < end) if (!*str++) return TRUE;
+        return FALSE;
+    }
+    return memchr( base + offset, 0, header->size - offset ) != NULL;
+}
+
+static BOOL check_font_index( const struct font_index_header *header, SIZE_T size )
+{
+    const char *base = (const char *)header;
+    const struct font_index_file *files;
+    const struct font_index_face *faces;
+    const struct font_index_load *loads;
+    DWORD i;
+
+    if (header->magic != FONT_INDEX_MAGIC || header->version != FONT_INDEX_VERSION ||
+        header->size != size)
+        return FALSE;
+    if (header->ft_version != FT_SimpleVersion || header->lcid != GetSystemDefaultLCID() ||
+        header->acp != GetACP())
+    {
+        TRACE( "index built with a different FreeType version or locale\n" );
+        return FALSE;
+    }
+    if (!check_index_array( header, header->files, header->file_count, sizeof(*files) ) ||
+        !check_index_array( header, header->faces, header->face_count, sizeof(*faces) ) ||
+        !check_index_array( header, header->loads, header->load_count, sizeof(*loads) ))
+        return FALSE;
+
+    files = (const struct font_index_file *)(base + header->files);
+    for (i = 0; i < header->file_count; i++)
+    {
+        if (!check_index_string( header, files[i].path, sizeof(char) )) return FALSE;
+        if (files[i].first_face > header->face_count ||
+            files[i].face_count > header->face_count - files[i].first_face)
+            return FALSE;
+        /* the files are looked up with a binary search */
+        if (i && strcmp( base + files[i - 1].path, base + files[i].path ) >= 0) return FALSE;
+    }
+
+    faces = (const struct font_index_face *)(base + header->faces);
+    for (i = 0; i < header->face_count; i++)
+    {
+        if (!check_index_string( header, faces[i].family_name, sizeof(WCHAR) ) ||
+            (faces[i].second_name && !check_index_string( header, faces[i].second_name, sizeof(WCHAR) )) ||
+            !check_index_string( header, faces[i].style_name, sizeof(WCHAR) ) ||
+            !check_index_string( header, faces[i].full_name, sizeof(WCHAR) ))
+            return FALSE;
+    }
+
+    loads = (const struct font_index_load *)(base + header->loads);
+    for (i = 0; i < header->load_count; i++)
+        if (loads[i].file >= header->file_count) return FALSE;
+
+    return TRUE;
+}
+
+static void map_font_index(void)
+{
+    struct stat st;
+    char *path;
+    void *ptr;
+    int fd;
+
+    if (!(path = get_font_index_path())) return;
+    fd = open( path, O_RDONLY );
+    HeapFree( GetProcessHeap(), 0, path );
+    if (fd == -1) return;
+
+    if (!fstat( fd, &st ) && st.st_size >= sizeof(struct font_index_header) && st.st_size <= MAXDWORD)
+    {
+        ptr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        if (ptr != MAP_FAILED)
+        {
+            if (check_font_index( ptr, st.st_size )) font_index = ptr;
+            else
+            {
+                TRACE( "ignoring font index\n" );
+                munmap( ptr, st.st_size );
+            }
+        }
+    }
+    close( fd );
+}
+
+static int compare_font_index_file( const void *key, const void *entry )
+{
+    const struct font_index_file *file = entry;
+    return strcmp( key, font_index_ptr( file->path ));
+}
+
+static const struct font_index_file *find_font_index_file( const char *path )
+{
+    if (!font_index) return NULL;
+    return bsearch( path, font_index_ptr( font_index->files ), font_index->file_count,
+                    sizeof(struct font_index_file), compare_font_index_file );
+}
+
+static struct index_file *get_mapped_index_file( const struct font_index_file *entry )
+{
+    const struct font_index_face *faces = font_index_ptr( font_index->faces );
+    struct index_file *file = HeapAlloc( GetProcessHeap(), 0, sizeof(*file) );
+    DWORD i;
+
+    file->path = font_index_ptr( entry->path );
+    file->size = entry->size;
+    file->mtime = entry->mtime;
+    file->dev = entry->dev;
+    file->ino = entry->ino;
+    file->truncated = (entry->flags & FONT_INDEX_TRUNCATED) != 0;
+    file->mapped = TRUE;
+    file->face_count = entry->face_count;
+    file->faces = HeapAlloc( GetProcessHeap(), 0, entry->face_count * sizeof(*file->faces) );
+
+    for (i = 0; i < entry->face_count; i++)
+    {
+        const struct font_index_face *face = &faces[entry->first_face + i];
+        struct index_face *info = &file->faces[i];
+
+        info->family_name = font_index_ptr( face->family_name );
+        info->second_name = face->second_name ? font_index_ptr( face->second_name ) : NULL;
+        info->style_name = font_index_ptr( face->style_name );
+        info->full_name = font_index_ptr( face->full_name );
+        info->face_index = face->face_index;
+        info->fs = face->fs;
+        info->ntm_flags = face->ntm_flags;
+        info->font_version = face->font_version;
+        info->scalable = (face->flags & FONT_INDEX_SCALABLE) != 0;
+        info->sfnt = (face->flags & FONT_INDEX_SFNT) != 0;
+        info->size.height = face->height;
+        info->size.width = face->width;
+        info->size.size = face->size;
+        info->size.x_ppem = face->x_ppem;
+        info->size.y_ppem = face->y_ppem;
+        info->size.internal_leading = face->internal_leading;
+    }
+    return file;
+}
+
+static void free_index_face( struct index_face *face )
+{
+    HeapFree( GetProcessHeap(), 0, (WCHAR *)face->family_name );
+    HeapFree( GetProcessHeap(), 0, (WCHAR *)face->second_name );
+    HeapFree( GetProcessHeap(), 0, (WCHAR *)face->style_name );
+    HeapFree( GetProcessHeap(), 0, (WCHAR *)face->full_name );
+}
+
+static void free_index_file( struct index_file *file )
+{
+    unsigned int i;
+
+    if (!file->mapped)
+    {
+        for (i = 0; i < file->face_count; i++) free_index_face( &file->faces[i] );
+        HeapFree( GetProcessHeap(), 0, (char *)file->path );
+    }
+    HeapFree( GetProcessHeap(), 0, file->faces );
+    HeapFree( GetProcessHeap(), 0, file );
+}
+
+static void free_index_file_entry( struct wine_rb_entry *entry, void *context )
+{
+    free_index_file( WINE_RB_ENTRY_VALUE( entry, struct index_file, entry ));
+}
+
+static int compare_index_file( const void *key, const struct wine_rb_entry *entry )
+{
+    return strcmp( key, WINE_RB_ENTRY_VALUE( entry, const struct index_file, entry )->path );
+}
+
+/* load all the faces of a font with FreeType */
+static struct index_file *scan_font_file( const char *path, void *font_data_ptr, DWORD font_data_size )
+{
+    struct index_file *file = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*file) );
+    unsigned int size = 1;
     FT_Long face_index = 0, num_faces;
+    FT_Face ft_face;
+
+    if (path)
+    {
+        char *copy = HeapAlloc( GetProcessHeap(), 0, strlen( path ) + 1 );
+        file->path = strcpy( copy, path );
+    }
+    file->faces = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*file->faces) );
+
+    do
+    {
+        /* the bitmap fonts are rejected when they are added if needed */
+        if (!(ft_face = new_ft_face( path, font_data_ptr, font_data_size, face_index, TRUE )))
+        {
+            file->truncated = TRUE;
+            break;
+        }
+
+        if (ft_face->family_name[0] == '.') /* Ignore fonts with names beginning with a dot */
+        {
+            TRACE("Ignoring %s since its family name begins with a dot\n", debugstr_a(path));
+            pFT_Done_Face( ft_face );
+            file->truncated = TRUE;
+            break;
+        }
+
+        if (file->face_count == size)
+        {
+            size *= 2;
+            file->faces = HeapReAlloc( GetProcessHeap(), 0, file->faces, size * sizeof(*file->faces) );
+        }
+        get_index_face( ft_face, face_index, &file->faces[file->face_count++] );
+
+        num_faces = ft_face->num_faces;
+        pFT_Done_Face( ft_face );
+    } while (num_faces > ++face_index);
+
+    return file;
+}
+
+/* get the faces of a font file, it's only loaded if the index doesn't have it */
+static struct index_file *get_font_index_file( const char *path )
+{
+    const struct font_index_file *entry;
+    struct wine_rb_entry *rb_entry;
+    struct index_file *file;
+    struct stat st;
+
+    if (font_index_recording && (rb_entry = wine_rb_get( &font_index_files, path )))
+        return WINE_RB_ENTRY_VALUE( rb_entry, struct index_file, entry );
+
+    if (stat( path, &st ) == -1)
+    {
+        WARN( "Unable to load font %s\n", debugstr_a(path) );
+        return NULL;
+    }
+
+    if ((entry = find_font_index_file( path )) && entry->size == st.st_size &&
+        entry->mtime == get_mtime( &st ) && entry->ino == st.st_ino)
+    {
+        TRACE( "found %s in the font index\n", debugstr_a(path) );
+        file = get_mapped_index_file( entry );
+    }
+    else file = scan_font_file( path, NULL, 0 );
+
+    file->size = st.st_size;
+    file->mtime = get_mtime( &st );
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+
+    if (font_index_recording) wine_rb_put( &font_index_files, file->path, &file->entry );
+    return file;
+}
+
+static void add_font_index_load( struct index_file *file, DWORD flags )
+{
+    if (font_index_load_count == font_index_load_size)
+    {
+        font_index_load_size = max( 256, font_index_load_size * 2 );
+        if (font_index_loads)
+            font_index_loads = HeapReAlloc( GetProcessHeap(), 0, font_index_loads,
+                                            font_index_load_size * sizeof(*font_index_loads) );
+        else
+            font_index_loads = HeapAlloc( GetProcessHeap(), 0, font_index_load_size * sizeof(*font_index_loads) );
+    }
+    /* store the antialiasing flags of this process, like the registry cache does */
+    if (!HIWORD( flags )) flags |= ADDFONT_AA_FLAGS( default_aa_flags );
+    font_index_loads[font_index_load_count].file = file;
+    font_index_loads[font_index_load_count].flags = flags;
+    font_index_load_count++;
+}
+
+static INT add_index_faces( const struct index_file *file, void *font_data_ptr, DWORD font_data_size, DWORD flags )
+{
+    unsigned int i;
     INT ret = 0;
 
+    for (i = 0; i < file->face_count; i++)
+    {
+        const struct index_face *face = &file->faces[i];
+
+        if (!face->sfnt && !(flags & ADDFONT_ALLOW_BITMAP))
+        {
+            WARN("Ignoring font %s/%p\n", debugstr_a(file->path), font_data_ptr);
+            return 0;
+        }
+
+        AddFaceToList( face, file, font_data_ptr, font_data_size, flags );
+        ++ret;
+
+        if (face->fs.fsCsb[0] & FS_DBCS_MASK)
+        {
+            AddFaceToList( face, file, font_data_ptr, font_data_size, flags | ADDFONT_VERTICAL_FONT );
+            ++ret;
+        }
+    }
+    return file->truncated ? 0 : ret;
+}
+
+static inline DWORD index_string_size( const WCHAR *str )
+{
+    return str ? (strlenW( str ) + 1) * sizeof(WCHAR) : 0;
+}
+
+static DWORD put_index_string( char *buffer, DWORD *pos, const WCHAR *str )
+{
+    DWORD offset = *pos, size = index_string_size( str );
+
+    if (!str) return 0;
+    memcpy( buffer + offset, str, size );
+    *pos += size;
+    return offset;
+}
+
+static void *build_font_index( DWORD *ret_size )
+{
+    struct font_index_header *header;
+    struct font_index_file *files;
+    struct font_index_face *faces;
+    struct font_index_load *loads;
+    struct index_file *file;
+    DWORD file_count = 0, face_count = 0, size, pos, i;
+    char *buffer;
+
+    size = 0;
+    WINE_RB_FOR_EACH_ENTRY( file, &font_index_files, struct index_file, entry )
+    {
+        file->index = file_count++;
+        face_count += file->face_count;
+        size += (strlen( file->path ) + 2) & ~1;  /* keep the names aligned */
+        for (i = 0; i < file->face_count; i++)
+            size += index_string_size( file->faces[i].family_name ) +
+                    index_string_size( file->faces[i].second_name ) +
+                    index_string_size( file->faces[i].style_name ) +
+                    index_string_size( file->faces[i].full_name );
+    }
+
+    pos = sizeof(*header) + file_count * sizeof(*files) + face_count * sizeof(*faces) +
+          font_index_load_count * sizeof(*loads);
+    size += pos;
+    if (!(buffer = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size ))) return NULL;
+
+    header = (struct font_index_header *)buffer;
+    header->magic = FONT_INDEX_MAGIC;
+    header->version = FONT_INDEX_VERSION;
+    header->ft_version = FT_SimpleVersion;
+    header->lcid = GetSystemDefaultLCID();
+    header->acp = GetACP();
+    header->size = size;
+    header->file_count = file_count;
+    header->files = sizeof(*header);
+    header->face_count = face_count;
+    header->faces = header->files + file_count * sizeof(*files);
+    header->load_count = font_index_load_count;
+    header->loads = header->faces + face_count * sizeof(*faces);
+
+    files = (struct font_index_file *)(buffer + header->files);
+    faces = (struct font_index_face *)(buffer + header->faces);
+    loads = (struct font_index_load *)(buffer + header->loads);
+
+    face_count = 0;
+    WINE_RB_FOR_EACH_ENTRY( file, &font_index_files, struct index_file, entry )
+    {
+        struct font_index_file *entry = &files[file->index];
+
+        entry->size = file->size;
+        entry->mtime = file->mtime;
+        entry->dev = file->dev;
+        entry->ino = file->ino;
+        entry->flags = file->truncated ? FONT_INDEX_TRUNCATED : 0;
+        entry->first_face = face_count;
+        entry->face_count = file->face_count;
+        entry->path = pos;
+        strcpy( buffer + pos, file->path );
+        pos += (strlen( file->path ) + 2) & ~1;
+
+        for (i = 0; i < file->face_count; i++)
+        {
+            const struct index_face *info = &file->faces[i];
+            struct font_index_face *face = &faces[face_count++];
+
+            face->font_version = info->font_version;
+            face->size = info->size.size;
+            face->x_ppem = info->size.x_ppem;
+            face->y_ppem = info->size.y_ppem;
+            face->fs = info->fs;
+            face->family_name = put_index_string( buffer, &pos, info->family_name );
+            face->second_name = put_index_string( buffer, &pos, info->second_name );
+            face->style_name = put_index_string( buffer, &pos, info->style_name );
+            face->full_name = put_index_string( buffer, &pos, info->full_name );
+            face->face_index = info->face_index;
+            face->ntm_flags = info->ntm_flags;
+            face->flags = (info->scalable ? FONT_INDEX_SCALABLE : 0) | (info->sfnt ? FONT_INDEX_SFNT : 0);
+            face->height = info->size.height;
+            face->width = info->size.width;
+            face->internal_leading = info->size.internal_leading;
+        }
+    }
+
+    for (i = 0; i < font_index_load_count; i++)
+    {
+        loads[i].file = font_index_loads[i].file->index;
+        loads[i].flags = font_index_loads[i].flags;
+    }
+
+    *ret_size = size;
+    return buffer;
+}
+
+static BOOL save_font_index( const void *buffer, DWORD size )
+{
+    char *path, *tmp;
+    BOOL ret = FALSE;
+    int fd;
+
+    if (!(path = get_font_index_path())) return FALSE;
+    tmp = HeapAlloc( GetProcessHeap(), 0, strlen( path ) + 16 );
+    sprintf( tmp, "%s.%x", path, GetCurrentProcessId() );
+
+    /* replace the index atomically, the other processes may have it mapped */
+    if ((fd = open( tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644 )) != -1)
+    {
+        ret = write( fd, buffer, size ) == size;
+        if (close( fd ) == -1) ret = FALSE;
+        if (ret && rename( tmp, path ) == -1) ret = FALSE;
+        if (!ret) unlink( tmp );
+    }
+
+    if (ret) TRACE( "wrote %s, %u bytes\n", debugstr_a(path), size );
+    else WARN( "failed to write the font index %s\n", debugstr_a(path) );
+
+    HeapFree( GetProcessHeap(), 0, tmp );
+    HeapFree( GetProcessHeap(), 0, path );
+    return ret;
+}
+
+static void write_font_index(void)
+{
+    struct font_index_header *header;
+    const DWORD offset = FIELD_OFFSET( struct font_index_header, magic );
+    DWORD size;
+    FILETIME ft;
+
+    font_index_recording = FALSE;
+
+    if ((header = build_font_index( &size )))
+    {
+        if (font_index && font_index->size == size &&
+            !memcmp( (char *)header + offset, (const char *)font_index + offset, size - offset ))
+        {
+            TRACE( "font index is up to date\n" );
+            header->serial = font_index->serial;
+        }
+        else
+        {
+            GetSystemTimeAsFileTime( &ft );
+            header->serial = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+            if (font_index && header->serial == font_index->serial) header->serial++;
+            if (!save_font_index( header, size )) header->serial = 0;
+        }
+
+        if (header->serial)
+            RegSetValueExW( hkey_font_cache, font_index_serial_value, 0, REG_BINARY,
+                            (BYTE *)&header->serial, sizeof(header->serial) );
+        HeapFree( GetProcessHeap(), 0, header );
+    }
+
+    wine_rb_destroy( &font_index_files, free_index_file_entry, NULL );
+    HeapFree( GetProcessHeap(), 0, font_index_loads );
+    font_index_loads = NULL;
+    font_index_load_count = font_index_load_size = 0;
+}
+
+/* replay the fonts loaded by the first process, if they haven't changed since */
+static BOOL load_font_list_from_index(void)
+{
+    const struct font_index_file *files;
+    const struct font_index_load *loads;
+    struct index_file *file;
+    ULONGLONG serial;
+    DWORD type, size = sizeof(serial), i;
+
+    if (!font_index) return FALSE;
+    if (RegQueryValueExW( hkey_font_cache, font_index_serial_value, NULL, &type, (BYTE *)&serial, &size ) ||
+        type != REG_BINARY || size != sizeof(serial) || serial != font_index->serial)
+        return FALSE;
+
+    TRACE( "loading %u fonts from the index\n", font_index->load_count );
+
+    files = font_index_ptr( font_index->files );
+    loads = font_index_ptr( font_index->loads );
+    font_index_replaying = TRUE;
+    for (i = 0; i < font_index->load_count; i++)
+    {
+        file = get_mapped_index_file( &files[loads[i].file] );
+        add_index_faces( file, NULL, 0, loads[i].flags );
+        free_index_file( file );
+    }
+    font_index_replaying = FALSE;
+    return TRUE;
+}
+
+static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_size, DWORD flags)
+{
+    struct index_file *index_file;
+    INT ret;
+
     /* we always load external fonts from files - otherwise we would get a crash in update_reg_entries */
     assert(file || !(flags & ADDFONT_EXTERNAL_FONT));
 
@@ -2297,33 +2981,18 @@ static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_
     }
 #endif /* HAVE_CARBON_CARBON_H */
 
-    do {
-        FONTSIGNATURE fs;
+    if (file) index_file = get_font_index_file( file );
+    else index_file = scan_font_file( NULL, font_data_ptr, font_data_size );
+    if (!index_file) return 0;
 
-        ft_face = new_ft_face( file, font_data_ptr, font_data_size, face_index, flags & ADDFONT_ALLOW_BITMAP );
-        if (!ft_face) return 0;
+    ret = add_index_faces( index_file, font_data_ptr, font_data_size, flags );
 
-        if(ft_face->family_name[0] == '.') /* Ignore fonts with names beginning with a dot */
-        {
-            TRACE("Ignoring %s since its family name begins with a dot\n", debugstr_a(file));
-            pFT_Done_Face(ft_face);
-            return 0;
-        }
-
-        AddFaceToList(ft_face, file, font_data_ptr, font_data_size, face_index, flags);
-        ++ret;
-
-        get_fontsig(ft_face, &fs);
-        if (fs.fsCsb[0] & FS_DBCS_MASK)
-        {
-            AddFaceToList(ft_face, file, font_data_ptr, font_data_size, face_index,
-                          flags | ADDFONT_VERTICAL_FONT);
-            ++ret;
-        }
-
-	num_faces = ft_face->num_faces;
-	pFT_Done_Face(ft_face);
-    } while(num_faces > ++face_index);
+    /* the files found while building the font list are kept for the index */
+    if (file && font_index_recording)
+    {
+        if (flags & ADDFONT_ADD_TO_CACHE) add_font_index_load( index_file, flags );
+    }
+    else free_index_file( index_file );
     return ret;
 }
 
@@ -3523,20 +4192,24 @@ static void GetEnumStructs(Face *face, const WCHAR *family_name, LPENUMLOGFONTEX
 static BOOL get_fontdir( const char *unix_name, struct fontdir *fd )
 {
     FT_Face ft_face = new_ft_face( unix_name, NULL, 0, 0, FALSE );
+    struct index_face info;
+    struct index_file file;
     Face *face;
-    WCHAR *family_name;
     ENUMLOGFONTEXW elf;
     NEWTEXTMETRICEXW ntm;
     DWORD type;
 
     if (!ft_face) return FALSE;
-    face = create_face( ft_face, 0, unix_name, NULL, 0, 0 );
-    family_name = ft_face_get_family_name( ft_face, GetSystemDefaultLCID() );
+    get_index_face( ft_face, 0, &info );
     pFT_Done_Face( ft_face );
 
-    GetEnumStructs( face, family_name, &elf, &ntm, &type );
+    memset( &file, 0, sizeof(file) );
+    file.path = unix_name;
+    face = create_face( &info, &file, NULL, 0, 0 );
+
+    GetEnumStructs( face, info.family_name, &elf, &ntm, &type );
     release_face( face );
-    HeapFree( GetProcessHeap(), 0, family_name );
+    free_index_face( &info );
 
     if ((type & TRUETYPE_FONTTYPE) == 0) return FALSE;
 
@@ -4458,10 +5131,16 @@ static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **c
     WaitForSingleObject(font_mutex, INFINITE);
 
     create_font_cache_key(&hkey_font_cache, &disposition);
+    map_font_index();
 
     if(disposition == REG_CREATED_NEW_KEY)
+    {
+        wine_rb_init( &font_index_files, compare_index_file );
+        font_index_recording = TRUE;
         init_font_list();
-    else
+        write_font_index();
+    }
+    else if (!load_font_list_from_index())
         load_font_list_from_cache(hkey_font_cache);
 
     reorder_font_list();
@@ -9310,8 +9989,6 @@ static const struct gdi_dc_funcs freetype_funcs =
 
 #else /* HAVE_FREETYPE */
 
-struct font_fileinfo;
-
 /*************************************************************************/
 
 BOOL WineEngInit(void)
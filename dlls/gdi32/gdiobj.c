@@ -39,7 +39,10 @@
 WINE_DEFAULT_DEBUG_CHANNEL(gdi);
 
 #define FIRST_GDI_HANDLE 32
-#define MAX_GDI_HANDLES  16384
+#define MAX_GDI_HANDLES  (0x10000 - FIRST_GDI_HANDLE)  /* limited by the 16-bit handle index */
+#define DEFAULT_GDI_HANDLES 16384
+#define MIN_GDI_HANDLES  256
+#define HANDLE_CACHE_SIZE 64
 
 struct hdc_list
 {
@@ -52,38 +55,259 @@ struct gdi_handle_entry
     void                       *obj;         /* pointer to the object-specific data */
     const struct gdi_obj_funcs *funcs;       /* type-specific functions */
     struct hdc_list            *hdcs;        /* list of HDCs interested in this object */
-    WORD                        generation;  /* generation count for reusing handle values */
-    WORD                        type;        /* object type (one of the OBJ_* constants) */
+    LONG                        unique;      /* generation count << 16 | object type, type 0 marks free entries */
     WORD                        selcount;    /* number of times the object is selected in a DC */
     WORD                        system : 1;  /* system object flag */
     WORD                        deleted : 1; /* whether DeleteObject has been called on this object */
 };
 
-static struct gdi_handle_entry gdi_handles[MAX_GDI_HANDLES];
+/* per-thread cache of free handle entries, to avoid contention on the global free list */
+struct handle_cache
+{
+    struct list              entry;    /* entry in the list of caches, protected by handle_section */
+    LONG                     lock;     /* only contended when another thread drains the cache */
+    unsigned int             count;
+    struct gdi_handle_entry *entries[HANDLE_CACHE_SIZE];
+};
+
+static struct gdi_handle_entry *gdi_handles;
+static unsigned int gdi_handle_count;
 static struct gdi_handle_entry *next_free;
-static struct gdi_handle_entry *next_unused = gdi_handles;
+static struct gdi_handle_entry *next_unused;
+static DWORD handle_cache_tls = TLS_OUT_OF_INDEXES;
+static struct list handle_caches = LIST_INIT( handle_caches );
 static LONG debug_count;
 HMODULE gdi32_module = 0;
 
-static inline HGDIOBJ entry_to_handle( struct gdi_handle_entry *entry )
+/* protects next_free, next_unused and the list of thread caches, objects themselves are
+ * protected by gdi_section; a thread cache lock may be taken while holding it, not the reverse */
+static CRITICAL_SECTION handle_section;
+static CRITICAL_SECTION_DEBUG handle_critsect_debug =
+{
+    0, 0, &handle_section,
+    { &handle_critsect_debug.ProcessLocksList, &handle_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": handle_section") }
+};
+static CRITICAL_SECTION handle_section = { &handle_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline HGDIOBJ make_handle( struct gdi_handle_entry *entry, LONG unique )
 {
     unsigned int idx = entry - gdi_handles + FIRST_GDI_HANDLE;
-    return LongToHandle( idx | (entry->generation << 16) );
+    return LongToHandle( idx | ((ULONG)HIWORD( unique ) << 16) );
 }
 
-static inline struct gdi_handle_entry *handle_entry( HGDIOBJ handle )
+static inline HGDIOBJ entry_to_handle( struct gdi_handle_entry *entry )
+{
+    return make_handle( entry, entry->unique );
+}
+
+/* look up a handle without taking any lock; the entry can be freed or reused by
+ * another thread unless the caller holds the GDI lock, so the returned unique value
+ * has to be checked again after reading any other field */
+static inline struct gdi_handle_entry *lookup_entry( HGDIOBJ handle, LONG *unique )
 {
     unsigned int idx = LOWORD(handle) - FIRST_GDI_HANDLE;
 
-    if (idx < MAX_GDI_HANDLES && gdi_handles[idx].type)
+    if (idx < gdi_handle_count)
     {
-        if (!HIWORD( handle ) || HIWORD( handle ) == gdi_handles[idx].generation)
+        /* pairs with the InterlockedExchange that publishes the entry in alloc_gdi_handle */
+        *unique = __atomic_load_n( &gdi_handles[idx].unique, __ATOMIC_ACQUIRE );
+        if (LOWORD( *unique ) && (!HIWORD( handle ) || HIWORD( handle ) == HIWORD( *unique )))
             return &gdi_handles[idx];
     }
     if (handle) WARN( "invalid handle %p\n", handle );
     return NULL;
 }
 
+static inline struct gdi_handle_entry *handle_entry( HGDIOBJ handle )
+{
+    LONG unique;
+    return lookup_entry( handle, &unique );
+}
+
+/* return the type-specific functions of an object and make the handle a full handle */
+static const struct gdi_obj_funcs *get_obj_funcs( HGDIOBJ *handle )
+{
+    struct gdi_handle_entry *entry;
+    const struct gdi_obj_funcs *funcs;
+    LONG unique;
+
+    do
+    {
+        if (!(entry = lookup_entry( *handle, &unique ))) return NULL;
+        funcs = *(const struct gdi_obj_funcs * volatile *)&entry->funcs;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );  /* read funcs before checking unique again */
+    } while (__atomic_load_n( &entry->unique, __ATOMIC_RELAXED ) != unique);  /* freed and reused meanwhile */
+
+    *handle = make_handle( entry, unique );
+    return funcs;
+}
+
+static struct handle_cache *get_handle_cache(void)
+{
+    DWORD err;
+    struct handle_cache *cache;
+
+    if (handle_cache_tls == TLS_OUT_OF_INDEXES) return NULL;
+    err = GetLastError();  /* TlsGetValue always resets last error */
+    cache = TlsGetValue( handle_cache_tls );
+    if (!cache && (cache = HeapAlloc( GetProcessHeap(), 0, sizeof(*cache) )))
+    {
+        cache->lock = 0;
+        cache->count = 0;
+        EnterCriticalSection( &handle_section );
+        list_add_tail( &handle_caches, &cache->entry );
+        LeaveCriticalSection( &handle_section );
+        TlsSetValue( handle_cache_tls, cache );
+    }
+    SetLastError( err );
+    return cache;
+}
+
+static inline void lock_handle_cache( struct handle_cache *cache )
+{
+    while (InterlockedCompareExchange( &cache->lock, 1, 0 )) Sleep( 0 );
+}
+
+static inline void unlock_handle_cache( struct handle_cache *cache )
+{
+    InterlockedExchange( &cache->lock, 0 );
+}
+
+/* move the entries of a thread cache to the global list, handle_section must be held */
+static void drain_handle_cache( struct handle_cache *cache )
+{
+    struct gdi_handle_entry *entry;
+
+    lock_handle_cache( cache );
+    while (cache->count)
+    {
+        entry = cache->entries[--cache->count];
+        entry->obj = next_free;
+        next_free = entry;
+    }
+    unlock_handle_cache( cache );
+}
+
+/* return the free entries cached by the current thread to the global list */
+static void free_handle_cache(void)
+{
+    struct handle_cache *cache;
+
+    if (handle_cache_tls == TLS_OUT_OF_INDEXES) return;
+    if (!(cache = TlsGetValue( handle_cache_tls ))) return;
+    EnterCriticalSection( &handle_section );
+    list_remove( &cache->entry );
+    drain_handle_cache( cache );
+    LeaveCriticalSection( &handle_section );
+    TlsSetValue( handle_cache_tls, NULL );
+    HeapFree( GetProcessHeap(), 0, cache );
+}
+
+static struct gdi_handle_entry *alloc_entry(void)
+{
+    struct handle_cache *cache = get_handle_cache(), *other;
+    struct gdi_handle_entry *entry = NULL;
+
+    if (cache)
+    {
+        lock_handle_cache( cache );
+        if (cache->count) entry = cache->entries[--cache->count];
+        unlock_handle_cache( cache );
+        if (entry) return entry;
+    }
+
+    EnterCriticalSection( &handle_section );
+    if (!next_free && next_unused == gdi_handles + gdi_handle_count)
+    {
+        /* the table is full, take back the entries parked in the other threads */
+        LIST_FOR_EACH_ENTRY( other, &handle_caches, struct handle_cache, entry )
+            drain_handle_cache( other );
+    }
+    if ((entry = next_free))
+    {
+        next_free = entry->obj;
+        /* refill the thread cache while we hold the lock */
+        if (cache)
+        {
+            lock_handle_cache( cache );
+            while (next_free && cache->count < HANDLE_CACHE_SIZE / 2)
+            {
+                cache->entries[cache->count++] = next_free;
+                next_free = next_free->obj;
+            }
+            unlock_handle_cache( cache );
+        }
+    }
+    else if (next_unused < gdi_handles + gdi_handle_count)
+        entry = next_unused++;
+    LeaveCriticalSection( &handle_section );
+    return entry;
+}
+
+static void free_entry( struct gdi_handle_entry *entry )
+{
+    struct handle_cache *cache = get_handle_cache();
+
+    if (cache)
+    {
+        lock_handle_cache( cache );
+        if (cache->count < HANDLE_CACHE_SIZE)
+        {
+            cache->entries[cache->count++] = entry;
+            entry = NULL;
+        }
+        unlock_handle_cache( cache );
+        if (!entry) return;
+    }
+
+    /* the thread cache is full, give half of it back */
+    EnterCriticalSection( &handle_section );
+    entry->obj = next_free;
+    next_free = entry;
+    if (cache)
+    {
+        lock_handle_cache( cache );
+        while (cache->count > HANDLE_CACHE_SIZE / 2)
+        {
+            entry = cache->entries[--cache->count];
+            entry->obj = next_free;
+            next_free = entry;
+        }
+        unlock_handle_cache( cache );
+    }
+    LeaveCriticalSection( &handle_section );
+}
+
+/* allocate the handle table, its size can be configured with the same registry value as on Windows */
+static BOOL init_gdi_handles(void)
+{
+    static const WCHAR windowsW[] = {'S','o','f','t','w','a','r','e','\\','M','i','c','r','o','s','o','f','t','\\',
+                                     'W','i','n','d','o','w','s',' ','N','T','\\',
+                                     'C','u','r','r','e','n','t','V','e','r','s','i','o','n','\\',
+                                     'W','i','n','d','o','w','s',0};
+    static const WCHAR quotaW[] = {'G','D','I','P','r','o','c','e','s','s','H','a','n','d','l','e','Q','u','o','t','a',0};
+    DWORD type, count, size = sizeof(count);
+    HKEY key;
+
+    gdi_handle_count = DEFAULT_GDI_HANDLES;
+    if (!RegOpenKeyW( HKEY_LOCAL_MACHINE, windowsW, &key ))
+    {
+        if (!RegQueryValueExW( key, quotaW, NULL, &type, (BYTE *)&count, &size ) && type == REG_DWORD)
+            gdi_handle_count = max( MIN_GDI_HANDLES, min( count, MAX_GDI_HANDLES ));
+        RegCloseKey( key );
+    }
+
+    /* committed pages are only backed by memory once they are used */
+    if (!(gdi_handles = VirtualAlloc( NULL, gdi_handle_count * sizeof(*gdi_handles),
+                                      MEM_COMMIT, PAGE_READWRITE )))
+        return FALSE;
+    next_unused = gdi_handles;
+    handle_cache_tls = TlsAlloc();
+    TRACE( "%u handles\n", gdi_handle_count );
+    return TRUE;
+}
+
 /***********************************************************************
  *          GDI stock objects
  */
@@ -686,10 +910,20 @@ BOOL WINAPI DllMain( HINSTANCE inst, DWORD reason, LPVOID reserved )
     const struct DefaultFontInfo* deffonts;
     int i;
 
-    if (reason != DLL_PROCESS_ATTACH) return TRUE;
+    switch (reason)
+    {
+    case DLL_PROCESS_ATTACH:
+        break;
+    case DLL_THREAD_DETACH:
+        free_handle_cache();
+        return TRUE;
+    default:
+        return TRUE;
+    }
 
     gdi32_module = inst;
-    DisableThreadLibraryCalls( inst );
+    if (!init_gdi_handles()) return FALSE;
+    init_dib_primitives();
     WineEngInit();
 
     /* create stock objects */
@@ -762,16 +996,16 @@ static void dump_gdi_objects( void )
 {
     struct gdi_handle_entry *entry;
 
-    TRACE( "%u objects:\n", MAX_GDI_HANDLES );
+    TRACE( "%u objects:\n", gdi_handle_count );
 
     EnterCriticalSection( &gdi_section );
     for (entry = gdi_handles; entry < next_unused; entry++)
     {
-        if (!entry->type)
+        if (!LOWORD( entry->unique ))
             TRACE( "handle %p FREE\n", entry_to_handle( entry ));
         else
             TRACE( "handle %p obj %p type %s selcount %u deleted %u\n",
-                   entry_to_handle( entry ), entry->obj, gdi_obj_type( entry->type ),
+                   entry_to_handle( entry ), entry->obj, gdi_obj_type( LOWORD( entry->unique )),
                    entry->selcount, entry->deleted );
     }
     LeaveCriticalSection( &gdi_section );
@@ -785,20 +1019,13 @@ static void dump_gdi_objects( void )
 HGDIOBJ alloc_gdi_handle( void *obj, WORD type, const struct gdi_obj_funcs *funcs )
 {
     struct gdi_handle_entry *entry;
+    WORD generation;
     HGDIOBJ ret;
 
     assert( type );  /* type 0 is reserved to mark free entries */
 
-    EnterCriticalSection( &gdi_section );
-
-    entry = next_free;
-    if (entry)
-        next_free = entry->obj;
-    else if (next_unused < gdi_handles + MAX_GDI_HANDLES)
-        entry = next_unused++;
-    else
+    if (!(entry = alloc_entry()))
     {
-        LeaveCriticalSection( &gdi_section );
         ERR( "out of GDI object handles, expect a crash\n" );
         if (TRACE_ON(gdi)) dump_gdi_objects();
         return 0;
@@ -806,15 +1033,16 @@ HGDIOBJ alloc_gdi_handle( void *obj, WORD type, const struct gdi_obj_funcs *func
     entry->obj      = obj;
     entry->funcs    = funcs;
     entry->hdcs     = NULL;
-    entry->type     = type;
     entry->selcount = 0;
     entry->system   = 0;
     entry->deleted  = 0;
-    if (++entry->generation == 0xffff) entry->generation = 1;
+    generation = HIWORD( entry->unique ) + 1;
+    if (generation == 0xffff) generation = 1;
+    /* the entry becomes visible to other threads once the type is set */
+    InterlockedExchange( &entry->unique, MAKELONG( type, generation ));
     ret = entry_to_handle( entry );
-    LeaveCriticalSection( &gdi_section );
     TRACE( "allocated %s %p %u/%u\n", gdi_obj_type(type), ret,
-           InterlockedIncrement( &debug_count ), MAX_GDI_HANDLES );
+           InterlockedIncrement( &debug_count ), gdi_handle_count );
     return ret;
 }
 
@@ -832,14 +1060,13 @@ void *free_gdi_handle( HGDIOBJ handle )
     EnterCriticalSection( &gdi_section );
     if ((entry = handle_entry( handle )))
     {
-        TRACE( "freed %s %p %u/%u\n", gdi_obj_type( entry->type ), handle,
-               InterlockedDecrement( &debug_count ) + 1, MAX_GDI_HANDLES );
+        TRACE( "freed %s %p %u/%u\n", gdi_obj_type( LOWORD( entry->unique )), handle,
+               InterlockedDecrement( &debug_count ) + 1, gdi_handle_count );
         object = entry->obj;
-        entry->type = 0;
-        entry->obj = next_free;
-        next_free = entry;
+        InterlockedExchange( &entry->unique, MAKELONG( 0, HIWORD( entry->unique )));
     }
     LeaveCriticalSection( &gdi_section );
+    if (entry) free_entry( entry );
     return object;
 }
 
@@ -852,13 +1079,10 @@ void *free_gdi_handle( HGDIOBJ handle )
 HGDIOBJ get_full_gdi_handle( HGDIOBJ handle )
 {
     struct gdi_handle_entry *entry;
+    LONG unique;
 
-    if (!HIWORD( handle ))
-    {
-        EnterCriticalSection( &gdi_section );
-        if ((entry = handle_entry( handle ))) handle = entry_to_handle( entry );
-        LeaveCriticalSection( &gdi_section );
-    }
+    if (!HIWORD( handle ) && (entry = lookup_entry( handle, &unique )))
+        handle = make_handle( entry, unique );
     return handle;
 }
 
@@ -873,13 +1097,14 @@ void *get_any_obj_ptr( HGDIOBJ handle, WORD *type )
 {
     void *ptr = NULL;
     struct gdi_handle_entry *entry;
+    LONG unique;
 
     EnterCriticalSection( &gdi_section );
 
-    if ((entry = handle_entry( handle )))
+    if ((entry = lookup_entry( handle, &unique )))
     {
         ptr = entry->obj;
-        *type = entry->type;
+        *type = LOWORD( unique );
     }
 
     if (!ptr) LeaveCriticalSection( &gdi_section );
@@ -1077,21 +1302,12 @@ HGDIOBJ WINAPI GetStockObject( INT obj )
  */
 INT WINAPI GetObjectA( HGDIOBJ handle, INT count, LPVOID buffer )
 {
-    struct gdi_handle_entry *entry;
-    const struct gdi_obj_funcs *funcs = NULL;
+    const struct gdi_obj_funcs *funcs;
     INT result = 0;
 
     TRACE("%p %d %p\n", handle, count, buffer );
 
-    EnterCriticalSection( &gdi_section );
-    if ((entry = handle_entry( handle )))
-    {
-        funcs = entry->funcs;
-        handle = entry_to_handle( entry );  /* make it a full handle */
-    }
-    LeaveCriticalSection( &gdi_section );
-
-    if (funcs)
+    if ((funcs = get_obj_funcs( &handle )))
     {
         if (!funcs->pGetObjectA)
             SetLastError( ERROR_INVALID_HANDLE );
@@ -1108,21 +1324,12 @@ INT WINAPI GetObjectA( HGDIOBJ handle, INT count, LPVOID buffer )
  */
 INT WINAPI GetObjectW( HGDIOBJ handle, INT count, LPVOID buffer )
 {
-    struct gdi_handle_entry *entry;
-    const struct gdi_obj_funcs *funcs = NULL;
+    const struct gdi_obj_funcs *funcs;
     INT result = 0;
 
     TRACE("%p %d %p\n", handle, count, buffer );
 
-    EnterCriticalSection( &gdi_section );
-    if ((entry = handle_entry( handle )))
-    {
-        funcs = entry->funcs;
-        handle = entry_to_handle( entry );  /* make it a full handle */
-    }
-    LeaveCriticalSection( &gdi_section );
-
-    if (funcs)
+    if ((funcs = get_obj_funcs( &handle )))
     {
         if (!funcs->pGetObjectW)
             SetLastError( ERROR_INVALID_HANDLE );
@@ -1139,12 +1346,10 @@ INT WINAPI GetObjectW( HGDIOBJ handle, INT count, LPVOID buffer )
  */
 DWORD WINAPI GetObjectType( HGDIOBJ handle )
 {
-    struct gdi_handle_entry *entry;
+    LONG unique;
     DWORD result = 0;
 
-    EnterCriticalSection( &gdi_section );
-    if ((entry = handle_entry( handle ))) result = entry->type;
-    LeaveCriticalSection( &gdi_section );
+    if (lookup_entry( handle, &unique )) result = LOWORD( unique );
 
     TRACE("%p -> %u\n", handle, result );
     if (!result) SetLastError( ERROR_INVALID_HANDLE );
@@ -1217,18 +1422,11 @@ HGDIOBJ WINAPI GetCurrentObject(HDC hdc,UINT type)
  */
 HGDIOBJ WINAPI SelectObject( HDC hdc, HGDIOBJ hObj )
 {
-    struct gdi_handle_entry *entry;
-    const struct gdi_obj_funcs *funcs = NULL;
+    const struct gdi_obj_funcs *funcs;
 
     TRACE( "(%p,%p)\n", hdc, hObj );
 
-    EnterCriticalSection( &gdi_section );
-    if ((entry = handle_entry( hObj )))
-    {
-        funcs = entry->funcs;
-        hObj = entry_to_handle( entry );  /* make it a full handle */
-    }
-    LeaveCriticalSection( &gdi_section );
+    funcs = get_obj_funcs( &hObj );
 
     if (funcs && funcs->pSelectObject) return funcs->pSelectObject( hObj, hdc );
     return 0;
@@ -1240,16 +1438,7 @@ HGDIOBJ WINAPI SelectObject( HDC hdc, HGDIOBJ hObj )
  */
 BOOL WINAPI UnrealizeObject( HGDIOBJ obj )
 {
-    const struct gdi_obj_funcs *funcs = NULL;
-    struct gdi_handle_entry *entry;
-
-    EnterCriticalSection( &gdi_section );
-    if ((entry = handle_entry( obj )))
-    {
-        funcs = entry->funcs;
-        obj = entry_to_handle( entry );  /* make it a full handle */
-    }
-    LeaveCriticalSection( &gdi_section );
+    const struct gdi_obj_funcs *funcs = get_obj_funcs( &obj );
 
     if (funcs && funcs->pUnrealizeObject) return funcs->pUnrealizeObject( obj );
     return funcs != NULL;
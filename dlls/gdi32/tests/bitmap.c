@@ -5935,6 +5935,299 @@ static void test_D3DKMTCreateDCFromMemory( void )
     }
 }
 
+static DWORD wide_rows_seed;
+
+static DWORD wide_rows_rand(void)
+{
+    wide_rows_seed = wide_rows_seed * 1103515245 + 12345;
+    return (wide_rows_seed >> 16) | (wide_rows_seed << 16);
+}
+
+static HBITMAP create_wide_rows_dib( HDC hdc, int width, int height, int bpp, DWORD compression, void **bits )
+{
+    char buffer[FIELD_OFFSET( BITMAPINFO, bmiColors[3] )];
+    BITMAPINFO *info = (BITMAPINFO *)buffer;
+    DWORD *masks = (DWORD *)info->bmiColors;
+
+    memset( buffer, 0, sizeof(buffer) );
+    info->bmiHeader.biSize = sizeof(info->bmiHeader);
+    info->bmiHeader.biWidth = width;
+    info->bmiHeader.biHeight = -height;
+    info->bmiHeader.biPlanes = 1;
+    info->bmiHeader.biBitCount = bpp;
+    info->bmiHeader.biCompression = compression;
+    masks[0] = 0xff0000;
+    masks[1] = 0x00ff00;
+    masks[2] = 0x0000ff;
+    return CreateDIBSection( hdc, info, DIB_RGB_COLORS, bits, NULL, 0 );
+}
+
+/* Operations on whole rows must give the same results as the same operations
+ * done one column at a time, whatever the implementation does with the rows. */
+static void test_wide_rows(void)
+{
+    static const struct
+    {
+        BYTE const_alpha, format;
+        DWORD compression;
+    }
+    blends[] =
+    {
+        { 255, AC_SRC_ALPHA, BI_RGB },
+        { 100, AC_SRC_ALPHA, BI_RGB },
+        { 100, 0, BI_RGB },
+        { 100, 0, BI_BITFIELDS },
+    };
+    static const DWORD rops[] = { SRCINVERT, SRCAND, SRCPAINT, NOTSRCCOPY, MERGEPAINT, DSTINVERT };
+    const int width = 37, height = 3;
+    DWORD *src_bits, *dst_bits, *ref_bits, buf32[37 * 3];
+    BYTE *bits24, buf24[((37 * 3 + 3) & ~3) * 3];
+    char buffer[FIELD_OFFSET( BITMAPINFO, bmiColors[3] )];
+    BITMAPINFO *info = (BITMAPINFO *)buffer;
+    HBITMAP src_bmp, dst_bmp, ref_bmp, bmp24;
+    HDC src_dc, dst_dc, ref_dc, dc24;
+    DWORD alpha;
+    BLENDFUNCTION blend;
+    HBRUSH brush;
+    int i, x, y, stride24 = (width * 3 + 3) & ~3;
+
+    if (!pGdiAlphaBlend)
+    {
+        win_skip( "GdiAlphaBlend() is not implemented\n" );
+        return;
+    }
+
+    src_dc = CreateCompatibleDC( 0 );
+    dst_dc = CreateCompatibleDC( 0 );
+    ref_dc = CreateCompatibleDC( 0 );
+    dst_bmp = create_wide_rows_dib( dst_dc, width, height, 32, BI_RGB, (void **)&dst_bits );
+    ref_bmp = create_wide_rows_dib( ref_dc, width, height, 32, BI_RGB, (void **)&ref_bits );
+    SelectObject( dst_dc, dst_bmp );
+    SelectObject( ref_dc, ref_bmp );
+
+    blend.BlendOp = AC_SRC_OVER;
+    blend.BlendFlags = 0;
+    for (i = 0; i < ARRAY_SIZE(blends); i++)
+    {
+        src_bmp = create_wide_rows_dib( src_dc, width, height, 32, blends[i].compression, (void **)&src_bits );
+        SelectObject( src_dc, src_bmp );
+
+        wide_rows_seed = i;
+        for (x = 0; x < width * height; x++)
+        {
+            dst_bits[x] = ref_bits[x] = wide_rows_rand();
+            /* premultiplied colors, with runs of opaque and transparent pixels */
+            switch ((x / 5) % 3)
+            {
+            case 0: alpha = 255; break;
+            case 1: alpha = 0; break;
+            default: alpha = wide_rows_rand() & 0xff; break;
+            }
+            src_bits[x] = wide_rows_rand();
+            src_bits[x] = (alpha << 24) | ((src_bits[x] & 0xff) * alpha / 255) |
+                          (((src_bits[x] >> 8) & 0xff) * alpha / 255) << 8 |
+                          (((src_bits[x] >> 16) & 0xff) * alpha / 255) << 16;
+        }
+
+        blend.SourceConstantAlpha = blends[i].const_alpha;
+        blend.AlphaFormat = blends[i].format;
+        pGdiAlphaBlend( dst_dc, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+        for (x = 0; x < width; x++)
+            pGdiAlphaBlend( ref_dc, x, 0, 1, height, src_dc, x, 0, 1, height, blend );
+        ok( !memcmp( dst_bits, ref_bits, width * height * 4 ), "%u: rows differ\n", i );
+
+        DeleteObject( src_bmp );
+    }
+
+    src_bmp = create_wide_rows_dib( src_dc, width, height, 32, BI_RGB, (void **)&src_bits );
+    SelectObject( src_dc, src_bmp );
+    for (i = 0; i < ARRAY_SIZE(rops); i++)
+    {
+        wide_rows_seed = i;
+        for (x = 0; x < width * height; x++)
+        {
+            dst_bits[x] = ref_bits[x] = wide_rows_rand();
+            src_bits[x] = wide_rows_rand();
+        }
+        BitBlt( dst_dc, 0, 0, width, height, src_dc, 0, 0, rops[i] );
+        for (x = 0; x < width; x++)
+            BitBlt( ref_dc, x, 0, 1, height, src_dc, x, 0, rops[i] );
+        ok( !memcmp( dst_bits, ref_bits, width * height * 4 ), "%u: rows differ\n", i );
+    }
+
+    brush = CreateSolidBrush( RGB( 0x12, 0x34, 0x56 ));
+    SelectObject( dst_dc, brush );
+    memcpy( ref_bits, dst_bits, width * height * 4 );
+    PatBlt( dst_dc, 0, 0, width, height, PATINVERT );
+    for (x = 0; x < width * height; x++)
+        if (dst_bits[x] != (ref_bits[x] ^ 0x123456)) break;
+    ok( x == width * height, "wrong pixel at %u\n", x );
+    SelectObject( dst_dc, GetStockObject( WHITE_BRUSH ));
+    DeleteObject( brush );
+
+    /* conversions between 24 and 32 bpp */
+    dc24 = CreateCompatibleDC( 0 );
+    bmp24 = create_wide_rows_dib( dc24, width, height, 24, BI_RGB, (void **)&bits24 );
+    for (x = 0; x < stride24 * height; x++) bits24[x] = wide_rows_rand();
+
+    memset( buffer, 0, sizeof(buffer) );
+    info->bmiHeader.biSize = sizeof(info->bmiHeader);
+    info->bmiHeader.biWidth = width;
+    info->bmiHeader.biHeight = -height;
+    info->bmiHeader.biPlanes = 1;
+    info->bmiHeader.biBitCount = 32;
+    info->bmiHeader.biCompression = BI_RGB;
+    memset( buf32, 0xcc, sizeof(buf32) );
+    GetDIBits( dc24, bmp24, 0, height, buf32, info, DIB_RGB_COLORS );
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            BYTE *p = bits24 + y * stride24 + x * 3;
+            if (buf32[y * width + x] != (p[0] | (p[1] << 8) | (p[2] << 16))) break;
+        }
+        ok( x == width, "%u: wrong pixel at %u\n", y, x );
+    }
+
+    for (x = 0; x < width * height; x++) buf32[x] = src_bits[x];
+    info->bmiHeader.biBitCount = 24;
+    memset( buf24, 0xcc, sizeof(buf24) );
+    GetDIBits( src_dc, src_bmp, 0, height, buf24, info, DIB_RGB_COLORS );
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            BYTE *p = buf24 + y * stride24 + x * 3;
+            if ((p[0] | (p[1] << 8) | (p[2] << 16)) != (buf32[y * width + x] & 0xffffff)) break;
+        }
+        ok( x == width, "%u: wrong pixel at %u\n", y, x );
+    }
+
+    DeleteDC( dc24 );
+    DeleteObject( bmp24 );
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+    DeleteDC( ref_dc );
+    DeleteObject( src_bmp );
+    DeleteObject( dst_bmp );
+    DeleteObject( ref_bmp );
+}
+
+/* draw the same thing on the whole bitmap and in strips small enough not to be split */
+static void draw_large_rect( HDC dc, int op, int width, int height, HDC src_dc, int src_width, int src_height )
+{
+    static const GRADIENT_TRIANGLE tri = { 0, 1, 2 };
+    TRIVERTEX vt[3];
+    BLENDFUNCTION blend;
+
+    vt[0].x = 0;
+    vt[0].y = 0;
+    vt[0].Red = 0x1234;
+    vt[0].Green = 0xff00;
+    vt[0].Blue = 0x0000;
+    vt[0].Alpha = 0xff00;
+    vt[1].x = width;
+    vt[1].y = height / 3;
+    vt[1].Red = 0xee00;
+    vt[1].Green = 0x0000;
+    vt[1].Blue = 0x5600;
+    vt[1].Alpha = 0x0000;
+    vt[2].x = width / 4;
+    vt[2].y = height;
+    vt[2].Red = 0x0000;
+    vt[2].Green = 0x7700;
+    vt[2].Blue = 0xff00;
+    vt[2].Alpha = 0x8000;
+
+    switch (op)
+    {
+    case 0:
+        pGdiGradientFill( dc, vt, 3, (void *)&tri, 1, GRADIENT_FILL_TRIANGLE );
+        break;
+    case 1:
+        SetStretchBltMode( dc, COLORONCOLOR );
+        StretchBlt( dc, 0, 0, width, height, src_dc, 0, 0, src_width / 4, src_height / 4, SRCCOPY );
+        break;
+    case 2:
+        SetStretchBltMode( dc, BLACKONWHITE );
+        StretchBlt( dc, 0, 0, width, height, src_dc, 0, 0, src_width, src_height, SRCCOPY );
+        break;
+    case 3:
+        blend.BlendOp = AC_SRC_OVER;
+        blend.BlendFlags = 0;
+        blend.SourceConstantAlpha = 200;
+        blend.AlphaFormat = AC_SRC_ALPHA;
+        pGdiAlphaBlend( dc, 0, 0, width, height, src_dc, 0, 0, src_width / 2, src_height / 2, blend );
+        break;
+    }
+}
+
+/* Large operations may be split in bands processed in parallel, they must
+ * give the same results as the same operations done on small strips. */
+static void test_large_rects(void)
+{
+    static const char *names[] = { "GradientFill", "StretchBlt", "StretchBlt shrink", "AlphaBlend" };
+    const int width = 1024, height = 512, strip = 16;
+    DWORD *src_bits, *dst_bits, *ref_bits;
+    HBITMAP src_bmp, dst_bmp, ref_bmp;
+    HDC src_dc, dst_dc, ref_dc;
+    char buffer[16];
+    BOOL set_threads;
+    int i, x, y;
+
+    if (!pGdiAlphaBlend || !pGdiGradientFill)
+    {
+        win_skip( "GdiAlphaBlend or GdiGradientFill is not implemented\n" );
+        return;
+    }
+
+    /* exercise the band-parallel paths in Wine */
+    if ((set_threads = !GetEnvironmentVariableA( "WINEDIBTHREADS", buffer, sizeof(buffer) )))
+        SetEnvironmentVariableA( "WINEDIBTHREADS", "4" );
+
+    src_dc = CreateCompatibleDC( 0 );
+    dst_dc = CreateCompatibleDC( 0 );
+    ref_dc = CreateCompatibleDC( 0 );
+    src_bmp = create_wide_rows_dib( src_dc, width * 2, height * 2, 32, BI_RGB, (void **)&src_bits );
+    dst_bmp = create_wide_rows_dib( dst_dc, width, height, 32, BI_RGB, (void **)&dst_bits );
+    ref_bmp = create_wide_rows_dib( ref_dc, width, height, 32, BI_RGB, (void **)&ref_bits );
+    SelectObject( src_dc, src_bmp );
+    SelectObject( dst_dc, dst_bmp );
+    SelectObject( ref_dc, ref_bmp );
+
+    wide_rows_seed = 0;
+    for (x = 0; x < width * height * 4; x++) src_bits[x] = wide_rows_rand();
+    for (x = 0; x < width * height * 4; x++)
+        if (x % 7 < 3) src_bits[x] &= 0x00ffffff;  /* premultiplied transparent pixels */
+        else src_bits[x] |= 0xff000000;
+
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+    {
+        for (x = 0; x < width * height; x++) dst_bits[x] = ref_bits[x] = x * 0x9e3779b1;
+
+        draw_large_rect( dst_dc, i, width, height, src_dc, width * 2, height * 2 );
+        for (y = 0; y < height; y += strip)
+        {
+            SaveDC( ref_dc );
+            IntersectClipRect( ref_dc, 0, y, width, y + strip );
+            draw_large_rect( ref_dc, i, width, height, src_dc, width * 2, height * 2 );
+            RestoreDC( ref_dc, -1 );
+        }
+        for (x = 0; x < width * height; x++) if (dst_bits[x] != ref_bits[x]) break;
+        ok( x == width * height, "%s: got %08x instead of %08x at %u,%u\n", names[i],
+            dst_bits[x % (width * height)], ref_bits[x % (width * height)], x % width, x / width );
+    }
+
+    if (set_threads) SetEnvironmentVariableA( "WINEDIBTHREADS", NULL );
+
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+    DeleteDC( ref_dc );
+    DeleteObject( src_bmp );
+    DeleteObject( dst_bmp );
+    DeleteObject( ref_bmp );
+}
+
 START_TEST(bitmap)
 {
     HMODULE hdll;
@@ -5981,4 +6274,6 @@ START_TEST(bitmap)
     test_SetDIBitsToDevice();
     test_SetDIBitsToDevice_RLE8();
     test_D3DKMTCreateDCFromMemory();
+    test_wide_rows();
+    test_large_rects();
 }
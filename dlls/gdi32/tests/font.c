@@ -7499,6 +7499,151 @@ static void test_char_width(void)
     ReleaseDC(NULL, dc);
 }
 
+static DWORD draw_glyph_cache_text(HDC hdc, const DWORD *bits, int height)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog. 0123456789";
+    HFONT hfont, hfont_old;
+    LOGFONTA lf;
+    DWORD sum = 0;
+    int i, y;
+
+    memset(&lf, 0, sizeof(lf));
+    strcpy(lf.lfFaceName, "Tahoma");
+    lf.lfHeight = -height;
+    lf.lfQuality = ANTIALIASED_QUALITY;
+    hfont = CreateFontIndirectA(&lf);
+    hfont_old = SelectObject(hdc, hfont);
+
+    PatBlt(hdc, 0, 0, 512, 256, WHITENESS);
+    for (y = 0; y < 256; y += height)
+        TextOutA(hdc, 0, y, text, strlen(text));
+    GdiFlush();
+
+    SelectObject(hdc, hfont_old);
+    DeleteObject(hfont);
+
+    for (i = 0; i < 512 * 256; i++) sum = ((sum << 5) | (sum >> 27)) ^ bits[i];
+    return sum;
+}
+
+static HDC create_glyph_cache_dc(DWORD **bits)
+{
+    BITMAPINFO info;
+    HBITMAP bitmap;
+    HDC hdc;
+
+    memset(&info, 0, sizeof(info));
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = 512;
+    info.bmiHeader.biHeight = -256;
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    hdc = CreateCompatibleDC(0);
+    bitmap = CreateDIBSection(hdc, &info, DIB_RGB_COLORS, (void **)bits, NULL, 0);
+    ok(bitmap != NULL, "CreateDIBSection failed\n");
+    SelectObject(hdc, bitmap);
+    return hdc;
+}
+
+static void delete_glyph_cache_dc(HDC hdc)
+{
+    HBITMAP bitmap = GetCurrentObject(hdc, OBJ_BITMAP);
+
+    DeleteDC(hdc);
+    DeleteObject(bitmap);
+}
+
+static void test_glyph_cache_child(const char *arg, BOOL hold)
+{
+    DWORD expected = strtoul(arg, NULL, 16), sum, *bits;
+    HDC hdc = create_glyph_cache_dc(&bits);
+    HANDLE ready, done;
+
+    /* the glyphs may come from the other child process */
+    sum = draw_glyph_cache_text(hdc, bits, 16);
+    ok(sum == expected, "got %08x, expected %08x\n", sum, expected);
+    delete_glyph_cache_dc(hdc);
+
+    if (!hold) return;
+
+    /* keep the cache alive until the other child is done */
+    ready = OpenEventA(EVENT_MODIFY_STATE, FALSE, "wine_test_glyph_cache_ready");
+    done = OpenEventA(SYNCHRONIZE, FALSE, "wine_test_glyph_cache_done");
+    ok(ready && done, "OpenEvent failed, error %u\n", GetLastError());
+    SetEvent(ready);
+    WaitForSingleObject(done, 30000);
+    CloseHandle(ready);
+    CloseHandle(done);
+}
+
+/* start a child with the shared glyph cache enabled in its environment only */
+static void start_glyph_cache_child(DWORD sum, BOOL hold, PROCESS_INFORMATION *info)
+{
+    static const char var[] = "WINEGLYPHCACHE=16";
+    char cmdline[MAX_PATH + 32], **argv, *env, *block, *p;
+    STARTUPINFOA startup;
+    SIZE_T size;
+
+    winetest_get_mainargs(&argv);
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    sprintf(cmdline, "%s font glyph_cache %08x%s", argv[0], sum, hold ? " hold" : "");
+
+    env = GetEnvironmentStringsA();
+    for (p = env; *p; p += strlen(p) + 1)
+        ;
+    size = p - env;
+    block = HeapAlloc(GetProcessHeap(), 0, size + sizeof(var) + 1);
+    memcpy(block, env, size);
+    memcpy(block + size, var, sizeof(var));
+    block[size + sizeof(var)] = 0;
+    FreeEnvironmentStringsA(env);
+
+    ok(CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, block, NULL, &startup, info),
+       "CreateProcess failed.\n");
+    HeapFree(GetProcessHeap(), 0, block);
+}
+
+static void test_glyph_cache(void)
+{
+    PROCESS_INFORMATION info, info2;
+    HANDLE ready, done;
+    DWORD sum, sum2, *bits;
+    HDC hdc;
+
+    if (!is_font_installed("Tahoma"))
+    {
+        skip("Tahoma is not installed\n");
+        return;
+    }
+
+    hdc = create_glyph_cache_dc(&bits);
+    sum = draw_glyph_cache_text(hdc, bits, 16);
+    sum2 = draw_glyph_cache_text(hdc, bits, 16);
+    ok(sum == sum2, "got %08x, expected %08x\n", sum2, sum);
+    delete_glyph_cache_dc(hdc);
+
+    /* the first child renders the glyphs, the second one gets them from the cache */
+    ready = CreateEventA(NULL, TRUE, FALSE, "wine_test_glyph_cache_ready");
+    done = CreateEventA(NULL, TRUE, FALSE, "wine_test_glyph_cache_done");
+
+    start_glyph_cache_child(sum, TRUE, &info);
+    ok(WaitForSingleObject(ready, 30000) == WAIT_OBJECT_0, "child didn't start\n");
+    start_glyph_cache_child(sum, FALSE, &info2);
+    wait_child_process(info2.hProcess);
+    SetEvent(done);
+    wait_child_process(info.hProcess);
+
+    CloseHandle(info.hProcess);
+    CloseHandle(info.hThread);
+    CloseHandle(info2.hProcess);
+    CloseHandle(info2.hThread);
+    CloseHandle(ready);
+    CloseHandle(done);
+}
+
 static void test_GetCharacterPlacement_kerning(void)
 {
     LOGFONTA lf;
@@ -7617,6 +7762,8 @@ START_TEST(font)
     {
         if (!strcmp(argv[2], "AddFontMemResource"))
             test_AddFontMemResource();
+        else if (!strcmp(argv[2], "glyph_cache") && argc >= 4)
+            test_glyph_cache_child(argv[3], argc >= 5 && !strcmp(argv[4], "hold"));
         return;
     }
 
@@ -7685,6 +7832,7 @@ START_TEST(font)
     test_ttf_names();
     test_lang_names();
     test_char_width();
+    test_glyph_cache();
 
     /* These tests should be last test until RemoveFontResource
      * is properly implemented.
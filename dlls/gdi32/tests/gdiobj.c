@@ -362,6 +362,93 @@ static void test_handles_on_win64(void)
     }
 }
 
+#define STRESS_THREADS    4
+#define STRESS_ITERATIONS 2000
+
+static DWORD WINAPI stress_thread_proc(void *param)
+{
+    HBITMAP bitmap, old_bitmap;
+    HBRUSH brush, old_brush;
+    HPEN pen, old_pen;
+    BITMAPINFO info;
+    HDC hdc;
+    void *bits;
+    DWORD type;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = 16;
+    info.bmiHeader.biHeight = 16;
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    hdc = CreateCompatibleDC(NULL);
+    ok(hdc != NULL, "CreateCompatibleDC failed\n");
+
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        brush = CreateSolidBrush(RGB(i, 0, 0));
+        pen = CreatePen(PS_SOLID, 1, RGB(0, i, 0));
+        bitmap = CreateDIBSection(hdc, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+        if (!brush || !pen || !bitmap)
+        {
+            ok(0, "failed to create objects %p %p %p at iteration %d\n", brush, pen, bitmap, i);
+            break;
+        }
+
+        type = GetObjectType(brush);
+        ok(type == OBJ_BRUSH, "wrong type %u\n", type);
+        type = GetObjectType(pen);
+        ok(type == OBJ_PEN, "wrong type %u\n", type);
+        type = GetObjectType(bitmap);
+        ok(type == OBJ_BITMAP, "wrong type %u\n", type);
+
+        old_brush = SelectObject(hdc, brush);
+        old_pen = SelectObject(hdc, pen);
+        old_bitmap = SelectObject(hdc, bitmap);
+        ok(old_brush && old_pen && old_bitmap, "SelectObject failed\n");
+        SelectObject(hdc, old_brush);
+        SelectObject(hdc, old_pen);
+        SelectObject(hdc, old_bitmap);
+
+        ok(DeleteObject(brush), "DeleteObject failed\n");
+        ok(DeleteObject(pen), "DeleteObject failed\n");
+        ok(DeleteObject(bitmap), "DeleteObject failed\n");
+
+        /* the handles must not be valid anymore, even if the entries are reused */
+        type = GetObjectType(brush);
+        ok(type == 0, "deleted brush %p still has type %u\n", brush, type);
+        type = GetObjectType(bitmap);
+        ok(type == 0, "deleted bitmap %p still has type %u\n", bitmap, type);
+    }
+
+    DeleteDC(hdc);
+    return 0;
+}
+
+static void test_handle_table_threads(void)
+{
+    HANDLE threads[STRESS_THREADS];
+    DWORD status;
+    int i;
+
+    stress_thread_proc(NULL);
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        threads[i] = CreateThread(NULL, 0, stress_thread_proc, NULL, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread error %u\n", GetLastError());
+    }
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        status = WaitForSingleObject(threads[i], INFINITE);
+        ok(status == WAIT_OBJECT_0, "WaitForSingleObject error %u\n", GetLastError());
+        CloseHandle(threads[i]);
+    }
+}
+
 START_TEST(gdiobj)
 {
     test_gdi_objects();
@@ -369,4 +456,5 @@ START_TEST(gdiobj)
     test_GetCurrentObject();
     test_region();
     test_handles_on_win64();
+    test_handle_table_threads();
 }
@@ -5555,6 +5555,173 @@ static void test_overlapped_read(void)
     ok(ret, "Unexpected error %u.\n", GetLastError());
 }
 
+static unsigned int apc_count;
+
+static void WINAPI queue_depth_apc(DWORD error, DWORD count, OVERLAPPED *ov)
+{
+    ok(!error, "got error %u\n", error);
+    ok(count == 4096, "got count %u\n", count);
+    apc_count++;
+}
+
+/* random 4k reads at various queue depths, similar to fio's randread */
+static void test_overlapped_queue_depth(void)
+{
+    static const unsigned int depths[] = {1, 4, 16, 32};
+    const unsigned int blocks = 256, reads = 128;
+    unsigned int i, j, d, next, done, seed = 1, *block;
+    char temp_path[MAX_PATH], file_name[MAX_PATH];
+    OVERLAPPED ov[32];
+    HANDLE events[32];
+    unsigned char *buffer;
+    DWORD count;
+    HANDLE hfile;
+    BOOL res;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "qd", 0, file_name);
+    buffer = HeapAlloc(GetProcessHeap(), 0, 32 * 4096);
+    block = HeapAlloc(GetProcessHeap(), 0, 32 * sizeof(*block));
+
+    hfile = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_FLAG_OVERLAPPED, NULL);
+    ok(hfile != INVALID_HANDLE_VALUE, "failed to create file, error %u\n", GetLastError());
+
+    /* write each block tagged with its index, using overlapped writes */
+    for (i = 0; i < 32; i++) events[i] = CreateEventA(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < blocks; i += 32)
+    {
+        for (j = 0; j < 32; j++)
+        {
+            memset(buffer + j * 4096, (i + j) & 0xff, 4096);
+            *(unsigned int *)(buffer + j * 4096) = i + j;
+            memset(&ov[j], 0, sizeof(ov[j]));
+            S(U(ov[j])).Offset = (i + j) * 4096;
+            ov[j].hEvent = events[j];
+            res = WriteFile(hfile, buffer + j * 4096, 4096, NULL, &ov[j]);
+            ok(res || GetLastError() == ERROR_IO_PENDING, "WriteFile failed, error %u\n", GetLastError());
+        }
+        for (j = 0; j < 32; j++)
+        {
+            res = GetOverlappedResult(hfile, &ov[j], &count, TRUE);
+            ok(res && count == 4096, "write failed, count %u error %u\n", count, GetLastError());
+        }
+    }
+
+    for (d = 0; d < ARRAY_SIZE(depths); d++)
+    {
+        next = done = 0;
+        while (done < reads)
+        {
+            while (next < reads && next - done < depths[d])
+            {
+                j = next % depths[d];
+                seed = seed * 1103515245 + 12345;
+                block[j] = (seed >> 8) % blocks;
+                memset(&ov[j], 0, sizeof(ov[j]));
+                S(U(ov[j])).Offset = block[j] * 4096;
+                ov[j].hEvent = events[j];
+                res = ReadFile(hfile, buffer + j * 4096, 4096, NULL, &ov[j]);
+                ok(res || GetLastError() == ERROR_IO_PENDING, "ReadFile failed, error %u\n", GetLastError());
+                next++;
+            }
+            /* reads are completed in submission order */
+            j = done % depths[d];
+            res = GetOverlappedResult(hfile, &ov[j], &count, TRUE);
+            ok(res && count == 4096, "read failed, count %u error %u\n", count, GetLastError());
+            ok(*(unsigned int *)(buffer + j * 4096) == block[j], "got block %u instead of %u\n",
+               *(unsigned int *)(buffer + j * 4096), block[j]);
+            done++;
+        }
+    }
+
+    /* completion through APCs */
+    apc_count = 0;
+    for (j = 0; j < 32; j++)
+    {
+        memset(&ov[j], 0, sizeof(ov[j]));
+        S(U(ov[j])).Offset = j * 4096;
+        res = ReadFileEx(hfile, buffer + j * 4096, 4096, &ov[j], queue_depth_apc);
+        ok(res, "ReadFileEx failed, error %u\n", GetLastError());
+    }
+    while (apc_count < 32)
+        if (SleepEx(5000, TRUE) != WAIT_IO_COMPLETION) break;
+    ok(apc_count == 32, "got %u APCs\n", apc_count);
+    for (j = 0; j < 32; j++)
+        ok(*(unsigned int *)(buffer + j * 4096) == j, "got block %u instead of %u\n",
+           *(unsigned int *)(buffer + j * 4096), j);
+
+    /* cancelled reads either complete or are aborted */
+    for (j = 0; j < 32; j++)
+    {
+        memset(&ov[j], 0, sizeof(ov[j]));
+        S(U(ov[j])).Offset = j * 4096;
+        ov[j].hEvent = events[j];
+        res = ReadFile(hfile, buffer + j * 4096, 4096, NULL, &ov[j]);
+        ok(res || GetLastError() == ERROR_IO_PENDING, "ReadFile failed, error %u\n", GetLastError());
+    }
+    CancelIoEx(hfile, NULL);
+    for (j = 0; j < 32; j++)
+    {
+        res = GetOverlappedResult(hfile, &ov[j], &count, TRUE);
+        ok((res && count == 4096) || (!res && GetLastError() == ERROR_OPERATION_ABORTED),
+           "got %d, count %u error %u\n", res, count, GetLastError());
+    }
+
+    /* reading past the end of file */
+    memset(&ov[0], 0, sizeof(ov[0]));
+    S(U(ov[0])).Offset = blocks * 4096;
+    ov[0].hEvent = events[0];
+    res = ReadFile(hfile, buffer, 4096, NULL, &ov[0]);
+    ok(!res && (GetLastError() == ERROR_IO_PENDING || broken(GetLastError() == ERROR_HANDLE_EOF)),
+       "ReadFile returned %d, error %u\n", res, GetLastError());
+    if (GetLastError() == ERROR_IO_PENDING)
+    {
+        res = GetOverlappedResult(hfile, &ov[0], &count, TRUE);
+        ok(!res && GetLastError() == ERROR_HANDLE_EOF, "got %d, error %u\n", res, GetLastError());
+    }
+
+    for (i = 0; i < 32; i++) CloseHandle(events[i]);
+    CloseHandle(hfile);
+    DeleteFileA(file_name);
+    HeapFree(GetProcessHeap(), 0, block);
+    HeapFree(GetProcessHeap(), 0, buffer);
+}
+
+/* run the same test in a child with WINEIOURING set, which is read at startup */
+static void test_overlapped_queue_depth_uring(void)
+{
+    static const char var[] = "WINEIOURING=1";
+    char cmdline[MAX_PATH + 32], **argv, *env, *block, *p;
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    SIZE_T size;
+    BOOL ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" file queue_depth", argv[0]);
+
+    env = GetEnvironmentStringsA();
+    for (p = env; *p; p += strlen(p) + 1)
+        ;
+    size = p - env;
+    block = HeapAlloc(GetProcessHeap(), 0, size + sizeof(var) + 1);
+    memcpy(block, env, size);
+    memcpy(block + size, var, sizeof(var));
+    block[size + sizeof(var)] = 0;
+    FreeEnvironmentStringsA(env);
+
+    ret = CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, block, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed, error %u\n", GetLastError());
+    if (ret)
+    {
+        wait_child_process(pi.hProcess);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+    }
+    HeapFree(GetProcessHeap(), 0, block);
+}
+
 static void test_file_readonly_access(void)
 {
     static const DWORD default_sharing = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
@@ -5856,11 +6023,19 @@ static void test_move_file(void)
 
 START_TEST(file)
 {
-    char temp_path[MAX_PATH];
+    char temp_path[MAX_PATH], **argv;
     DWORD ret;
+    int argc;
 
     InitFunctionPointers();
 
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 3 && !strcmp(argv[2], "queue_depth"))
+    {
+        test_overlapped_queue_depth();
+        return;
+    }
+
     ret = GetTempPathA(MAX_PATH, temp_path);
     ok(ret != 0, "GetTempPath error %u\n", GetLastError());
     ret = GetTempFileNameA(temp_path, "tmp", 0, filename);
@@ -5924,6 +6099,8 @@ START_TEST(file)
     test_GetFileAttributesExW();
     test_post_completion();
     test_overlapped_read();
+    test_overlapped_queue_depth();
+    test_overlapped_queue_depth_uring();
     test_file_readonly_access();
     test_find_file_stream();
     test_SetFileTime();
@@ -42,6 +42,7 @@
 static LPVOID (WINAPI *pHeapAlloc)(HANDLE,DWORD,SIZE_T);
 static LPVOID (WINAPI *pHeapReAlloc)(HANDLE,DWORD,LPVOID,SIZE_T);
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
@@ -899,6 +900,145 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+#define LFH_THREADS 4
+#define LFH_BLOCKS  1024
+
+static HANDLE lfh_heap;
+static BYTE *lfh_blocks[LFH_THREADS][LFH_BLOCKS];
+static LONG lfh_errors;
+
+static SIZE_T lfh_block_size( unsigned int id, unsigned int i )
+{
+    return 1 + (i * 37 + id * 11) % 2048;
+}
+
+/* even passes allocate the blocks of a thread, odd passes free the ones of the next thread */
+static DWORD WINAPI lfh_thread( void *arg )
+{
+    unsigned int id = (ULONG_PTR)arg >> 1, owner = (id + 1) % LFH_THREADS, i;
+    SIZE_T size;
+    BYTE *p;
+
+    if (!((ULONG_PTR)arg & 1))
+    {
+        for (i = 0; i < LFH_BLOCKS; i++)
+        {
+            size = lfh_block_size( id, i );
+            lfh_blocks[id][i] = p = HeapAlloc( lfh_heap, 0, size );
+            if (!p || HeapSize( lfh_heap, 0, p ) != size) InterlockedIncrement( &lfh_errors );
+            else memset( p, id + i, size );
+        }
+        return 0;
+    }
+
+    for (i = 0; i < LFH_BLOCKS; i++)
+    {
+        if (!(p = lfh_blocks[owner][i])) continue;
+        size = lfh_block_size( owner, i );
+        if (p[0] != (BYTE)(owner + i) || p[size - 1] != (BYTE)(owner + i)) InterlockedIncrement( &lfh_errors );
+        if (!HeapFree( lfh_heap, 0, p )) InterlockedIncrement( &lfh_errors );
+        lfh_blocks[owner][i] = NULL;
+    }
+    return 0;
+}
+
+static void test_lfh(void)
+{
+    unsigned int i, round;
+    HANDLE threads[LFH_THREADS];
+    ULONG info;
+    BYTE *p, *p2, *reserved, *other, *bad[4];
+    SIZE_T size;
+    BOOL ret;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    lfh_heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    ok( lfh_heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( lfh_heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n" );
+    HeapDestroy( lfh_heap );
+
+    lfh_heap = HeapCreate( 0, 0, 0 );
+    ok( lfh_heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( lfh_heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( lfh_heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    p = HeapAlloc( lfh_heap, HEAP_ZERO_MEMORY, 100 );
+    ok( p != NULL, "HeapAlloc failed\n" );
+    for (i = 0; i < 100; i++) if (p[i]) break;
+    ok( i == 100, "memory not zeroed at %u\n", i );
+    memset( p, 0x55, 100 );
+    ok( HeapValidate( lfh_heap, 0, p ), "HeapValidate failed\n" );
+    p2 = HeapReAlloc( lfh_heap, HEAP_REALLOC_IN_PLACE_ONLY, p, 90 );
+    ok( p2 == p, "HeapReAlloc moved the block %p -> %p\n", p, p2 );
+    ok( HeapSize( lfh_heap, 0, p ) == 90, "wrong size %lu\n", HeapSize( lfh_heap, 0, p ) );
+    p2 = HeapReAlloc( lfh_heap, HEAP_ZERO_MEMORY, p, 1000 );
+    ok( p2 != NULL, "HeapReAlloc failed\n" );
+    ok( HeapSize( lfh_heap, 0, p2 ) == 1000, "wrong size %lu\n", HeapSize( lfh_heap, 0, p2 ) );
+    ok( p2[0] == 0x55 && p2[89] == 0x55, "data not preserved\n" );
+    ok( !p2[90] && !p2[999], "memory not zeroed\n" );
+    ret = HeapFree( lfh_heap, 0, p2 );
+    ok( ret, "HeapFree failed\n" );
+
+    /* pointers that don't belong to the heap must not be dereferenced */
+    p = HeapAlloc( lfh_heap, HEAP_ZERO_MEMORY, 100 );
+    ok( p != NULL, "HeapAlloc failed\n" );
+    reserved = VirtualAlloc( NULL, 0x10000, MEM_RESERVE, PAGE_NOACCESS );
+    ok( reserved != NULL, "VirtualAlloc failed\n" );
+    other = HeapAlloc( GetProcessHeap(), 0, 100 );
+    ok( other != NULL, "HeapAlloc failed\n" );
+    bad[0] = reserved + 0x1010;
+    bad[1] = other;
+    bad[2] = p + 1;
+    bad[3] = p + 8;
+    for (i = 0; i < ARRAY_SIZE(bad); i++)
+    {
+        ret = HeapValidate( lfh_heap, 0, bad[i] );
+        ok( !ret, "%u: HeapValidate succeeded\n", i );
+        size = HeapSize( lfh_heap, 0, bad[i] );
+        ok( size == ~(SIZE_T)0, "%u: got size %lu\n", i, size );
+        ret = HeapFree( lfh_heap, 0, bad[i] );
+        ok( !ret, "%u: HeapFree succeeded\n", i );
+    }
+    ok( HeapValidate( lfh_heap, 0, p ), "HeapValidate failed\n" );
+    ret = HeapFree( lfh_heap, 0, p );
+    ok( ret, "HeapFree failed\n" );
+    HeapFree( GetProcessHeap(), 0, other );
+    VirtualFree( reserved, 0, MEM_RELEASE );
+
+    /* the second round reuses the blocks freed by other threads */
+    for (round = 0; round < 2; round++)
+    {
+        for (i = 0; i < LFH_THREADS; i++)
+            threads[i] = CreateThread( NULL, 0, lfh_thread, (void *)(ULONG_PTR)(i << 1), 0, NULL );
+        WaitForMultipleObjects( LFH_THREADS, threads, TRUE, INFINITE );
+        for (i = 0; i < LFH_THREADS; i++) CloseHandle( threads[i] );
+        if (!round) ok( HeapValidate( lfh_heap, 0, NULL ), "HeapValidate failed\n" );
+
+        for (i = 0; i < LFH_THREADS; i++)
+            threads[i] = CreateThread( NULL, 0, lfh_thread, (void *)(ULONG_PTR)(i << 1 | 1), 0, NULL );
+        WaitForMultipleObjects( LFH_THREADS, threads, TRUE, INFINITE );
+        for (i = 0; i < LFH_THREADS; i++) CloseHandle( threads[i] );
+    }
+    ok( !lfh_errors, "got %d errors\n", lfh_errors );
+    ok( HeapValidate( lfh_heap, 0, NULL ), "HeapValidate failed\n" );
+
+    ret = HeapDestroy( lfh_heap );
+    ok( ret, "HeapDestroy failed\n" );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1255,6 +1395,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_lfh();
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
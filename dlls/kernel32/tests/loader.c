@@ -2309,6 +2309,100 @@ static void test_import_resolution(void)
     }
 }
 
+static void test_image_relocation(void)
+{
+    char temp_path[MAX_PATH];
+    char dll_name[MAX_PATH];
+    DWORD dummy;
+    HANDLE hfile;
+    HMODULE mod;
+    void *reserved;
+    struct relocs
+    {
+        ULONG_PTR ptr;
+        char str[16];
+        IMAGE_BASE_RELOCATION rel;
+        WORD relocs[2];
+    } data, *ptr;
+    IMAGE_NT_HEADERS nt;
+    IMAGE_SECTION_HEADER section;
+    int i;
+
+#define DATA_RVA(ptr) (page_size + ((char *)(ptr) - (char *)&data))
+    nt = nt_header_template;
+    nt.FileHeader.NumberOfSections = 1;
+    nt.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+    nt.FileHeader.Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL;
+    nt.OptionalHeader.SectionAlignment = page_size;
+    nt.OptionalHeader.FileAlignment = 0x200;
+    nt.OptionalHeader.ImageBase = 0x12340000;
+    nt.OptionalHeader.SizeOfImage = 2 * page_size;
+    nt.OptionalHeader.SizeOfHeaders = nt.OptionalHeader.FileAlignment;
+    nt.OptionalHeader.SizeOfCode = page_size;
+    nt.OptionalHeader.DllCharacteristics = IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
+    nt.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    memset( nt.OptionalHeader.DataDirectory, 0, sizeof(nt.OptionalHeader.DataDirectory) );
+    nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size = sizeof(data.rel) + sizeof(data.relocs);
+    nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress = DATA_RVA(&data.rel);
+
+    memset( &data, 0, sizeof(data) );
+    data.ptr = nt.OptionalHeader.ImageBase + DATA_RVA( data.str );
+    strcpy( data.str, "relocated" );
+    data.rel.VirtualAddress = page_size;
+    data.rel.SizeOfBlock = sizeof(data.rel) + sizeof(data.relocs);
+    data.relocs[0] = ((is_win64 ? IMAGE_REL_BASED_DIR64 : IMAGE_REL_BASED_HIGHLOW) << 12) |
+                     (DATA_RVA( &data.ptr ) - page_size);
+    data.relocs[1] = IMAGE_REL_BASED_ABSOLUTE << 12;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "ldr", 0, dll_name);
+
+    hfile = CreateFileA(dll_name, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, 0, 0);
+    ok( hfile != INVALID_HANDLE_VALUE, "creation failed\n" );
+
+    memset( &section, 0, sizeof(section) );
+    memcpy( section.Name, ".data", sizeof(".data") );
+    section.PointerToRawData = nt.OptionalHeader.FileAlignment;
+    section.VirtualAddress = nt.OptionalHeader.SectionAlignment;
+    section.Misc.VirtualSize = sizeof(data);
+    section.SizeOfRawData = sizeof(data);
+    section.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
+    WriteFile(hfile, &dos_header, sizeof(dos_header), &dummy, NULL);
+    WriteFile(hfile, &nt, sizeof(nt), &dummy, NULL);
+    WriteFile(hfile, &section, sizeof(section), &dummy, NULL);
+
+    SetFilePointer( hfile, section.PointerToRawData, NULL, SEEK_SET );
+    WriteFile(hfile, &data, sizeof(data), &dummy, NULL);
+
+    CloseHandle( hfile );
+
+    /* keep the preferred base busy so that the dll has to be relocated */
+    reserved = VirtualAlloc( (void *)nt.OptionalHeader.ImageBase, nt.OptionalHeader.SizeOfImage,
+                             MEM_RESERVE, PAGE_NOACCESS );
+    ok( reserved != NULL, "failed to reserve preferred base err %u\n", GetLastError() );
+
+    /* load it twice, the second load may reuse pages relocated by the first one */
+    for (i = 0; i < 2; i++)
+    {
+        mod = LoadLibraryA( dll_name );
+        ok( mod != NULL, "%u: failed to load err %u\n", i, GetLastError() );
+        if (!mod) break;
+        ok( (ULONG_PTR)mod != nt.OptionalHeader.ImageBase, "%u: loaded at preferred base\n", i );
+        ptr = (struct relocs *)((char *)mod + page_size);
+        ok( ptr->ptr == (ULONG_PTR)ptr->str, "%u: pointer not relocated %p / %p\n",
+            i, (void *)ptr->ptr, ptr->str );
+        ok( !strcmp( ptr->str, "relocated" ), "%u: wrong data %s\n", i, ptr->str );
+        /* writes must stay private to this load */
+        ptr->ptr = 0;
+        FreeLibrary( mod );
+    }
+
+    if (reserved) VirtualFree( reserved, 0, MEM_RELEASE );
+    DeleteFileA( dll_name );
+#undef DATA_RVA
+}
+
 #define MAX_COUNT 10
 static HANDLE attached_thread[MAX_COUNT];
 static DWORD attached_thread_count;
@@ -4192,6 +4286,7 @@ START_TEST(loader)
     test_ImportDescriptors();
     test_section_access();
     test_import_resolution();
+    test_image_relocation();
     test_ExitProcess();
     test_InMemoryOrderModuleList();
     test_LoadPackagedLibrary();
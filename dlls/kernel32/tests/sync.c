@@ -3156,6 +3156,57 @@ static void test_zigzag_event(void)
     trace("count: %d\n", zigzag_count[0]);
 }
 
+#define WAIT_ALL_ITERATIONS 200
+
+static LONG wait_all_inside, wait_all_count;
+
+static DWORD CALLBACK wait_all_thread(void *arg)
+{
+    HANDLE *objs = arg;
+    DWORD ret;
+    int i;
+
+    for (i = 0; i < WAIT_ALL_ITERATIONS; i++)
+    {
+        ret = WaitForMultipleObjects(2, objs, TRUE, INFINITE);
+        ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+        ok(InterlockedIncrement(&wait_all_inside) == 1, "mutex held by more than one thread\n");
+        wait_all_count++;
+        InterlockedDecrement(&wait_all_inside);
+        ReleaseMutex(objs[0]);
+        ReleaseSemaphore(objs[1], 1, NULL);
+    }
+    return 0;
+}
+
+static void test_wait_all_contention(void)
+{
+    /* Several threads repeatedly wait for a mutex together with a semaphore,
+     * which exercises grabbing several objects at once under contention. */
+
+    HANDLE threads[4], objs[2];
+    DWORD ret;
+    int i;
+
+    objs[0] = CreateMutexA(NULL, FALSE, NULL);
+    objs[1] = CreateSemaphoreA(NULL, 2, 2, NULL);
+    wait_all_inside = wait_all_count = 0;
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread(NULL, 0, wait_all_thread, objs, 0, NULL);
+    ret = WaitForMultipleObjects(ARRAY_SIZE(threads), threads, TRUE, 60000);
+    ok(ret == WAIT_OBJECT_0, "wait failed: %u\n", ret);
+
+    ok(wait_all_count == ARRAY_SIZE(threads) * WAIT_ALL_ITERATIONS, "got count %d\n", wait_all_count);
+    ret = WaitForSingleObject(objs[1], 0);
+    ok(ret == WAIT_OBJECT_0, "semaphore count was not restored: %u\n", ret);
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        CloseHandle(threads[i]);
+    CloseHandle(objs[0]);
+    CloseHandle(objs[1]);
+}
+
 START_TEST(sync)
 {
     char **argv;
@@ -3219,5 +3270,6 @@ START_TEST(sync)
     test_alertable_wait();
     test_apc_deadlock();
     test_zigzag_event();
+    test_wait_all_contention();
     test_crit_section();
 }
@@ -2147,6 +2147,67 @@ static void test_write_watch(void)
     VirtualFree( base, 0, MEM_RELEASE );
 }
 
+static void test_write_watch_large(void)
+{
+    SIZE_T size = winetest_interactive ? 64 * 1024 * 1024 : 4 * 1024 * 1024;
+    ULONG_PTR count, pages, i;
+    DWORD ret;
+    ULONG pagesize;
+    void **results;
+    char *base;
+    int round;
+
+    if (!pGetWriteWatch || !pResetWriteWatch)
+    {
+        win_skip( "GetWriteWatch not supported\n" );
+        return;
+    }
+
+    base = VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    if (!base)
+    {
+        skip( "cannot allocate %lu bytes with write watches\n", size );
+        return;
+    }
+    pages = size / si.dwPageSize;
+    results = HeapAlloc( GetProcessHeap(), 0, pages * sizeof(*results) );
+
+    /* dirty every page, then collect and reset them all at once */
+    for (round = 0; round < 3; round++)
+    {
+        for (i = 0; i < pages; i++) base[i * si.dwPageSize] = round + 1;
+
+        count = pages;
+        ret = pGetWriteWatch( WRITE_WATCH_FLAG_RESET, base, size, results, &count, &pagesize );
+        ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+        ok( count == pages, "wrong count %lu / %lu\n", count, pages );
+        ok( results[0] == base, "wrong result %p\n", results[0] );
+        ok( results[count - 1] == base + (pages - 1) * si.dwPageSize, "wrong result %p\n", results[count - 1] );
+    }
+
+    count = pages;
+    ret = pGetWriteWatch( 0, base, size, results, &count, &pagesize );
+    ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+    ok( !count, "wrong count %lu\n", count );
+
+    /* decommitted and recommitted pages are still watched */
+    ret = VirtualFree( base + si.dwPageSize, 4 * si.dwPageSize, MEM_DECOMMIT );
+    ok( ret, "VirtualFree failed %u\n", GetLastError() );
+    ok( VirtualAlloc( base + si.dwPageSize, 4 * si.dwPageSize, MEM_COMMIT, PAGE_READWRITE ) != NULL,
+        "VirtualAlloc failed %u\n", GetLastError() );
+    ret = pResetWriteWatch( base, size );
+    ok( !ret, "ResetWriteWatch failed %u\n", ret );
+    base[2 * si.dwPageSize] = 1;
+    count = pages;
+    ret = pGetWriteWatch( 0, base, size, results, &count, &pagesize );
+    ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+    ok( count == 1, "wrong count %lu\n", count );
+    ok( results[0] == base + 2 * si.dwPageSize, "wrong result %p\n", results[0] );
+
+    HeapFree( GetProcessHeap(), 0, results );
+    VirtualFree( base, 0, MEM_RELEASE );
+}
+
 #if defined(__i386__) || defined(__x86_64__)
 
 static DWORD WINAPI stack_commit_func( void *arg )
@@ -4514,6 +4575,7 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_write_watch_large();
 #if defined(__i386__) || defined(__x86_64__)
     test_stack_commit();
 #endif
@@ -172,6 +172,86 @@ static void test_WaitOnAddress(void)
     ok(!address, "got unexpected value %s\n", wine_dbgstr_longlong(address));
 }
 
+struct pingpong_pair
+{
+    LONG values[512];
+    unsigned int count;
+};
+
+struct pingpong_thread
+{
+    struct pingpong_pair *pair;
+    BOOL server;
+};
+
+static DWORD WINAPI test_WaitOnAddress_pingpong_func(void *arg)
+{
+    struct pingpong_thread *thread = arg;
+    struct pingpong_pair *pair = thread->pair;
+    LONG zero = 0, one = 1, *value;
+    unsigned int i;
+    BOOL ret;
+
+    for (i = 0; i < pair->count; i++)
+    {
+        value = &pair->values[i % ARRAY_SIZE(pair->values)];
+        if (thread->server)
+        {
+            while (!*(volatile LONG *)value)
+            {
+                ret = pWaitOnAddress(value, &zero, sizeof(zero), 10000);
+                ok(ret, "wait failed\n");
+            }
+            InterlockedExchange(value, 0);
+        }
+        else
+        {
+            InterlockedExchange(value, 1);
+        }
+        pWakeByAddressSingle(value);
+        if (!thread->server)
+        {
+            while (*(volatile LONG *)value)
+            {
+                ret = pWaitOnAddress(value, &one, sizeof(one), 10000);
+                ok(ret, "wait failed\n");
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void test_WaitOnAddress_contention(void)
+{
+    unsigned int i, num_pairs = 4;
+    struct pingpong_thread threads[8];
+    struct pingpong_pair *pairs;
+    HANDLE handles[8];
+    DWORD ret;
+
+    /* every pair of threads passes a token back and forth through its own
+     * set of addresses, so the pairs only contend inside the implementation */
+    pairs = calloc(num_pairs, sizeof(*pairs));
+    for (i = 0; i < num_pairs * 2; i++)
+    {
+        threads[i].pair = &pairs[i / 2];
+        threads[i].pair->count = 1000;
+        threads[i].server = i & 1;
+    }
+
+    for (i = 0; i < num_pairs * 2; i++)
+        handles[i] = CreateThread(NULL, 0, test_WaitOnAddress_pingpong_func, &threads[i], 0, NULL);
+    for (i = 0; i < num_pairs * 2; i++)
+    {
+        ret = WaitForSingleObject(handles[i], 60000);
+        ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+        CloseHandle(handles[i]);
+    }
+
+    free(pairs);
+}
+
 static void test_Sleep(void)
 {
     LARGE_INTEGER frequency;
@@ -211,5 +291,6 @@ START_TEST(sync)
     pWakeByAddressSingle = (void *)GetProcAddress(hmod, "WakeByAddressSingle");
 
     test_WaitOnAddress();
+    test_WaitOnAddress_contention();
     test_Sleep();
 }
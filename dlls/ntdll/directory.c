@@ -144,6 +144,49 @@ typedef struct
 #define AT_NO_AUTOMOUNT 0x800
 #endif
 
+/* same layout as struct linux_dirent64 */
+struct kernel_dirent64
+{
+    ULONGLONG      d_ino;
+    LONGLONG       d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[1];
+};
+
+/* same layout as struct statx in <linux/stat.h> */
+struct kernel_statx_timestamp
+{
+    LONGLONG     tv_sec;
+    unsigned int tv_nsec;
+    int          reserved;
+};
+
+struct kernel_statx
+{
+    unsigned int   stx_mask;
+    unsigned int   stx_blksize;
+    ULONGLONG      stx_attributes;
+    unsigned int   stx_nlink;
+    unsigned int   stx_uid;
+    unsigned int   stx_gid;
+    unsigned short stx_mode;
+    unsigned short spare0;
+    ULONGLONG      stx_ino;
+    ULONGLONG      stx_size;
+    ULONGLONG      stx_blocks;
+    ULONGLONG      stx_attributes_mask;
+    struct kernel_statx_timestamp stx_atime;
+    struct kernel_statx_timestamp stx_btime;
+    struct kernel_statx_timestamp stx_ctime;
+    struct kernel_statx_timestamp stx_mtime;
+    unsigned int   stx_rdev_major;
+    unsigned int   stx_rdev_minor;
+    unsigned int   stx_dev_major;
+    unsigned int   stx_dev_minor;
+    ULONGLONG      spare2[14];
+};
+
 #endif  /* linux */
 
 #define IS_OPTION_TRUE(ch) ((ch) == 'y' || (ch) == 'Y' || (ch) == 't' || (ch) == 'T' || (ch) == '1')
@@ -200,6 +243,16 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    struct dir_listing     *listing; /* listing holding the names strings, if not in buffer */
+};
+
+/* full sorted contents of a directory, shared by all the handles that enumerate it */
+struct dir_listing
+{
+    struct list             entry;    /* entry in the listings cache */
+    unsigned int            refcount; /* number of references, including the cache */
+    struct stat             st;       /* directory stat info when the listing was read */
+    struct dir_data        *data;     /* all the directory entries */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
@@ -209,6 +262,11 @@ static const unsigned int dir_data_names_initial_size  = 64;
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
 
+static const unsigned int dir_listings_max = 16;
+
+static struct list dir_listings = LIST_INIT( dir_listings );
+static unsigned int dir_listings_count;
+
 static BOOL show_dot_files;
 static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
 
@@ -226,6 +284,34 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* names of large directories, cached for case-insensitive lookups */
+struct name_cache_dir
+{
+    struct list          entry;      /* entry in the name cache list, most recently used first */
+    unsigned int         gen;        /* server names generation when the directory was read */
+    ULONG                fold;       /* case folding probe when the directory was read */
+    unsigned int         hash_mask;  /* size of the hash table - 1 */
+    unsigned int        *buckets;    /* hash buckets, containing key index + 1 */
+    unsigned int        *next;       /* hash chains; keys are the long names followed by the short names */
+    ULONG               *hashes;     /* hash value of each key */
+    struct dir_data     *data;       /* directory names in readdir order */
+};
+
+static const unsigned int name_cache_min_entries = 128;
+static const unsigned int name_cache_max_dirs = 64;
+
+static struct list name_cache = LIST_INIT( name_cache );
+static unsigned int name_cache_count;
+
+static RTL_CRITICAL_SECTION name_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG name_cache_critsect_debug =
+{
+    0, 0, &name_cache_section,
+    { &name_cache_critsect_debug.ProcessLocksList, &name_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": name_cache_section") }
+};
+static RTL_CRITICAL_SECTION name_cache_section = { &name_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -380,6 +466,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
+static void release_dir_listing( struct dir_listing *listing );
+
 /* free the complete directory data structure */
 static void free_dir_data( struct dir_data *data )
 {
@@ -392,10 +480,19 @@ static void free_dir_data( struct dir_data *data )
         next = buffer->next;
         RtlFreeHeap( GetProcessHeap(), 0, buffer );
     }
+    if (data->listing) release_dir_listing( data->listing );
     RtlFreeHeap( GetProcessHeap(), 0, data->names );
     RtlFreeHeap( GetProcessHeap(), 0, data );
 }
 
+/* release a reference to a directory listing */
+static void release_dir_listing( struct dir_listing *listing )
+{
+    if (--listing->refcount) return;
+    free_dir_data( listing->data );
+    RtlFreeHeap( GetProcessHeap(), 0, listing );
+}
+
 
 /* support for a directory queue for filesystem searches */
 
@@ -1490,6 +1587,113 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
 }
 
 
+#if defined(linux) && defined(__NR_statx)
+
+#define KERNEL_STATX_TYPE   0x0001
+#define KERNEL_STATX_MODE   0x0002
+#define KERNEL_STATX_ATIME  0x0020
+#define KERNEL_STATX_MTIME  0x0040
+#define KERNEL_STATX_CTIME  0x0080
+#define KERNEL_STATX_INO    0x0100
+#define KERNEL_STATX_SIZE   0x0200
+#define KERNEL_STATX_BLOCKS 0x0400
+
+/***********************************************************************
+ *           stat_dir_entry
+ *
+ * Retrieve the stat info of a directory entry without following symlinks,
+ * asking statx only for the fields in mask so that network file systems
+ * don't need to revalidate the others.
+ */
+static int stat_dir_entry( const char *name, unsigned int mask, struct stat *st )
+{
+    static int statx_supported = 1;
+    struct kernel_statx stx;
+
+    if (statx_supported)
+    {
+        if (!syscall( __NR_statx, AT_FDCWD, name, AT_SYMLINK_NOFOLLOW, mask, &stx ))
+        {
+            memset( st, 0, sizeof(*st) );
+            st->st_dev    = makedev( stx.stx_dev_major, stx.stx_dev_minor );
+            st->st_ino    = stx.stx_ino;
+            st->st_mode   = stx.stx_mode;
+            st->st_nlink  = stx.stx_nlink;
+            st->st_size   = stx.stx_size;
+            st->st_blocks = stx.stx_blocks;
+            st->st_atime  = stx.stx_atime.tv_sec;
+            st->st_mtime  = stx.stx_mtime.tv_sec;
+            st->st_ctime  = stx.stx_ctime.tv_sec;
+#ifdef HAVE_STRUCT_STAT_ST_ATIM
+            st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+            st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+            st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+#endif
+            return 0;
+        }
+        if (errno != ENOSYS && errno != EPERM) return -1;
+        statx_supported = 0;
+    }
+    return lstat( name, st );
+}
+
+#else  /* linux && __NR_statx */
+
+#define KERNEL_STATX_TYPE   0
+#define KERNEL_STATX_MODE   0
+#define KERNEL_STATX_ATIME  0
+#define KERNEL_STATX_MTIME  0
+#define KERNEL_STATX_CTIME  0
+#define KERNEL_STATX_INO    0
+#define KERNEL_STATX_SIZE   0
+#define KERNEL_STATX_BLOCKS 0
+
+static int stat_dir_entry( const char *name, unsigned int mask, struct stat *st )
+{
+    return lstat( name, st );
+}
+
+#endif  /* linux && __NR_statx */
+
+
+/***********************************************************************
+ *           get_dir_entry_info
+ *
+ * Get the stat info and attributes of a directory entry, retrieving only
+ * what is needed for the given information class.
+ */
+static int get_dir_entry_info( const struct dir_data *dir_data, const char *name,
+                               FILE_INFORMATION_CLASS class, struct stat *st, ULONG *attributes )
+{
+    unsigned int mask = KERNEL_STATX_TYPE | KERNEL_STATX_INO;
+
+    /* the parent directories of . and .. are not the directory itself */
+    if (!strcmp( name, "." ) || !strcmp( name, ".." )) return get_file_info( name, st, attributes );
+
+    if (class != FileNamesInformation)
+        mask |= KERNEL_STATX_MODE | KERNEL_STATX_SIZE | KERNEL_STATX_BLOCKS |
+                KERNEL_STATX_ATIME | KERNEL_STATX_MTIME | KERNEL_STATX_CTIME;
+
+    if (stat_dir_entry( name, mask, st ) == -1) return -1;
+
+    /* symlinks need information about their target */
+    if (S_ISLNK( st->st_mode )) return get_file_info( name, st, attributes );
+
+    *attributes = 0;
+    if (class == FileNamesInformation) return 0;
+
+    /* consider mount points to be reparse points (IO_REPARSE_TAG_MOUNT_POINT) */
+    if (S_ISDIR( st->st_mode ) && st->st_dev != dir_data->id.dev)
+        *attributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+    *attributes |= get_file_attributes_by_name( name, st );
+    return 0;
+}
+
+
 /***********************************************************************
  *           get_dir_data_entry
  *
@@ -1504,7 +1708,7 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
 
-    if (get_file_info( names->unix_name, &st, &attributes ) == -1)
+    if (get_dir_entry_info( dir_data, names->unix_name, class, &st, &attributes ) == -1)
     {
         TRACE( "file no longer exists %s\n", names->unix_name );
         return STATUS_SUCCESS;
@@ -1734,36 +1938,100 @@ done:
 }
 
 
+#if defined(linux) && defined(__NR_getdents64)
+
+static const unsigned int getdents_buffer_size = 0x10000;
+
 /***********************************************************************
- *           read_directory_data
+ *           read_directory_getdents
  *
- * Read the full contents of a directory, using one of the above helper functions.
+ * Read a directory in large batches using the getdents64 syscall; helper for NtQueryDirectoryFile.
  */
-static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICODE_STRING *mask )
+static NTSTATUS read_directory_data_getdents( struct dir_data *data )
 {
-    NTSTATUS status;
+    struct kernel_dirent64 *de;
+    NTSTATUS status = STATUS_NO_MEMORY;
+    char *buffer;
+    int fd, pos, size;
 
-#ifdef VFAT_IOCTL_READDIR_BOTH
-    if (!(status = read_directory_data_vfat( data, fd, mask ))) return status;
-#endif
+    if ((fd = open( ".", O_RDONLY | O_DIRECTORY )) == -1) return STATUS_NO_SUCH_FILE;
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, getdents_buffer_size ))) goto done;
 
-    if (!has_wildcard( mask ))
+    if ((size = syscall( __NR_getdents64, fd, buffer, getdents_buffer_size )) == -1)
     {
-        /* convert the mask to a Unix name and check for it */
-        char unix_name[MAX_DIR_ENTRY_LEN * 3 + 1];
-        int ret = ntdll_wcstoumbs( mask->Buffer, mask->Length / sizeof(WCHAR),
-                                   unix_name, sizeof(unix_name) - 1, TRUE );
-        if (ret > 0)
+        status = STATUS_NOT_SUPPORTED;
+        goto done;
+    }
+
+    if (!append_entry( data, ".", NULL, NULL )) goto done;
+    if (!append_entry( data, "..", NULL, NULL )) goto done;
+    while (size > 0)
+    {
+        for (pos = 0; pos < size; pos += de->d_reclen)
         {
-            unix_name[ret] = 0;
+            de = (struct kernel_dirent64 *)(buffer + pos);
+            if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+            if (!append_entry( data, de->d_name, NULL, NULL )) goto done;
+        }
+        size = syscall( __NR_getdents64, fd, buffer, getdents_buffer_size );
+    }
+    /* don't return a partial listing */
+    status = size ? FILE_GetNtStatus() : STATUS_SUCCESS;
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    close( fd );
+    return status;
+}
+
+#endif  /* linux && __NR_getdents64 */
+
+
+/***********************************************************************
+ *           read_directory_data_name
+ *
+ * Read a single file from a directory, if the mask is a plain file name.
+ */
+static NTSTATUS read_directory_data_name( struct dir_data *data, const UNICODE_STRING *mask )
+{
+    NTSTATUS status = STATUS_NO_SUCH_FILE;
+    char unix_name[MAX_DIR_ENTRY_LEN * 3 + 1];
+    int ret;
+
+    if (has_wildcard( mask )) return status;
+
+    /* convert the mask to a Unix name and check for it */
+    ret = ntdll_wcstoumbs( mask->Buffer, mask->Length / sizeof(WCHAR),
+                           unix_name, sizeof(unix_name) - 1, TRUE );
+    if (ret > 0)
+    {
+        unix_name[ret] = 0;
 #ifdef HAVE_GETATTRLIST
-            if (!(status = read_directory_data_getattrlist( data, unix_name ))) return status;
+        if (!(status = read_directory_data_getattrlist( data, unix_name ))) return status;
 #endif
-            if (!(status = read_directory_data_stat( data, unix_name ))) return status;
-        }
+        status = read_directory_data_stat( data, unix_name );
     }
+    return status;
+}
 
-    return read_directory_data_readdir( data, mask );
+
+/***********************************************************************
+ *           read_directory_data
+ *
+ * Read the full contents of a directory, using one of the above helper functions.
+ */
+static NTSTATUS read_directory_data( struct dir_data *data, int fd )
+{
+    NTSTATUS status;
+
+#ifdef VFAT_IOCTL_READDIR_BOTH
+    if (!(status = read_directory_data_vfat( data, fd, NULL ))) return status;
+#endif
+#if defined(linux) && defined(__NR_getdents64)
+    if ((status = read_directory_data_getdents( data )) != STATUS_NOT_SUPPORTED) return status;
+#endif
+
+    return read_directory_data_readdir( data, NULL );
 }
 
 
@@ -1779,24 +2047,62 @@ static int name_compare( const void *a, const void *b )
 }
 
 
+/* check whether a directory is unchanged since its stat info was retrieved */
+static BOOL is_same_dir_stat( const struct stat *old, const struct stat *st )
+{
+    if (old->st_mtime != st->st_mtime || old->st_ctime != st->st_ctime) return FALSE;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    if (old->st_mtim.tv_nsec != st->st_mtim.tv_nsec) return FALSE;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    if (old->st_ctim.tv_nsec != st->st_ctim.tv_nsec) return FALSE;
+#endif
+    return old->st_size == st->st_size && old->st_nlink == st->st_nlink;
+}
+
+
 /***********************************************************************
- *           init_cached_dir_data
+ *           get_dir_listing
  *
- * Initialize the cached directory contents.
+ * Retrieve the full sorted contents of a directory, reusing a previous
+ * listing if the directory hasn't been modified since it was read.
  */
-static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const UNICODE_STRING *mask )
+static NTSTATUS get_dir_listing( struct dir_listing **listing_ret, int fd )
 {
+    struct dir_listing *listing;
     struct dir_data *data;
     struct stat st;
     NTSTATUS status;
     unsigned int i;
 
+    if (fstat( fd, &st ) == -1) return FILE_GetNtStatus();
+
+    LIST_FOR_EACH_ENTRY( listing, &dir_listings, struct dir_listing, entry )
+    {
+        if (!is_same_file( &listing->data->id, &st )) continue;
+        list_remove( &listing->entry );
+        if (is_same_dir_stat( &listing->st, &st ))
+        {
+            list_add_head( &dir_listings, &listing->entry );
+            listing->refcount++;
+            *listing_ret = listing;
+            return STATUS_SUCCESS;
+        }
+        dir_listings_count--;
+        release_dir_listing( listing );
+        break;
+    }
+
+    if (!(listing = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*listing) ))) return STATUS_NO_MEMORY;
     if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, listing );
         return STATUS_NO_MEMORY;
-
-    if ((status = read_directory_data( data, fd, mask )))
+    }
+    if ((status = read_directory_data( data, fd )))
     {
         free_dir_data( data );
+        RtlFreeHeap( GetProcessHeap(), 0, listing );
         return status;
     }
 
@@ -1806,6 +2112,97 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
     if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
     if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
 
+    data->id.dev = st.st_dev;
+    data->id.ino = st.st_ino;
+    listing->data = data;
+    listing->st = st;
+    listing->refcount = 1;
+
+    /* a change within the timestamp granularity could go unnoticed, so only
+     * keep listings of directories that haven't been modified very recently */
+    if (time( NULL ) > max( st.st_mtime, st.st_ctime ) + 1)
+    {
+        if (dir_listings_count >= dir_listings_max)
+        {
+            struct dir_listing *old = LIST_ENTRY( list_tail( &dir_listings ), struct dir_listing, entry );
+
+            list_remove( &old->entry );
+            dir_listings_count--;
+            release_dir_listing( old );
+        }
+        list_add_head( &dir_listings, &listing->entry );
+        dir_listings_count++;
+        listing->refcount++;
+    }
+
+    *listing_ret = listing;
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           filter_dir_listing
+ *
+ * Select the entries of a directory listing that match the mask.
+ */
+static NTSTATUS filter_dir_listing( struct dir_data *data, struct dir_listing *listing,
+                                    const UNICODE_STRING *mask )
+{
+    const struct dir_data *all = listing->data;
+    UNICODE_STRING str;
+    unsigned int i;
+
+    if (!(data->names = RtlAllocateHeap( GetProcessHeap(), 0, max( all->count, 1 ) * sizeof(*data->names) )))
+        return STATUS_NO_MEMORY;
+    data->size = max( all->count, 1 );
+    data->listing = listing;
+
+    for (i = 0; i < all->count; i++)
+    {
+        if (mask)
+        {
+            RtlInitUnicodeString( &str, all->names[i].long_name );
+            if (!match_filename( &str, mask ))
+            {
+                if (!all->names[i].short_name[0]) continue;  /* no short name to match */
+                RtlInitUnicodeString( &str, all->names[i].short_name );
+                if (!match_filename( &str, mask )) continue;
+            }
+        }
+        data->names[data->count++] = all->names[i];
+    }
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           init_cached_dir_data
+ *
+ * Initialize the cached directory contents.
+ */
+static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const UNICODE_STRING *mask )
+{
+    struct dir_listing *listing = NULL;
+    struct dir_data *data;
+    struct stat st;
+    NTSTATUS status;
+    unsigned int i;
+
+    if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) )))
+        return STATUS_NO_MEMORY;
+
+    if ((status = read_directory_data_name( data, mask )))
+    {
+        if (!(status = get_dir_listing( &listing, fd )) &&
+            (status = filter_dir_listing( data, listing, mask )))
+            release_dir_listing( listing );
+    }
+    if (status)
+    {
+        free_dir_data( data );
+        return status;
+    }
+
     if (data->count)
     {
         /* release unused space */
@@ -1984,6 +2381,273 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryDirectoryFile( HANDLE handle, HANDLE ev
 }
 
 
+/* hash a file name the same way for all case-insensitive matches */
+static ULONG hash_dir_name( const WCHAR *name, int length )
+{
+    UNICODE_STRING str;
+    ULONG hash;
+
+    str.Buffer = (WCHAR *)name;
+    str.Length = str.MaximumLength = length * sizeof(WCHAR);
+    RtlHashUnicodeString( &str, TRUE, HASH_STRING_ALGORITHM_X65599, &hash );
+    return hash;
+}
+
+/* the case tables are loaded during process init, until then hashing only folds ASCII chars */
+static ULONG get_name_cache_fold(void)
+{
+    static const WCHAR probeW[] = {0xe4};
+    return hash_dir_name( probeW, 1 );
+}
+
+static void free_name_cache_dir( struct name_cache_dir *cache )
+{
+    free_dir_data( cache->data );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->buckets );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+
+/***********************************************************************
+ *           get_dir_names_generation
+ *
+ * Retrieve the names generation of a directory from the server, which
+ * changes every time an entry is added, removed or renamed.
+ */
+static NTSTATUS get_dir_names_generation( int fd, unsigned int *gen )
+{
+    NTSTATUS status;
+
+    wine_server_send_fd( fd );
+
+    SERVER_START_REQ( get_directory_generation )
+    {
+        req->fd = fd;
+        if (!(status = wine_server_call( req ))) *gen = reply->gen;
+    }
+    SERVER_END_REQ;
+    return status;
+}
+
+
+/***********************************************************************
+ *           read_name_cache_dir
+ *
+ * Read the names of a directory and index them for case-insensitive lookups.
+ */
+static struct name_cache_dir *read_name_cache_dir( const char *dir_name )
+{
+    struct name_cache_dir *cache = NULL;
+    struct dir_data *data = NULL;
+    struct dirent *de;
+    unsigned int i, gen, count, hash_size, *bucket;
+    const WCHAR *name;
+    DIR *dir;
+
+    if (!(dir = opendir( dir_name ))) return NULL;
+    if (get_dir_names_generation( dirfd( dir ), &gen )) goto done;
+
+    if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) ))) goto done;
+    while ((de = readdir( dir )))
+        if (!append_entry( data, de->d_name, NULL, NULL )) goto done;
+
+    count = data->count;
+    for (hash_size = 16; hash_size < count; hash_size *= 2) ;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*cache) ))) goto done;
+    if (!(cache->buckets = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                            (hash_size + 4 * count) * sizeof(unsigned int) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        cache = NULL;
+        goto done;
+    }
+    cache->gen       = gen;
+    cache->fold      = get_name_cache_fold();
+    cache->hash_mask = hash_size - 1;
+    cache->next      = cache->buckets + hash_size;
+    cache->hashes    = cache->next + 2 * count;
+    cache->data      = data;
+
+    for (i = 0; i < 2 * count; i++)
+    {
+        name = i < count ? data->names[i].long_name : data->names[i - count].short_name;
+        if (!name[0]) continue;
+        cache->hashes[i] = hash_dir_name( name, wcslen(name) );
+        bucket = &cache->buckets[cache->hashes[i] & cache->hash_mask];
+        cache->next[i] = *bucket;
+        *bucket = i + 1;
+    }
+    data = NULL;
+
+done:
+    closedir( dir );
+    free_dir_data( data );
+    return cache;
+}
+
+
+/***********************************************************************
+ *           lookup_name_cache_dir
+ *
+ * Find a name in a cached directory, matching it the same way find_file_in_dir
+ * does. Returns the index of the first matching entry in readdir order, or -1.
+ */
+static int lookup_name_cache_dir( const struct name_cache_dir *cache, const WCHAR *name, int length,
+                                  BOOLEAN is_name_8_dot_3 )
+{
+    const struct dir_data_names *names = cache->data->names;
+    unsigned int key, idx, count = cache->data->count;
+    ULONG hash = hash_dir_name( name, length );
+    int ret = -1;
+
+    for (key = cache->buckets[hash & cache->hash_mask]; key; key = cache->next[key - 1])
+    {
+        if (cache->hashes[key - 1] != hash) continue;
+        if (key <= count)
+        {
+            idx = key - 1;
+            if (ret != -1 && idx >= (unsigned int)ret) continue;
+            if (wcslen( names[idx].long_name ) == length &&
+                !RtlCompareUnicodeStrings( names[idx].long_name, length, name, length, TRUE ))
+                ret = idx;
+        }
+        else if (is_name_8_dot_3)
+        {
+            idx = key - 1 - count;
+            if (ret != -1 && idx >= (unsigned int)ret) continue;
+            if (wcslen( names[idx].short_name ) == length && !wcsnicmp( names[idx].short_name, name, length ))
+                ret = idx;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           add_name_cache_dir
+ *
+ * Add a directory to the name cache, replacing any previous contents.
+ */
+static void add_name_cache_dir( struct name_cache_dir *cache )
+{
+    struct name_cache_dir *old;
+
+    RtlEnterCriticalSection( &name_cache_section );
+    LIST_FOR_EACH_ENTRY( old, &name_cache, struct name_cache_dir, entry )
+    {
+        if (old->data->id.dev != cache->data->id.dev || old->data->id.ino != cache->data->id.ino) continue;
+        list_remove( &old->entry );
+        free_name_cache_dir( old );
+        name_cache_count--;
+        break;
+    }
+    if (name_cache_count >= name_cache_max_dirs)
+    {
+        old = LIST_ENTRY( list_tail( &name_cache ), struct name_cache_dir, entry );
+        list_remove( &old->entry );
+        free_name_cache_dir( old );
+        name_cache_count--;
+    }
+    list_add_head( &name_cache, &cache->entry );
+    name_cache_count++;
+    RtlLeaveCriticalSection( &name_cache_section );
+}
+
+
+/***********************************************************************
+ *           cache_dir_names
+ *
+ * Read a large directory into the name cache, so that further lookups don't need to scan it.
+ */
+static void cache_dir_names( const char *dir_name )
+{
+    struct name_cache_dir *cache;
+
+    if (!(cache = read_name_cache_dir( dir_name ))) return;
+    if (cache->data->count >= name_cache_min_entries) add_name_cache_dir( cache );
+    else free_name_cache_dir( cache );
+}
+
+
+/***********************************************************************
+ *           find_file_in_name_cache
+ *
+ * Find a file in a directory using the name cache.
+ * unix_name contains the directory name, the file found is appended at pos.
+ * Returns 1 if found, 0 if not found, -1 if the directory is not cached.
+ */
+static int find_file_in_name_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                    BOOLEAN is_name_8_dot_3 )
+{
+    struct name_cache_dir *cache;
+    struct file_identity id;
+    struct stat st;
+    unsigned int gen = 0, new_gen;
+    ULONG fold = get_name_cache_fold();
+    BOOL cached = FALSE;
+    int fd, idx = -1;
+
+    if (stat( unix_name, &st ) == -1) return -1;
+    id.dev = st.st_dev;
+    id.ino = st.st_ino;
+
+    RtlEnterCriticalSection( &name_cache_section );
+    LIST_FOR_EACH_ENTRY( cache, &name_cache, struct name_cache_dir, entry )
+    {
+        if (cache->data->id.dev != id.dev || cache->data->id.ino != id.ino) continue;
+        list_remove( &cache->entry );
+        if (cache->fold != fold)
+        {
+            free_name_cache_dir( cache );
+            name_cache_count--;
+            break;
+        }
+        list_add_head( &name_cache, &cache->entry );
+        if ((idx = lookup_name_cache_dir( cache, name, length, is_name_8_dot_3 )) != -1)
+            strcpy( unix_name + pos, cache->data->names[idx].unix_name );
+        gen = cache->gen;
+        cached = TRUE;
+        break;
+    }
+    RtlLeaveCriticalSection( &name_cache_section );
+
+    if (!cached) return -1;
+
+    if (idx != -1)
+    {
+        /* make sure it hasn't been removed in the meantime */
+        unix_name[pos - 1] = '/';
+        if (!lstat( unix_name, &st )) return 1;
+        unix_name[pos - 1] = 0;
+    }
+
+    /* not found, check with the server whether the directory has changed */
+    if ((fd = open( unix_name, O_RDONLY | O_DIRECTORY )) == -1) return -1;
+    if (get_dir_names_generation( fd, &new_gen ))
+    {
+        close( fd );
+        return -1;
+    }
+    if (idx == -1 && new_gen == gen && !fstat( fd, &st ) && st.st_dev == id.dev && st.st_ino == id.ino)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    /* it has, read it again */
+    if (!(cache = read_name_cache_dir( unix_name ))) return -1;
+    if ((idx = lookup_name_cache_dir( cache, name, length, is_name_8_dot_3 )) != -1)
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, cache->data->names[idx].unix_name );
+    }
+    add_name_cache_dir( cache );
+    return idx != -1;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2000,6 +2664,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     DIR *dir;
     struct dirent *de;
     struct stat st;
+    unsigned int count = 0;
     int ret;
 
     /* try a shortcut for this directory */
@@ -2080,6 +2745,14 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+    /* large directories are cached to avoid scanning them on every lookup */
+
+    switch (find_file_in_name_cache( unix_name, pos, name, length, is_name_8_dot_3 ))
+    {
+    case 0: goto not_found;
+    case 1: goto success;
+    }
+
     if (!(dir = opendir( unix_name )))
     {
         if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
@@ -2090,6 +2763,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     str.MaximumLength = sizeof(buffer);
     while ((de = readdir( dir )))
     {
+        count++;
         ret = ntdll_umbstowcs( de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
         if (ret == length && !RtlCompareUnicodeStrings( buffer, ret, name, ret, TRUE ))
         {
@@ -2117,10 +2791,17 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
 not_found:
     unix_name[pos - 1] = 0;
+    if (count >= name_cache_min_entries) cache_dir_names( unix_name );
     return STATUS_OBJECT_PATH_NOT_FOUND;
 
 success:
     if (is_win_dir && !lstat( unix_name, &st )) *is_win_dir = is_same_file( &windir, &st );
+    if (count >= name_cache_min_entries)
+    {
+        unix_name[pos - 1] = 0;
+        cache_dir_names( unix_name );
+        unix_name[pos - 1] = '/';
+    }
     return STATUS_SUCCESS;
 }
 
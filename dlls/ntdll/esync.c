@@ -23,6 +23,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
@@ -36,6 +37,10 @@
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#include <time.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -51,13 +56,42 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(esync);
 
+#if defined(__linux__) && defined(HAVE_SYS_EVENTFD_H)
+# define USE_FSYNC
+# ifndef __NR_futex_waitv
+#  define __NR_futex_waitv 449
+# endif
+#endif
+
+/* With WINEFSYNC, the object state in the shared memory section is the only
+ * state there is, and we wait on it directly with futex_waitv(). This needs
+ * Linux 5.16; on older kernels we silently fall back to eventfds, exactly as
+ * the server does. */
+int do_fsync(void)
+{
+#ifdef USE_FSYNC
+    static int do_fsync_cached = -1;
+
+    if (do_fsync_cached == -1)
+    {
+        /* fails with EINVAL if the kernel supports futex_waitv() */
+        syscall( __NR_futex_waitv, NULL, 0, 0, NULL, 0 );
+        do_fsync_cached = getenv("WINEFSYNC") && atoi(getenv("WINEFSYNC")) && errno != ENOSYS;
+    }
+
+    return do_fsync_cached;
+#else
+    return 0;
+#endif
+}
+
 int do_esync(void)
 {
 #ifdef HAVE_SYS_EVENTFD_H
     static int do_esync_cached = -1;
 
     if (do_esync_cached == -1)
-        do_esync_cached = getenv("WINEESYNC") && atoi(getenv("WINEESYNC"));
+        do_esync_cached = (getenv("WINEESYNC") && atoi(getenv("WINEESYNC"))) || do_fsync();
 
     return do_esync_cached;
 #else
@@ -102,6 +136,38 @@ struct event
 };
 C_ASSERT(sizeof(struct event) == 8);
 
+/* same layout as struct futex_waitv in <linux/futex.h> */
+struct futex_wait_entry
+{
+    ULONGLONG val;
+    ULONGLONG uaddr;
+    UINT      flags;
+    UINT      reserved;
+};
+
+#define FUTEX_WAKE  1
+#define FUTEX_32    2   /* futex_waitv() flag for 32-bit futexes */
+
+/* The shm section is shared between processes, so none of these can be
+ * private futexes. */
+static inline void futex_wake( int *addr, int count )
+{
+#ifdef USE_FSYNC
+    syscall( __NR_futex, addr, FUTEX_WAKE, count, NULL, 0, 0 );
+#endif
+}
+
+static inline int futex_waitv( const struct futex_wait_entry *futexes, unsigned int count,
+                               const struct timespec *timeout )
+{
+#ifdef USE_FSYNC
+    return syscall( __NR_futex_waitv, futexes, count, 0, timeout, CLOCK_MONOTONIC );
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 static char shm_name[29];
 static int shm_fd;
 static void **shm_addrs;
@@ -110,6 +176,7 @@ static long pagesize;
 
 static NTSTATUS create_esync( enum esync_type type, HANDLE *handle,
     ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr, int initval, int max );
+static void *get_shm( unsigned int idx );
 
 void esync_init(void)
 {
@@ -153,6 +220,16 @@ void esync_init(void)
 
     shm_addrs = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, 128 * sizeof(shm_addrs[0]) );
     shm_addrs_size = 128;
+
+    /* the server stores whether it uses futexes in the reserved index 0 */
+    if (*(int *)get_shm( 0 ) != do_fsync())
+    {
+        if (do_fsync())
+            ERR("Server is running without WINEFSYNC but this process is using it, please disable WINEFSYNC or restart wineserver.\n");
+        else
+            ERR("Server is running with WINEFSYNC but this process is not, please enable WINEFSYNC or restart wineserver.\n");
+        exit(1);
+    }
 }
 
 static RTL_CRITICAL_SECTION shm_addrs_section;
@@ -290,8 +367,11 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
             {
                 type = reply->type;
                 shm_idx = reply->shm_idx;
-                fd = receive_fd( &fd_handle );
-                assert( wine_server_ptr_handle(fd_handle) == handle );
+                if (!do_fsync())
+                {
+                    fd = receive_fd( &fd_handle );
+                    assert( wine_server_ptr_handle(fd_handle) == handle );
+                }
             }
         }
         SERVER_END_REQ;
@@ -327,7 +407,8 @@ NTSTATUS esync_close( HANDLE handle )
     {
         if (InterlockedExchange((int *)&esync_list[entry][idx].type, 0))
         {
-            close( esync_list[entry][idx].fd );
+            if (esync_list[entry][idx].fd != -1)
+                close( esync_list[entry][idx].fd );
             return STATUS_SUCCESS;
         }
     }
@@ -344,7 +425,7 @@ static NTSTATUS create_esync( enum esync_type type, HANDLE *handle,
     obj_handle_t fd_handle;
     unsigned int shm_idx;
     sigset_t sigset;
-    int fd;
+    int fd = -1;
 
     if ((ret = alloc_object_attributes( attr, &objattr, &len ))) return ret;
 
@@ -364,8 +445,11 @@ static NTSTATUS create_esync( enum esync_type type, HANDLE *handle,
             *handle = wine_server_ptr_handle( reply->handle );
             type = reply->type;
             shm_idx = reply->shm_idx;
-            fd = receive_fd( &fd_handle );
-            assert( wine_server_ptr_handle(fd_handle) == *handle );
+            if (!do_fsync())
+            {
+                fd = receive_fd( &fd_handle );
+                assert( wine_server_ptr_handle(fd_handle) == *handle );
+            }
         }
     }
     SERVER_END_REQ;
@@ -389,7 +473,7 @@ static NTSTATUS open_esync( enum esync_type type, HANDLE *handle,
     obj_handle_t fd_handle;
     unsigned int shm_idx;
     sigset_t sigset;
-    int fd;
+    int fd = -1;
 
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
     SERVER_START_REQ( open_esync )
@@ -405,8 +489,11 @@ static NTSTATUS open_esync( enum esync_type type, HANDLE *handle,
             *handle = wine_server_ptr_handle( reply->handle );
             type = reply->type;
             shm_idx = reply->shm_idx;
-            fd = receive_fd( &fd_handle );
-            assert( wine_server_ptr_handle(fd_handle) == *handle );
+            if (!do_fsync())
+            {
+                fd = receive_fd( &fd_handle );
+                assert( wine_server_ptr_handle(fd_handle) == *handle );
+            }
         }
     }
     SERVER_END_REQ;
@@ -461,6 +548,14 @@ NTSTATUS esync_release_semaphore( HANDLE handle, ULONG count, ULONG *prev )
 
     if (prev) *prev = current;
 
+    if (do_fsync())
+    {
+        /* Wake everybody; a woken wait-all waiter may go back to sleep
+         * without taking the count, and must not swallow the wakeup. */
+        futex_wake( &semaphore->count, INT_MAX );
+        return STATUS_SUCCESS;
+    }
+
     /* We don't have to worry about a race between increasing the count and
      * write(). The fact that we were able to increase the count means that we
      * have permission to actually write that many releases to the semaphore. */
@@ -591,6 +686,15 @@ NTSTATUS esync_set_event( HANDLE handle, LONG *prev )
     if ((ret = get_object( handle, &obj ))) return ret;
     event = obj->shm;
 
+    if (do_fsync())
+    {
+        /* The futex is the only state, so there is nothing to lock. */
+        if (!(current = InterlockedExchange( &event->signaled, 1 )))
+            futex_wake( &event->signaled, INT_MAX );
+        if (prev) *prev = current;
+        return STATUS_SUCCESS;
+    }
+
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
@@ -638,6 +742,13 @@ NTSTATUS esync_reset_event( HANDLE handle, LONG *prev )
     if ((ret = get_object( handle, &obj ))) return ret;
     event = obj->shm;
 
+    if (do_fsync())
+    {
+        current = InterlockedExchange( &event->signaled, 0 );
+        if (prev) *prev = current;
+        return STATUS_SUCCESS;
+    }
+
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
@@ -683,6 +794,17 @@ NTSTATUS esync_pulse_event( HANDLE handle, LONG *prev )
     if ((ret = get_object( handle, &obj ))) return ret;
     event = obj->shm;
 
+    if (do_fsync())
+    {
+        /* Same caveats as below. */
+        if (!InterlockedExchange( &event->signaled, 1 ))
+            futex_wake( &event->signaled, INT_MAX );
+        NtYieldExecution();
+        current = InterlockedExchange( &event->signaled, 0 );
+        if (prev) *prev = current;
+        return STATUS_SUCCESS;
+    }
+
     /* Acquire the spinlock. */
     while (InterlockedCompareExchange( &event->locked, 1, 0 ))
         small_pause();
@@ -726,9 +848,17 @@ NTSTATUS esync_query_event( HANDLE handle, EVENT_INFORMATION_CLASS class,
 
     if ((ret = get_object( handle, &obj ))) return ret;
 
-    fd.fd = obj->fd;
-    fd.events = POLLIN;
-    out->EventState = poll( &fd, 1, 0 );
+    if (do_fsync())
+    {
+        struct event *event = obj->shm;
+        out->EventState = event->signaled;
+    }
+    else
+    {
+        fd.fd = obj->fd;
+        fd.events = POLLIN;
+        out->EventState = poll( &fd, 1, 0 );
+    }
     out->EventType = (obj->type == ESYNC_AUTO_EVENT ? SynchronizationEvent : NotificationEvent);
     if (ret_len) *ret_len = sizeof(*out);
 
@@ -779,7 +909,9 @@ NTSTATUS esync_release_mutex( HANDLE *handle, LONG *prev )
          * theirs. */
         mutex->tid = 0;
 
-        if (write( obj->fd, &value, sizeof(value) ) == -1)
+        if (do_fsync())
+            futex_wake( (int *)&mutex->tid, INT_MAX );
+        else if (write( obj->fd, &value, sizeof(value) ) == -1)
             return FILE_GetNtStatus();
     }
 
@@ -894,6 +1026,284 @@ static BOOL update_grabbed_object( struct esync *obj )
     return ret;
 }
 
+static inline void set_futex_wait( struct futex_wait_entry *futex, void *addr, int val )
+{
+    futex->val = val;
+    futex->uaddr = (ULONG_PTR)addr;
+    futex->flags = FUTEX_32;
+    futex->reserved = 0;
+}
+
+/* Check whether an object is signaled without acquiring it. If it isn't, fill
+ * in the futex to wait on. */
+static BOOL fsync_is_signaled( struct esync *obj, struct futex_wait_entry *futex )
+{
+    switch (obj->type)
+    {
+    case ESYNC_SEMAPHORE:
+    {
+        struct semaphore *semaphore = obj->shm;
+        int current = *(volatile int *)&semaphore->count;
+
+        if (current) return TRUE;
+        set_futex_wait( futex, &semaphore->count, current );
+        return FALSE;
+    }
+    case ESYNC_MUTEX:
+    {
+        struct mutex *mutex = obj->shm;
+        DWORD tid = *(volatile DWORD *)&mutex->tid;
+
+        if (!tid || tid == ~0 || tid == GetCurrentThreadId()) return TRUE;
+        set_futex_wait( futex, &mutex->tid, tid );
+        return FALSE;
+    }
+    default:
+    {
+        struct event *event = obj->shm;
+        int current = *(volatile int *)&event->signaled;
+
+        if (current) return TRUE;
+        set_futex_wait( futex, &event->signaled, current );
+        return FALSE;
+    }
+    }
+}
+
+/* Try to acquire an object. If it isn't signaled, fill in the futex to wait
+ * on and return FALSE. */
+static BOOL fsync_try_grab( struct esync *obj, struct futex_wait_entry *futex, BOOL *abandoned )
+{
+    switch (obj->type)
+    {
+    case ESYNC_SEMAPHORE:
+    {
+        struct semaphore *semaphore = obj->shm;
+        int current;
+
+        while ((current = *(volatile int *)&semaphore->count))
+        {
+            if (InterlockedCompareExchange( &semaphore->count, current - 1, current ) == current)
+                return TRUE;
+        }
+        set_futex_wait( futex, &semaphore->count, 0 );
+        return FALSE;
+    }
+    case ESYNC_MUTEX:
+    {
+        struct mutex *mutex = obj->shm;
+        DWORD tid = GetCurrentThreadId(), current;
+
+        if (mutex->tid == tid)
+        {
+            mutex->count++;
+            return TRUE;
+        }
+        while (!(current = *(volatile DWORD *)&mutex->tid) || current == ~0)
+        {
+            if (InterlockedCompareExchange( (int *)&mutex->tid, tid, current ) == current)
+            {
+                /* the server resets the count when abandoning the mutex */
+                if (current == ~0) *abandoned = TRUE;
+                mutex->count++;
+                return TRUE;
+            }
+        }
+        set_futex_wait( futex, &mutex->tid, current );
+        return FALSE;
+    }
+    case ESYNC_MANUAL_EVENT:
+    case ESYNC_MANUAL_SERVER:
+    {
+        struct event *event = obj->shm;
+
+        if (*(volatile int *)&event->signaled) return TRUE;
+        set_futex_wait( futex, &event->signaled, 0 );
+        return FALSE;
+    }
+    default:
+    {
+        struct event *event = obj->shm;
+
+        if (InterlockedCompareExchange( &event->signaled, 0, 1 ) == 1) return TRUE;
+        set_futex_wait( futex, &event->signaled, 0 );
+        return FALSE;
+    }
+    }
+}
+
+/* Undo fsync_try_grab() when a wait-all fails part way through. */
+static void fsync_put_back( struct esync *obj, BOOL abandoned )
+{
+    switch (obj->type)
+    {
+    case ESYNC_SEMAPHORE:
+    {
+        struct semaphore *semaphore = obj->shm;
+        InterlockedIncrement( &semaphore->count );
+        futex_wake( &semaphore->count, INT_MAX );
+        break;
+    }
+    case ESYNC_MUTEX:
+    {
+        struct mutex *mutex = obj->shm;
+        if (!--mutex->count)
+        {
+            mutex->tid = abandoned ? ~0 : 0;
+            futex_wake( (int *)&mutex->tid, INT_MAX );
+        }
+        break;
+    }
+    case ESYNC_MANUAL_EVENT:
+    case ESYNC_MANUAL_SERVER:
+        break;
+    default:
+    {
+        struct event *event = obj->shm;
+        event->signaled = 1;
+        futex_wake( &event->signaled, INT_MAX );
+        break;
+    }
+    }
+}
+
+/* Sleep until one of the futexes changes, the timeout expires, or we are
+ * interrupted. Returns STATUS_PENDING if the caller should check its objects
+ * again. */
+static NTSTATUS fsync_wait( const struct futex_wait_entry *futexes, unsigned int count,
+                            const ULONGLONG *end )
+{
+    struct timespec ts;
+    int ret;
+
+    if (end)
+    {
+        LONGLONG timeleft = update_timeout( *end );
+
+        if (!timeleft) return STATUS_TIMEOUT;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        ts.tv_sec += timeleft / TICKSPERSEC;
+        ts.tv_nsec += (timeleft % TICKSPERSEC) * 100;
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+    }
+
+    ret = futex_waitv( futexes, count, end ? &ts : NULL );
+    if (ret == -1)
+    {
+        /* EAGAIN means a value changed before we went to sleep; EINTR is
+         * probably a suspend (SIGUSR1) or a system APC. */
+        if (errno == ETIMEDOUT) return STATUS_TIMEOUT;
+        if (errno != EAGAIN && errno != EINTR)
+        {
+            ERR("futex_waitv failed: %s\n", strerror(errno));
+            return FILE_GetNtStatus();
+        }
+    }
+    return STATUS_PENDING;
+}
+
+/* Returns TRUE if the USER driver has pending events for a message wait. */
+static BOOL driver_events_pending(void)
+{
+    struct pollfd fd;
+
+    if ((fd.fd = ntdll_get_thread_data()->esync_queue_fd) == -1) return FALSE;
+    fd.events = POLLIN;
+    return poll( &fd, 1, 0 ) > 0;
+}
+
+/* The futex_waitv() counterpart of the poll() loops below. Everything we can
+ * wait on has a futex in the shm section: for esync objects it is the object
+ * state itself, for server objects and the APC fd it is an event-like flag
+ * which the server sets and clears instead of writing to the eventfd.
+ *
+ * Driver events can't be waited on with a futex. Instead the server polls the
+ * driver fd while we are in a message wait and signals the queue, so we only
+ * have to catch the events which were already pending before we started. */
+static NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, struct esync **objs,
+    BOOLEAN wait_any, BOOLEAN alertable, BOOL msgwait, const ULONGLONG *end )
+{
+    struct futex_wait_entry futexes[MAXIMUM_WAIT_OBJECTS + 1];
+    struct event *apc_event = ntdll_get_thread_data()->esync_apc_shm;
+    BOOL abandoned[MAXIMUM_WAIT_OBJECTS];
+    unsigned int nr_futexes;
+    NTSTATUS ret;
+    int i, j;
+
+    for (;;)
+    {
+        nr_futexes = 0;
+        memset( abandoned, 0, count * sizeof(abandoned[0]) );
+
+        if (wait_any || count == 1)
+        {
+            for (i = 0; i < count; i++)
+            {
+                if (!objs[i]) continue;
+                if (fsync_try_grab( objs[i], &futexes[nr_futexes], &abandoned[i] ))
+                {
+                    TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                    return abandoned[i] ? STATUS_ABANDONED_WAIT_0 + i : i;
+                }
+                nr_futexes++;
+            }
+        }
+        else
+        {
+            for (i = 0; i < count; i++)
+            {
+                if (objs[i] && !fsync_is_signaled( objs[i], &futexes[nr_futexes] ))
+                    nr_futexes++;
+            }
+
+            if (!nr_futexes)
+            {
+                BOOL any_abandoned = FALSE;
+
+                /* Everything looks signaled, so try to grab it all. If someone
+                 * beats us to an object, put back what we took and wait for
+                 * that object before starting over. */
+                for (i = 0; i < count; i++)
+                {
+                    if (objs[i] && !fsync_try_grab( objs[i], &futexes[0], &abandoned[i] ))
+                        break;
+                    any_abandoned |= abandoned[i];
+                }
+                if (i == count)
+                {
+                    TRACE("Wait successful%s.\n", any_abandoned ? ", but some object(s) were abandoned" : "");
+                    return any_abandoned ? STATUS_ABANDONED : STATUS_SUCCESS;
+                }
+                for (j = 0; j < i; j++)
+                    if (objs[j]) fsync_put_back( objs[j], abandoned[j] );
+                nr_futexes = 1;
+            }
+        }
+
+        if (msgwait && driver_events_pending())
+        {
+            TRACE("Woken up by driver events.\n");
+            return count - 1;
+        }
+
+        if (alertable)
+        {
+            if (*(volatile int *)&apc_event->signaled) return STATUS_USER_APC;
+            set_futex_wait( &futexes[nr_futexes++], &apc_event->signaled, 0 );
+        }
+
+        if ((ret = fsync_wait( futexes, nr_futexes, end )) != STATUS_PENDING)
+        {
+            if (ret == STATUS_TIMEOUT) TRACE("Wait timed out.\n");
+            return ret;
+        }
+    }
+}
+
 /* A value of STATUS_NOT_IMPLEMENTED returned from this function means that we
  * need to delegate to server_select(). */
 static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles,
@@ -914,8 +1324,24 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles,
     int i, j;
     int ret;
 
+    /* With futexes we only need the shm index of the APC fd. */
+    if (do_fsync() && alertable && !ntdll_get_thread_data()->esync_apc_shm)
+    {
+        unsigned int shm_idx = 0;
+
+        SERVER_START_REQ( get_esync_apc_fd )
+        {
+            if (!(ret = wine_server_call( req )))
+                shm_idx = reply->shm_idx;
+        }
+        SERVER_END_REQ;
+        if (ret) return ret;
+
+        ntdll_get_thread_data()->esync_apc_shm = get_shm( shm_idx );
+    }
+
     /* Grab the APC fd if we don't already have it. */
-    if (alertable && ntdll_get_thread_data()->esync_apc_fd == -1)
+    if (!do_fsync() && alertable && ntdll_get_thread_data()->esync_apc_fd == -1)
     {
         obj_handle_t fd_handle;
         sigset_t sigset;
@@ -1000,6 +1426,14 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles,
         }
     }
 
+    if (do_fsync())
+    {
+        ret = fsync_wait_objects( count, handles, objs, wait_any, alertable, msgwait,
+                                  timeout ? &end : NULL );
+        if (ret == STATUS_USER_APC) goto userapc;
+        return ret;
+    }
+
     if (wait_any || count == 1)
     {
         /* Try to check objects now, so we can obviate poll() at least. */
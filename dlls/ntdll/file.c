@@ -43,6 +43,12 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -101,6 +107,7 @@
 #define WIN32_NO_STATUS
 #define NONAMELESSUNION
 #include "wine/debug.h"
+#include "wine/list.h"
 #include "wine/server.h"
 #include "ntdll_misc.h"
 
@@ -211,12 +218,30 @@ NTSTATUS fd_set_file_info( int fd, ULONG attr )
     return STATUS_SUCCESS;
 }
 
+/* get the file attributes for a file (by name), including any stored DOS attributes */
+ULONG get_file_attributes_by_name( const char *path, const struct stat *st )
+{
+    char hexattr[11];
+    ULONG attr = get_file_attributes( st );
+    int len;
+
+    /* retrieve any stored DOS attributes */
+    len = xattr_get( path, SAMBA_XATTR_DOS_ATTRIB, hexattr, sizeof(hexattr)-1 );
+    if (len == -1)
+    {
+        /* convert Unix-style hidden files to a DOS hidden file attribute */
+        if (DIR_is_hidden_file( path ))
+            attr |= FILE_ATTRIBUTE_HIDDEN;
+        return attr;
+    }
+    return attr | get_file_xattr( hexattr, len );
+}
+
 /* get the stat info and file attributes for a file (by name) */
 int get_file_info( const char *path, struct stat *st, ULONG *attr )
 {
     char *parent_path;
-    char hexattr[11];
-    int len, ret;
+    int ret;
 
     *attr = 0;
     ret = lstat( path, st );
@@ -248,17 +273,7 @@ int get_file_info( const char *path, struct stat *st, ULONG *attr )
 
         RtlFreeHeap( GetProcessHeap(), 0, parent_path );
     }
-    *attr |= get_file_attributes( st );
-    /* retrieve any stored DOS attributes */
-    len = xattr_get( path, SAMBA_XATTR_DOS_ATTRIB, hexattr, sizeof(hexattr)-1 );
-    if (len == -1)
-    {
-        /* convert Unix-style hidden files to a DOS hidden file attribute */
-        if (DIR_is_hidden_file( path ))
-            *attr |= FILE_ATTRIBUTE_HIDDEN;
-        return ret;
-    }
-    *attr |= get_file_xattr( hexattr, len );
+    *attr |= get_file_attributes_by_name( path, st );
     return ret;
 }
 
@@ -636,6 +651,421 @@ NTSTATUS FILE_GetNtStatus(void)
     }
 }
 
+/* io_uring support for asynchronous I/O on regular files
+ *
+ * Overlapped reads and writes on regular files are otherwise done
+ * synchronously, since the fd is always ready. With WINEIOURING=1 they
+ * are queued to an io_uring instead, and a dedicated thread completes
+ * them. Requests are only queued when the caller waits on an event or an
+ * APC, since waiting on the file handle itself requires the server to
+ * know about the async I/O. For the same reason they are cancelled
+ * separately from the server asyncs. */
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+/* same layout as struct io_uring_sqe in <linux/io_uring.h> */
+struct uring_sqe
+{
+    unsigned char  opcode;
+    unsigned char  flags;
+    unsigned short ioprio;
+    int            fd;
+    ULONGLONG      off;
+    ULONGLONG      addr;
+    unsigned int   len;
+    unsigned int   rw_flags;
+    ULONGLONG      user_data;
+    ULONGLONG      pad[3];
+};
+
+/* same layout as struct io_uring_cqe */
+struct uring_cqe
+{
+    ULONGLONG      user_data;
+    int            res;
+    unsigned int   flags;
+};
+
+/* same layout as struct io_uring_params */
+struct uring_params
+{
+    unsigned int   sq_entries;
+    unsigned int   cq_entries;
+    unsigned int   flags;
+    unsigned int   sq_thread_cpu;
+    unsigned int   sq_thread_idle;
+    unsigned int   features;
+    unsigned int   wq_fd;
+    unsigned int   resv[3];
+    struct
+    {
+        unsigned int head, tail, ring_mask, ring_entries, flags, dropped, array, resv1;
+        ULONGLONG    resv2;
+    } sq_off;
+    struct
+    {
+        unsigned int head, tail, ring_mask, ring_entries, overflow, cqes, flags, resv1;
+        ULONGLONG    resv2;
+    } cq_off;
+};
+
+#define URING_OP_READV          1
+#define URING_OP_WRITEV         2
+#define URING_OP_ASYNC_CANCEL   14
+#define URING_OFF_SQ_RING       0
+#define URING_OFF_CQ_RING       0x8000000
+#define URING_OFF_SQES          0x10000000
+#define URING_FEAT_SINGLE_MMAP  (1 << 0)
+#define URING_ENTER_GETEVENTS   (1 << 0)
+
+struct uring_io
+{
+    struct list      entry;     /* entry in the list of queued requests */
+    DWORD            tid;       /* thread that queued the request */
+    BOOL             cancelled; /* whether a cancel request was already queued */
+    HANDLE           handle;    /* file handle, for completion ports and cancellation */
+    HANDLE           event;     /* event to signal on completion */
+    HANDLE           thread;    /* thread to queue the APC to */
+    PIO_APC_ROUTINE  apc;
+    void            *apc_user;
+    ULONG_PTR        cvalue;    /* completion port value */
+    IO_STATUS_BLOCK *iosb;
+    int              fd;        /* our own reference to the Unix fd */
+    BOOL             write;
+    ULONGLONG        offset;
+    struct iovec     iov;
+};
+
+static struct
+{
+    int               fd;
+    unsigned int     *sq_tail;
+    unsigned int      sq_mask;
+    unsigned int     *sq_array;
+    struct uring_sqe *sqes;
+    unsigned int     *cq_head;
+    unsigned int     *cq_tail;
+    unsigned int      cq_mask;
+    struct uring_cqe *cqes;
+    LONG              inflight;
+    LONG              max_inflight;
+} uring = { -1 };
+
+static struct list uring_ios = LIST_INIT( uring_ios );
+
+static const unsigned int uring_entries = 256;
+
+static RTL_RUN_ONCE uring_once = RTL_RUN_ONCE_INIT;
+
+static RTL_CRITICAL_SECTION uring_section;
+static RTL_CRITICAL_SECTION_DEBUG uring_critsect_debug =
+{
+    0, 0, &uring_section,
+    { &uring_critsect_debug.ProcessLocksList, &uring_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": uring_section") }
+};
+static RTL_CRITICAL_SECTION uring_section = { &uring_critsect_debug, -1, 0, 0, 0, 0 };
+
+/* finish an io_uring request and notify the waiters */
+static void complete_uring_io( struct uring_io *io, int res )
+{
+    char *buffer = io->iov.iov_base;
+    ULONG length = io->iov.iov_len, total = 0;
+    NTSTATUS status;
+    ssize_t ret;
+
+    RtlEnterCriticalSection( &uring_section );
+    list_remove( &io->entry );
+    RtlLeaveCriticalSection( &uring_section );
+
+    if (res >= 0) total = res;
+
+    /* finish short transfers and faults on protected pages the usual way */
+    if (res == -EFAULT || (res >= 0 && total < length))
+    {
+        res = 0;
+        while (total < length)
+        {
+            if (io->write) ret = pwrite( io->fd, buffer + total, length - total, io->offset + total );
+            else ret = virtual_locked_pread( io->fd, buffer + total, length - total, io->offset + total );
+            if (ret > 0) total += ret;
+            else if (!ret) break;
+            else if (errno != EINTR)
+            {
+                res = -errno;
+                break;
+            }
+        }
+    }
+
+    if (res == -ECANCELED) status = STATUS_CANCELLED;
+    else if (res < 0 && !total)
+    {
+        errno = -res;
+        if (io->write && errno == EFAULT) status = STATUS_INVALID_USER_BUFFER;
+        else status = FILE_GetNtStatus();
+    }
+    else if (!io->write && !total && length) status = STATUS_END_OF_FILE;
+    else status = STATUS_SUCCESS;
+
+    close( io->fd );
+    io->iosb->Information = total;
+    InterlockedExchange( (LONG *)&io->iosb->u.Status, status );
+
+    if (io->event) NtSetEvent( io->event, NULL );
+    if (io->apc)
+    {
+        NtQueueApcThread( io->thread, (PNTAPCFUNC)io->apc, (ULONG_PTR)io->apc_user, (ULONG_PTR)io->iosb, 0 );
+        NtClose( io->thread );
+    }
+    if (io->cvalue) NTDLL_AddCompletion( io->handle, io->cvalue, status, total, TRUE );
+
+    InterlockedDecrement( &uring.inflight );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+}
+
+/* thread reaping the io_uring completions */
+static void WINAPI uring_completion_thread( void *arg )
+{
+    struct uring_cqe *cqe;
+    struct uring_io *io;
+    unsigned int head, tail;
+    int res;
+
+    for (;;)
+    {
+        head = *uring.cq_head;
+        tail = __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE );
+        if (head == tail)
+        {
+            syscall( __NR_io_uring_enter, uring.fd, 0, 1, URING_ENTER_GETEVENTS, NULL, 0 );
+            continue;
+        }
+        while (head != tail)
+        {
+            cqe = &uring.cqes[head & uring.cq_mask];
+            io = (struct uring_io *)(ULONG_PTR)cqe->user_data;
+            res = cqe->res;
+            __atomic_store_n( uring.cq_head, ++head, __ATOMIC_RELEASE );
+            if (io) complete_uring_io( io, res );
+            else InterlockedDecrement( &uring.inflight );  /* cancel request */
+        }
+    }
+}
+
+static DWORD WINAPI init_uring( RTL_RUN_ONCE *once, void *param, void **context )
+{
+    static const WCHAR WINEIOURINGW[] = {'W','I','N','E','I','O','U','R','I','N','G',0};
+    UNICODE_STRING name, value;
+    WCHAR buffer[16];
+    struct uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ring, *cq_ring;
+    HANDLE thread;
+    void *sqes;
+    int fd;
+
+    /* use the process environment, so that it can be set for child processes */
+    RtlInitUnicodeString( &name, WINEIOURINGW );
+    value.Buffer = buffer;
+    value.MaximumLength = sizeof(buffer) - sizeof(WCHAR);
+    if (RtlQueryEnvironmentVariable_U( NULL, &name, &value )) return TRUE;
+    buffer[value.Length / sizeof(WCHAR)] = 0;
+    if (!wcstoul( buffer, NULL, 10 )) return TRUE;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, uring_entries, &params )) == -1)
+    {
+        WARN( "io_uring not supported, errno %d\n", errno );
+        return TRUE;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct uring_cqe);
+    if (params.features & URING_FEAT_SINGLE_MMAP) sq_size = cq_size = max( sq_size, cq_size );
+
+    sq_ring = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, URING_OFF_SQ_RING );
+    if (sq_ring == MAP_FAILED) goto failed;
+    if (params.features & URING_FEAT_SINGLE_MMAP) cq_ring = sq_ring;
+    else if ((cq_ring = mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, URING_OFF_CQ_RING )) == MAP_FAILED)
+        goto failed;
+    sqes = mmap( NULL, params.sq_entries * sizeof(struct uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, URING_OFF_SQES );
+    if (sqes == MAP_FAILED) goto failed;
+
+    uring.sq_tail      = (unsigned int *)(sq_ring + params.sq_off.tail);
+    uring.sq_mask      = *(unsigned int *)(sq_ring + params.sq_off.ring_mask);
+    uring.sq_array     = (unsigned int *)(sq_ring + params.sq_off.array);
+    uring.sqes         = sqes;
+    uring.cq_head      = (unsigned int *)(cq_ring + params.cq_off.head);
+    uring.cq_tail      = (unsigned int *)(cq_ring + params.cq_off.tail);
+    uring.cq_mask      = *(unsigned int *)(cq_ring + params.cq_off.ring_mask);
+    uring.cqes         = (struct uring_cqe *)(cq_ring + params.cq_off.cqes);
+    uring.max_inflight = params.cq_entries;
+    uring.fd           = fd;
+
+    if (RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                             uring_completion_thread, NULL, &thread, NULL ))
+    {
+        uring.fd = -1;
+        goto failed;
+    }
+    NtClose( thread );
+    TRACE( "using io_uring with %u entries\n", params.sq_entries );
+    return TRUE;
+
+failed:
+    /* the mappings are kept around, they're not worth the trouble */
+    WARN( "failed to set up io_uring\n" );
+    close( fd );
+    return TRUE;
+}
+
+/* queue a single request and submit it; must be called with uring_section held */
+static int submit_uring_sqe( unsigned char opcode, int fd, ULONGLONG off, ULONGLONG addr,
+                             unsigned int len, ULONGLONG user_data )
+{
+    unsigned int tail = *uring.sq_tail;
+    struct uring_sqe *sqe = &uring.sqes[tail & uring.sq_mask];
+    int ret;
+
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->off       = off;
+    sqe->addr      = addr;
+    sqe->len       = len;
+    sqe->user_data = user_data;
+    uring.sq_array[tail & uring.sq_mask] = tail & uring.sq_mask;
+    __atomic_store_n( uring.sq_tail, tail + 1, __ATOMIC_RELEASE );
+    while ((ret = syscall( __NR_io_uring_enter, uring.fd, 1, 0, 0, NULL, 0 )) == -1 &&
+           (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        ;
+    if (ret == -1)
+    {
+        /* the entry wasn't consumed, take it back */
+        WARN( "io_uring submission failed, errno %d\n", errno );
+        __atomic_store_n( uring.sq_tail, tail, __ATOMIC_RELEASE );
+        return -1;
+    }
+    return 0;
+}
+
+/***********************************************************************
+ *           uring_file_io
+ *
+ * Queue an asynchronous read or write on a regular file to the io_uring.
+ * Returns STATUS_NOT_SUPPORTED if the I/O should be done synchronously.
+ */
+static NTSTATUS uring_file_io( HANDLE handle, int unix_fd, HANDLE event, PIO_APC_ROUTINE apc,
+                               void *apc_user, ULONG_PTR cvalue, IO_STATUS_BLOCK *iosb,
+                               const void *buffer, ULONG length, ULONGLONG offset, BOOL write )
+{
+    struct uring_io *io;
+    int ret;
+
+    if (!event && !apc) return STATUS_NOT_SUPPORTED;
+
+    RtlRunOnceExecuteOnce( &uring_once, init_uring, NULL, NULL );
+    if (uring.fd == -1) return STATUS_NOT_SUPPORTED;
+
+    if (InterlockedIncrement( &uring.inflight ) > uring.max_inflight) goto failed;
+    if (!(io = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*io) ))) goto failed;
+    if ((io->fd = dup( unix_fd )) == -1)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        goto failed;
+    }
+    io->thread = 0;
+    if (apc && NtDuplicateObject( NtCurrentProcess(), GetCurrentThread(), NtCurrentProcess(),
+                                  &io->thread, 0, 0, DUPLICATE_SAME_ACCESS ))
+    {
+        close( io->fd );
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        goto failed;
+    }
+    io->tid          = GetCurrentThreadId();
+    io->cancelled    = FALSE;
+    io->handle       = handle;
+    io->event        = event;
+    io->apc          = apc;
+    io->apc_user     = apc_user;
+    io->cvalue       = cvalue;
+    io->iosb         = iosb;
+    io->write        = write;
+    io->offset       = offset;
+    io->iov.iov_base = (void *)buffer;
+    io->iov.iov_len  = length;
+
+    iosb->u.Status = STATUS_PENDING;
+    if (event) NtResetEvent( event, NULL );
+
+    RtlEnterCriticalSection( &uring_section );
+    list_add_tail( &uring_ios, &io->entry );
+    ret = submit_uring_sqe( write ? URING_OP_WRITEV : URING_OP_READV, io->fd, offset,
+                            (ULONG_PTR)&io->iov, 1, (ULONG_PTR)io );
+    if (ret) list_remove( &io->entry );
+    RtlLeaveCriticalSection( &uring_section );
+
+    if (!ret) return STATUS_PENDING;
+
+    /* fall back to synchronous I/O */
+    if (io->thread) NtClose( io->thread );
+    close( io->fd );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+
+failed:
+    InterlockedDecrement( &uring.inflight );
+    return STATUS_NOT_SUPPORTED;
+}
+
+/***********************************************************************
+ *           uring_cancel_io
+ *
+ * Queue cancel requests for the io_uring requests on a file.
+ * The cancelled requests complete with STATUS_CANCELLED, unless they were
+ * already being processed. Returns TRUE if any request was found.
+ */
+static BOOL uring_cancel_io( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    struct uring_io *io;
+    BOOL found = FALSE;
+
+    if (uring.fd == -1) return FALSE;
+
+    RtlEnterCriticalSection( &uring_section );
+    LIST_FOR_EACH_ENTRY( io, &uring_ios, struct uring_io, entry )
+    {
+        if (io->handle != handle) continue;
+        if (iosb && io->iosb != iosb) continue;
+        if (only_thread && io->tid != GetCurrentThreadId()) continue;
+        found = TRUE;
+        if (io->cancelled) continue;
+        InterlockedIncrement( &uring.inflight );
+        if (!submit_uring_sqe( URING_OP_ASYNC_CANCEL, -1, 0, (ULONG_PTR)io, 0, 0 )) io->cancelled = TRUE;
+        else InterlockedDecrement( &uring.inflight );
+    }
+    RtlLeaveCriticalSection( &uring_section );
+    return found;
+}
+
+#else  /* __linux__ && __NR_io_uring_setup && __NR_io_uring_enter */
+
+static NTSTATUS uring_file_io( HANDLE handle, int unix_fd, HANDLE event, PIO_APC_ROUTINE apc,
+                               void *apc_user, ULONG_PTR cvalue, IO_STATUS_BLOCK *iosb,
+                               const void *buffer, ULONG length, ULONGLONG offset, BOOL write )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static BOOL uring_cancel_io( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    return FALSE;
+}
+
+#endif  /* __linux__ && __NR_io_uring_setup && __NR_io_uring_enter */
+
 /***********************************************************************
  *             FILE_AsyncReadService      (INTERNAL)
  */
@@ -989,6 +1419,11 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            if (async_read && (status = uring_file_io( hFile, unix_handle, hEvent, apc, apc_user, cvalue,
+                                                       io_status, buffer, length, offset->QuadPart,
+                                                       FALSE )) != STATUS_NOT_SUPPORTED)
+                goto err;
+
             /* async I/O doesn't make sense on regular files */
             while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
@@ -1393,6 +1828,10 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write && (status = uring_file_io( hFile, unix_handle, hEvent, apc, apc_user, cvalue,
+                                                             io_status, buffer, length, off,
+                                                             TRUE )) != STATUS_NOT_SUPPORTED)
+                goto err;
 
             /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
@@ -4486,6 +4925,8 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
     }
     SERVER_END_REQ;
 
+    if (uring_cancel_io( hFile, iosb, FALSE ) && io_status->u.Status == STATUS_NOT_FOUND)
+        io_status->u.Status = STATUS_SUCCESS;
     return io_status->u.Status;
 }
 
@@ -4507,6 +4948,8 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
     }
     SERVER_END_REQ;
 
+    if (uring_cancel_io( hFile, NULL, TRUE ) && io_status->u.Status == STATUS_NOT_FOUND)
+        io_status->u.Status = STATUS_SUCCESS;
     return io_status->u.Status;
 }
 
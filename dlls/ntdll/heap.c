@@ -93,6 +93,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c
+#define ARENA_LFH_FREE_MAGIC   0x464c46
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -130,7 +132,17 @@ C_ASSERT( sizeof(ARENA_LARGE) % LARGE_ALIGNMENT == 0 );
 /* number of free lists */
 #define HEAP_NB_FREE_LISTS  128
 
+/* low fragmentation heap front end, see lfh_allocate */
+#define LFH_MAX_SIZE           2048  /* largest allocation served by the LFH */
+#define LFH_NB_BINS            36    /* number of LFH size classes */
+#define LFH_MAX_SLOTS          8     /* maximum number of affinity slots per size class */
+#define LFH_ACTIVATION_COUNT   17    /* allocations of a size class before it moves to the LFH */
+#define LFH_GROUP_SIZE         0x2000  /* preferred size of a group of LFH blocks */
+#define LFH_MIN_GROUP_BLOCKS   8     /* minimum number of blocks in a group */
+#define LFH_PAGE_MASK          0xfff /* LFH blocks never start on a page boundary */
+
 struct tagHEAP;
+struct lfh_heap;
 
 typedef struct tagSUBHEAP
 {
@@ -170,6 +182,8 @@ typedef struct tagHEAP
     struct list     *freeList;      /* Free lists */
     struct wine_rb_tree freeTree;   /* Free tree */
     unsigned long    freeMask[HEAP_NB_FREE_LISTS / (8 * sizeof(unsigned long))];
+    struct lfh_heap *lfh;           /* Low fragmentation heap front end */
+    BYTE             lfh_counts[LFH_NB_BINS]; /* Allocations per LFH size class until activation */
 } HEAP;
 
 #define HEAP_FREEMASK_BLOCK    (8 * sizeof(unsigned long))
@@ -179,6 +193,7 @@ typedef struct tagHEAP
 C_ASSERT( HEAP_NB_FREE_LISTS % HEAP_FREEMASK_BLOCK == 0 );
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
+#define LFH_GROUP_MAGIC  ((DWORD)('L' | ('F'<<8) | ('H'<<16) | ('G'<<24)))
 
 #define HEAP_DEF_SIZE        0x110000   /* Default heap size = 1Mb + 64Kb */
 #define COMMIT_MASK          0xffff  /* bitmask for commit/decommit granularity */
@@ -193,6 +208,7 @@ C_ASSERT( HEAP_NB_FREE_LISTS % HEAP_FREEMASK_BLOCK == 0 );
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
+static struct lfh_group *lfh_get_group( const HEAP *heap, const void *ptr );
 
 /* get arena size for an rb tree entry */
 static inline DWORD get_arena_size( const struct wine_rb_entry *entry )
@@ -642,13 +658,15 @@ static inline BOOL HEAP_Decommit( SUBHEAP *subheap, void *ptr )
     decommit_size = subheap->commitSize - size;
     addr = (char *)subheap->base + size;
 
+    /* shrink it first, lfh_get_group checks it without the heap lock */
+    subheap->commitSize = size;
     if (NtFreeVirtualMemory( NtCurrentProcess(), &addr, &decommit_size, MEM_DECOMMIT ))
     {
         WARN("Could not decommit %08lx bytes at %p for heap %p\n",
              decommit_size, (char *)subheap->base + size, subheap->heap );
+        subheap->commitSize = size + decommit_size;
         return FALSE;
     }
-    subheap->commitSize -= decommit_size;
     return TRUE;
 }
 
@@ -754,7 +772,7 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
     /* Free the whole sub-heap if it's empty and not the original one */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) && !subheap->heap->lfh)
     {
         void *addr = subheap->base;
 
@@ -1006,6 +1024,8 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->commitSize = commitSize;
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
+        /* the list is walked without the heap lock by lfh_get_group */
+        __atomic_thread_fence( __ATOMIC_RELEASE );
         list_add_head( &heap->subheap_list, &subheap->entry );
     }
     else
@@ -1016,6 +1036,8 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
+        heap->lfh           = NULL;
+        memset( heap->lfh_counts, 0, sizeof(heap->lfh_counts) );
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
 
@@ -1490,6 +1512,13 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
     {
         const ARENA_INUSE *arena = (const ARENA_INUSE *)block - 1;
 
+        if (lfh_get_group( heapPtr, block ))
+        {
+            ret = (arena->magic == ARENA_LFH_MAGIC);
+            if (!ret && quiet == NOISY) ERR( "Heap %p: block %p is not allocated\n", heapPtr, block );
+            goto done;
+        }
+
         if (!(subheap = HEAP_FindSubHeap( heapPtr, arena )) ||
             ((const char *)arena < (char *)subheap->base + subheap->headerSize))
         {
@@ -1583,6 +1612,490 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           allocate_block
+ *
+ * Allocate a block from the free lists. The heap must be locked.
+ */
+static void *allocate_block( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    ARENA_FREE *pArena;
+    ARENA_INUSE *pInUse;
+    SUBHEAP *subheap;
+
+    /* Locate a suitable free block */
+
+    if (!(pArena = HEAP_FindFreeBlock( heap, rounded_size, &subheap ))) return NULL;
+
+    /* Remove the arena from the free list */
+
+    HEAP_DeleteFreeBlock( heap, pArena );
+
+    /* Build the in-use arena */
+
+    pInUse = (ARENA_INUSE *)pArena;
+
+    /* in-use arena is smaller than free arena,
+     * so we have to add the difference to the size */
+    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
+    pInUse->magic = ARENA_INUSE_MAGIC;
+
+    /* Shrink the block */
+
+    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
+    pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+
+    notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+    return pInUse + 1;
+}
+
+
+/***********************************************************************
+ * Low fragmentation heap
+ *
+ * Small allocations of a size class that is used often enough are served
+ * from groups of equally sized blocks, carved out of regular heap blocks.
+ * Each size class has a few affinity slots, protected by spinlocks, that
+ * own an active group and allocate from its local free list without taking
+ * the heap lock. Blocks are freed without any lock by pushing them on the
+ * remote free list of their group, which the owning slot reclaims once its
+ * local list is empty. Groups that run out of blocks are detached from their
+ * slot, queued on the size class again when one of their blocks is freed, and
+ * given back to the heap once all their blocks are free.
+ *
+ * LFH blocks use the regular in-use arena, with the offset of the block in
+ * its group in the low word of the size field and the requested size in the
+ * high word. The group header is followed by the blocks, skipping those
+ * that would start on a page boundary so that the arena of a block and
+ * its group header can always be accessed safely.
+ */
+
+#define LFH_GROUP_ACTIVE    0  /* group is owned by a slot */
+#define LFH_GROUP_DETACHED  1  /* group is on the available stack, on the partial list, or full */
+
+#define LFH_LIST_NONE       0  /* group is not queued on its size class */
+#define LFH_LIST_AVAILABLE  1  /* group is on the available stack */
+#define LFH_LIST_PARTIAL    2  /* group is on the partial list */
+
+struct lfh_bin;
+
+struct lfh_group
+{
+    DWORD                        magic;          /* LFH_GROUP_MAGIC */
+    LONG                         state;          /* LFH_GROUP_ACTIVE or LFH_GROUP_DETACHED */
+    HEAP                        *heap;           /* heap the group belongs to */
+    struct lfh_bin              *bin;            /* size class of the group */
+    ARENA_INUSE                 *local;          /* free blocks, only used by the owning slot */
+    ARENA_INUSE        *volatile remote;         /* blocks freed since the last refill */
+    LONG                         used;           /* number of allocated blocks */
+    LONG                         list;           /* LFH_LIST_* value */
+    struct lfh_group            *next_available; /* next group on the available stack */
+    struct list                  entry;          /* entry in the partial list */
+};
+
+struct lfh_slot
+{
+    LONG                         lock;           /* spinlock protecting the slot */
+    struct lfh_group            *group;          /* active group of the slot */
+};
+
+struct lfh_bin
+{
+    LONG                         slot_count;     /* number of slots in use, a power of 2 */
+    struct lfh_group   *volatile available;      /* detached groups that got blocks freed */
+    struct list                  partial;        /* detached groups with free blocks, heap lock held */
+    DWORD                        index;          /* index of the size class */
+    struct lfh_slot              slots[LFH_MAX_SLOTS];
+};
+
+struct lfh_heap
+{
+    struct lfh_bin               bins[LFH_NB_BINS];
+};
+
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+/* size classes are 16 bytes apart up to 256, 64 up to 1024 and 128 up to 2048 */
+static inline unsigned int lfh_bin_index( SIZE_T size )
+{
+    if (size <= 256) return size ? (size - 1) / 16 : 0;
+    if (size <= 1024) return 16 + (size - 257) / 64;
+    return 28 + (size - 1025) / 128;
+}
+
+static inline SIZE_T lfh_bin_size( unsigned int index )
+{
+    if (index < 16) return (index + 1) * 16;
+    if (index < 28) return 256 + (index - 15) * 64;
+    return 1024 + (index - 27) * 128;
+}
+
+static inline ARENA_INUSE *lfh_next_block( const ARENA_INUSE *arena )
+{
+    return *(ARENA_INUSE *const *)(arena + 1);
+}
+
+/* check if the heap flags allow the use of the low fragmentation heap */
+static inline BOOL heap_use_lfh( const HEAP *heap )
+{
+    if (RUNNING_ON_VALGRIND) return FALSE;
+    return (heap->flags & (HEAP_GROWABLE | HEAP_NO_SERIALIZE | HEAP_SHARED | HEAP_PAGE_ALLOCS |
+                           HEAP_VALIDATE | HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED))
+            == HEAP_GROWABLE;
+}
+
+/* check if an allocation can be served by the low fragmentation heap */
+static inline BOOL lfh_enabled( const HEAP *heap, SIZE_T size )
+{
+    if (size > LFH_MAX_SIZE || !heap->lfh) return FALSE;
+    if (heap->lfh_counts[lfh_bin_index( size )] < LFH_ACTIVATION_COUNT) return FALSE;
+    if (!heap_use_lfh( heap )) return FALSE;
+    /* the heap may be locked with RtlLockHeap, and the slots are locked before the heap */
+    return heap->critSection.OwningThread != ULongToHandle(GetCurrentThreadId());
+}
+
+/* create the low fragmentation heap structures; the heap must be locked */
+static struct lfh_heap *lfh_create( HEAP *heap )
+{
+    struct lfh_heap *lfh;
+    SIZE_T size = sizeof(*lfh);
+    unsigned int i;
+
+    if (heap->lfh) return heap->lfh;
+    if (!(lfh = allocate_block( heap, heap->flags | HEAP_ZERO_MEMORY, size,
+                                ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE )))
+        return NULL;
+
+    for (i = 0; i < LFH_NB_BINS; i++)
+    {
+        lfh->bins[i].slot_count = 1;
+        lfh->bins[i].index = i;
+        list_init( &lfh->bins[i].partial );
+    }
+    InterlockedExchangePointer( (void **)&heap->lfh, lfh );
+    TRACE( "heap %p: enabled low fragmentation heap %p\n", heap, lfh );
+    return lfh;
+}
+
+/* count an allocation from the free lists, activating the size class once it is used
+ * often enough; the heap must be locked */
+static void lfh_count_allocation( HEAP *heap, SIZE_T size )
+{
+    unsigned int index = lfh_bin_index( size );
+
+    if (heap->lfh_counts[index] >= LFH_ACTIVATION_COUNT) return;
+    if (++heap->lfh_counts[index] == LFH_ACTIVATION_COUNT && !lfh_create( heap ))
+        heap->lfh_counts[index]--;
+}
+
+/* lock one of the affinity slots of a size class, adding slots when they are contended */
+static struct lfh_slot *lfh_lock_slot( struct lfh_bin *bin )
+{
+    DWORD hash = GetCurrentThreadId() >> 2;
+    unsigned int spins = 0;
+    struct lfh_slot *slot;
+    LONG count;
+
+    for (;;)
+    {
+        count = bin->slot_count;
+        slot = &bin->slots[hash & (count - 1)];
+        if (!slot->lock && !InterlockedCompareExchange( &slot->lock, 1, 0 )) return slot;
+
+        if (count < LFH_MAX_SLOTS && !spins)
+        {
+            InterlockedCompareExchange( &bin->slot_count, count * 2, count );
+            continue;
+        }
+        if (++spins < 100) small_pause();
+        else
+        {
+            NtYieldExecution();
+            spins = 0;
+        }
+    }
+}
+
+static inline void lfh_unlock_slot( struct lfh_slot *slot )
+{
+    InterlockedExchange( &slot->lock, 0 );
+}
+
+/* detach a group from its slot; returns FALSE if blocks were freed in the meantime and
+ * the group stays active; the heap must be locked */
+static BOOL lfh_detach_group( struct lfh_group *group )
+{
+    InterlockedExchange( &group->state, LFH_GROUP_DETACHED );
+    if (!(group->local = InterlockedExchangePointer( (void **)&group->remote, NULL ))) return TRUE;
+    group->state = LFH_GROUP_ACTIVE;
+    return FALSE;
+}
+
+/* give the memory of an unused group back to the heap; the heap must be locked */
+static void lfh_release_group( HEAP *heap, struct lfh_group *group )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)group - 1;
+    SUBHEAP *subheap;
+
+    if (!(subheap = HEAP_FindSubHeap( heap, arena ))) return;
+    TRACE( "heap %p: releasing group %p\n", heap, group );
+    group->magic = 0;
+    HEAP_MakeInUseBlockFree( subheap, arena );
+}
+
+/* move the groups queued by lfh_free_block to the partial list, releasing empty ones as
+ * long as another group is available; the heap must be locked */
+static void lfh_collect_available( HEAP *heap, struct lfh_bin *bin )
+{
+    struct lfh_group *group, *next;
+
+    group = InterlockedExchangePointer( (void **)&bin->available, NULL );
+    for (; group; group = next)
+    {
+        next = group->next_available;
+        if (group->state != LFH_GROUP_DETACHED)
+            group->list = LFH_LIST_NONE;  /* reattached to a slot before we got here */
+        else if (!group->used && !list_empty( &bin->partial ))
+            lfh_release_group( heap, group );
+        else
+        {
+            group->list = LFH_LIST_PARTIAL;
+            list_add_tail( &bin->partial, &group->entry );
+        }
+    }
+}
+
+/* create a new group of blocks; the heap must be locked */
+static struct lfh_group *lfh_create_group( HEAP *heap, struct lfh_bin *bin )
+{
+    SIZE_T header = (sizeof(struct lfh_group) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    SIZE_T stride = lfh_bin_size( bin->index ) + ALIGNMENT;
+    SIZE_T size = max( LFH_GROUP_SIZE, header + LFH_MIN_GROUP_BLOCKS * stride );
+    struct lfh_group *group;
+    ARENA_INUSE *arena, **next;
+    char *ptr, *end;
+
+    if (!(group = allocate_block( heap, heap->flags, size, ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE )))
+        return NULL;
+
+    group->magic = LFH_GROUP_MAGIC;
+    group->state = LFH_GROUP_ACTIVE;
+    group->heap = heap;
+    group->bin = bin;
+    group->remote = NULL;
+    group->used = 0;
+    group->list = LFH_LIST_NONE;
+    group->next_available = NULL;
+
+    next = &group->local;
+    end = (char *)group + size;
+    for (ptr = (char *)group + header; ptr + stride <= end; ptr += stride)
+    {
+        arena = (ARENA_INUSE *)(ptr + ARENA_OFFSET);
+        if (!((ULONG_PTR)(arena + 1) & LFH_PAGE_MASK)) continue;
+        arena->size = ((char *)(arena + 1) - (char *)group) / ALIGNMENT;
+        arena->magic = ARENA_LFH_FREE_MAGIC;
+        arena->unused_bytes = 0;
+        *next = arena;
+        next = (ARENA_INUSE **)(arena + 1);
+    }
+    *next = NULL;
+
+    TRACE( "heap %p: new group %p for size %lu\n", heap, group, lfh_bin_size( bin->index ) );
+    return group;
+}
+
+/* give a slot a group with free blocks; the slot must be locked */
+static struct lfh_group *lfh_refill_slot( HEAP *heap, struct lfh_bin *bin, struct lfh_slot *slot )
+{
+    struct lfh_group *group = slot->group;
+
+    /* reclaim the blocks freed from other threads first */
+    if (group && (group->local = InterlockedExchangePointer( (void **)&group->remote, NULL )))
+        return group;
+
+    enter_critical_section( &heap->critSection );
+
+    if (group && lfh_detach_group( group )) group = slot->group = NULL;
+
+    if (!group)
+    {
+        lfh_collect_available( heap, bin );
+        while (!list_empty( &bin->partial ))
+        {
+            group = LIST_ENTRY( list_head( &bin->partial ), struct lfh_group, entry );
+            list_remove( &group->entry );
+            group->state = LFH_GROUP_ACTIVE;
+            InterlockedExchange( &group->list, LFH_LIST_NONE );
+            if ((group->local = InterlockedExchangePointer( (void **)&group->remote, NULL ))) break;
+            if (!lfh_detach_group( group )) break;
+            group = NULL;
+        }
+        if (!group) group = lfh_create_group( heap, bin );
+        slot->group = group;
+    }
+
+    leave_critical_section( &heap->critSection );
+    return group;
+}
+
+/* allocate a block from the low fragmentation heap */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size )
+{
+    struct lfh_bin *bin = &heap->lfh->bins[lfh_bin_index( size )];
+    struct lfh_slot *slot = lfh_lock_slot( bin );
+    struct lfh_group *group = slot->group;
+    ARENA_INUSE *arena;
+
+    if ((!group || !group->local) && !(group = lfh_refill_slot( heap, bin, slot )))
+    {
+        lfh_unlock_slot( slot );
+        return NULL;
+    }
+
+    arena = group->local;
+    group->local = lfh_next_block( arena );
+    InterlockedIncrement( &group->used );
+    lfh_unlock_slot( slot );
+
+    arena->size = (arena->size & 0xffff) | (size << 16);
+    arena->magic = ARENA_LFH_MAGIC;
+    if (flags & HEAP_ZERO_MEMORY) memset( arena + 1, 0, size );
+    return arena + 1;
+}
+
+/* free a block of the low fragmentation heap; the heap lock is only taken when a
+ * detached group may become unused. Returns FALSE if the block isn't allocated. */
+static BOOL lfh_free_block( struct lfh_group *group, ARENA_INUSE *arena )
+{
+    struct lfh_bin *bin = group->bin;
+    HEAP *heap = group->heap;
+    struct lfh_group *head;
+    ARENA_INUSE *next;
+
+    /* unused_bytes is always 0 in LFH blocks, so the magic can be switched atomically
+     * and only one of several threads freeing the same block gets past this */
+    if (InterlockedCompareExchange( (LONG *)&arena->size + 1, ARENA_LFH_FREE_MAGIC,
+                                    ARENA_LFH_MAGIC ) != ARENA_LFH_MAGIC)
+        return FALSE;
+
+    do
+    {
+        next = group->remote;
+        *(ARENA_INUSE **)(arena + 1) = next;
+    } while (InterlockedCompareExchangePointer( (void **)&group->remote, arena, next ) != next);
+
+    if (group->state != LFH_GROUP_DETACHED)
+    {
+        InterlockedDecrement( &group->used );
+        return TRUE;
+    }
+
+    if (!InterlockedCompareExchange( &group->list, LFH_LIST_AVAILABLE, LFH_LIST_NONE ))
+    {
+        do
+        {
+            head = bin->available;
+            group->next_available = head;
+        } while (InterlockedCompareExchangePointer( (void **)&bin->available, group, head ) != head);
+    }
+
+    if (group->used > 1)
+    {
+        /* this must be the last access, the group may be released as soon as it is unused */
+        InterlockedDecrement( &group->used );
+        return TRUE;
+    }
+
+    enter_critical_section( &heap->critSection );
+    if (!InterlockedDecrement( &group->used ) && group->state == LFH_GROUP_DETACHED)
+    {
+        if (group->list == LFH_LIST_AVAILABLE)
+            lfh_collect_available( heap, bin );
+        else if (group->list == LFH_LIST_PARTIAL && list_next( &bin->partial, list_head( &bin->partial )))
+        {
+            list_remove( &group->entry );
+            lfh_release_group( heap, group );
+        }
+    }
+    leave_critical_section( &heap->critSection );
+    return TRUE;
+}
+
+/* find the group of a low fragmentation heap block, or NULL if ptr isn't one; this is
+ * called without the heap lock, which is fine since subheaps are kept once the LFH is
+ * enabled, and nothing is read before checking that it is committed heap memory */
+static struct lfh_group *lfh_get_group( const HEAP *heap, const void *ptr )
+{
+    const ARENA_INUSE *arena = (const ARENA_INUSE *)ptr - 1;
+    struct lfh_group *group;
+    const SUBHEAP *subheap;
+    const char *start, *end;
+
+    if (!heap->lfh) return NULL;
+    if ((ULONG_PTR)ptr % ALIGNMENT || !((ULONG_PTR)ptr & LFH_PAGE_MASK)) return NULL;
+    if (!(subheap = HEAP_FindSubHeap( heap, arena ))) return NULL;
+    start = (const char *)subheap->base + subheap->headerSize;
+    end = (const char *)subheap->base + *(volatile SIZE_T *)&subheap->commitSize;
+    if ((const char *)arena < start || (const char *)ptr > end) return NULL;
+
+    if (arena->magic != ARENA_LFH_MAGIC && arena->magic != ARENA_LFH_FREE_MAGIC) return NULL;
+    group = (struct lfh_group *)((char *)ptr - (arena->size & 0xffff) * ALIGNMENT);
+    if ((const char *)group < start || (const char *)(group + 1) > (const char *)arena) return NULL;
+    if (group->magic != LFH_GROUP_MAGIC || group->heap != heap) return NULL;
+    return group;
+}
+
+/* resize a block of the low fragmentation heap */
+static void *lfh_reallocate( HEAP *heap, DWORD flags, struct lfh_group *group,
+                             ARENA_INUSE *arena, SIZE_T size )
+{
+    SIZE_T old_size = arena->size >> 16;
+    unsigned int index = group->bin->index;
+    void *ret;
+
+    if (arena->magic != ARENA_LFH_MAGIC)
+    {
+        WARN( "Heap %p: block %p used after free\n", heap, arena + 1 );
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+        return NULL;
+    }
+
+    if (size <= lfh_bin_size( index ) &&
+        ((flags & HEAP_REALLOC_IN_PLACE_ONLY) || lfh_bin_index( size ) == index))
+    {
+        if ((flags & HEAP_ZERO_MEMORY) && size > old_size)
+            memset( (char *)(arena + 1) + old_size, 0, size - old_size );
+        arena->size = (arena->size & 0xffff) | (size << 16);
+        return arena + 1;
+    }
+
+    if (!(flags & HEAP_REALLOC_IN_PLACE_ONLY) &&
+        (ret = RtlAllocateHeap( heap, flags & (HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY), size )))
+    {
+        memcpy( ret, arena + 1, min( size, old_size ));
+        if (lfh_free_block( group, arena )) return ret;
+        /* freed by another thread meanwhile */
+        WARN( "Heap %p: block %p used after free\n", heap, arena + 1 );
+        RtlFreeHeap( heap, flags & HEAP_NO_SERIALIZE, ret );
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+        return NULL;
+    }
+
+    if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+    RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+    return NULL;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1790,11 +2303,9 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
  */
 void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 {
-    ARENA_FREE *pArena;
-    ARENA_INUSE *pInUse;
-    SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SIZE_T rounded_size;
+    void *ret;
 
     /* Validate the parameters */
 
@@ -1809,20 +2320,24 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (lfh_enabled( heapPtr, size ) && (ret = lfh_allocate( heapPtr, flags, size )))
+    {
+        TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
     {
-        void *ret = allocate_large_block( heap, flags, size );
+        ret = allocate_large_block( heap, flags, size );
         if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
         if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
         return ret;
     }
 
-    /* Locate a suitable free block */
-
-    if (!(pArena = HEAP_FindFreeBlock( heapPtr, rounded_size, &subheap )))
+    if (!(ret = allocate_block( heapPtr, flags, size, rounded_size )))
     {
         TRACE("(%p,%08x,%08lx): returning NULL\n",
                   heap, flags, size  );
@@ -1831,31 +2346,12 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
         return NULL;
     }
 
-    /* Remove the arena from the free list */
-
-    HEAP_DeleteFreeBlock( heapPtr, pArena );
-
-    /* Build the in-use arena */
-
-    pInUse = (ARENA_INUSE *)pArena;
-
-    /* in-use arena is smaller than free arena,
-     * so we have to add the difference to the size */
-    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
-    pInUse->magic = ARENA_INUSE_MAGIC;
-
-    /* Shrink the block */
-
-    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
-    pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
-
-    notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
-    initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+    if (size <= LFH_MAX_SIZE && heap_use_lfh( heapPtr )) lfh_count_allocation( heapPtr, size );
 
     if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
 
-    TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
-    return pInUse + 1;
+    TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+    return ret;
 }
 
 
@@ -1875,6 +2371,7 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
  */
 BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *ptr )
 {
+    struct lfh_group *group;
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr;
@@ -1892,6 +2389,21 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    if ((group = lfh_get_group( heapPtr, ptr )))
+    {
+        pInUse = (ARENA_INUSE *)ptr - 1;
+        if (!lfh_free_block( group, pInUse ))
+        {
+            WARN( "Heap %p: block %p used after free\n", heapPtr, ptr );
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            TRACE("(%p,%08x,%p): returning FALSE\n", heap, flags, ptr );
+            return FALSE;
+        }
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
@@ -1935,6 +2447,7 @@ error:
  */
 PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size )
 {
+    struct lfh_group *group;
     ARENA_INUSE *pArena;
     HEAP *heapPtr;
     SUBHEAP *subheap;
@@ -1953,6 +2466,14 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if ((group = lfh_get_group( heapPtr, ptr )))
+    {
+        ret = lfh_reallocate( heapPtr, flags, group, (ARENA_INUSE *)ptr - 1, size );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE;
@@ -2162,9 +2683,22 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     pArena = (const ARENA_INUSE *)ptr - 1;
+    if (lfh_get_group( heapPtr, ptr ))
+    {
+        if (pArena->magic == ARENA_LFH_MAGIC) ret = pArena->size >> 16;
+        else
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            ret = ~0UL;
+        }
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
+
     if (!validate_block_pointer( heapPtr, &subheap, pArena ))
     {
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
@@ -2372,6 +2906,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2380,7 +2916,9 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0;  /* low fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2394,6 +2932,25 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
+    HEAP *heapPtr;
+    unsigned int i;
+
+    if (info_class == HeapCompatibilityInformation)
+    {
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (*(ULONG *)info == 2)  /* low fragmentation heap */
+        {
+            if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+            if (!heap_use_lfh( heapPtr )) return STATUS_UNSUCCESSFUL;
+
+            enter_critical_section( &heapPtr->critSection );
+            if (lfh_create( heapPtr ))
+                for (i = 0; i < LFH_NB_BINS; i++) heapPtr->lfh_counts[i] = LFH_ACTIVATION_COUNT;
+            leave_critical_section( &heapPtr->critSection );
+            return heapPtr->lfh ? STATUS_SUCCESS : STATUS_NO_MEMORY;
+        }
+    }
+
     FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
     return STATUS_SUCCESS;
 }
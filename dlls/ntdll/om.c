@@ -247,8 +247,19 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
         {
             OBJECT_DATA_INFORMATION* p = ptr;
 
+            unsigned int flags;
+
             if (len < sizeof(*p)) return STATUS_INVALID_BUFFER_SIZE;
 
+            if ((status = server_get_handle_info( handle, NULL, &flags )) != STATUS_NOT_SUPPORTED)
+            {
+                if (status) break;
+                p->InheritHandle = (flags & HANDLE_FLAG_INHERIT) != 0;
+                p->ProtectFromClose = (flags & HANDLE_FLAG_PROTECT_FROM_CLOSE) != 0;
+                if (used_len) *used_len = sizeof(*p);
+                break;
+            }
+
             SERVER_START_REQ( set_handle_info )
             {
                 req->handle = wine_server_obj_handle( handle );
@@ -449,12 +460,18 @@ NTSTATUS close_handle( HANDLE handle )
     if (do_esync())
         esync_close( handle );
 
-    SERVER_START_REQ( close_handle )
+    /* closing a handle that is already free doesn't need a server round trip */
+    if (server_get_handle_info( handle, NULL, NULL ) == STATUS_INVALID_HANDLE)
+        ret = STATUS_INVALID_HANDLE;
+    else
     {
-        req->handle = wine_server_obj_handle( handle );
-        ret = wine_server_call( req );
+        SERVER_START_REQ( close_handle )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            ret = wine_server_call( req );
+        }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
     if (fd != -1) close( fd );
 
     if (ret == STATUS_INVALID_HANDLE && handle && NtCurrentTeb()->Peb->BeingDebugged)
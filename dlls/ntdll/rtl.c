@@ -1753,27 +1753,139 @@ PSLIST_ENTRY FASTCALL RtlInterlockedPushListSList(PSLIST_HEADER list, PSLIST_ENT
     return RtlInterlockedPushListSListEx(list, first, last, count);
 }
 
+/* hash chain match finder shared by the LZ77 based compressors */
+
+#define LZ_MIN_MATCH 3
+
+#define LZNT1_HASH_BITS         12
+#define LZNT1_WINDOW            0x1000
+#define XPRESS_HASH_BITS        14
+#define XPRESS_WINDOW           0x2000
+#define XPRESS_HUFF_HASH_BITS   15
+#define XPRESS_HUFF_WINDOW      0x10000
+#define XPRESS_HUFF_BLOCK       0x10000
+#define XPRESS_HUFF_SYMBOLS     512
+#define XPRESS_HUFF_MAX_BITS    15
+
+#define LZ_WORKSPACE_SIZE(hash_bits, window) (((1 << (hash_bits)) + (window)) * sizeof(LONG))
+
+struct lz_match_finder
+{
+    const UCHAR *src;
+    const UCHAR *end;
+    LONG        *head;      /* most recent position for each hash value */
+    LONG        *prev;      /* previous position with the same hash, indexed by position */
+    ULONG        hash_shift;
+    ULONG        prev_mask;
+    ULONG        max_chain; /* number of candidates to check before giving up */
+    ULONG        nice_len;  /* stop searching once a match of this length is found */
+};
+
+static void lz_init( struct lz_match_finder *mf, const UCHAR *src, ULONG size, void *workspace,
+                     ULONG hash_bits, ULONG window, BOOL maximum )
+{
+    mf->src        = src;
+    mf->end        = src + size;
+    mf->head       = workspace;
+    mf->prev       = mf->head + (1 << hash_bits);
+    mf->hash_shift = 32 - hash_bits;
+    mf->prev_mask  = window - 1;
+    mf->max_chain  = maximum ? 256 : 16;
+    mf->nice_len   = maximum ? 258 : 32;
+    memset( mf->head, 0xff, sizeof(LONG) << hash_bits );
+}
+
+static inline ULONG lz_hash( const struct lz_match_finder *mf, const UCHAR *p )
+{
+    return ((p[0] | (p[1] << 8) | (p[2] << 16)) * 0x9e3779b1) >> mf->hash_shift;
+}
+
+static inline void lz_insert( struct lz_match_finder *mf, ULONG pos, ULONG count )
+{
+    const UCHAR *p = mf->src + pos;
+    ULONG hash, avail;
+
+    /* the last two bytes can't start a match */
+    avail = mf->end - p >= LZ_MIN_MATCH ? mf->end - p - (LZ_MIN_MATCH - 1) : 0;
+    if (count > avail) count = avail;
+
+    for (; count; count--, pos++, p++)
+    {
+        hash = lz_hash( mf, p );
+        mf->prev[pos & mf->prev_mask] = mf->head[hash];
+        mf->head[hash] = pos;
+    }
+}
+
+/* returns the length of the longest match at pos starting at or after min_pos, or 0 */
+static ULONG lz_find_match( struct lz_match_finder *mf, ULONG pos, ULONG min_pos,
+                            ULONG max_len, ULONG *offset )
+{
+    const UCHAR *cur = mf->src + pos, *match;
+    ULONG chain = mf->max_chain, best_len = LZ_MIN_MATCH - 1, len;
+    LONG candidate;
+
+    if (max_len > mf->end - cur) max_len = mf->end - cur;
+    if (max_len < LZ_MIN_MATCH) return 0;
+
+    candidate = mf->head[lz_hash( mf, cur )];
+    while (candidate >= (LONG)min_pos && chain--)
+    {
+        match = mf->src + candidate;
+        if (match[best_len] == cur[best_len] && match[0] == cur[0] && match[1] == cur[1])
+        {
+            for (len = 2; len < max_len && match[len] == cur[len]; len++);
+            if (len > best_len)
+            {
+                best_len = len;
+                *offset  = pos - candidate;
+                if (len >= mf->nice_len || len == max_len) break;
+            }
+        }
+        candidate = mf->prev[candidate & mf->prev_mask];
+    }
+
+    return best_len >= LZ_MIN_MATCH ? best_len : 0;
+}
+
+struct xpress_huff_workspace
+{
+    LONG   match[(1 << XPRESS_HUFF_HASH_BITS) + XPRESS_HUFF_WINDOW];
+    USHORT offset[XPRESS_HUFF_BLOCK];   /* 0 for literals */
+    USHORT value[XPRESS_HUFF_BLOCK];    /* literal byte or match length - 3 */
+};
+
 /******************************************************************************
  *  RtlGetCompressionWorkSpaceSize		[NTDLL.@]
  */
 NTSTATUS WINAPI RtlGetCompressionWorkSpaceSize(USHORT format, PULONG compress_workspace,
                                                PULONG decompress_workspace)
 {
-    FIXME("0x%04x, %p, %p: semi-stub\n", format, compress_workspace, decompress_workspace);
+    TRACE("0x%04x, %p, %p\n", format, compress_workspace, decompress_workspace);
 
     switch (format & ~COMPRESSION_ENGINE_MAXIMUM)
     {
         case COMPRESSION_FORMAT_LZNT1:
             if (compress_workspace)
-            {
-                /* FIXME: The current implementation of RtlCompressBuffer does not use a
-                 * workspace buffer, but Windows applications might expect a nonzero value. */
-                *compress_workspace = 16;
-            }
+                *compress_workspace = LZ_WORKSPACE_SIZE(LZNT1_HASH_BITS, LZNT1_WINDOW);
             if (decompress_workspace)
                 *decompress_workspace = 0x1000;
             return STATUS_SUCCESS;
 
+        case COMPRESSION_FORMAT_XPRESS:
+            if (compress_workspace)
+                *compress_workspace = LZ_WORKSPACE_SIZE(XPRESS_HASH_BITS, XPRESS_WINDOW);
+            if (decompress_workspace)
+                *decompress_workspace = 0;
+            return STATUS_SUCCESS;
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            if (compress_workspace)
+                *compress_workspace = sizeof(struct xpress_huff_workspace);
+            if (decompress_workspace)
+                *decompress_workspace = 0;
+            return STATUS_SUCCESS;
+
         case COMPRESSION_FORMAT_NONE:
         case COMPRESSION_FORMAT_DEFAULT:
             return STATUS_INVALID_PARAMETER;
@@ -1784,28 +1896,89 @@ NTSTATUS WINAPI RtlGetCompressionWorkSpaceSize(USHORT format, PULONG compress_wo
     }
 }
 
-/* compress data using LZNT1, currently only a stub */
+/* compress a single LZNT1 chunk, returns 0 if the result doesn't fit into dst_size */
+static ULONG lznt1_compress_chunk(struct lz_match_finder *mf, ULONG start, ULONG size,
+                                  UCHAR *dst, ULONG dst_size)
+{
+    const UCHAR *src = mf->src + start;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *flags = NULL;
+    ULONG pos = 0, count = 0, displacement_bits = 4;
+    ULONG match_len, offset;
+
+    while (pos < size)
+    {
+        if (!(count++ & 7))
+        {
+            if (dst_cur >= dst_end) return 0;
+            flags = dst_cur++;
+            *flags = 0;
+        }
+
+        /* the split between displacement and length depends on the position in the chunk */
+        while (displacement_bits < 12 && pos > (1 << displacement_bits)) displacement_bits++;
+
+        match_len = lz_find_match( mf, start + pos, start,
+                                   min( (1 << (16 - displacement_bits)) + 2, size - pos ), &offset );
+        if (match_len)
+        {
+            if (dst_cur + sizeof(WORD) > dst_end) return 0;
+            *(WORD *)dst_cur = ((offset - 1) << (16 - displacement_bits)) | (match_len - 3);
+            dst_cur += sizeof(WORD);
+            *flags |= 1 << ((count - 1) & 7);
+        }
+        else
+        {
+            if (dst_cur >= dst_end) return 0;
+            *dst_cur++ = src[pos];
+            match_len = 1;
+        }
+
+        lz_insert( mf, start + pos, match_len );
+        pos += match_len;
+    }
+
+    return dst_cur - dst;
+}
+
+/* compress data using LZNT1 */
 static NTSTATUS lznt1_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                               ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+                               ULONG chunk_size, ULONG *final_size, UCHAR *workspace, BOOL maximum)
 {
     UCHAR *src_cur = src, *src_end = src + src_size;
     UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-    ULONG block_size;
+    struct lz_match_finder mf;
+    ULONG block_size, size;
+
+    lz_init( &mf, src, src_size, workspace, LZNT1_HASH_BITS, LZNT1_WINDOW, maximum );
 
     while (src_cur < src_end)
     {
         /* determine size of current chunk */
         block_size = min(0x1000, src_end - src_cur);
-        if (dst_cur + sizeof(WORD) + block_size > dst_end)
+        if (dst_cur + sizeof(WORD) > dst_end)
             return STATUS_BUFFER_TOO_SMALL;
 
-        /* write (uncompressed) chunk header */
-        *(WORD *)dst_cur = 0x3000 | (block_size - 1);
-        dst_cur += sizeof(WORD);
+        /* try to compress the chunk, fall back to storing it if that doesn't save anything */
+        size = lznt1_compress_chunk( &mf, src_cur - src, block_size, dst_cur + sizeof(WORD),
+                                     min( dst_end - dst_cur - sizeof(WORD), block_size - 1 ) );
+        if (size)
+        {
+            *(WORD *)dst_cur = 0xb000 | (size - 1);
+            dst_cur += sizeof(WORD) + size;
+        }
+        else
+        {
+            if (dst_cur + sizeof(WORD) + block_size > dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
 
-        /* write chunk content */
-        memcpy(dst_cur, src_cur, block_size);
-        dst_cur += block_size;
+            /* write (uncompressed) chunk header */
+            *(WORD *)dst_cur = 0x3000 | (block_size - 1);
+            dst_cur += sizeof(WORD);
+
+            /* write chunk content */
+            memcpy(dst_cur, src_cur, block_size);
+            dst_cur += block_size;
+        }
         src_cur += block_size;
     }
 
@@ -1815,6 +1988,323 @@ static NTSTATUS lznt1_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst
     return STATUS_SUCCESS;
 }
 
+/* compress data using the plain LZ77 variant of XPRESS */
+static NTSTATUS xpress_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                                ULONG *final_size, UCHAR *workspace, BOOL maximum)
+{
+    UCHAR *dst_cur = dst + sizeof(DWORD), *dst_end = dst + dst_size;
+    UCHAR *flags_ptr = dst, *nibble = NULL;
+    ULONG flags = 0, flag_count = 0, pos = 0;
+    ULONG match_len, offset, len, needed;
+    struct lz_match_finder mf;
+
+    if (dst_size < sizeof(DWORD))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    lz_init( &mf, src, src_size, workspace, XPRESS_HASH_BITS, XPRESS_WINDOW, maximum );
+
+    while (pos < src_size)
+    {
+        match_len = lz_find_match( &mf, pos, pos > XPRESS_WINDOW ? pos - XPRESS_WINDOW : 0,
+                                   src_size - pos, &offset );
+        if (match_len)
+        {
+            len = match_len - 3;
+
+            /* 16-bit offset/length word, optionally followed by a length nibble shared
+             * between two matches and extra length bytes */
+            needed = sizeof(WORD);
+            if (len >= 7 && !nibble) needed++;
+            if (len >= 7 + 15) needed += (len - 7 - 15 < 255) ? 1 : (len < 0x10000 ? 3 : 7);
+            if (dst_end - dst_cur < needed) return STATUS_BUFFER_TOO_SMALL;
+
+            *(WORD *)dst_cur = ((offset - 1) << 3) | min( len, 7 );
+            dst_cur += sizeof(WORD);
+            if (len >= 7)
+            {
+                len -= 7;
+                if (!nibble)
+                {
+                    nibble = dst_cur;
+                    *dst_cur++ = min( len, 15 );
+                }
+                else
+                {
+                    *nibble |= min( len, 15 ) << 4;
+                    nibble = NULL;
+                }
+                if (len >= 15)
+                {
+                    len -= 15;
+                    if (len < 255) *dst_cur++ = len;
+                    else
+                    {
+                        *dst_cur++ = 255;
+                        len += 15 + 7;
+                        if (len < 0x10000)
+                        {
+                            *(WORD *)dst_cur = len;
+                            dst_cur += sizeof(WORD);
+                        }
+                        else
+                        {
+                            *(WORD *)dst_cur = 0;
+                            *(DWORD *)(dst_cur + sizeof(WORD)) = len;
+                            dst_cur += sizeof(WORD) + sizeof(DWORD);
+                        }
+                    }
+                }
+            }
+            flags = (flags << 1) | 1;
+        }
+        else
+        {
+            if (dst_cur >= dst_end) return STATUS_BUFFER_TOO_SMALL;
+            *dst_cur++ = src[pos];
+            flags <<= 1;
+            match_len = 1;
+        }
+
+        lz_insert( &mf, pos, match_len );
+        pos += match_len;
+
+        if (++flag_count == 32)
+        {
+            if (dst_end - dst_cur < sizeof(DWORD)) return STATUS_BUFFER_TOO_SMALL;
+            *(DWORD *)flags_ptr = flags;
+            flag_count = 0;
+            flags_ptr = dst_cur;
+            dst_cur += sizeof(DWORD);
+        }
+    }
+
+    /* the remaining flag bits are set, which terminates the stream */
+    if (flag_count) flags = (flags << (32 - flag_count)) | ((1u << (32 - flag_count)) - 1);
+    else flags = ~0u;
+    *(DWORD *)flags_ptr = flags;
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* compute length limited Huffman code lengths for the given symbol frequencies */
+static void huffman_code_lengths( ULONG *freqs, UCHAR *lens, ULONG count, ULONG max_bits )
+{
+    ULONG weight[2 * XPRESS_HUFF_SYMBOLS], parent[2 * XPRESS_HUFF_SYMBOLS];
+    ULONG depth[2 * XPRESS_HUFF_SYMBOLS], syms[XPRESS_HUFF_SYMBOLS];
+    ULONG i, j, n, sym, next, leaf, node, max_depth, child[2];
+
+    for (;;)
+    {
+        /* sort the used symbols by frequency */
+        for (n = sym = 0; sym < count; sym++)
+        {
+            lens[sym] = 0;
+            if (!freqs[sym]) continue;
+            for (i = n++; i && freqs[syms[i - 1]] > freqs[sym]; i--) syms[i] = syms[i - 1];
+            syms[i] = sym;
+        }
+        for (i = 0; i < n; i++) weight[i] = freqs[syms[i]];
+        if (n < 2)
+        {
+            if (n) lens[syms[0]] = 1;
+            return;
+        }
+
+        /* leaves and internal nodes are both created in increasing weight order,
+         * so the two smallest nodes are always at the head of one of the queues */
+        for (leaf = 0, node = next = n; next < 2 * n - 1; next++)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                if (leaf < n && (node >= next || weight[leaf] <= weight[node])) child[j] = leaf++;
+                else child[j] = node++;
+            }
+            weight[next] = weight[child[0]] + weight[child[1]];
+            parent[child[0]] = parent[child[1]] = next;
+        }
+
+        depth[2 * n - 2] = 0;
+        for (i = 2 * n - 2, max_depth = 0; i--;)
+        {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < n && depth[i] > max_depth) max_depth = depth[i];
+        }
+        if (max_depth <= max_bits) break;
+
+        /* flatten the distribution and try again */
+        for (sym = 0; sym < count; sym++)
+            if (freqs[sym]) freqs[sym] = (freqs[sym] + 1) / 2;
+    }
+
+    for (i = 0; i < n; i++) lens[syms[i]] = depth[i];
+}
+
+/* assign canonical codes, shorter codes first and in symbol order for the same length */
+static void huffman_codes( const UCHAR *lens, USHORT *codes, ULONG count, ULONG max_bits )
+{
+    ULONG bl_count[XPRESS_HUFF_MAX_BITS + 1] = {0}, next_code[XPRESS_HUFF_MAX_BITS + 1];
+    ULONG sym, bits, code = 0;
+
+    for (sym = 0; sym < count; sym++) bl_count[lens[sym]]++;
+    bl_count[0] = 0;
+    for (bits = 1; bits <= max_bits; bits++)
+    {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (sym = 0; sym < count; sym++)
+        if (lens[sym]) codes[sym] = next_code[lens[sym]]++;
+}
+
+/* bit writer for XPRESS Huffman; bits are stored in 16-bit little endian words which are
+ * interleaved with the extra length bytes, so that the decoder finds them right after
+ * the words it has already loaded */
+struct xpress_bit_writer
+{
+    UCHAR *next_bits;
+    UCHAR *next_bits2;
+    UCHAR *next_byte;
+    UCHAR *end;
+    ULONG  bitbuf;
+    ULONG  bitcount;
+    BOOL   overflow;
+};
+
+static inline void xpress_write_bits( struct xpress_bit_writer *bw, ULONG bits, ULONG count )
+{
+    bw->bitbuf = (bw->bitbuf << count) | bits;
+    bw->bitcount += count;
+    if (bw->bitcount > 16)
+    {
+        bw->bitcount -= 16;
+        if (bw->end - bw->next_byte < sizeof(WORD))
+        {
+            bw->overflow = TRUE;
+            return;
+        }
+        *(WORD *)bw->next_bits = bw->bitbuf >> bw->bitcount;
+        bw->next_bits  = bw->next_bits2;
+        bw->next_bits2 = bw->next_byte;
+        bw->next_byte += sizeof(WORD);
+    }
+}
+
+static inline void xpress_write_byte( struct xpress_bit_writer *bw, UCHAR byte )
+{
+    if (bw->next_byte >= bw->end) bw->overflow = TRUE;
+    else *bw->next_byte++ = byte;
+}
+
+/* compress data using the Huffman variant of XPRESS */
+static NTSTATUS xpress_huff_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                                     ULONG *final_size, UCHAR *workspace, BOOL maximum)
+{
+    struct xpress_huff_workspace *ws = (struct xpress_huff_workspace *)workspace;
+    ULONG freqs[XPRESS_HUFF_SYMBOLS];
+    UCHAR lens[XPRESS_HUFF_SYMBOLS];
+    USHORT codes[XPRESS_HUFF_SYMBOLS];
+    struct xpress_bit_writer bw;
+    struct lz_match_finder mf;
+    ULONG block = 0, block_end, pos, count, used, i, sym, len, offset, log2;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    BOOL last;
+
+    lz_init( &mf, src, src_size, ws->match, XPRESS_HUFF_HASH_BITS, XPRESS_HUFF_WINDOW, maximum );
+
+    do
+    {
+        /* find the matches of the current block, matches may refer to previous blocks */
+        block_end = min( block + XPRESS_HUFF_BLOCK, src_size );
+        last = (block_end == src_size);
+        memset( freqs, 0, sizeof(freqs) );
+
+        for (pos = block, count = 0; pos < block_end; pos += len, count++)
+        {
+            len = lz_find_match( &mf, pos, pos >= XPRESS_HUFF_WINDOW ? pos - XPRESS_HUFF_WINDOW + 1 : 0,
+                                 min( block_end - pos, 0xffff + 3 ), &offset );
+            /* that match would be symbol 256, which ends the stream once the input is used up */
+            if (len == 3 && offset == 1) len = 0;
+            if (len)
+            {
+                for (log2 = 0; offset >> (log2 + 1); log2++);
+                freqs[256 + (log2 << 4) + min( len - 3, 15 )]++;
+                ws->offset[count] = offset;
+                ws->value[count] = len - 3;
+            }
+            else
+            {
+                freqs[src[pos]]++;
+                ws->offset[count] = 0;
+                ws->value[count] = src[pos];
+                len = 1;
+            }
+            lz_insert( &mf, pos, len );
+        }
+
+        /* the end of the stream is marked with symbol 256 */
+        if (last) freqs[256]++;
+        /* make sure that there are at least two codes */
+        for (i = used = 0; i < XPRESS_HUFF_SYMBOLS; i++) if (freqs[i]) used++;
+        for (i = 0; used < 2; i++) if (!freqs[i]) { freqs[i] = 1; used++; }
+
+        huffman_code_lengths( freqs, lens, XPRESS_HUFF_SYMBOLS, XPRESS_HUFF_MAX_BITS );
+        huffman_codes( lens, codes, XPRESS_HUFF_SYMBOLS, XPRESS_HUFF_MAX_BITS );
+
+        if (dst_end - dst_cur < XPRESS_HUFF_SYMBOLS / 2 + 2 * sizeof(WORD))
+            return STATUS_BUFFER_TOO_SMALL;
+        for (i = 0; i < XPRESS_HUFF_SYMBOLS / 2; i++)
+            dst_cur[i] = lens[2 * i] | (lens[2 * i + 1] << 4);
+
+        bw.next_bits  = dst_cur + XPRESS_HUFF_SYMBOLS / 2;
+        bw.next_bits2 = bw.next_bits + sizeof(WORD);
+        bw.next_byte  = bw.next_bits2 + sizeof(WORD);
+        bw.end        = dst_end;
+        bw.bitbuf     = 0;
+        bw.bitcount   = 0;
+        bw.overflow   = FALSE;
+
+        for (i = 0; i < count; i++)
+        {
+            if (!(offset = ws->offset[i]))
+            {
+                xpress_write_bits( &bw, codes[ws->value[i]], lens[ws->value[i]] );
+                continue;
+            }
+            len = ws->value[i];
+            for (log2 = 0; offset >> (log2 + 1); log2++);
+            sym = 256 + (log2 << 4) + min( len, 15 );
+            xpress_write_bits( &bw, codes[sym], lens[sym] );
+            if (len >= 15)
+            {
+                xpress_write_byte( &bw, min( len - 15, 255 ) );
+                if (len - 15 >= 255)
+                {
+                    xpress_write_byte( &bw, len & 0xff );
+                    xpress_write_byte( &bw, len >> 8 );
+                }
+            }
+            xpress_write_bits( &bw, offset & ((1 << log2) - 1), log2 );
+        }
+        if (last) xpress_write_bits( &bw, codes[256], lens[256] );
+        if (bw.overflow) return STATUS_BUFFER_TOO_SMALL;
+
+        /* flush the remaining bits */
+        *(WORD *)bw.next_bits  = bw.bitbuf << (16 - bw.bitcount);
+        *(WORD *)bw.next_bits2 = 0;
+        dst_cur = bw.next_byte;
+        block = block_end;
+    }
+    while (!last);
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
 /******************************************************************************
  *  RtlCompressBuffer		[NTDLL.@]
  */
@@ -1822,23 +2312,63 @@ NTSTATUS WINAPI RtlCompressBuffer(USHORT format, PUCHAR uncompressed, ULONG unco
                                   PUCHAR compressed, ULONG compressed_size, ULONG chunk_size,
                                   PULONG final_size, PVOID workspace)
 {
-    FIXME("0x%04x, %p, %u, %p, %u, %u, %p, %p: semi-stub\n", format, uncompressed,
+    BOOL maximum = (format & COMPRESSION_ENGINE_MAXIMUM) != 0;
+    void *buffer = NULL;
+    ULONG size;
+    NTSTATUS status;
+
+    TRACE("0x%04x, %p, %u, %p, %u, %u, %p, %p\n", format, uncompressed,
           uncompressed_size, compressed, compressed_size, chunk_size, final_size, workspace);
 
+    if ((status = RtlGetCompressionWorkSpaceSize( format, &size, NULL ))) return status;
+
+    /* the workspace is used for the match finder, be nice to callers which don't pass one */
+    if (!workspace && !(workspace = buffer = RtlAllocateHeap( GetProcessHeap(), 0, size )))
+        return STATUS_NO_MEMORY;
+
     switch (format & ~COMPRESSION_ENGINE_MAXIMUM)
     {
         case COMPRESSION_FORMAT_LZNT1:
-            return lznt1_compress(uncompressed, uncompressed_size, compressed,
-                                  compressed_size, chunk_size, final_size, workspace);
+            status = lznt1_compress(uncompressed, uncompressed_size, compressed,
+                                    compressed_size, chunk_size, final_size, workspace, maximum);
+            break;
 
-        case COMPRESSION_FORMAT_NONE:
-        case COMPRESSION_FORMAT_DEFAULT:
-            return STATUS_INVALID_PARAMETER;
+        case COMPRESSION_FORMAT_XPRESS:
+            status = xpress_compress(uncompressed, uncompressed_size, compressed,
+                                     compressed_size, final_size, workspace, maximum);
+            break;
 
         default:
-            FIXME("format %u not implemented\n", format);
-            return STATUS_UNSUPPORTED_COMPRESSION;
+            status = xpress_huff_compress(uncompressed, uncompressed_size, compressed,
+                                          compressed_size, final_size, workspace, maximum);
+            break;
     }
+
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    return status;
+}
+
+/* copy a match; source and destination can overlap, which repeats the same bytes */
+static inline UCHAR *lz_copy_match( UCHAR *dst_cur, ULONG offset, ULONG length )
+{
+    const UCHAR *src = dst_cur - offset;
+
+    if (offset == 1)
+    {
+        memset( dst_cur, *src, length );
+        return dst_cur + length;
+    }
+    /* the copied bytes repeat with a period of offset, so the non-overlapping
+     * part doubles with every step */
+    while (length > offset)
+    {
+        memcpy( dst_cur, src, offset );
+        dst_cur += offset;
+        length  -= offset;
+        offset <<= 1;
+    }
+    memcpy( dst_cur, src, length );
+    return dst_cur + length;
 }
 
 /* decompress a single LZNT1 chunk */
@@ -1875,14 +2405,10 @@ static UCHAR *lznt1_decompress_chunk(UCHAR *dst, ULONG dst_size, UCHAR *src, ULO
                 if (dst_cur < dst + code_displacement)
                     return NULL;
 
-                /* copy bytes of chunk - we can't use memcpy() since source and dest can
-                 * be overlapping, and the same bytes can be repeated over and over again */
-                while (code_length--)
-                {
-                    if (dst_cur >= dst_end) return dst_cur;
-                    *dst_cur = *(dst_cur - code_displacement);
-                    dst_cur++;
-                }
+                /* copy bytes of chunk, stop when the destination is full */
+                if (code_length > dst_end - dst_cur)
+                    return lz_copy_match(dst_cur, code_displacement, dst_end - dst_cur);
+                dst_cur = lz_copy_match(dst_cur, code_displacement, code_length);
             }
             else
             {
@@ -2018,6 +2544,249 @@ out:
 
 }
 
+/* decompress data encoded with the plain LZ77 variant of XPRESS */
+static NTSTATUS xpress_decompress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                                  ULONG *final_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *nibble = NULL;
+    ULONG flags = 0, flag_count = 0;
+    ULONG length, offset;
+
+    while (dst_cur < dst_end)
+    {
+        if (!flag_count)
+        {
+            if (src_end - src_cur < sizeof(DWORD)) break;
+            flags = *(DWORD *)src_cur;
+            src_cur += sizeof(DWORD);
+            flag_count = 32;
+        }
+        flag_count--;
+
+        if (!(flags & (1u << flag_count)))
+        {
+            /* literal */
+            if (src_cur >= src_end) break;
+            *dst_cur++ = *src_cur++;
+            continue;
+        }
+
+        /* a match flag without any remaining input terminates the stream */
+        if (src_cur == src_end) break;
+        if (src_end - src_cur < sizeof(WORD))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        length = *(WORD *)src_cur;
+        src_cur += sizeof(WORD);
+        offset = (length >> 3) + 1;
+        length &= 7;
+
+        if (length == 7)
+        {
+            if (!nibble)
+            {
+                if (src_cur >= src_end) return STATUS_BAD_COMPRESSION_BUFFER;
+                nibble = src_cur++;
+                length = *nibble & 0xf;
+            }
+            else
+            {
+                length = *nibble >> 4;
+                nibble = NULL;
+            }
+
+            if (length == 15)
+            {
+                if (src_cur >= src_end) return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if (src_end - src_cur < sizeof(WORD)) return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+                    if (!length)
+                    {
+                        if (src_end - src_cur < sizeof(DWORD)) return STATUS_BAD_COMPRESSION_BUFFER;
+                        length = *(DWORD *)src_cur;
+                        src_cur += sizeof(DWORD);
+                    }
+                    if (length < 15 + 7) return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15 + 7;
+                }
+                length += 15;
+            }
+            length += 7;
+        }
+        length += 3;
+
+        if (offset > dst_cur - dst) return STATUS_BAD_COMPRESSION_BUFFER;
+        dst_cur = lz_copy_match( dst_cur, offset, min( length, dst_end - dst_cur ) );
+    }
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* codes up to this length are resolved with a single table lookup */
+#define XPRESS_HUFF_TABLE_BITS  12
+
+struct xpress_huff_decoder
+{
+    USHORT table[1 << XPRESS_HUFF_TABLE_BITS];  /* symbol << 4 | length, 0 if not a short code */
+    USHORT start[XPRESS_HUFF_MAX_BITS + 1];     /* first 15-bit prefix of each code length */
+    USHORT end[XPRESS_HUFF_MAX_BITS + 1];       /* prefix following the last code of each length */
+    USHORT base[XPRESS_HUFF_MAX_BITS + 1];      /* index of the first symbol of each length */
+    USHORT syms[XPRESS_HUFF_SYMBOLS];           /* symbols sorted by code length */
+};
+
+static BOOL xpress_huff_build_decoder( struct xpress_huff_decoder *dec, const UCHAR *lens )
+{
+    ULONG count[XPRESS_HUFF_MAX_BITS + 1] = {0};
+    ULONG sym, bits, i, entry = 0, index = 0, span;
+
+    for (sym = 0; sym < XPRESS_HUFF_SYMBOLS; sym++)
+        count[(lens[sym / 2] >> (4 * (sym & 1))) & 0xf]++;
+
+    memset( dec->table, 0, sizeof(dec->table) );
+    for (bits = 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+    {
+        span = 1 << (XPRESS_HUFF_MAX_BITS - bits);
+        dec->start[bits] = entry;
+        dec->base[bits] = index;
+        if (entry + count[bits] * span > 1 << XPRESS_HUFF_MAX_BITS) return FALSE;
+
+        for (sym = 0; sym < XPRESS_HUFF_SYMBOLS && index - dec->base[bits] < count[bits]; sym++)
+        {
+            if (((lens[sym / 2] >> (4 * (sym & 1))) & 0xf) != bits) continue;
+            dec->syms[index++] = sym;
+            if (bits <= XPRESS_HUFF_TABLE_BITS)
+            {
+                for (i = entry >> (XPRESS_HUFF_MAX_BITS - XPRESS_HUFF_TABLE_BITS);
+                     i < (entry + span) >> (XPRESS_HUFF_MAX_BITS - XPRESS_HUFF_TABLE_BITS); i++)
+                    dec->table[i] = (sym << 4) | bits;
+            }
+            entry += span;
+        }
+        dec->end[bits] = entry;
+    }
+
+    return TRUE;
+}
+
+/* decode a symbol from the next 15 bits, returns FALSE for invalid codes */
+static inline BOOL xpress_huff_decode( const struct xpress_huff_decoder *dec, ULONG next_bits,
+                                       ULONG *sym, ULONG *length )
+{
+    USHORT entry = dec->table[next_bits >> (XPRESS_HUFF_MAX_BITS - XPRESS_HUFF_TABLE_BITS)];
+    ULONG bits;
+
+    if (entry)
+    {
+        *sym    = entry >> 4;
+        *length = entry & 0xf;
+        return TRUE;
+    }
+
+    for (bits = XPRESS_HUFF_TABLE_BITS + 1; bits <= XPRESS_HUFF_MAX_BITS; bits++)
+    {
+        if (next_bits < dec->start[bits] || next_bits >= dec->end[bits]) continue;
+        *sym    = dec->syms[dec->base[bits] + ((next_bits - dec->start[bits]) >> (XPRESS_HUFF_MAX_BITS - bits))];
+        *length = bits;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* decompress data encoded with the Huffman variant of XPRESS */
+static NTSTATUS xpress_huff_decompress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                                       ULONG *final_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *block_end;
+    struct xpress_huff_decoder dec;
+    ULONG next_bits, sym, length, offset, bits;
+    int extra_bits;
+
+/* refill the bit buffer after consuming bits; reading beyond the end of the
+ * input only provides zero bits, which are never consumed by a valid stream */
+#define CONSUME_BITS(count) \
+    do { \
+        next_bits <<= (count); \
+        extra_bits -= (count); \
+        if (extra_bits < 0) \
+        { \
+            if (src_end - src_cur >= sizeof(WORD)) \
+            { \
+                next_bits |= (ULONG)*(WORD *)src_cur << -extra_bits; \
+                src_cur += sizeof(WORD); \
+            } \
+            extra_bits += 16; \
+        } \
+    } while (0)
+
+    while (dst_cur < dst_end && src_end - src_cur >= XPRESS_HUFF_SYMBOLS / 2 + 2 * sizeof(WORD))
+    {
+        if (!xpress_huff_build_decoder( &dec, src_cur ))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        src_cur += XPRESS_HUFF_SYMBOLS / 2;
+
+        next_bits = ((ULONG)*(WORD *)src_cur << 16) | *(WORD *)(src_cur + sizeof(WORD));
+        src_cur += 2 * sizeof(WORD);
+        extra_bits = 16;
+        block_end = dst_cur + min( XPRESS_HUFF_BLOCK, dst_end - dst_cur );
+
+        while (dst_cur < block_end)
+        {
+            if (!xpress_huff_decode( &dec, next_bits >> (32 - XPRESS_HUFF_MAX_BITS), &sym, &bits ))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            CONSUME_BITS(bits);
+
+            if (sym < 256)
+            {
+                *dst_cur++ = sym;
+                continue;
+            }
+            if (sym == 256 && src_cur >= src_end) goto done;
+
+            sym -= 256;
+            length = sym & 0xf;
+            bits = sym >> 4;
+            if (length == 15)
+            {
+                if (src_cur >= src_end) return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+                if (length == 255)
+                {
+                    if (src_end - src_cur < sizeof(WORD)) return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+                    if (length < 15) return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15;
+                }
+                length += 15;
+            }
+            length += 3;
+
+            offset = (bits ? next_bits >> (32 - bits) : 0) | (1 << bits);
+            if (bits) CONSUME_BITS(bits);
+
+            if (offset > dst_cur - dst) return STATUS_BAD_COMPRESSION_BUFFER;
+            dst_cur = lz_copy_match( dst_cur, offset, min( length, dst_end - dst_cur ) );
+        }
+    }
+
+#undef CONSUME_BITS
+
+done:
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
 /******************************************************************************
  *  RtlDecompressFragment	[NTDLL.@]
  */
@@ -2054,8 +2823,20 @@ NTSTATUS WINAPI RtlDecompressBuffer(USHORT format, PUCHAR uncompressed, ULONG un
     TRACE("0x%04x, %p, %u, %p, %u, %p\n", format, uncompressed,
         uncompressed_size, compressed, compressed_size, final_size);
 
-    return RtlDecompressFragment(format, uncompressed, uncompressed_size,
-                                 compressed, compressed_size, 0, final_size, NULL);
+    switch (format & ~COMPRESSION_ENGINE_MAXIMUM)
+    {
+        case COMPRESSION_FORMAT_XPRESS:
+            return xpress_decompress(uncompressed, uncompressed_size, compressed,
+                                     compressed_size, final_size);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            return xpress_huff_decompress(uncompressed, uncompressed_size, compressed,
+                                          compressed_size, final_size);
+
+        default:
+            return RtlDecompressFragment(format, uncompressed, uncompressed_size,
+                                         compressed, compressed_size, 0, final_size, NULL);
+    }
 }
 
 /***********************************************************************
@@ -81,6 +81,9 @@
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #ifdef __APPLE__
 #include <crt_externs.h>
 #include <spawn.h>
@@ -318,6 +321,112 @@ static inline unsigned int wait_reply( struct __server_request_info *req )
 }
 
 
+#ifdef __linux__
+
+#define REQUEST_SHM_SPIN_COUNT 4000
+
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+/***********************************************************************
+ *           can_use_request_shm
+ *
+ * Check whether a request fits in the thread request mailbox.
+ */
+static BOOL can_use_request_shm( const struct __server_request_info *req )
+{
+    request_shm_t *shm = ntdll_get_thread_data()->request_shm;
+    unsigned int i;
+
+    if (!shm) return FALSE;
+    if (req->u.req.request_header.request_size > sizeof(shm->data)) return FALSE;
+    if (req->u.req.request_header.reply_size > sizeof(shm->data)) return FALSE;
+
+    /* let the pipe path report invalid buffers as access violations */
+    for (i = 0; i < req->data_count; i++)
+        if (!virtual_check_buffer_for_read( req->data[i].ptr, req->data[i].size )) return FALSE;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           check_server_alive
+ *
+ * Terminate the thread if the server went away while we were waiting in the mailbox.
+ */
+static void check_server_alive(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = ntdll_get_thread_data()->reply_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll( &pfd, 1, 0 ) == 1 && (pfd.revents & (POLLHUP | POLLERR))) abort_thread(0);
+}
+
+
+/***********************************************************************
+ *           server_call_shm
+ *
+ * Perform a server call through the thread request mailbox.
+ */
+static unsigned int server_call_shm( struct __server_request_info *req )
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    request_shm_t *shm = thread_data->request_shm;
+    static const ULONG64 value = 1;
+    unsigned int i, pos, spin;
+    int state;
+
+    memcpy( &shm->header, &req->u.req, sizeof(req->u.req) );
+    for (i = pos = 0; i < req->data_count; i++)
+    {
+        memcpy( shm->data + pos, req->data[i].ptr, req->data[i].size );
+        pos += req->data[i].size;
+    }
+    __atomic_store_n( &shm->state, REQUEST_SHM_REQUEST, __ATOMIC_SEQ_CST );
+
+    if (write( thread_data->request_notify_fd, &value, sizeof(value) ) != sizeof(value))
+        server_protocol_perror( "write" );
+
+    /* the server usually replies quickly, so spin a bit before going to sleep */
+    if (NtCurrentTeb()->Peb->NumberOfProcessors > 1)
+    {
+        for (spin = 0; spin < REQUEST_SHM_SPIN_COUNT; spin++)
+        {
+            if (__atomic_load_n( &shm->state, __ATOMIC_ACQUIRE ) != REQUEST_SHM_REQUEST) break;
+            small_pause();
+        }
+    }
+
+    while ((state = __atomic_load_n( &shm->state, __ATOMIC_SEQ_CST )) == REQUEST_SHM_REQUEST)
+    {
+        struct timespec timeout = { 0, 100000000 };
+
+        __atomic_store_n( &shm->waiting, 1, __ATOMIC_SEQ_CST );
+        if (syscall( __NR_futex, &shm->state, 0 /* FUTEX_WAIT */, REQUEST_SHM_REQUEST, &timeout, 0, 0 ) == -1 &&
+            errno == ETIMEDOUT)
+            check_server_alive();
+    }
+    shm->waiting = 0;
+    if (state != REQUEST_SHM_REPLY) abort_thread(0);  /* the thread got killed */
+
+    memcpy( &req->u.reply, &shm->header, sizeof(req->u.reply) );
+    if (req->u.reply.reply_header.reply_size)
+        memcpy( req->reply_data, shm->data, req->u.reply.reply_header.reply_size );
+    __atomic_store_n( &shm->state, REQUEST_SHM_IDLE, __ATOMIC_RELEASE );
+    return req->u.reply.reply_header.error;
+}
+
+#endif  /* __linux__ */
+
+
 /***********************************************************************
  *           server_call_unlocked
  */
@@ -326,6 +435,9 @@ unsigned int server_call_unlocked( void *req_ptr )
     struct __server_request_info * const req = req_ptr;
     unsigned int ret;
 
+#ifdef __linux__
+    if (can_use_request_shm( req )) return server_call_shm( req );
+#endif
     if ((ret = send_request( req ))) return ret;
     return wait_reply( req );
 }
@@ -956,6 +1068,9 @@ C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
 
+/* handle table metadata maintained by the server, mapped read-only */
+static const handle_shm_entry_t *handle_shm;
+
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
     unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
@@ -1048,6 +1163,34 @@ int server_remove_fd_from_cache( HANDLE handle )
 }
 
 
+/***********************************************************************
+ *           server_get_handle_info
+ *
+ * Retrieve the access rights and HANDLE_FLAG_* flags of a handle from the
+ * shared handle table, without a server call.
+ * Returns STATUS_NOT_SUPPORTED if the handle is not covered by the table.
+ *
+ * The server writes the flags last, so a valid entry always has its access
+ * rights set. If another thread changes the handle at the same time, the
+ * result can mix the old and new state, which is no different from the
+ * server call returning just before or after the change.
+ */
+NTSTATUS server_get_handle_info( HANDLE handle, unsigned int *access, unsigned int *flags )
+{
+    unsigned int idx = (wine_server_obj_handle( handle ) >> 2) - 1;
+    const volatile handle_shm_entry_t *entry;
+    unsigned int entry_flags;
+
+    if (!handle_shm || idx >= HANDLE_SHM_ENTRIES) return STATUS_NOT_SUPPORTED;
+    entry = handle_shm + idx;
+    entry_flags = __atomic_load_n( &entry->flags, __ATOMIC_ACQUIRE );
+    if (!(entry_flags & HANDLE_SHM_VALID)) return STATUS_INVALID_HANDLE;
+    if (access) *access = entry->access;
+    if (flags) *flags = entry_flags & ~HANDLE_SHM_VALID;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           server_get_unix_fd
  *
@@ -1067,6 +1210,7 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
 
     ret = get_cached_fd( handle, &fd, type, &access, options );
     if (ret != STATUS_INVALID_HANDLE) goto done;
+    if (server_get_handle_info( handle, NULL, NULL ) == STATUS_INVALID_HANDLE) return STATUS_INVALID_HANDLE;
 
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
     ret = get_cached_fd( handle, &fd, type, &access, options );
@@ -1702,6 +1846,93 @@ void server_init_process_done(void)
 }
 
 
+/***********************************************************************
+ *           server_init_request_shm
+ *
+ * Set up the shared memory request mailbox of the current thread, if enabled.
+ */
+static void server_init_request_shm(void)
+{
+#ifdef __linux__
+    static int enabled = -1;
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    int shm_fd = -1, notify_fd = -1;
+    obj_handle_t dummy;
+    sigset_t sigset;
+    void *mem;
+
+    if (enabled == -1)
+    {
+        const char *str = getenv( "WINESHMREQUESTS" );
+        enabled = str && atoi( str );
+        if (enabled) WARN_(winediag)( "Using shared memory server requests\n" );
+    }
+    if (!enabled) return;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+
+    SERVER_START_REQ( get_request_shm )
+    {
+        if (!wine_server_call( req ))
+        {
+            shm_fd = receive_fd( &dummy );
+            notify_fd = receive_fd( &dummy );
+        }
+    }
+    SERVER_END_REQ;
+
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (shm_fd != -1 && notify_fd != -1)
+    {
+        mem = mmap( NULL, sizeof(request_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0 );
+        if (mem != MAP_FAILED)
+        {
+            thread_data->request_shm = mem;
+            thread_data->request_notify_fd = notify_fd;
+            notify_fd = -1;
+        }
+    }
+    if (shm_fd != -1) close( shm_fd );
+    if (notify_fd != -1) close( notify_fd );
+#endif
+}
+
+
+/***********************************************************************
+ *           server_init_handle_shm
+ *
+ * Map the shared handle table metadata of the process.
+ */
+static void server_init_handle_shm(void)
+{
+    static BOOL initialized;
+    obj_handle_t dummy;
+    sigset_t sigset;
+    int fd = -1;
+    void *mem;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (!initialized)
+    {
+        initialized = TRUE;
+        SERVER_START_REQ( get_handle_table_shm )
+        {
+            if (!wine_server_call( req )) fd = receive_fd( &dummy );
+        }
+        SERVER_END_REQ;
+    }
+
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return;
+    mem = mmap( NULL, HANDLE_SHM_ENTRIES * sizeof(*handle_shm), PROT_READ, MAP_SHARED, fd, 0 );
+    if (mem != MAP_FAILED) handle_shm = mem;
+    close( fd );
+}
+
+
 /***********************************************************************
  *           server_init_thread
  *
@@ -1754,6 +1985,8 @@ size_t server_init_thread( void *entry_point, BOOL *suspend )
     /* initialize thread shared memory pointers */
     NtCurrentTeb()->Reserved5[1] = server_get_shared_memory( 0 );
     NtCurrentTeb()->Reserved5[2] = server_get_shared_memory( NtCurrentTeb()->ClientId.UniqueThread );
+    if (!ret) server_init_request_shm();
+    if (!ret) server_init_handle_shm();
 
     is_wow64 = !is_win64 && (server_cpus & ((1 << CPU_x86_64) | (1 << CPU_ARM64))) != 0;
     ntdll_get_thread_data()->wow64_redir = is_wow64;
@@ -59,6 +59,7 @@
 #include "winternl.h"
 #include "wine/server.h"
 #include "wine/debug.h"
+#include "wine/list.h"
 
 #include "ntdll_misc.h"
 #include "esync.h"
@@ -2541,65 +2542,140 @@ static BOOL compare_addr( const void *addr, const void *cmp, SIZE_T size )
 #ifdef __linux__
 /* We can't map addresses to futex directly, because an application can wait on
  * 8 bytes, and we can't pass all 8 as the compare value to futex(). Instead we
- * map all addresses to a small fixed table of futexes. This may result in
- * spurious wakes, but the application is already expected to handle those. */
+ * hash addresses to a table of buckets, each with its own lock and a list of
+ * the threads waiting on addresses in that bucket. Every waiter sleeps on a
+ * futex of its own, so wakes only ever reach threads waiting on the same
+ * address and unrelated addresses don't contend on a common lock. */
 
-static int addr_futex_table[256];
+struct addr_wait_entry
+{
+    struct list entry;
+    const void *addr;
+    int         woken;
+};
+
+struct addr_wait_bucket
+{
+    int         lock;     /* 0 - unlocked, 1 - locked, 2 - locked with waiters */
+    struct list waiters;
+} DECLSPEC_ALIGN(64);
+
+static struct addr_wait_bucket addr_wait_table[256];
 
-static inline int *hash_addr( const void *addr )
+static inline struct addr_wait_bucket *hash_addr( const void *addr )
 {
     ULONG_PTR val = (ULONG_PTR)addr;
 
-    return &addr_futex_table[(val >> 2) & 255];
+    val ^= val >> 12;
+    return &addr_wait_table[(val >> 3) % ARRAY_SIZE(addr_wait_table)];
+}
+
+static void lock_addr_bucket( struct addr_wait_bucket *bucket )
+{
+    int val;
+
+    if (!(val = InterlockedCompareExchange( &bucket->lock, 1, 0 ))) return;
+    do
+    {
+        if (val == 2 || InterlockedCompareExchange( &bucket->lock, 2, 1 ))
+            futex_wait( &bucket->lock, 2, NULL );
+    } while ((val = InterlockedCompareExchange( &bucket->lock, 2, 0 )));
+}
+
+static void unlock_addr_bucket( struct addr_wait_bucket *bucket )
+{
+    if (InterlockedExchange( &bucket->lock, 0 ) == 2)
+        futex_wake( &bucket->lock, 1 );
 }
 
 static inline NTSTATUS fast_wait_addr( const void *addr, const void *cmp, SIZE_T size,
                                        const LARGE_INTEGER *timeout )
 {
-    int *futex;
-    int val;
+    struct addr_wait_bucket *bucket;
+    struct addr_wait_entry wait;
     struct timespec timespec;
+    LARGE_INTEGER deadline;
     int ret;
 
     if (!use_futexes())
         return STATUS_NOT_IMPLEMENTED;
 
-    futex = hash_addr( addr );
+    bucket = hash_addr( addr );
+
+    /* retries after EINTR or a spurious wakeup only wait for the remaining time */
+    if (timeout)
+    {
+        deadline = *timeout;
+        if (deadline.QuadPart <= 0)
+        {
+            NtQuerySystemTime( &deadline );
+            deadline.QuadPart -= timeout->QuadPart;
+        }
+    }
 
-    /* We must read the previous value of the futex before checking the value
-     * of the address being waited on. That way, if we receive a wake between
-     * now and waiting on the futex, we know that val will have changed.
-     * Use an atomic load so that memory accesses are ordered between this read
-     * and the increment below. */
-    val = InterlockedCompareExchange( futex, 0, 0 );
+    /* The value has to be compared with the bucket locked. Wakers take the
+     * same lock after changing it, so either we see the new value or they
+     * see our entry in the list. */
+    lock_addr_bucket( bucket );
+    if (!bucket->waiters.next) list_init( &bucket->waiters );
     if (!compare_addr( addr, cmp, size ))
+    {
+        unlock_addr_bucket( bucket );
         return STATUS_SUCCESS;
+    }
+    wait.addr  = addr;
+    wait.woken = 0;
+    list_add_tail( &bucket->waiters, &wait.entry );
+    unlock_addr_bucket( bucket );
 
-    if (timeout)
+    while (!InterlockedCompareExchange( &wait.woken, 0, 0 ))
     {
-        timespec_from_timeout( &timespec, timeout );
-        ret = futex_wait( futex, val, &timespec );
+        if (timeout)
+        {
+            timespec_from_timeout( &timespec, &deadline );
+            if (timespec.tv_sec < 0 || (!timespec.tv_sec && timespec.tv_nsec <= 0)) break;
+        }
+        ret = futex_wait( &wait.woken, 0, timeout ? &timespec : NULL );
+        if (ret == -1 && errno == ETIMEDOUT) break;
     }
-    else
-        ret = futex_wait( futex, val, NULL );
 
-    if (ret == -1 && errno == ETIMEDOUT)
-        return STATUS_TIMEOUT;
-    return STATUS_SUCCESS;
+    if (InterlockedCompareExchange( &wait.woken, 0, 0 ))
+        return STATUS_SUCCESS;
+
+    /* We timed out, but may have been woken in the meantime. In that case
+     * report success, so that the wake isn't lost. */
+    lock_addr_bucket( bucket );
+    if (!wait.woken) list_remove( &wait.entry );
+    unlock_addr_bucket( bucket );
+    return wait.woken ? STATUS_SUCCESS : STATUS_TIMEOUT;
 }
 
-static inline NTSTATUS fast_wake_addr( const void *addr )
+static inline NTSTATUS fast_wake_addr( const void *addr, int count )
 {
-    int *futex;
+    struct addr_wait_bucket *bucket;
+    struct addr_wait_entry *wait, *next;
 
     if (!use_futexes())
         return STATUS_NOT_IMPLEMENTED;
 
-    futex = hash_addr( addr );
+    bucket = hash_addr( addr );
 
-    InterlockedIncrement( futex );
-
-    futex_wake( futex, INT_MAX );
+    lock_addr_bucket( bucket );
+    if (bucket->waiters.next)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiters, struct addr_wait_entry, entry )
+        {
+            if (wait->addr != addr) continue;
+            list_remove( &wait->entry );
+            /* The waiter may return as soon as it sees the flag, so the
+             * entry must not be touched afterwards. A late futex wake on its
+             * stack is harmless, futex waiters always recheck their value. */
+            InterlockedExchange( &wait->woken, 1 );
+            futex_wake( &wait->woken, 1 );
+            if (!--count) break;
+        }
+    }
+    unlock_addr_bucket( bucket );
     return STATUS_SUCCESS;
 }
 #else
@@ -2609,7 +2685,7 @@ static inline NTSTATUS fast_wait_addr( const void *addr, const void *cmp, SIZE_T
     return STATUS_NOT_IMPLEMENTED;
 }
 
-static inline NTSTATUS fast_wake_addr( const void *addr )
+static inline NTSTATUS fast_wake_addr( const void *addr, int count )
 {
     return STATUS_NOT_IMPLEMENTED;
 }
@@ -2658,7 +2734,7 @@ NTSTATUS WINAPI RtlWaitOnAddress( const void *addr, const void *cmp, SIZE_T size
  */
 void WINAPI RtlWakeAddressAll( const void *addr )
 {
-    if (fast_wake_addr( addr ) != STATUS_NOT_IMPLEMENTED)
+    if (fast_wake_addr( addr, INT_MAX ) != STATUS_NOT_IMPLEMENTED)
         return;
 
     RtlEnterCriticalSection( &addr_section );
@@ -2671,7 +2747,7 @@ void WINAPI RtlWakeAddressAll( const void *addr )
  */
 void WINAPI RtlWakeAddressSingle( const void *addr )
 {
-    if (fast_wake_addr( addr ) != STATUS_NOT_IMPLEMENTED)
+    if (fast_wake_addr( addr, 1 ) != STATUS_NOT_IMPLEMENTED)
         return;
 
     RtlEnterCriticalSection( &addr_section );
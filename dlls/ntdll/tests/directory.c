@@ -877,6 +877,146 @@ static void test_redirection(void)
     pRtlWow64EnableFsRedirectionEx( old, &cur );
 }
 
+static unsigned int count_dir_files( const char *dir, const char *find, BOOL *found )
+{
+    WIN32_FIND_DATAA data;
+    char mask[MAX_PATH];
+    unsigned int count = 0;
+    HANDLE h;
+
+    *found = FALSE;
+    sprintf( mask, "%s\\*", dir );
+    h = FindFirstFileA( mask, &data );
+    ok( h != INVALID_HANDLE_VALUE, "FindFirstFile failed, error %u\n", GetLastError() );
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    do
+    {
+        if (!strcmp( data.cFileName, find )) *found = TRUE;
+        count++;
+    } while (FindNextFileA( h, &data ));
+    FindClose( h );
+    return count;
+}
+
+static void test_directory_listing_changes(void)
+{
+    unsigned int i, count, files = 100;
+    char testdir[MAX_PATH], name[MAX_PATH];
+    BOOL found;
+    HANDLE h;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "listing.tmp" );
+    CreateDirectoryA( testdir, NULL );
+    for (i = 0; i < files; i++)
+    {
+        sprintf( name, "%s\\file%05u", testdir, i );
+        h = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", name, GetLastError() );
+        CloseHandle( h );
+    }
+
+    /* listings of directories modified within the last second are never reused */
+    Sleep( 2500 );
+    for (i = 0; i < 3; i++)
+    {
+        count = count_dir_files( testdir, "", &found );
+        ok( count == files + 2, "got %u files\n", count );
+    }
+
+    /* a reused listing must not hide new or removed files */
+    sprintf( name, "%s\\newfile", testdir );
+    h = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", name, GetLastError() );
+    CloseHandle( h );
+    count = count_dir_files( testdir, "newfile", &found );
+    ok( count == files + 3, "got %u files\n", count );
+    ok( found, "newfile not found\n" );
+
+    ok( DeleteFileA( name ), "failed to delete %s, error %u\n", name, GetLastError() );
+    count = count_dir_files( testdir, "newfile", &found );
+    ok( count == files + 2, "got %u files\n", count );
+    ok( !found, "newfile still found\n" );
+
+    for (i = 0; i < files; i++)
+    {
+        sprintf( name, "%s\\file%05u", testdir, i );
+        DeleteFileA( name );
+    }
+    RemoveDirectoryA( testdir );
+}
+
+static void test_large_directory_case(void)
+{
+    unsigned int i, j, dirs = 2, files = 200;  /* enough entries to get the names cached */
+    char testdir[MAX_PATH], dirname[MAX_PATH], name[MAX_PATH];
+    HANDLE h;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "largedir.tmp" );
+    CreateDirectoryA( testdir, NULL );
+
+    for (i = 0; i < dirs; i++)
+    {
+        sprintf( dirname, "%s\\dir%u", testdir, i );
+        CreateDirectoryA( dirname, NULL );
+        for (j = 0; j < files; j++)
+        {
+            sprintf( name, "%s\\File%05u.Txt", dirname, j );
+            h = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+            ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", name, GetLastError() );
+            CloseHandle( h );
+        }
+    }
+
+    for (i = 0; i < dirs; i++)
+    {
+        for (j = 0; j < files; j++)
+        {
+            sprintf( name, "%s\\DIR%u\\fILE%05u.tXT", testdir, i, j );
+            h = CreateFileA( name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+            ok( h != INVALID_HANDLE_VALUE, "failed to open %s, error %u\n", name, GetLastError() );
+            CloseHandle( h );
+        }
+    }
+
+    /* names added or removed after a directory has been looked up must be seen */
+
+    sprintf( name, "%s\\dir0\\NewFile.Txt", testdir );
+    h = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", name, GetLastError() );
+    CloseHandle( h );
+    sprintf( name, "%s\\DIR0\\newfile.TXT", testdir );
+    h = CreateFileA( name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to open %s, error %u\n", name, GetLastError() );
+    CloseHandle( h );
+    ok( DeleteFileA( name ), "failed to delete %s, error %u\n", name, GetLastError() );
+    h = CreateFileA( name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    ok( h == INVALID_HANDLE_VALUE, "%s still exists\n", name );
+    ok( GetLastError() == ERROR_FILE_NOT_FOUND, "got error %u\n", GetLastError() );
+
+    sprintf( name, "%s\\dir0\\File00000.Txt", testdir );
+    sprintf( dirname, "%s\\dir0\\Renamed.Txt", testdir );
+    ok( MoveFileA( name, dirname ), "failed to rename %s, error %u\n", name, GetLastError() );
+    sprintf( name, "%s\\dir0\\FILE00000.TXT", testdir );
+    ok( GetFileAttributesA( name ) == INVALID_FILE_ATTRIBUTES, "%s still exists\n", name );
+    sprintf( name, "%s\\dir0\\RENAMED.TXT", testdir );
+    ok( GetFileAttributesA( name ) != INVALID_FILE_ATTRIBUTES, "%s not found\n", name );
+    ok( DeleteFileA( name ), "failed to delete %s, error %u\n", name, GetLastError() );
+
+    for (i = 0; i < dirs; i++)
+    {
+        for (j = 0; j < files; j++)
+        {
+            sprintf( name, "%s\\dir%u\\File%05u.Txt", testdir, i, j );
+            DeleteFileA( name );
+        }
+        sprintf( dirname, "%s\\dir%u", testdir, i );
+        RemoveDirectoryA( dirname );
+    }
+    RemoveDirectoryA( testdir );
+}
+
 START_TEST(directory)
 {
     WCHAR sysdir[MAX_PATH];
@@ -905,5 +1045,7 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_large_directory_case();
+    test_directory_listing_changes();
     test_redirection();
 }
@@ -2193,6 +2193,125 @@ static void test_mutant(void)
     NtClose( mutant );
 }
 
+static void init_indexed_name( UNICODE_STRING *str, WCHAR *buffer, const char *prefix, unsigned int index )
+{
+    char name[32];
+    int i, len = sprintf( name, "%s%u", prefix, index );
+
+    for (i = 0; i < len; i++) buffer[i] = name[i];
+    str->Buffer = buffer;
+    str->Length = str->MaximumLength = len * sizeof(WCHAR);
+}
+
+static void test_many_names(void)
+{
+    unsigned int i, count = 2000;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING str;
+    WCHAR buffer[32];
+    HANDLE dir, h, *handles;
+    NTSTATUS status;
+
+    InitializeObjectAttributes( &attr, NULL, 0, 0, NULL );
+    status = pNtCreateDirectoryObject( &dir, GENERIC_ALL, &attr );
+    ok( !status, "NtCreateDirectoryObject failed %08x\n", status );
+    handles = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*handles) );
+
+    InitializeObjectAttributes( &attr, &str, 0, dir, NULL );
+    for (i = 0; i < count; i++)
+    {
+        init_indexed_name( &str, buffer, "event", i );
+        status = pNtCreateEvent( &handles[i], GENERIC_ALL, &attr, NotificationEvent, FALSE );
+        if (status) break;
+    }
+    ok( !status, "%u: NtCreateEvent failed %08x\n", i, status );
+    count = i;
+
+    /* lookups must keep working while the namespace grows and after it has been rehashed */
+    attr.Attributes = OBJ_CASE_INSENSITIVE;
+    for (i = 0; i < count; i++)
+    {
+        init_indexed_name( &str, buffer, "EVENT", i );
+        status = pNtOpenEvent( &h, GENERIC_ALL, &attr );
+        if (status) break;
+        pNtClose( h );
+    }
+    ok( !status, "%u: NtOpenEvent failed %08x\n", i, status );
+
+    init_indexed_name( &str, buffer, "event", count );
+    status = pNtOpenEvent( &h, GENERIC_ALL, &attr );
+    ok( status == STATUS_OBJECT_NAME_NOT_FOUND, "NtOpenEvent returned %08x\n", status );
+
+    for (i = 0; i < count; i += 2) pNtClose( handles[i] );
+    for (i = 0; i < count; i++)
+    {
+        init_indexed_name( &str, buffer, "event", i );
+        status = pNtOpenEvent( &h, GENERIC_ALL, &attr );
+        if (status != ((i & 1) ? STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND)) break;
+        if (!status) pNtClose( h );
+    }
+    ok( i == count, "%u: NtOpenEvent returned %08x\n", i, status );
+
+    for (i = 1; i < count; i += 2) pNtClose( handles[i] );
+    HeapFree( GetProcessHeap(), 0, handles );
+    pNtClose( dir );
+}
+
+static void test_handle_churn(void)
+{
+    unsigned int i, count = 1000;
+    OBJECT_DATA_INFORMATION info;
+    HANDLE event, h, prev = 0;
+    NTSTATUS status;
+    ULONG len;
+    BOOL ret;
+
+    event = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ok( event != NULL, "CreateEvent failed %u\n", GetLastError() );
+
+    for (i = 0; i < count; i++)
+    {
+        ret = DuplicateHandle( GetCurrentProcess(), event, GetCurrentProcess(), &h, 0, FALSE,
+                               DUPLICATE_SAME_ACCESS );
+        if (!ret) break;
+        status = pNtClose( h );
+        if (status) break;
+        prev = h;
+    }
+    ok( i == count, "%u: DuplicateHandle/NtClose failed %u %08x\n", i, GetLastError(), status );
+
+    /* a closed handle must be seen as invalid right away */
+    status = pNtClose( prev );
+    ok( status == STATUS_INVALID_HANDLE, "NtClose returned %08x\n", status );
+    status = pNtQueryObject( prev, ObjectDataInformation, &info, sizeof(info), &len );
+    ok( status == STATUS_INVALID_HANDLE, "NtQueryObject returned %08x\n", status );
+
+    ret = DuplicateHandle( GetCurrentProcess(), event, GetCurrentProcess(), &h, 0, TRUE,
+                           DUPLICATE_SAME_ACCESS );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    len = 0;
+    memset( &info, 0xcc, sizeof(info) );
+    status = pNtQueryObject( h, ObjectDataInformation, &info, sizeof(info), &len );
+    ok( !status, "NtQueryObject failed %08x\n", status );
+    ok( len == sizeof(info), "wrong len %u\n", len );
+    ok( info.InheritHandle, "handle not inheritable\n" );
+    ok( !info.ProtectFromClose, "handle protected from close\n" );
+
+    ret = SetHandleInformation( h, HANDLE_FLAG_INHERIT | HANDLE_FLAG_PROTECT_FROM_CLOSE,
+                                HANDLE_FLAG_PROTECT_FROM_CLOSE );
+    ok( ret, "SetHandleInformation failed %u\n", GetLastError() );
+    status = pNtQueryObject( h, ObjectDataInformation, &info, sizeof(info), &len );
+    ok( !status, "NtQueryObject failed %08x\n", status );
+    ok( !info.InheritHandle, "handle inheritable\n" );
+    ok( info.ProtectFromClose, "handle not protected from close\n" );
+
+    ret = SetHandleInformation( h, HANDLE_FLAG_PROTECT_FROM_CLOSE, 0 );
+    ok( ret, "SetHandleInformation failed %u\n", GetLastError() );
+    status = pNtClose( h );
+    ok( !status, "NtClose failed %08x\n", status );
+    pNtClose( event );
+}
+
 static void test_wait_on_address(void)
 {
     DWORD ticks;
@@ -2332,6 +2451,8 @@ START_TEST(om)
     test_name_collisions();
     test_name_limits();
     test_directory();
+    test_many_names();
+    test_handle_churn();
     test_symboliclink();
     test_query_object();
     test_query_object_types();
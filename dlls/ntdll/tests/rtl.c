@@ -2465,7 +2465,6 @@ static void test_RtlCompressBuffer(void)
                                buf1, sizeof(buf1), 4096, &final_size, workspace);
     ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
     ok((*(WORD *)buf1 & 0x7000) == 0x3000, "no chunk signature found %04x\n", *(WORD *)buf1);
-    todo_wine
     ok(final_size < sizeof(test_buffer), "got wrong final_size %u\n", final_size);
 
     /* test decompression */
@@ -2520,6 +2519,24 @@ static void test_RtlGetCompressionWorkSpaceSize(void)
     ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
     ok(compress_workspace != 0, "got wrong compress_workspace %u\n", compress_workspace);
     ok(decompress_workspace == 0x1000, "got wrong decompress_workspace %u\n", decompress_workspace);
+
+    /* test XPRESS and XPRESS Huffman */
+    compress_workspace = decompress_workspace = 0xdeadbeef;
+    status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_XPRESS, &compress_workspace,
+                                            &decompress_workspace);
+    if (status == STATUS_UNSUPPORTED_COMPRESSION)
+    {
+        win_skip("XPRESS compression not supported\n");
+        return;
+    }
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(compress_workspace != 0, "got wrong compress_workspace %u\n", compress_workspace);
+
+    compress_workspace = decompress_workspace = 0xdeadbeef;
+    status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_XPRESS_HUFF, &compress_workspace,
+                                            &decompress_workspace);
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(compress_workspace != 0, "got wrong compress_workspace %u\n", compress_workspace);
 }
 
 /* helper for test_RtlDecompressBuffer, checks if a chunk is incomplete */
@@ -2959,6 +2976,209 @@ static void test_RtlDecompressBuffer(void)
 #undef DECOMPRESS_BROKEN_FRAGMENT
 #undef DECOMPRESS_BROKEN_TRUNCATED
 
+static void test_RtlDecompressBuffer_xpress(void)
+{
+    /* examples from the MS-XCA specification */
+    static const UCHAR xpress_alphabet[] =
+    {
+        0x3f, 0x00, 0x00, 0x00, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l',
+        'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'
+    };
+    static const UCHAR xpress_abc[] =
+    {
+        0xff, 0xff, 0xff, 0x1f, 'a', 'b', 'c', 0x17, 0x00, 0x0f, 0xff, 0x26, 0x01
+    };
+    UCHAR xpress_huff_abc[260], buf[0x200];
+    ULONG final_size, i;
+    NTSTATUS status;
+
+    final_size = 0xdeadbeef;
+    memset(buf, 0x11, sizeof(buf));
+    status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, buf, sizeof(buf), (UCHAR *)xpress_alphabet,
+                                 sizeof(xpress_alphabet), &final_size);
+    if (status == STATUS_UNSUPPORTED_COMPRESSION)
+    {
+        win_skip("XPRESS compression not supported\n");
+        return;
+    }
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(final_size == 26, "got wrong final_size %u\n", final_size);
+    ok(!memcmp(buf, "abcdefghijklmnopqrstuvwxyz", 26), "got wrong decoded data\n");
+    ok(buf[26] == 0x11, "too many bytes written\n");
+
+    final_size = 0xdeadbeef;
+    memset(buf, 0x11, sizeof(buf));
+    status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, buf, sizeof(buf), (UCHAR *)xpress_abc,
+                                 sizeof(xpress_abc), &final_size);
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(final_size == 300, "got wrong final_size %u\n", final_size);
+    for (i = 0; i < 300; i++) if (buf[i] != "abc"[i % 3]) break;
+    ok(i == 300, "got wrong decoded data at %u\n", i);
+    ok(buf[300] == 0x11, "too many bytes written\n");
+
+    /* truncated output */
+    final_size = 0xdeadbeef;
+    memset(buf, 0x11, sizeof(buf));
+    status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, buf, 100, (UCHAR *)xpress_abc,
+                                 sizeof(xpress_abc), &final_size);
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(final_size == 100, "got wrong final_size %u\n", final_size);
+    ok(buf[100] == 0x11, "too many bytes written\n");
+
+    /* "abc" with XPRESS Huffman, four 2-bit codes followed by the end of data symbol */
+    memset(xpress_huff_abc, 0, sizeof(xpress_huff_abc));
+    xpress_huff_abc[0x30] = 0x20;
+    xpress_huff_abc[0x31] = 0x22;
+    xpress_huff_abc[0x80] = 0x02;
+    xpress_huff_abc[0x101] = 0x1b;
+
+    final_size = 0xdeadbeef;
+    memset(buf, 0x11, sizeof(buf));
+    status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS_HUFF, buf, sizeof(buf), xpress_huff_abc,
+                                 sizeof(xpress_huff_abc), &final_size);
+    ok(status == STATUS_SUCCESS, "got wrong status 0x%08x\n", status);
+    ok(final_size == 3, "got wrong final_size %u\n", final_size);
+    ok(!memcmp(buf, "abc", 3), "got wrong decoded data\n");
+    ok(buf[3] == 0x11, "too many bytes written\n");
+
+    /* invalid backwards reference */
+    final_size = 0xdeadbeef;
+    status = RtlDecompressBuffer(COMPRESSION_FORMAT_XPRESS, buf, sizeof(buf), (UCHAR *)xpress_abc + 4,
+                                 sizeof(xpress_abc) - 4, &final_size);
+    ok(status == STATUS_BAD_COMPRESSION_BUFFER, "got wrong status 0x%08x\n", status);
+}
+
+/* fill a buffer with text like data, random bytes and runs */
+static void fill_compression_corpus(UCHAR *buf, ULONG size)
+{
+    static const char *words[] = { "Wine ", "is ", "not ", "an ", "emulator ", "compress ", "buffer ",
+                                   "the ", "quick ", "brown ", "fox ", "\r\n" };
+    ULONG i = 0, seed = 0x1234, len;
+    const char *word;
+
+    while (i < size)
+    {
+        switch (RtlRandom(&seed) % 4)
+        {
+        case 0:
+        case 1:
+            for (len = 0; len < 64 && i < size; len++)
+            {
+                word = words[RtlRandom(&seed) % ARRAY_SIZE(words)];
+                while (*word && i < size) buf[i++] = *word++;
+            }
+            break;
+        case 2:
+            for (len = RtlRandom(&seed) % 256; len && i < size; len--) buf[i++] = RtlRandom(&seed);
+            break;
+        case 3:
+            for (len = RtlRandom(&seed) % 1024; len && i < size; len--) buf[i++] = 0;
+            break;
+        }
+    }
+}
+
+static void test_compression_roundtrip(void)
+{
+    static const USHORT formats[] =
+    {
+        COMPRESSION_FORMAT_LZNT1,
+        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM,
+        COMPRESSION_FORMAT_XPRESS,
+        COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM,
+        COMPRESSION_FORMAT_XPRESS_HUFF,
+        COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM,
+    };
+    static const ULONG sizes[] = { 1, 3, 100, 4095, 4096, 4097, 65535, 65536, 65537, 200000 };
+    static const char text[] = "The quick brown fox jumps over the lazy dog. ";
+    const ULONG size = 256 * 1024;
+    ULONG compress_workspace, decompress_workspace, final_size, compressed_size, i, j, k;
+    UCHAR *src, *compressed, *dst, *workspace;
+    NTSTATUS status;
+
+    src = HeapAlloc(GetProcessHeap(), 0, size);
+    compressed = HeapAlloc(GetProcessHeap(), 0, size + size / 8 + 0x1000);
+    dst = HeapAlloc(GetProcessHeap(), 0, size + 1);
+    fill_compression_corpus(src, size);
+
+    for (i = 0; i < ARRAY_SIZE(formats); i++)
+    {
+        status = RtlGetCompressionWorkSpaceSize(formats[i], &compress_workspace, &decompress_workspace);
+        if (status == STATUS_UNSUPPORTED_COMPRESSION)
+        {
+            win_skip("format 0x%04x not supported\n", formats[i]);
+            continue;
+        }
+        ok(status == STATUS_SUCCESS, "format 0x%04x: got wrong status 0x%08x\n", formats[i], status);
+        workspace = HeapAlloc(GetProcessHeap(), 0, compress_workspace);
+
+        for (j = 0; j < ARRAY_SIZE(sizes); j++)
+        {
+            status = RtlCompressBuffer(formats[i], src, sizes[j], compressed, size + size / 8 + 0x1000,
+                                       4096, &compressed_size, workspace);
+            ok(status == STATUS_SUCCESS, "format 0x%04x, size %u: got wrong status 0x%08x\n",
+               formats[i], sizes[j], status);
+
+            memset(dst, 0x11, sizes[j] + 1);
+            final_size = 0xdeadbeef;
+            status = RtlDecompressBuffer(formats[i] & ~COMPRESSION_ENGINE_MAXIMUM, dst, sizes[j] + 1,
+                                         compressed, compressed_size, &final_size);
+            ok(status == STATUS_SUCCESS, "format 0x%04x, size %u: got wrong status 0x%08x\n",
+               formats[i], sizes[j], status);
+            ok(final_size == sizes[j], "format 0x%04x, size %u: got wrong final_size %u\n",
+               formats[i], sizes[j], final_size);
+            ok(!memcmp(dst, src, sizes[j]), "format 0x%04x, size %u: got wrong decoded data\n",
+               formats[i], sizes[j]);
+            ok(dst[sizes[j]] == 0x11, "format 0x%04x, size %u: too many bytes written\n",
+               formats[i], sizes[j]);
+        }
+
+        /* inputs ending in a short run, which can be encoded as a match at offset 1 */
+        for (j = 4; j < 200; j++)
+        {
+            if (j < 16) memset(src, 'a', j);
+            else
+            {
+                for (k = 0; k < j - 4; k++) src[k] = text[k % (sizeof(text) - 1)];
+                memcpy(src + j - 4, "zzzz", 4);
+            }
+
+            status = RtlCompressBuffer(formats[i], src, j, compressed, size + size / 8 + 0x1000,
+                                       4096, &compressed_size, workspace);
+            ok(status == STATUS_SUCCESS, "format 0x%04x, size %u: got wrong status 0x%08x\n",
+               formats[i], j, status);
+
+            memset(dst, 0x11, j + 1);
+            final_size = 0xdeadbeef;
+            status = RtlDecompressBuffer(formats[i] & ~COMPRESSION_ENGINE_MAXIMUM, dst, j + 1,
+                                         compressed, compressed_size, &final_size);
+            ok(status == STATUS_SUCCESS, "format 0x%04x, size %u: got wrong status 0x%08x\n",
+               formats[i], j, status);
+            ok(final_size == j, "format 0x%04x, size %u: got wrong final_size %u\n", formats[i], j, final_size);
+            ok(!memcmp(dst, src, j), "format 0x%04x, size %u: got wrong decoded data\n", formats[i], j);
+        }
+        fill_compression_corpus(src, size);
+
+        /* the whole corpus, which is mostly compressible */
+        status = RtlCompressBuffer(formats[i], src, size, compressed, size + size / 8 + 0x1000,
+                                   4096, &compressed_size, workspace);
+        ok(status == STATUS_SUCCESS, "format 0x%04x: got wrong status 0x%08x\n", formats[i], status);
+        ok(compressed_size < size * 3 / 4, "format 0x%04x: got compressed size %u\n", formats[i], compressed_size);
+
+        status = RtlDecompressBuffer(formats[i] & ~COMPRESSION_ENGINE_MAXIMUM, dst, size,
+                                     compressed, compressed_size, &final_size);
+        ok(status == STATUS_SUCCESS, "format 0x%04x: got wrong status 0x%08x\n", formats[i], status);
+        ok(final_size == size && !memcmp(dst, src, size), "format 0x%04x: got wrong decoded data\n",
+           formats[i]);
+
+        HeapFree(GetProcessHeap(), 0, workspace);
+    }
+
+    HeapFree(GetProcessHeap(), 0, src);
+    HeapFree(GetProcessHeap(), 0, compressed);
+    HeapFree(GetProcessHeap(), 0, dst);
+}
+
 struct critsect_locked_info
 {
     CRITICAL_SECTION crit;
@@ -3596,6 +3816,8 @@ START_TEST(rtl)
     test_RtlCompressBuffer();
     test_RtlGetCompressionWorkSpaceSize();
     test_RtlDecompressBuffer();
+    test_RtlDecompressBuffer_xpress();
+    test_compression_roundtrip();
     test_RtlIsCriticalSectionLocked();
     test_RtlInitializeCriticalSectionEx();
     test_RtlLeaveCriticalSection();
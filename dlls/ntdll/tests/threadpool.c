@@ -732,6 +732,85 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+struct post_info
+{
+    TP_POOL *pool;
+    unsigned int count;
+    LONG total;
+    LONG done;
+    HANDLE event;
+};
+
+static void CALLBACK post_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct post_info *info = userdata;
+    if (InterlockedIncrement(&info->done) == info->total)
+        SetEvent(info->event);
+}
+
+static DWORD WINAPI post_thread(void *arg)
+{
+    struct post_info *info = arg;
+    TP_CALLBACK_ENVIRON environment;
+    NTSTATUS status;
+    unsigned int i;
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = info->pool;
+    for (i = 0; i < info->count; i++)
+    {
+        status = pTpSimpleTryPost(post_cb, info, &environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    return 0;
+}
+
+static void test_tp_concurrent_post(void)
+{
+    static const unsigned int thread_counts[] = {1, 4};
+    unsigned int i, j;
+    HANDLE threads[4];
+    struct post_info info;
+    NTSTATUS status;
+    DWORD result;
+
+    info.count = 500;
+    info.event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(info.event != NULL, "CreateEventW failed %u\n", GetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(thread_counts); i++)
+    {
+        info.pool = NULL;
+        status = pTpAllocPool(&info.pool, NULL);
+        ok(!status, "TpAllocPool failed with status %x\n", status);
+        ok(info.pool != NULL, "expected pool != NULL\n");
+
+        info.total = thread_counts[i] * info.count;
+        info.done = 0;
+        ResetEvent(info.event);
+
+        for (j = 0; j < thread_counts[i]; j++)
+        {
+            threads[j] = CreateThread(NULL, 0, post_thread, &info, 0, NULL);
+            ok(threads[j] != NULL, "CreateThread failed %u\n", GetLastError());
+        }
+        for (j = 0; j < thread_counts[i]; j++)
+        {
+            result = WaitForSingleObject(threads[j], 30000);
+            ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+            CloseHandle(threads[j]);
+        }
+        result = WaitForSingleObject(info.event, 30000);
+        ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+        ok(info.done == info.total, "expected %d callbacks, got %d\n", info.total, info.done);
+
+        pTpReleasePool(info.pool);
+    }
+
+    CloseHandle(info.event);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -2244,6 +2323,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_concurrent_post();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
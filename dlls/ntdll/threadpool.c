@@ -125,8 +125,20 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_SURPLUS_WORKER_TIMEOUT 500
+#define THREADPOOL_MAX_QUEUES 16
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* work queue of a threadpool, each worker thread has a home queue and
+ * steals work from the other queues when it runs out of work */
+struct threadpool_queue
+{
+    struct threadpool      *pool;
+    CRITICAL_SECTION        cs;
+    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    struct list             pools[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -134,16 +146,23 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
-    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
-    struct list             pools[3];
     RTL_CONDITION_VARIABLE  update_event;
     /* information about worker threads, locked via .cs */
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
-    int                     num_busy_workers;
+    /* updated with interlocked functions, can be read without lock */
+    LONG                    num_busy_workers;
+    LONG                    num_idle_workers;
+    LONG                    num_starting_workers;
+    LONG                    num_queued[3];
+    LONG                    next_queue;
+    /* read-only information */
+    int                     num_cpus;
+    unsigned int            num_queues;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
+    struct threadpool_queue queues[THREADPOOL_MAX_QUEUES];
 };
 
 enum threadpool_objtype
@@ -170,6 +189,7 @@ struct threadpool_object
     /* read-only information */
     enum threadpool_objtype type;
     struct threadpool       *pool;
+    struct threadpool_queue *queue;
     struct threadpool_group *group;
     PVOID                   userdata;
     PTP_CLEANUP_GROUP_CANCEL_CALLBACK group_cancel_callback;
@@ -180,7 +200,7 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* information about the pool, locked via .queue->cs */
     struct list             pool_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
@@ -224,7 +244,7 @@ struct threadpool_object
         struct
         {
             PTP_IO_CALLBACK callback;
-            /* locked via .pool->cs */
+            /* locked via .queue->cs */
             unsigned int    pending_count, completion_count, completion_max;
             struct io_completion *completions;
         } io;
@@ -1393,6 +1413,7 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
     HANDLE thread;
     NTSTATUS status;
 
+    InterlockedIncrement( &pool->num_starting_workers );
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
                                   threadpool_worker_proc, pool, &thread, NULL );
     if (status == STATUS_SUCCESS)
@@ -1401,6 +1422,7 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
         pool->num_workers++;
         NtClose( thread );
     }
+    else InterlockedDecrement( &pool->num_starting_workers );
     return status;
 }
 
@@ -1750,13 +1772,13 @@ static void CALLBACK ioqueue_thread_proc( void *param )
         {
             io = (struct threadpool_object *)key;
 
-            RtlEnterCriticalSection( &io->pool->cs );
+            RtlEnterCriticalSection( &io->queue->cs );
 
             if (!array_reserve((void **)&io->u.io.completions, &io->u.io.completion_max,
                     io->u.io.completion_count + 1, sizeof(*io->u.io.completions)))
             {
                 ERR("Failed to allocate memory.\n");
-                RtlLeaveCriticalSection( &io->pool->cs );
+                RtlLeaveCriticalSection( &io->queue->cs );
                 continue;
             }
 
@@ -1766,7 +1788,7 @@ static void CALLBACK ioqueue_thread_proc( void *param )
 
             tp_object_submit( io, FALSE );
 
-            RtlLeaveCriticalSection( &io->pool->cs );
+            RtlLeaveCriticalSection( &io->queue->cs );
         }
 
         if (!ioqueue.objcount)
@@ -1857,7 +1879,7 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
     struct threadpool *pool;
-    unsigned int i;
+    unsigned int i, j;
 
     pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
     if (!pool)
@@ -1870,14 +1892,30 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSection( &pool->cs );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        list_init( &pool->pools[i] );
     RtlInitializeConditionVariable( &pool->update_event );
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
+    pool->num_starting_workers    = 0;
+    pool->next_queue              = 0;
+    pool->num_cpus                = max( NtCurrentTeb()->Peb->NumberOfProcessors, 1 );
+    pool->num_queues              = min( pool->num_cpus, THREADPOOL_MAX_QUEUES );
+    for (i = 0; i < ARRAY_SIZE(pool->num_queued); ++i)
+        pool->num_queued[i] = 0;
+
+    for (i = 0; i < pool->num_queues; ++i)
+    {
+        struct threadpool_queue *queue = &pool->queues[i];
+
+        queue->pool = pool;
+        RtlInitializeCriticalSection( &queue->cs );
+        queue->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool_queue.cs");
+        for (j = 0; j < ARRAY_SIZE(queue->pools); ++j)
+            list_init( &queue->pools[j] );
+    }
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
@@ -1898,8 +1936,10 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
 {
     assert( pool != default_threadpool );
 
+    enter_critical_section( &pool->cs );
     pool->shutdown = TRUE;
     RtlWakeAllConditionVariable( &pool->update_event );
+    leave_critical_section( &pool->cs );
 }
 
 /***********************************************************************
@@ -1909,7 +1949,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    unsigned int i;
+    unsigned int i, j;
 
     if (InterlockedDecrement( &pool->refcount ))
         return FALSE;
@@ -1918,8 +1958,15 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        assert( list_empty( &pool->pools[i] ) );
+    for (i = 0; i < pool->num_queues; ++i)
+    {
+        struct threadpool_queue *queue = &pool->queues[i];
+
+        for (j = 0; j < ARRAY_SIZE(queue->pools); ++j)
+            assert( list_empty( &queue->pools[j] ) );
+        queue->cs.DebugInfo->Spare[0] = 0;
+        RtlDeleteCriticalSection( &queue->cs );
+    }
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -2015,6 +2062,85 @@ static void tp_threadpool_unlock( struct threadpool *pool )
     tp_threadpool_release( pool );
 }
 
+/***********************************************************************
+ *           tp_threadpool_get_queue    (internal)
+ *
+ * Selects the work queue for a new threadpool object. Objects created
+ * from a worker thread use its home queue, all other objects are spread
+ * over the queues of the pool.
+ */
+static struct threadpool_queue *tp_threadpool_get_queue( struct threadpool *pool )
+{
+    struct threadpool_queue *queue = ntdll_get_thread_data()->threadpool_queue;
+
+    if (queue && queue->pool == pool)
+        return queue;
+
+    return &pool->queues[(ULONG)InterlockedIncrement( &pool->next_queue ) % pool->num_queues];
+}
+
+/***********************************************************************
+ *           tp_threadpool_need_worker    (internal)
+ *
+ * Checks whether another worker thread should be started because all
+ * existing ones are busy. Above the number of processors only one new
+ * thread is started at a time, the new thread starts the next one if the
+ * work still piles up. Has to be called with the pool lock held to get a
+ * reliable result.
+ */
+static BOOL tp_threadpool_need_worker( const struct threadpool *pool )
+{
+    if (pool->num_busy_workers < pool->num_workers)
+        return FALSE;
+    if (pool->num_workers >= pool->max_workers)
+        return FALSE;
+    return pool->num_workers < pool->num_cpus || !pool->num_starting_workers;
+}
+
+/***********************************************************************
+ *           tp_threadpool_notify    (internal)
+ *
+ * Makes sure that newly queued work is picked up, either by waking up an
+ * idle worker thread or by starting a new one.
+ */
+static void tp_threadpool_notify( struct threadpool *pool )
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* Workers which are not idle check the queues before going to sleep. */
+    if (!pool->num_idle_workers && !tp_threadpool_need_worker( pool ))
+        return;
+
+    enter_critical_section( &pool->cs );
+
+    /* Start new worker threads if required. */
+    if (tp_threadpool_need_worker( pool ))
+        status = tp_new_worker_thread( pool );
+
+    /* No new thread started - wake up one existing thread. */
+    if (status != STATUS_SUCCESS)
+    {
+        assert( pool->num_workers > 0 );
+        RtlWakeConditionVariable( &pool->update_event );
+    }
+
+    leave_critical_section( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_threadpool_has_work    (internal)
+ *
+ * Checks whether any of the work queues of a threadpool is non-empty.
+ */
+static BOOL tp_threadpool_has_work( const struct threadpool *pool )
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(pool->num_queued); ++i)
+        if (pool->num_queued[i] > 0) return TRUE;
+    return FALSE;
+}
+
 /***********************************************************************
  *           tp_group_alloc    (internal)
  *
@@ -2088,6 +2214,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     object->shutdown                = FALSE;
 
     object->pool                    = pool;
+    object->queue                   = tp_threadpool_get_queue( pool );
     object->group                   = NULL;
     object->userdata                = userdata;
     object->group_cancel_callback   = NULL;
@@ -2121,7 +2248,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
             TP_CALLBACK_ENVIRON_V3 *environment_v3 = (TP_CALLBACK_ENVIRON_V3 *)environment;
 
             object->priority = environment_v3->CallbackPriority;
-            assert( object->priority < ARRAY_SIZE(pool->pools) );
+            assert( object->priority < ARRAY_SIZE(pool->num_queued) );
         }
 
         if (environment->ActivationContext)
@@ -2160,8 +2287,9 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
 
 static void tp_object_prio_queue( struct threadpool_object *object )
 {
-    ++object->pool->num_busy_workers;
-    list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
+    InterlockedIncrement( &object->pool->num_busy_workers );
+    list_add_tail( &object->queue->pools[object->priority], &object->pool_entry );
+    InterlockedIncrement( &object->pool->num_queued[object->priority] );
 }
 
 /***********************************************************************
@@ -2173,17 +2301,12 @@ static void tp_object_prio_queue( struct threadpool_object *object )
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 {
     struct threadpool *pool = object->pool;
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    struct threadpool_queue *queue = object->queue;
 
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
-    enter_critical_section( &pool->cs );
-
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
-        pool->num_workers < pool->max_workers)
-        status = tp_new_worker_thread( pool );
+    enter_critical_section( &queue->cs );
 
     /* Queue work item and increment refcount. */
     InterlockedIncrement( &object->refcount );
@@ -2194,14 +2317,11 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
-    {
-        assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
-    }
+    leave_critical_section( &queue->cs );
 
-    leave_critical_section( &pool->cs );
+    /* Start or wake up a worker thread if required. The caller holds a
+     * reference to the object, so the pool can't go away here. */
+    tp_threadpool_notify( pool );
 }
 
 /***********************************************************************
@@ -2212,21 +2332,24 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 static void tp_object_cancel( struct threadpool_object *object )
 {
     struct threadpool *pool = object->pool;
+    struct threadpool_queue *queue = object->queue;
     LONG pending_callbacks = 0;
 
-    enter_critical_section( &pool->cs );
+    enter_critical_section( &queue->cs );
     if (object->num_pending_callbacks)
     {
         pending_callbacks = object->num_pending_callbacks;
         object->num_pending_callbacks = 0;
         list_remove( &object->pool_entry );
+        InterlockedDecrement( &pool->num_queued[object->priority] );
+        InterlockedDecrement( &pool->num_busy_workers );
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
             object->u.wait.signaled = 0;
     }
     if (object->type == TP_OBJECT_TYPE_IO)
         object->u.io.pending_count = 0;
-    leave_critical_section( &pool->cs );
+    leave_critical_section( &queue->cs );
 
     while (pending_callbacks--)
         tp_object_release( object );
@@ -2253,17 +2376,17 @@ static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
  */
 static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
 {
-    struct threadpool *pool = object->pool;
+    struct threadpool_queue *queue = object->queue;
 
-    enter_critical_section( &pool->cs );
+    enter_critical_section( &queue->cs );
     while (!object_is_finished( object, group_wait ))
     {
         if (group_wait)
-            RtlSleepConditionVariableCS( &object->group_finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableCS( &object->group_finished_event, &queue->cs, NULL );
         else
-            RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableCS( &object->finished_event, &queue->cs, NULL );
     }
-    leave_critical_section( &pool->cs );
+    leave_critical_section( &queue->cs );
 }
 
 /***********************************************************************
@@ -2323,18 +2446,38 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
+/***********************************************************************
+ *           threadpool_get_next_item    (internal)
+ *
+ * Returns the next object with the highest priority, looking at the home
+ * queue of the worker first and stealing work from the other queues if it
+ * is empty. On success the queue of the returned object is locked.
+ */
+static struct threadpool_object *threadpool_get_next_item( struct threadpool *pool, unsigned int home )
 {
+    struct threadpool_queue *queue;
     struct list *ptr;
-    unsigned int i;
+    unsigned int i, prio;
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    for (prio = 0; prio < ARRAY_SIZE(pool->num_queued); ++prio)
     {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
+        if (pool->num_queued[prio] <= 0)
+            continue;
+
+        for (i = 0; i < pool->num_queues; ++i)
+        {
+            queue = &pool->queues[(home + i) % pool->num_queues];
+            if (list_empty( &queue->pools[prio] ))
+                continue;
+
+            enter_critical_section( &queue->cs );
+            if ((ptr = list_head( &queue->pools[prio] )))
+                return LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+            leave_critical_section( &queue->cs );
+        }
     }
 
-    return ptr;
+    return NULL;
 }
 
 /***********************************************************************
@@ -2346,24 +2489,30 @@ static void CALLBACK threadpool_worker_proc( void *param )
     struct threadpool_instance instance;
     struct io_completion completion;
     struct threadpool *pool = param;
+    struct threadpool_object *object;
+    struct threadpool_queue *queue;
     TP_WAIT_RESULT wait_result = 0;
     LARGE_INTEGER timeout;
-    struct list *ptr;
+    unsigned int home;
     NTSTATUS status;
 
     TRACE( "starting worker thread for pool %p\n", pool );
 
-    enter_critical_section( &pool->cs );
+    home = (ULONG)InterlockedIncrement( &pool->next_queue ) % pool->num_queues;
+    ntdll_get_thread_data()->threadpool_queue = &pool->queues[home];
+    InterlockedDecrement( &pool->num_starting_workers );
+
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        while ((object = threadpool_get_next_item( pool, home )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+            queue = object->queue;
             assert( object->num_pending_callbacks > 0 );
 
             /* If further pending callbacks are queued, move the work item to
              * the end of the pool list. Otherwise remove it from the pool. */
             list_remove( &object->pool_entry );
+            InterlockedDecrement( &pool->num_queued[object->priority] );
             if (--object->num_pending_callbacks)
                 tp_object_prio_queue( object );
 
@@ -2383,7 +2532,17 @@ static void CALLBACK threadpool_worker_proc( void *param )
             /* Leave critical section and do the actual callback. */
             object->num_associated_callbacks++;
             object->num_running_callbacks++;
-            leave_critical_section( &pool->cs );
+            leave_critical_section( &queue->cs );
+
+            /* Start another worker thread if the remaining work would have to
+             * wait for this callback to finish. */
+            if (tp_threadpool_need_worker( pool ))
+            {
+                enter_critical_section( &pool->cs );
+                if (tp_threadpool_need_worker( pool ))
+                    tp_new_worker_thread( pool );
+                leave_critical_section( &pool->cs );
+            }
 
             /* Initialize threadpool instance struct. */
             callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
@@ -2487,9 +2646,9 @@ static void CALLBACK threadpool_worker_proc( void *param )
             }
 
         skip_cleanup:
-            enter_critical_section( &pool->cs );
+            enter_critical_section( &queue->cs );
             assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+            InterlockedDecrement( &pool->num_busy_workers );
 
             /* Simple callbacks are automatically shutdown after execution. */
             if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2509,29 +2668,53 @@ static void CALLBACK threadpool_worker_proc( void *param )
                     RtlWakeAllConditionVariable( &object->finished_event );
             }
 
+            leave_critical_section( &queue->cs );
             tp_object_release( object );
         }
 
+        /* Submitters only wake up idle threads, so check the queues again
+         * after announcing that we're idle. */
+        enter_critical_section( &pool->cs );
+        InterlockedIncrement( &pool->num_idle_workers );
+        if (tp_threadpool_has_work( pool ))
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
+            leave_critical_section( &pool->cs );
+            continue;
+        }
+
         /* Shutdown worker thread if requested. */
         if (pool->shutdown)
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
             break;
+        }
 
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
          * decreased without violating the min_workers limit. An exception is when
          * min_workers == 0, then objcount is used to detect if the last thread
-         * can be terminated. */
-        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
+         * can be terminated. Threads above the number of processors were only
+         * started for a burst of work and terminate sooner. */
+        if (pool->num_workers > pool->num_cpus)
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_SURPLUS_WORKER_TIMEOUT * -10000;
+        else
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        InterlockedDecrement( &pool->num_idle_workers );
+        if (status == STATUS_TIMEOUT && !tp_threadpool_has_work( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) ||
             (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
+        leave_critical_section( &pool->cs );
     }
     pool->num_workers--;
     leave_critical_section( &pool->cs );
 
+    ntdll_get_thread_data()->threadpool_queue = NULL;
+
     TRACE( "terminating worker thread for pool %p\n", pool );
     tp_threadpool_release( pool );
     RtlExitUserThread( 0 );
@@ -2724,7 +2907,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
 
     TRACE( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlEnterCriticalSection( &this->queue->cs );
 
     this->u.io.pending_count--;
     if (object_is_finished( this, TRUE ))
@@ -2732,7 +2915,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
     if (object_is_finished( this, FALSE ))
         RtlWakeAllConditionVariable( &this->finished_event );
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlLeaveCriticalSection( &this->queue->cs );
 }
 
 /***********************************************************************
@@ -2852,7 +3035,7 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
+    struct threadpool_queue *queue;
 
     TRACE( "%p\n", instance );
 
@@ -2865,14 +3048,14 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    enter_critical_section( &pool->cs );
+    queue = object->queue;
+    enter_critical_section( &queue->cs );
 
     object->num_associated_callbacks--;
     if (object_is_finished( object, FALSE ))
         RtlWakeAllConditionVariable( &object->finished_event );
 
-    leave_critical_section( &pool->cs );
+    leave_critical_section( &queue->cs );
     this->associated = FALSE;
 }
 
@@ -3277,11 +3460,11 @@ void WINAPI TpStartAsyncIoOperation( TP_IO *io )
 
     TRACE( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlEnterCriticalSection( &this->queue->cs );
 
     this->u.io.pending_count++;
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlLeaveCriticalSection( &this->queue->cs );
 }
 
 /***********************************************************************
@@ -36,6 +36,12 @@
 #ifdef HAVE_SYS_SOCKET_H
 # include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #ifdef HAVE_SYS_STAT_H
 # include <sys/stat.h>
 #endif
@@ -88,6 +94,7 @@ struct file_view
 #define VPROT_WRITTEN    0x80
 /* per-mapping protection flags */
 #define VPROT_SYSTEM     0x0200  /* system view (underlying mmap not under our control) */
+#define VPROT_KERNEL_WRITEWATCH 0x0400  /* write watches are tracked by the kernel */
 
 /* Conversion from VPROT_* to Win32 flags */
 static const BYTE VIRTUAL_Win32Flags[16] =
@@ -696,6 +703,16 @@ static inline BOOL is_write_watch_range( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           is_kernel_write_watch_range
+ */
+static inline BOOL is_kernel_write_watch_range( const void *addr, size_t size )
+{
+    struct file_view *view = VIRTUAL_FindView( addr, size );
+    return view && (view->protect & VPROT_KERNEL_WRITEWATCH);
+}
+
+
 /***********************************************************************
  *           is_system_range
  */
@@ -1276,6 +1293,249 @@ static void reset_write_watches( void *base, SIZE_T size )
 }
 
 
+/* Kernel-assisted write watches.
+ *
+ * Write-protecting pages and catching the resulting faults costs a signal for
+ * the first write to every page. Since Linux 6.7 the kernel can do the same
+ * tracking itself: pages registered with an asynchronous userfaultfd in
+ * write-protect mode are unprotected by the kernel on first write without
+ * notifying anybody, and the PAGEMAP_SCAN ioctl on /proc/self/pagemap reports
+ * the written pages and optionally protects them again in one go.
+ *
+ * Soft-dirty bits would work on older kernels, but they can only be cleared
+ * for the whole process at once, which doesn't fit per-range resets. */
+
+#if defined(__linux__) && defined(__NR_userfaultfd) && defined(HAVE_SYS_IOCTL_H)
+
+/* from <linux/userfaultfd.h> and <linux/fs.h>, which may be too old */
+struct uffd_range
+{
+    ULONG64 start;
+    ULONG64 len;
+};
+
+struct uffd_api
+{
+    ULONG64 api;
+    ULONG64 features;
+    ULONG64 ioctls;
+};
+
+struct uffd_register
+{
+    struct uffd_range range;
+    ULONG64 mode;
+    ULONG64 ioctls;
+};
+
+struct uffd_writeprotect
+{
+    struct uffd_range range;
+    ULONG64 mode;
+};
+
+struct pm_page_region
+{
+    ULONG64 start;
+    ULONG64 end;
+    ULONG64 categories;
+};
+
+struct pm_scan_arg
+{
+    ULONG64 size;
+    ULONG64 flags;
+    ULONG64 start;
+    ULONG64 end;
+    ULONG64 walk_end;
+    ULONG64 vec;
+    ULONG64 vec_len;
+    ULONG64 max_pages;
+    ULONG64 category_inverted;
+    ULONG64 category_mask;
+    ULONG64 category_anyof_mask;
+    ULONG64 return_mask;
+};
+
+#define UFFD_USER_MODE_ONLY             1
+#define UFFD_API_VERSION                0xaa
+#define UFFD_FEATURE_WP_UNPOPULATED     (1 << 13)
+#define UFFD_FEATURE_WP_ASYNC           (1 << 15)
+#define UFFDIO_REGISTER_MODE_WP         (1 << 1)
+#define UFFDIO_WRITEPROTECT_MODE_WP     (1 << 0)
+#define UFFDIO_API_IOCTL                _IOWR( 0xaa, 0x3f, struct uffd_api )
+#define UFFDIO_REGISTER_IOCTL           _IOWR( 0xaa, 0x00, struct uffd_register )
+#define UFFDIO_WRITEPROTECT_IOCTL       _IOWR( 0xaa, 0x06, struct uffd_writeprotect )
+#define PAGEMAP_SCAN_IOCTL              _IOWR( 'f', 16, struct pm_scan_arg )
+#define PM_SCAN_WP_MATCHING             (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC           (1 << 1)
+#define PAGE_IS_WRITTEN                 (1 << 1)
+
+static int uffd = -1;
+static int pagemap_fd = -1;
+
+/***********************************************************************
+ *           use_kernel_writewatch
+ *
+ * Open the userfaultfd and pagemap descriptors on first use.
+ * The csVirtual section must be held by caller.
+ */
+static BOOL use_kernel_writewatch(void)
+{
+    static int enabled = -1;
+    struct uffd_api api;
+    const char *env;
+
+    if (enabled != -1) return enabled;
+    enabled = FALSE;
+
+    if ((env = getenv( "WINE_DISABLE_KERNEL_WRITEWATCH" )) && atoi( env )) return FALSE;
+
+    if ((uffd = syscall( __NR_userfaultfd, UFFD_USER_MODE_ONLY | O_CLOEXEC | O_NONBLOCK )) == -1)
+    {
+        TRACE( "userfaultfd not available: %s\n", strerror( errno ));
+        return FALSE;
+    }
+
+    api.api = UFFD_API_VERSION;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    api.ioctls = 0;
+    if (ioctl( uffd, UFFDIO_API_IOCTL, &api ) ||
+        (api.features & (UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED)) !=
+            (UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED))
+    {
+        TRACE( "asynchronous write protection not supported\n" );
+        goto failed;
+    }
+
+    if ((pagemap_fd = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1)
+    {
+        TRACE( "cannot open pagemap: %s\n", strerror( errno ));
+        goto failed;
+    }
+
+    TRACE( "using kernel write watches\n" );
+    return (enabled = TRUE);
+
+failed:
+    close( uffd );
+    uffd = -1;
+    return FALSE;
+}
+
+/***********************************************************************
+ *           kernel_writewatch_register
+ *
+ * Register a range with the userfaultfd and write-protect it.
+ */
+static BOOL kernel_writewatch_register( void *base, size_t size )
+{
+    struct uffd_register reg;
+    struct uffd_writeprotect wp;
+
+    reg.range.start = (ULONG_PTR)base;
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    reg.ioctls = 0;
+    if (ioctl( uffd, UFFDIO_REGISTER_IOCTL, &reg ))
+    {
+        WARN( "failed to register %p-%p: %s\n", base, (char *)base + size, strerror( errno ));
+        return FALSE;
+    }
+
+    wp.range = reg.range;
+    wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+    if (ioctl( uffd, UFFDIO_WRITEPROTECT_IOCTL, &wp ))
+    {
+        WARN( "failed to protect %p-%p: %s\n", base, (char *)base + size, strerror( errno ));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *           kernel_get_write_watches
+ *
+ * Retrieve and optionally reset the written pages of a range. With no
+ * address buffer, just reset the whole range.
+ */
+static void kernel_get_write_watches( char *base, char *end, void **addresses,
+                                      ULONG_PTR *count, BOOL reset )
+{
+    struct pm_page_region regions[256];
+    struct pm_scan_arg arg;
+    ULONG_PTR pos = 0;
+    char *addr = base;
+    long i, ret;
+
+    memset( &arg, 0, sizeof(arg) );
+    arg.size = sizeof(arg);
+    arg.flags = PM_SCAN_CHECK_WPASYNC | (reset ? PM_SCAN_WP_MATCHING : 0);
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask = PAGE_IS_WRITTEN;
+
+    while ((!addresses || pos < *count) && addr < end)
+    {
+        arg.start = (ULONG_PTR)addr;
+        arg.end = (ULONG_PTR)end;
+        arg.vec = addresses ? (ULONG_PTR)regions : 0;
+        arg.vec_len = addresses ? ARRAY_SIZE(regions) : 0;
+        arg.max_pages = addresses ? *count - pos : 0;
+
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN_IOCTL, &arg )) < 0)
+        {
+            ERR( "PAGEMAP_SCAN failed for %p-%p: %s\n", addr, end, strerror( errno ));
+            break;
+        }
+        for (i = 0; i < ret; i++)
+        {
+            char *page = (char *)(ULONG_PTR)regions[i].start;
+            for ( ; page < (char *)(ULONG_PTR)regions[i].end; page += page_size)
+                addresses[pos++] = page;
+        }
+        if ((char *)(ULONG_PTR)arg.walk_end <= addr) break;
+        addr = (char *)(ULONG_PTR)arg.walk_end;
+    }
+    if (addresses) *count = pos;
+}
+
+#else
+
+static BOOL use_kernel_writewatch(void)
+{
+    return FALSE;
+}
+
+static BOOL kernel_writewatch_register( void *base, size_t size )
+{
+    return FALSE;
+}
+
+static void kernel_get_write_watches( char *base, char *end, void **addresses,
+                                      ULONG_PTR *count, BOOL reset )
+{
+    if (addresses) *count = 0;
+}
+
+#endif
+
+
+/***********************************************************************
+ *           enable_kernel_writewatch
+ *
+ * Switch a newly created write watch view over to kernel tracking if possible.
+ */
+static void enable_kernel_writewatch( struct file_view *view )
+{
+    if (!use_kernel_writewatch()) return;
+    if (!kernel_writewatch_register( view->base, view->size )) return;
+
+    view->protect |= VPROT_KERNEL_WRITEWATCH;
+    set_page_vprot_bits( view->base, view->size, 0, VPROT_WRITEWATCH );
+    mprotect_range( view->base, view->size, 0, 0 );
+}
+
+
 /***********************************************************************
  *           unmap_extra_space
  *
@@ -1809,6 +2069,9 @@ static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t siz
     if (wine_anon_mmap( (char *)view->base + start, size, PROT_NONE, MAP_FIXED ) != (void *)-1)
     {
         set_page_vprot_bits( (char *)view->base + start, size, 0, VPROT_COMMITTED );
+        /* the new mapping isn't registered for write watches any more */
+        if (view->protect & VPROT_KERNEL_WRITEWATCH)
+            kernel_writewatch_register( (char *)view->base + start, size );
         return STATUS_SUCCESS;
     }
     return FILE_GetNtStatus();
@@ -1930,6 +2193,8 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
     struct file_view *view = NULL;
     char *ptr, *header_end, *header_start;
     char *base = wine_server_get_ptr( image_info->base );
+    HANDLE reloc_file = 0;
+    int reloc_fd = -1, reloc_needs_close = 0;
 
     if (total_size != image_info->map_size)  /* truncated */
     {
@@ -1955,6 +2220,30 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
     ptr = view->base;
     TRACE_(module)( "mapped PE file at %p-%p\n", ptr, ptr + total_size );
 
+    /* if the image needs relocating, try to get a copy already relocated
+     * to this address, which is shared with other processes using it */
+
+    if (ptr != base && base && shared_fd == -1 &&
+        (image_info->image_charact & IMAGE_FILE_DLL) &&
+        (image_info->image_flags & IMAGE_FLAGS_ImageDynamicallyRelocated) &&
+        !(image_info->image_flags & IMAGE_FLAGS_ImageMappedFlat))
+    {
+        SERVER_START_REQ( get_image_reloc_file )
+        {
+            req->handle = wine_server_obj_handle( hmapping );
+            req->access = access;
+            req->base   = wine_server_client_ptr( ptr );
+            if (!wine_server_call( req )) reloc_file = wine_server_ptr_handle( reply->reloc_file );
+        }
+        SERVER_END_REQ;
+        if (reloc_file && server_get_unix_fd( reloc_file, FILE_READ_DATA, &reloc_fd,
+                                              &reloc_needs_close, NULL, NULL ))
+        {
+            reloc_fd = -1;
+            reloc_needs_close = 0;
+        }
+    }
+
     /* map the header */
 
     if (fstat( fd, &st ) == -1)
@@ -1963,13 +2252,20 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
         goto error;
     }
     header_size = min( image_info->header_size, st.st_size );
-    if ((status = map_pe_header( view->base, header_size, fd, &removable )) != STATUS_SUCCESS) goto error;
+    if (reloc_fd != -1)
+    {
+        TRACE_(module)( "using relocated image copy for %p\n", ptr );
+        status = map_file_into_view( view, reloc_fd, 0, total_size, 0,
+                                     VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY, FALSE );
+    }
+    else status = map_pe_header( view->base, header_size, fd, &removable );
+    if (status != STATUS_SUCCESS) goto error;
 
     status = STATUS_INVALID_IMAGE_FORMAT;  /* generic error */
     dos = (IMAGE_DOS_HEADER *)ptr;
     nt = (IMAGE_NT_HEADERS *)(ptr + dos->e_lfanew);
     header_end = ptr + ROUND_SIZE( 0, header_size );
-    memset( ptr + header_size, 0, header_end - (ptr + header_size) );
+    if (reloc_fd == -1) memset( ptr + header_size, 0, header_end - (ptr + header_size) );
     if ((char *)(nt + 1) > header_end) goto error;
     header_start = (char*)&nt->OptionalHeader+nt->FileHeader.SizeOfOptionalHeader;
     if (nt->FileHeader.NumberOfSections > ARRAY_SIZE( sections )) goto error;
@@ -2066,6 +2362,8 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
             continue;
         }
 
+        if (reloc_fd != -1) continue;  /* already mapped from the relocated copy */
+
         TRACE_(module)( "mapping section %.8s at %p off %x size %x virt %x flags %x\n",
                         sec->Name, ptr + sec->VirtualAddress,
                         sec->PointerToRawData, sec->SizeOfRawData,
@@ -2146,6 +2444,8 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
 
     VIRTUAL_DEBUG_DUMP_VIEW( view );
     server_leave_uninterrupted_section( &csVirtual, &sigset );
+    if (reloc_needs_close) close( reloc_fd );
+    if (reloc_file) close_handle( reloc_file );
 
     *addr_ptr = ptr;
 #ifdef VALGRIND_LOAD_PDB_DEBUGINFO
@@ -2157,6 +2457,8 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
  error:
     if (view) delete_view( view );
     server_leave_uninterrupted_section( &csVirtual, &sigset );
+    if (reloc_needs_close) close( reloc_fd );
+    if (reloc_file) close_handle( reloc_file );
     return status;
 }
 
@@ -3349,7 +3651,11 @@ NTSTATUS virtual_alloc( PVOID *ret, unsigned short zero_bits_64, SIZE_T *size_pt
             else if (is_dos_memory) status = allocate_dos_memory( &view, vprot );
             else status = map_view( &view, base, size, type & MEM_TOP_DOWN, vprot, zero_bits_64 );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                base = view->base;
+                if (vprot & VPROT_WRITEWATCH) enable_kernel_writewatch( view );
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -4393,7 +4699,13 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
 
-    if (is_write_watch_range( base, size ))
+    if (is_kernel_write_watch_range( base, size ))
+    {
+        kernel_get_write_watches( base, (char *)base + size, addresses, count,
+                                  flags & WRITE_WATCH_FLAG_RESET );
+        *granularity = page_size;
+    }
+    else if (is_write_watch_range( base, size ))
     {
         ULONG_PTR pos = 0;
         char *addr = base;
@@ -4433,7 +4745,9 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
 
-    if (is_write_watch_range( base, size ))
+    if (is_kernel_write_watch_range( base, size ))
+        kernel_get_write_watches( base, (char *)base + size, NULL, NULL, TRUE );
+    else if (is_write_watch_range( base, size ))
         reset_write_watches( base, size );
     else
         status = STATUS_INVALID_PARAMETER;
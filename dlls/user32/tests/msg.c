@@ -12891,6 +12891,64 @@ static const struct message WmStopQuitSeq[] = {
     { 0 }
 };
 
+static void test_PeekMessage_flood(void)
+{
+    unsigned int i, count = 1000;
+    HWND flood, hwnd, child;
+    BOOL ret;
+    MSG msg;
+
+    flood = CreateWindowA("TestWindowClass", "flood", WS_OVERLAPPEDWINDOW,
+                          10, 10, 200, 200, NULL, NULL, NULL, NULL);
+    ok(flood != NULL, "expected flood != NULL\n");
+    hwnd = CreateWindowA("TestWindowClass", "PeekMessage flood", WS_OVERLAPPEDWINDOW,
+                         10, 10, 200, 200, NULL, NULL, NULL, NULL);
+    ok(hwnd != NULL, "expected hwnd != NULL\n");
+    child = CreateWindowA("TestWindowClass", "child", WS_CHILD,
+                          0, 0, 10, 10, hwnd, NULL, NULL, NULL);
+    ok(child != NULL, "expected child != NULL\n");
+    flush_events();
+
+    for (i = 0; i < count; i++)
+        if (!PostMessageA(flood, WM_USER + (i & 1), i, 0)) break;
+    ok(i == count, "PostMessage failed at %u, error %u\n", i, GetLastError());
+    PostMessageA(child, WM_USER + 1, 1, 0);
+    PostMessageA(hwnd, WM_USER, 2, 0);
+    PostMessageA(child, WM_APP, 3, 0);
+
+    /* messages of the children match the parent window filter */
+    ret = PeekMessageA(&msg, hwnd, 0, 0, PM_REMOVE);
+    ok(ret && msg.hwnd == child && msg.message == WM_USER + 1 && msg.wParam == 1,
+       "got %d hwnd %p msg %04x wparam %lu\n", ret, msg.hwnd, msg.message, msg.wParam);
+    ret = PeekMessageA(&msg, NULL, WM_APP, WM_APP, PM_REMOVE);
+    ok(ret && msg.hwnd == child && msg.message == WM_APP && msg.wParam == 3,
+       "got %d hwnd %p msg %04x wparam %lu\n", ret, msg.hwnd, msg.message, msg.wParam);
+    ret = PeekMessageA(&msg, hwnd, WM_USER, WM_USER, PM_NOREMOVE);
+    ok(ret && msg.hwnd == hwnd && msg.message == WM_USER && msg.wParam == 2,
+       "got %d hwnd %p msg %04x wparam %lu\n", ret, msg.hwnd, msg.message, msg.wParam);
+    ret = PeekMessageA(&msg, hwnd, 0, 0, PM_REMOVE);
+    ok(ret && msg.hwnd == hwnd && msg.message == WM_USER && msg.wParam == 2,
+       "got %d hwnd %p msg %04x wparam %lu\n", ret, msg.hwnd, msg.message, msg.wParam);
+    ret = PeekMessageA(&msg, hwnd, 0, 0, PM_NOREMOVE);
+    ok(!ret, "expected PeekMessage to return FALSE, got %u\n", ret);
+
+    /* the flooded window still gets its messages in order */
+    ret = PeekMessageA(&msg, NULL, WM_USER + 1, WM_USER + 1, PM_NOREMOVE);
+    ok(ret && msg.hwnd == flood && msg.wParam == 1,
+       "got %d hwnd %p msg %04x wparam %lu\n", ret, msg.hwnd, msg.message, msg.wParam);
+    for (i = 0; i < count; i++)
+    {
+        if (!PeekMessageA(&msg, flood, WM_USER, WM_USER + 1, PM_REMOVE)) break;
+        if (msg.message != WM_USER + (i & 1) || msg.wParam != i) break;
+    }
+    ok(i == count, "got message %04x wparam %lu at %u\n", msg.message, msg.wParam, i);
+
+    DestroyWindow(child);
+    DestroyWindow(hwnd);
+    DestroyWindow(flood);
+    flush_events();
+}
+
 static void test_quit_message(void)
 {
     MSG msg;
@@ -18343,6 +18401,7 @@ START_TEST(msg)
     test_PeekMessage();
     test_PeekMessage2();
     test_PeekMessage3();
+    test_PeekMessage_flood();
     test_WaitForInputIdle( test_argv[0] );
     test_scrollwindowex();
     test_messages();
@@ -67,6 +67,43 @@ typedef struct
 } shmlocal_t;
 
 
+#define REQUEST_SHM_IDLE     0
+#define REQUEST_SHM_REQUEST  1
+#define REQUEST_SHM_REPLY    2
+#define REQUEST_SHM_CLOSED   3
+
+#define REQUEST_SHM_SIZE     0x4000
+
+typedef struct
+{
+    int                     state;
+    int                     waiting;
+    struct request_max_size header;
+    char                    data[REQUEST_SHM_SIZE - 2 * sizeof(int) - sizeof(struct request_max_size)];
+} request_shm_t;
+
+
+#define HANDLE_SHM_ENTRIES   0x10000
+#define HANDLE_SHM_VALID     0x8000
+
+typedef struct
+{
+    unsigned int    access;
+    unsigned short  type;
+    unsigned short  flags;
+} handle_shm_entry_t;
+
+#define REQUEST_STATS_BUCKETS 16
+
+
+struct request_stats
+{
+    unsigned __int64 count;
+    unsigned __int64 time;
+    unsigned int     hist[REQUEST_STATS_BUCKETS];
+};
+
+
 typedef union
 {
     int code;
@@ -1643,6 +1680,20 @@ struct get_directory_cache_entry_reply
 
 
 
+struct get_directory_generation_request
+{
+    struct request_header __header;
+    int          fd;
+};
+struct get_directory_generation_reply
+{
+    struct reply_header __header;
+    unsigned int gen;
+    char __pad_12[4];
+};
+
+
+
 struct get_shared_memory_request
 {
     struct request_header __header;
@@ -1655,6 +1706,46 @@ struct get_shared_memory_reply
 
 
 
+
+struct get_request_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_request_shm_reply
+{
+    struct reply_header __header;
+};
+
+
+
+
+struct get_handle_table_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_handle_table_shm_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct get_request_stats_request
+{
+    struct request_header __header;
+    process_id_t pid;
+};
+struct get_request_stats_reply
+{
+    struct reply_header __header;
+    mem_size_t   freq;
+    /* VARARG(stats,request_stats); */
+};
+
+
+
 struct flush_request
 {
     struct request_header __header;
@@ -2419,6 +2510,23 @@ struct get_mapping_info_reply
 
 
 
+struct get_image_reloc_file_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    unsigned int access;
+    char __pad_20[4];
+    client_ptr_t base;
+};
+struct get_image_reloc_file_reply
+{
+    struct reply_header __header;
+    obj_handle_t reloc_file;
+    char __pad_12[4];
+};
+
+
+
 struct map_view_request
 {
     struct request_header __header;
@@ -6112,6 +6220,8 @@ struct get_esync_apc_fd_request
 struct get_esync_apc_fd_reply
 {
     struct reply_header __header;
+    unsigned int shm_idx;
+    char __pad_12[4];
 };
 
 
@@ -6187,7 +6297,11 @@ enum request
     REQ_get_handle_unix_name,
     REQ_get_handle_fd,
     REQ_get_directory_cache_entry,
+    REQ_get_directory_generation,
     REQ_get_shared_memory,
+    REQ_get_request_shm,
+    REQ_get_handle_table_shm,
+    REQ_get_request_stats,
     REQ_flush,
     REQ_get_file_info,
     REQ_get_volume_info,
@@ -6229,6 +6343,7 @@ enum request
     REQ_create_mapping,
     REQ_open_mapping,
     REQ_get_mapping_info,
+    REQ_get_image_reloc_file,
     REQ_map_view,
     REQ_unmap_view,
     REQ_get_mapping_file,
@@ -6509,7 +6624,11 @@ union generic_request
     struct get_handle_unix_name_request get_handle_unix_name_request;
     struct get_handle_fd_request get_handle_fd_request;
     struct get_directory_cache_entry_request get_directory_cache_entry_request;
+    struct get_directory_generation_request get_directory_generation_request;
     struct get_shared_memory_request get_shared_memory_request;
+    struct get_request_shm_request get_request_shm_request;
+    struct get_handle_table_shm_request get_handle_table_shm_request;
+    struct get_request_stats_request get_request_stats_request;
     struct flush_request flush_request;
     struct get_file_info_request get_file_info_request;
     struct get_volume_info_request get_volume_info_request;
@@ -6551,6 +6670,7 @@ union generic_request
     struct create_mapping_request create_mapping_request;
     struct open_mapping_request open_mapping_request;
     struct get_mapping_info_request get_mapping_info_request;
+    struct get_image_reloc_file_request get_image_reloc_file_request;
     struct map_view_request map_view_request;
     struct unmap_view_request unmap_view_request;
     struct get_mapping_file_request get_mapping_file_request;
@@ -6829,7 +6949,11 @@ union generic_reply
     struct get_handle_unix_name_reply get_handle_unix_name_reply;
     struct get_handle_fd_reply get_handle_fd_reply;
     struct get_directory_cache_entry_reply get_directory_cache_entry_reply;
+    struct get_directory_generation_reply get_directory_generation_reply;
     struct get_shared_memory_reply get_shared_memory_reply;
+    struct get_request_shm_reply get_request_shm_reply;
+    struct get_handle_table_shm_reply get_handle_table_shm_reply;
+    struct get_request_stats_reply get_request_stats_reply;
     struct flush_reply flush_reply;
     struct get_file_info_reply get_file_info_reply;
     struct get_volume_info_reply get_volume_info_reply;
@@ -6871,6 +6995,7 @@ union generic_reply
     struct create_mapping_reply create_mapping_reply;
     struct open_mapping_reply open_mapping_reply;
     struct get_mapping_info_reply get_mapping_info_reply;
+    struct get_image_reloc_file_reply get_image_reloc_file_reply;
     struct map_view_reply map_view_reply;
     struct unmap_view_reply unmap_view_reply;
     struct get_mapping_file_reply get_mapping_file_reply;
@@ -7100,7 +7225,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 607
+#define SERVER_PROTOCOL_VERSION 613
 
 /* ### protocol_version end ### */
 
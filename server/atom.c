@@ -39,9 +39,10 @@
 #include "winuser.h"
 #include "winternl.h"
 
-#define HASH_SIZE     37
+#define HASH_SIZE     32
 #define MIN_HASH_SIZE 4
 #define MAX_HASH_SIZE 0x200
+#define HASH_LOAD_FACTOR 2  /* average number of atoms per hash entry before growing */
 
 #define MAX_ATOM_LEN  (255 * sizeof(WCHAR))
 #define MIN_STR_ATOM  0xc000
@@ -54,8 +55,8 @@ struct atom_entry
     int                count;  /* reference count */
     short              pinned; /* whether the atom is pinned or not */
     atom_t             atom;   /* atom handle */
-    unsigned short     hash;   /* string hash */
     unsigned short     len;    /* string len */
+    unsigned int       hash;   /* string hash */
     WCHAR              str[1]; /* atom string */
 };
 
@@ -65,7 +66,8 @@ struct atom_table
     int                 count;               /* count of atom handles */
     int                 last;                /* last handle in-use */
     struct atom_entry **handles;             /* atom handles */
-    int                 entries_count;       /* number of hash entries */
+    int                 entries_count;       /* number of hash entries (power of two) */
+    int                 entries_used;        /* number of atoms in the hash table */
     struct atom_entry **entries;             /* hash table entries */
 };
 
@@ -105,10 +107,14 @@ static struct atom_table *create_table(int entries_count)
 
     if ((table = alloc_object( &atom_table_ops )))
     {
+        int size = MIN_HASH_SIZE;
+
         if ((entries_count < MIN_HASH_SIZE) ||
             (entries_count > MAX_HASH_SIZE)) entries_count = HASH_SIZE;
+        while (size < entries_count) size *= 2;
         table->handles = NULL;
-        table->entries_count = entries_count;
+        table->entries_count = size;
+        table->entries_used = 0;
         if (!(table->entries = malloc( sizeof(*table->entries) * table->entries_count )))
         {
             set_error( STATUS_NO_MEMORY );
@@ -178,7 +184,7 @@ static void atom_table_dump( struct object *obj, int verbose )
     {
         struct atom_entry *entry = table->handles[i];
         if (!entry) continue;
-        fprintf( stderr, "  %04x: ref=%d pinned=%c hash=%d \"",
+        fprintf( stderr, "  %04x: ref=%d pinned=%c hash=%08x \"",
                  entry->atom, entry->count, entry->pinned ? 'Y' : 'N', entry->hash );
         dump_strW( entry->str, entry->len, stderr, "\"\"");
         fprintf( stderr, "\"\n" );
@@ -201,9 +207,9 @@ static void atom_table_destroy( struct object *obj )
 
 /* find an atom entry in its hash list */
 static struct atom_entry *find_atom_entry( struct atom_table *table, const struct unicode_str *str,
-                                           unsigned short hash )
+                                           unsigned int hash )
 {
-    struct atom_entry *entry = table->entries[hash];
+    struct atom_entry *entry = table->entries[hash & (table->entries_count - 1)];
     while (entry)
     {
         if (entry->len == str->len && !memicmp_strW( entry->str, str->str, str->len )) break;
@@ -212,11 +218,44 @@ static struct atom_entry *find_atom_entry( struct atom_table *table, const struc
     return entry;
 }
 
+/* insert an entry in the hash table */
+static void insert_atom_entry( struct atom_table *table, struct atom_entry *entry )
+{
+    struct atom_entry **head = &table->entries[entry->hash & (table->entries_count - 1)];
+
+    entry->prev = NULL;
+    if ((entry->next = *head)) entry->next->prev = entry;
+    *head = entry;
+}
+
+/* double the size of the hash table once it gets too crowded */
+static void grow_atom_table( struct atom_table *table )
+{
+    struct atom_entry **old_entries = table->entries, *entry, *next;
+    int i, old_count = table->entries_count;
+
+    if (!(table->entries = calloc( old_count * 2, sizeof(*table->entries) )))
+    {
+        table->entries = old_entries;  /* keep using the current table */
+        return;
+    }
+    table->entries_count = old_count * 2;
+    for (i = 0; i < old_count; i++)
+    {
+        for (entry = old_entries[i]; entry; entry = next)
+        {
+            next = entry->next;
+            insert_atom_entry( table, entry );
+        }
+    }
+    free( old_entries );
+}
+
 /* add an atom to the table */
 static atom_t add_atom( struct atom_table *table, const struct unicode_str *str )
 {
     struct atom_entry *entry;
-    unsigned short hash = hash_strW( str->str, str->len, table->entries_count );
+    unsigned int hash = hash_strW( str->str, str->len );
     atom_t atom = 0;
 
     if (!str->len)
@@ -239,14 +278,15 @@ static atom_t add_atom( struct atom_table *table, const struct unicode_str *str
     {
         if ((atom = add_atom_entry( table, entry )))
         {
-            entry->prev  = NULL;
-            if ((entry->next = table->entries[hash])) entry->next->prev = entry;
-            table->entries[hash] = entry;
+            if (table->entries_used >= table->entries_count * HASH_LOAD_FACTOR)
+                grow_atom_table( table );
             entry->count  = 1;
             entry->pinned = 0;
             entry->hash   = hash;
             entry->len    = str->len;
             memcpy( entry->str, str->str, str->len );
+            insert_atom_entry( table, entry );
+            table->entries_used++;
         }
         else free( entry );
     }
@@ -264,8 +304,9 @@ static void delete_atom( struct atom_table *table, atom_t atom, int if_pinned )
     {
         if (entry->next) entry->next->prev = entry->prev;
         if (entry->prev) entry->prev->next = entry->next;
-        else table->entries[entry->hash] = entry->next;
+        else table->entries[entry->hash & (table->entries_count - 1)] = entry->next;
         table->handles[atom - MIN_STR_ATOM] = NULL;
+        table->entries_used--;
         free( entry );
     }
 }
@@ -285,8 +326,7 @@ static atom_t find_atom( struct atom_table *table, const struct unicode_str *str
         set_error( STATUS_INVALID_PARAMETER );
         return 0;
     }
-    if (table && (entry = find_atom_entry( table, str,
-                                           hash_strW( str->str, str->len, table->entries_count ))))
+    if (table && (entry = find_atom_entry( table, str, hash_strW( str->str, str->len ))))
         return entry->atom;
     set_error( STATUS_OBJECT_NAME_NOT_FOUND );
     return 0;
@@ -343,7 +383,7 @@ atom_t find_global_atom( struct winstation *winstation, const struct unicode_str
     struct atom_entry *entry;
 
     if (!str->len || str->len > MAX_ATOM_LEN || !table) return 0;
-    if ((entry = find_atom_entry( table, str, hash_strW( str->str, str->len, table->entries_count ))))
+    if ((entry = find_atom_entry( table, str, hash_strW( str->str, str->len ))))
         return entry->atom;
     return 0;
 }
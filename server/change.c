@@ -35,6 +35,9 @@
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
 #ifdef HAVE_SYS_INOTIFY_H
 #include <sys/inotify.h>
 #endif
@@ -432,15 +435,23 @@ struct inode {
     struct list dirs;        /* directory handles watching this inode */
     struct list ino_entry;   /* entry in the inode hash */
     struct list wd_entry;    /* entry in the watch descriptor hash */
+    struct list gen_entry;   /* entry in the list of inodes watched for client name lookups */
     dev_t dev;               /* device number */
     ino_t ino;               /* device's inode number */
     int wd;                  /* inotify's watch descriptor */
+    unsigned int gen;        /* names change generation, 0 if not watched for client lookups */
     char *name;              /* basename name of the inode */
 };
 
 static struct list inode_hash[ HASH_SIZE ];
 static struct list wd_hash[ HASH_SIZE ];
 
+/* directories watched on behalf of the client side name lookup cache, oldest first */
+#define MAX_GEN_INODES 1024
+static struct list gen_inodes = LIST_INIT( gen_inodes );
+static unsigned int gen_inode_count;
+static unsigned int last_gen;
+
 static int inotify_add_dir( char *path, unsigned int filter );
 
 static struct inode *inode_from_wd( int wd )
@@ -484,6 +495,7 @@ static struct inode *create_inode( dev_t dev, ino_t ino )
         inode->ino = ino;
         inode->dev = dev;
         inode->wd = -1;
+        inode->gen = 0;
         inode->parent = NULL;
         inode->name = NULL;
         list_add_tail( get_hash_list( dev, ino ), &inode->ino_entry );
@@ -538,7 +550,7 @@ static void free_inode( struct inode *inode )
         }
     }
 
-    if (watches)
+    if (watches || inode->gen)
         return;
 
     if (inode->parent)
@@ -731,7 +743,7 @@ static void inode_check_dir( struct inode *parent, const char *name )
         goto end;
 
     inode = inode_add( parent, st.st_dev, st.st_ino, name );
-    if (!inode || inode->wd != -1)
+    if (!inode || (inode->wd != -1 && !inode->gen))
         goto end;
 
     wd = inotify_add_dir( path, filter );
@@ -771,6 +783,35 @@ static int prepend( char **path, const char *segment )
     return 1;
 }
 
+static unsigned int next_gen(void)
+{
+    if (!++last_gen) ++last_gen;
+    return last_gen;
+}
+
+/* stop watching a directory for client name lookups */
+static void release_gen_inode( struct inode *inode )
+{
+    list_remove( &inode->gen_entry );
+    gen_inode_count--;
+    inode->gen = 0;
+    if (list_empty( &inode->dirs ) && !inode->parent)
+        free_inode( inode );
+}
+
+/* the kernel dropped a watch, e.g. because the directory was deleted */
+static void inotify_watch_removed( int wd )
+{
+    struct inode *inode = inode_from_wd( wd );
+
+    if (!inode)
+        return;
+    list_remove( &inode->wd_entry );
+    inode->wd = -1;
+    if (inode->gen)
+        inode->gen = next_gen();
+}
+
 static void inotify_notify_all( struct inotify_event *ie )
 {
     unsigned int filter, action;
@@ -785,6 +826,9 @@ static void inotify_notify_all( struct inotify_event *ie )
         return;
     }
 
+    if (inode->gen && (ie->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+        inode->gen = next_gen();
+
     filter = filter_from_event( ie );
     
     if (ie->mask & IN_CREATE)
@@ -831,18 +875,26 @@ static void inotify_notify_all( struct inotify_event *ie )
     }
 }
 
-static void inotify_poll_event( struct fd *fd, int event )
+/* events have been lost, assume that all watched directories have changed */
+static void inotify_queue_overflow(void)
 {
-    int r, ofs, unix_fd;
+    struct inode *inode;
+
+    LIST_FOR_EACH_ENTRY( inode, &gen_inodes, struct inode, gen_entry )
+        inode->gen = next_gen();
+}
+
+static int inotify_read_events( int unix_fd )
+{
+    int r, ofs;
     char buffer[0x1000];
     struct inotify_event *ie;
 
-    unix_fd = get_unix_fd( fd );
     r = read( unix_fd, buffer, sizeof buffer );
     if (r < 0)
     {
         fprintf(stderr,"inotify_poll_event(): inotify read failed!\n");
-        return;
+        return r;
     }
 
     for( ofs = 0; ofs < r - offsetof(struct inotify_event, name); )
@@ -851,7 +903,24 @@ static void inotify_poll_event( struct fd *fd, int event )
         ofs += offsetof( struct inotify_event, name[ie->len] );
         if (ofs > r) break;
         if (ie->len) inotify_notify_all( ie );
+        else if (ie->mask & IN_IGNORED) inotify_watch_removed( ie->wd );
+        else if (ie->mask & IN_Q_OVERFLOW) inotify_queue_overflow();
     }
+    return r;
+}
+
+static void inotify_poll_event( struct fd *fd, int event )
+{
+    inotify_read_events( get_unix_fd( fd ) );
+}
+
+/* process all the queued events, so that name generations are up to date */
+static void inotify_flush_events( void )
+{
+    int avail, unix_fd = get_unix_fd( inotify_fd );
+
+    while (!ioctl( unix_fd, FIONREAD, &avail ) && avail > 0)
+        if (inotify_read_events( unix_fd ) <= 0) break;
 }
 
 static inline struct fd *create_inotify_fd( void )
@@ -1053,6 +1122,65 @@ static int dir_add_to_existing_notify( struct dir *dir )
     return 1;
 }
 
+/* return the names generation of a directory, starting to watch it if necessary */
+static unsigned int get_dir_names_gen( int unix_fd )
+{
+    static const unsigned int mask = IN_MASK_ADD | IN_ONLYDIR | IN_CREATE | IN_DELETE |
+                                     IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+    struct inode *inode;
+    struct stat st;
+    char path[32];
+    int wd;
+
+    if (!init_inotify())
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return 0;
+    }
+    if (fstat( unix_fd, &st ) == -1 || !S_ISDIR( st.st_mode ))
+    {
+        set_error( STATUS_NOT_A_DIRECTORY );
+        return 0;
+    }
+
+    inotify_flush_events();
+
+    if (!(inode = get_inode( st.st_dev, st.st_ino )))
+    {
+        set_error( STATUS_NO_MEMORY );
+        return 0;
+    }
+
+    if (inode->gen && inode->wd != -1)
+    {
+        list_remove( &inode->gen_entry );
+        list_add_tail( &gen_inodes, &inode->gen_entry );
+        return inode->gen;
+    }
+
+    sprintf( path, "/proc/self/fd/%u", unix_fd );
+    wd = inotify_add_watch( get_unix_fd( inotify_fd ), path, mask );
+    if (wd == -1)
+    {
+        file_set_error();
+        if (!inode->gen && inode->wd == -1 && list_empty( &inode->dirs ) && !inode->parent)
+            free_inode( inode );
+        return 0;
+    }
+    set_fd_events( inotify_fd, POLLIN );
+    inode_set_wd( inode, wd );
+
+    if (!inode->gen)
+    {
+        if (gen_inode_count >= MAX_GEN_INODES)
+            release_gen_inode( LIST_ENTRY( list_head( &gen_inodes ), struct inode, gen_entry ));
+        list_add_tail( &gen_inodes, &inode->gen_entry );
+        gen_inode_count++;
+    }
+    inode->gen = next_gen();
+    return inode->gen;
+}
+
 #else
 
 static int init_inotify( void )
@@ -1075,6 +1203,12 @@ static int dir_add_to_existing_notify( struct dir *dir )
     return 0;
 }
 
+static unsigned int get_dir_names_gen( int unix_fd )
+{
+    set_error( STATUS_NOT_SUPPORTED );
+    return 0;
+}
+
 #endif  /* HAVE_SYS_INOTIFY_H */
 
 struct object *create_dir_obj( struct fd *fd, unsigned int access, mode_t mode,
@@ -1134,6 +1268,20 @@ done:  /* allow freeing entries even on failure */
     release_object( dir );
 }
 
+/* watch a directory for name changes on behalf of the client lookup cache */
+DECL_HANDLER(get_directory_generation)
+{
+    int unix_fd;
+
+    if ((unix_fd = thread_get_inflight_fd( current, req->fd )) == -1)
+    {
+        set_error( STATUS_INVALID_HANDLE );
+        return;
+    }
+    reply->gen = get_dir_names_gen( unix_fd );
+    close( unix_fd );
+}
+
 /* enable change notifications for a directory */
 DECL_HANDLER(read_directory_changes)
 {
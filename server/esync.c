@@ -21,7 +21,9 @@
 #include "config.h"
 #include "wine/port.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -34,6 +36,9 @@
 #ifdef HAVE_SYS_STAT_H
 # include <sys/stat.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -46,13 +51,41 @@
 #include "file.h"
 #include "esync.h"
 
+#if defined(__linux__) && defined(HAVE_SYS_EVENTFD_H)
+# define USE_FSYNC
+# ifndef __NR_futex_waitv
+#  define __NR_futex_waitv 449
+# endif
+#endif
+
+/* With WINEFSYNC, objects keep their state only in the shared memory section
+ * and clients wait on it with futex_waitv(). The eventfds are still created,
+ * but only serve to allocate unique shm indices. */
+int do_fsync(void)
+{
+#ifdef USE_FSYNC
+    static int do_fsync_cached = -1;
+
+    if (do_fsync_cached == -1)
+    {
+        /* fails with EINVAL if the kernel supports futex_waitv() */
+        syscall( __NR_futex_waitv, NULL, 0, 0, NULL, 0 );
+        do_fsync_cached = getenv("WINEFSYNC") && atoi(getenv("WINEFSYNC")) && errno != ENOSYS;
+    }
+
+    return do_fsync_cached;
+#else
+    return 0;
+#endif
+}
+
 int do_esync(void)
 {
 #ifdef HAVE_SYS_EVENTFD_H
     static int do_esync_cached = -1;
 
     if (do_esync_cached == -1)
-        do_esync_cached = getenv("WINEESYNC") && atoi(getenv("WINEESYNC"));
+        do_esync_cached = (getenv("WINEESYNC") && atoi(getenv("WINEESYNC"))) || do_fsync();
 
     return do_esync_cached;
 #else
@@ -60,6 +93,14 @@ int do_esync(void)
 #endif
 }
 
+static inline void futex_wake_all( int *addr )
+{
+#ifdef USE_FSYNC
+    /* the section is shared between processes, so this can't be a private futex */
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, INT_MAX, NULL, 0, 0 );
+#endif
+}
+
 static char shm_name[29];
 static int shm_fd;
 static off_t shm_size;
@@ -67,6 +108,8 @@ static void **shm_addrs;
 static int shm_addrs_size;  /* length of the allocated shm_addrs array */
 static long pagesize;
 
+static void *get_shm( unsigned int idx );
+
 static void shm_cleanup(void)
 {
     close( shm_fd );
@@ -101,6 +144,9 @@ void esync_init(void)
     if (ftruncate( shm_fd, shm_size ) == -1)
         perror( "ftruncate" );
 
+    /* index 0 is reserved; use it to tell clients whether we are using futexes */
+    *(int *)get_shm( 0 ) = do_fsync();
+
     atexit( shm_cleanup );
 }
 
@@ -217,6 +263,21 @@ static void *get_shm( unsigned int idx )
     return (void *)((unsigned long)shm_addrs[entry] + offset);
 }
 
+/* make sure the shm section is large enough to hold the given index */
+static void grow_shm( unsigned int idx )
+{
+    while (idx * 8 >= shm_size)
+    {
+        shm_size += pagesize;
+        if (ftruncate( shm_fd, shm_size ) == -1)
+        {
+            fprintf( stderr, "esync: couldn't expand %s to size %ld: ",
+                shm_name, (long)shm_size );
+            perror( "ftruncate" );
+        }
+    }
+}
+
 struct semaphore
 {
     int max;
@@ -268,17 +329,7 @@ static struct esync *create_esync( struct object *root, const struct unicode_str
             /* Use the fd as index, since that'll be unique across all
              * processes, but should hopefully end up also allowing reuse. */
             esync->shm_idx = esync->fd + 1; /* we keep index 0 reserved */
-            while (esync->shm_idx * 8 >= shm_size)
-            {
-                /* Better expand the shm section. */
-                shm_size += pagesize;
-                if (ftruncate( shm_fd, shm_size ) == -1)
-                {
-                    fprintf( stderr, "esync: couldn't expand %s to size %ld: ",
-                        shm_name, shm_size );
-                    perror( "ftruncate" );
-                }
-            }
+            grow_shm( esync->shm_idx );
 
             /* Initialize the shared memory portion. We want to do this on the
              * server side to avoid a potential though unlikely race whereby
@@ -343,6 +394,15 @@ int esync_create_fd( int initval, int flags )
     fd = eventfd( initval, flags | EFD_CLOEXEC | EFD_NONBLOCK );
     if (fd == -1)
         perror( "eventfd" );
+    else if (do_fsync())
+    {
+        struct event *event;
+
+        grow_shm( fd + 1 );
+        event = get_shm( fd + 1 );
+        event->signaled = initval ? 1 : 0;
+        event->locked = 0;
+    }
 
     return fd;
 #else
@@ -355,6 +415,15 @@ void esync_wake_fd( int fd )
 {
     static const uint64_t value = 1;
 
+    if (do_fsync())
+    {
+        struct event *event = get_shm( fd + 1 );
+
+        if (!InterlockedExchange( &event->signaled, 1 ))
+            futex_wake_all( &event->signaled );
+        return;
+    }
+
     if (write( fd, &value, sizeof(value) ) == -1)
         perror( "esync: write" );
 }
@@ -376,6 +445,13 @@ void esync_clear( int fd )
 {
     uint64_t value;
 
+    if (do_fsync())
+    {
+        struct event *event = get_shm( fd + 1 );
+        event->signaled = 0;
+        return;
+    }
+
     /* we don't care about the return value */
     read( fd, &value, sizeof(value) );
 }
@@ -401,6 +477,14 @@ void esync_set_event( struct esync *esync )
     if (debug_level)
         fprintf( stderr, "esync_set_event() fd=%d\n", esync->fd );
 
+    if (do_fsync())
+    {
+        /* clients don't use the lock with futexes */
+        if (!InterlockedExchange( &event->signaled, 1 ))
+            futex_wake_all( &event->signaled );
+        return;
+    }
+
     if (esync->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
@@ -432,6 +516,12 @@ void esync_reset_event( struct esync *esync )
     if (debug_level)
         fprintf( stderr, "esync_reset_event() fd=%d\n", esync->fd );
 
+    if (do_fsync())
+    {
+        event->signaled = 0;
+        return;
+    }
+
     if (esync->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
@@ -468,7 +558,10 @@ void esync_abandon_mutexes( struct thread *thread )
                 fprintf( stderr, "esync_abandon_mutexes() fd=%d\n", esync->fd );
             mutex->tid = ~0;
             mutex->count = 0;
-            esync_wake_fd( esync->fd );
+            if (do_fsync())
+                futex_wake_all( (int *)&mutex->tid );
+            else
+                esync_wake_fd( esync->fd );
         }
     }
 }
@@ -506,7 +599,8 @@ DECL_HANDLER(create_esync)
 
         reply->type = esync->type;
         reply->shm_idx = esync->shm_idx;
-        send_client_fd( current->process, esync->fd, reply->handle );
+        if (!do_fsync())
+            send_client_fd( current->process, esync->fd, reply->handle );
         release_object( esync );
     }
 
@@ -539,7 +633,8 @@ DECL_HANDLER(open_esync)
         reply->type = esync->type;
         reply->shm_idx = esync->shm_idx;
 
-        send_client_fd( current->process, esync->fd, reply->handle );
+        if (!do_fsync())
+            send_client_fd( current->process, esync->fd, reply->handle );
         release_object( esync );
     }
 }
@@ -564,9 +659,12 @@ DECL_HANDLER(get_esync_fd)
             struct esync *esync = (struct esync *)obj;
             reply->shm_idx = esync->shm_idx;
         }
+        else if (do_fsync())
+            reply->shm_idx = fd + 1;
         else
             reply->shm_idx = 0;
-        send_client_fd( current->process, fd, req->handle );
+        if (!do_fsync())
+            send_client_fd( current->process, fd, req->handle );
     }
     else
     {
@@ -584,5 +682,8 @@ DECL_HANDLER(get_esync_fd)
 /* Return the fd used for waiting on user APCs. */
 DECL_HANDLER(get_esync_apc_fd)
 {
-    send_client_fd( current->process, current->esync_apc_fd, current->id );
+    if (do_fsync())
+        reply->shm_idx = current->esync_apc_fd + 1;
+    else
+        send_client_fd( current->process, current->esync_apc_fd, current->id );
 }
@@ -19,6 +19,7 @@
  */
 
 extern int do_esync(void);
+extern int do_fsync(void);
 void esync_init(void);
 int esync_create_fd( int initval, int flags );
 void esync_wake_fd( int fd );
@@ -195,7 +195,11 @@ struct fd
     unsigned int         cacheable :1;/* can the fd be cached on the client side? */
     unsigned int         signaled :1; /* is the fd signaled? */
     unsigned int         fs_locks :1; /* can we use filesystem locks for this fd? */
+    unsigned int         edge_trig :1;/* can the fd be polled in edge-triggered mode? */
     int                  poll_index;  /* index of fd in poll array */
+    int                  epoll_mask;  /* events currently registered with epoll, or -1 */
+    int                  epoll_stale; /* registered events we stopped being interested in */
+    struct list          epoll_entry; /* entry in list of fds with pending epoll changes */
     struct async_queue   read_q;      /* async readers of this fd */
     struct async_queue   write_q;     /* async writers of this fd */
     struct async_queue   wait_q;      /* other async waiters of this fd */
@@ -373,16 +377,30 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 /****************************************************************/
 /* timeouts support */
 
+/* Pending timeouts are kept in two binary min-heaps, one for absolute
+ * timeouts and one for relative ones, so that adding and removing a
+ * timeout is O(log n) and finding the next one to expire is O(1). */
+
+#define TIMEOUT_NOT_QUEUED (~0u)
+
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired timeout list */
+    unsigned int          index;      /* index in the timeout heap, or TIMEOUT_NOT_QUEUED */
     abstime_t             when;       /* timeout expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+struct timeout_heap
+{
+    struct timeout_user **users;      /* heap array */
+    unsigned int          count;      /* number of entries in use */
+    unsigned int          size;       /* number of allocated entries */
+};
+
+static struct timeout_heap abs_timeouts;  /* absolute timeouts heap */
+static struct timeout_heap rel_timeouts;  /* relative timeouts heap */
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -436,43 +454,122 @@ void set_current_time(void)
     if (user_shared_data) set_user_shared_data_time();
 }
 
+/* return the expiry of a timeout as an increasing key within its heap */
+static inline timeout_t timeout_key( const struct timeout_user *user )
+{
+    return user->when > 0 ? user->when : -user->when;
+}
+
+static inline struct timeout_heap *get_timeout_heap( const struct timeout_user *user )
+{
+    return user->when > 0 ? &abs_timeouts : &rel_timeouts;
+}
+
+static inline void set_heap_entry( struct timeout_heap *heap, unsigned int index, struct timeout_user *user )
+{
+    heap->users[index] = user;
+    user->index = index;
+}
+
+/* move a heap entry towards the root until the heap property holds */
+static void timeout_heap_up( struct timeout_heap *heap, unsigned int index )
+{
+    struct timeout_user *user = heap->users[index];
+    timeout_t key = timeout_key( user );
+
+    while (index)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (timeout_key( heap->users[parent] ) <= key) break;
+        set_heap_entry( heap, index, heap->users[parent] );
+        index = parent;
+    }
+    set_heap_entry( heap, index, user );
+}
+
+/* move a heap entry towards the leaves until the heap property holds */
+static void timeout_heap_down( struct timeout_heap *heap, unsigned int index )
+{
+    struct timeout_user *user = heap->users[index];
+    timeout_t key = timeout_key( user );
+
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count &&
+            timeout_key( heap->users[child + 1] ) < timeout_key( heap->users[child] )) child++;
+        if (key <= timeout_key( heap->users[child] )) break;
+        set_heap_entry( heap, index, heap->users[child] );
+        index = child;
+    }
+    set_heap_entry( heap, index, user );
+}
+
+static int timeout_heap_insert( struct timeout_heap *heap, struct timeout_user *user )
+{
+    if (heap->count == heap->size)
+    {
+        unsigned int new_size = heap->size ? heap->size * 2 : 64;
+        struct timeout_user **new_users;
+
+        if (!(new_users = realloc( heap->users, new_size * sizeof(*new_users) )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return 0;
+        }
+        heap->users = new_users;
+        heap->size = new_size;
+    }
+    heap->users[heap->count] = user;
+    timeout_heap_up( heap, heap->count++ );
+    return 1;
+}
+
+static void timeout_heap_remove( struct timeout_heap *heap, struct timeout_user *user )
+{
+    unsigned int index = user->index;
+
+    assert( index < heap->count && heap->users[index] == user );
+    user->index = TIMEOUT_NOT_QUEUED;
+    if (index == --heap->count) return;
+
+    set_heap_entry( heap, index, heap->users[heap->count] );
+    if (index && timeout_key( heap->users[(index - 1) / 2] ) > timeout_key( heap->users[index] ))
+        timeout_heap_up( heap, index );
+    else
+        timeout_heap_down( heap, index );
+}
+
+/* return the earliest timeout of a heap, or NULL if empty */
+static inline struct timeout_user *timeout_heap_head( const struct timeout_heap *heap )
+{
+    return heap->count ? heap->users[0] : NULL;
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
+    if (!timeout_heap_insert( get_timeout_heap( user ), user ))
     {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
-    {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
-        }
+        free( user );
+        return NULL;
     }
-    list_add_before( ptr, &user->entry );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index != TIMEOUT_NOT_QUEUED) timeout_heap_remove( get_timeout_heap( user ), user );
+    else list_remove( &user->entry );  /* expired but callback not called yet */
     free( user );
 }
 
@@ -531,67 +628,146 @@ static inline void fd_poll_event( struct fd *fd, int event )
 
 #ifdef USE_EPOLL
 
+#ifndef EPOLLET
+#define EPOLLET (1u << 31)
+#endif
+
 static int epoll_fd = -1;
+static struct epoll_event *epoll_events;       /* event array passed to epoll_wait */
+static int epoll_events_size;                   /* allocated size of the event array */
+static struct list epoll_pending_list = LIST_INIT(epoll_pending_list); /* fds with pending changes */
+
+/* statistics, dumped at exit when debugging */
+static unsigned int epoll_loop_count;           /* number of epoll_wait calls */
+static unsigned int epoll_ctl_count;            /* number of epoll_ctl calls */
+static unsigned int epoll_event_count;          /* number of events returned by epoll_wait */
 
 static inline void init_epoll(void)
 {
     epoll_fd = epoll_create( 128 );
 }
 
-/* set the events that epoll waits for on this fd; helper for set_fd_events */
-static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
+static int do_epoll_ctl( struct fd *fd, int ctl, int events )
 {
     struct epoll_event ev;
-    int ctl;
 
+    ev.events = events;
+    memset(&ev.data, 0, sizeof(ev.data));
+    ev.data.u32 = fd->poll_index;
+
+    epoll_ctl_count++;
+    if (epoll_ctl( epoll_fd, ctl, fd->unix_fd, &ev ) != -1) return 1;
+
+    if (errno == ENOMEM)  /* not enough memory, give up on epoll */
+    {
+        close( epoll_fd );
+        epoll_fd = -1;
+    }
+    else perror( "epoll_ctl" );  /* should not happen */
+    return 0;
+}
+
+/* set the events that epoll waits for on this fd; helper for set_fd_events */
+/* changes are only queued here, they are applied by flush_epoll_events before the next wait */
+static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
+{
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
     {
         if (pollfd[user].fd == -1) return;  /* already removed */
-        ctl = EPOLL_CTL_DEL;
-    }
-    else if (pollfd[user].fd == -1)
-    {
-        if (pollfd[user].events) return;  /* stopped waiting on it, don't restart */
-        ctl = EPOLL_CTL_ADD;
-    }
-    else
-    {
-        if (pollfd[user].events == events) return;  /* nothing to do */
-        ctl = EPOLL_CTL_MOD;
+        if (fd->epoll_mask != -1)
+        {
+            struct epoll_event dummy;
+            epoll_ctl_count++;
+            epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd->unix_fd, &dummy );
+            fd->epoll_mask = -1;
+        }
+        list_remove( &fd->epoll_entry );
+        list_init( &fd->epoll_entry );
+        return;
     }
+    if (pollfd[user].fd == -1 && pollfd[user].events) return;  /* stopped waiting on it, don't restart */
 
-    ev.events = events;
-    memset(&ev.data, 0, sizeof(ev.data));
-    ev.data.u32 = user;
+    if (list_empty( &fd->epoll_entry )) list_add_tail( &epoll_pending_list, &fd->epoll_entry );
+}
+
+/* apply the event mask changes queued since the last wait */
+static void flush_epoll_events(void)
+{
+    struct list *ptr;
 
-    if (epoll_ctl( epoll_fd, ctl, fd->unix_fd, &ev ) == -1)
+    while ((ptr = list_head( &epoll_pending_list )))
     {
-        if (errno == ENOMEM)  /* not enough memory, give up on epoll */
+        struct fd *fd = LIST_ENTRY( ptr, struct fd, epoll_entry );
+        int events = pollfd[fd->poll_index].events;
+
+        list_remove( &fd->epoll_entry );
+        list_init( &fd->epoll_entry );
+        if (epoll_fd == -1) continue;
+
+        if (fd->epoll_mask == -1)
+        {
+            if (!do_epoll_ctl( fd, EPOLL_CTL_ADD, fd->edge_trig ? events | EPOLLET : events )) continue;
+            fd->epoll_mask = events;
+            fd->epoll_stale = 0;
+        }
+        else if (fd->edge_trig && !(events & ~fd->epoll_mask) && !(events & fd->epoll_stale))
+        {
+            /* an edge-triggered fd can stay registered for a superset of the events it
+             * wants, the extra ones are filtered out by the main loop; if they are wanted
+             * again the registration has to be refreshed as we may have missed an edge */
+            fd->epoll_stale |= fd->epoll_mask & ~events;
+        }
+        else if (events != fd->epoll_mask || fd->epoll_stale)
         {
-            close( epoll_fd );
-            epoll_fd = -1;
+            if (!do_epoll_ctl( fd, EPOLL_CTL_MOD, fd->edge_trig ? events | EPOLLET : events )) continue;
+            fd->epoll_mask = events;
+            fd->epoll_stale = 0;
         }
-        else perror( "epoll_ctl" );  /* should not happen */
     }
 }
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+    list_remove( &fd->epoll_entry );
+    list_init( &fd->epoll_entry );
+
     if (epoll_fd == -1) return;
 
-    if (pollfd[user].fd != -1)
+    if (fd->epoll_mask != -1)
     {
         struct epoll_event dummy;
+        epoll_ctl_count++;
         epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd->unix_fd, &dummy );
+        fd->epoll_mask = -1;
     }
 }
 
+/* grow the event array when a wait filled it, up to the number of polled fds */
+static void grow_epoll_events(void)
+{
+    struct epoll_event *new_events;
+    int new_size = epoll_events_size * 2;
+
+    if (new_size > active_users) new_size = active_users;
+    if (new_size <= epoll_events_size) return;
+    if (!(new_events = realloc( epoll_events, new_size * sizeof(*new_events) ))) return;
+    epoll_events = new_events;
+    epoll_events_size = new_size;
+}
+
+static void dump_epoll_stats(void)
+{
+    if (!epoll_loop_count) return;
+    fprintf( stderr, "wineserver: epoll: %u waits, %u events, %u epoll_ctl calls (%u.%02u per wait)\n",
+             epoll_loop_count, epoll_event_count, epoll_ctl_count,
+             epoll_ctl_count / epoll_loop_count, epoll_ctl_count * 100 / epoll_loop_count % 100 );
+}
+
 static inline void main_loop_epoll(void)
 {
     int i, ret, timeout;
-    struct epoll_event events[128];
 
     assert( POLLIN == EPOLLIN );
     assert( POLLOUT == EPOLLOUT );
@@ -600,30 +776,46 @@ static inline void main_loop_epoll(void)
 
     if (epoll_fd == -1) return;
 
+    epoll_events_size = 128;
+    if (!(epoll_events = malloc( epoll_events_size * sizeof(*epoll_events) ))) return;
+    if (debug_level) atexit( dump_epoll_stats );  /* the server usually exits from a timeout */
+
     while (active_users)
     {
         timeout = get_next_timeout();
 
         if (!active_users) break;  /* last user removed by a timeout */
+
+        flush_epoll_events();
         if (epoll_fd == -1) break;  /* an error occurred with epoll */
 
-        ret = epoll_wait( epoll_fd, events, ARRAY_SIZE( events ), timeout );
+        ret = epoll_wait( epoll_fd, epoll_events, epoll_events_size, timeout );
         set_current_time();
+        epoll_loop_count++;
+        if (ret > 0) epoll_event_count += ret;
 
         /* put the events into the pollfd array first, like poll does */
         for (i = 0; i < ret; i++)
         {
-            int user = events[i].data.u32;
-            pollfd[user].revents = events[i].events;
+            int user = epoll_events[i].data.u32;
+            int revents = epoll_events[i].events;
+
+            if (poll_users[user]->edge_trig) revents &= pollfd[user].events | POLLERR | POLLHUP;
+            pollfd[user].revents = revents;
         }
 
         /* read events from the pollfd array, as set_fd_events may modify them */
         for (i = 0; i < ret; i++)
         {
-            int user = events[i].data.u32;
+            int user = epoll_events[i].data.u32;
             if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
         }
+
+        if (ret == epoll_events_size) grow_epoll_events();
     }
+
+    free( epoll_events );
+    epoll_events = NULL;
 }
 
 #elif defined(HAVE_KQUEUE)
@@ -896,6 +1088,9 @@ static int add_poll_user( struct fd *fd )
     pollfd[ret].events = 0;
     pollfd[ret].revents = 0;
     poll_users[ret] = fd;
+    fd->epoll_mask  = -1;
+    fd->epoll_stale = 0;
+    list_init( &fd->epoll_entry );
     active_users++;
     return ret;
 }
@@ -920,57 +1115,44 @@ static int get_next_timeout(void)
 {
     int ret = user_shared_data ? user_shared_data_timeout : -1;
 
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeouts.count || rel_timeouts.count)
     {
+        struct timeout_user *timeout;
         struct list expired_list, *ptr;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heaps */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
+        while ((timeout = timeout_heap_head( &abs_timeouts )) && timeout->when <= current_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &abs_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
+        while ((timeout = timeout_heap_head( &rel_timeouts )) && -timeout->when <= monotonic_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (-timeout->when <= monotonic_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &rel_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
 
         /* now call the callback for all the removed timers */
 
         while ((ptr = list_head( &expired_list )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             list_remove( &timeout->entry );
             timeout->callback( timeout->private );
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if ((timeout = timeout_heap_head( &abs_timeouts )))
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             int diff = (timeout->when - current_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if ((timeout = timeout_heap_head( &rel_timeouts )))
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             int diff = (-timeout->when - monotonic_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
@@ -1658,6 +1840,13 @@ void set_fd_events( struct fd *fd, int events )
     }
 }
 
+/* allow polling the fd in edge-triggered mode; must be called before its events are set */
+/* this is only safe if the poll_event callback consumes all the pending data on every event */
+void set_fd_edge_triggered( struct fd *fd )
+{
+    fd->edge_trig = 1;
+}
+
 /* prepare an fd for unmounting its corresponding device */
 static inline void unmount_fd( struct fd *fd )
 {
@@ -1698,6 +1887,7 @@ static struct fd *alloc_fd_object(void)
     fd->cacheable  = 0;
     fd->signaled   = 1;
     fd->fs_locks   = 1;
+    fd->edge_trig  = 0;
     fd->poll_index = -1;
     fd->completion = NULL;
     fd->comp_flags = 0;
@@ -1738,6 +1928,7 @@ struct fd *alloc_pseudo_fd( const struct fd_ops *fd_user_ops, struct object *use
     fd->cacheable  = 0;
     fd->signaled   = 0;
     fd->fs_locks   = 0;
+    fd->edge_trig  = 0;
     fd->poll_index = -1;
     fd->completion = NULL;
     fd->comp_flags = 0;
@@ -38,6 +38,7 @@
 #include "thread.h"
 #include "security.h"
 #include "request.h"
+#include "file.h"
 
 struct handle_entry
 {
@@ -53,6 +54,8 @@ struct handle_table
     int                  last;        /* last used entry */
     int                  free;        /* first entry that may be free */
     struct handle_entry *entries;     /* handle entries */
+    handle_shm_entry_t  *shm;         /* metadata shared read-only with the client */
+    int                  shm_fd;      /* file descriptor of the shared metadata */
 };
 
 static struct handle_table *global_table;
@@ -97,6 +100,51 @@ static inline obj_handle_t handle_global_to_local( obj_handle_t handle )
     return handle ^ HANDLE_OBFUSCATOR;
 }
 
+/* cache of object type indexes, indexed by a hash of the object ops */
+static struct
+{
+    const struct object_ops *ops;
+    unsigned short           type;
+} type_cache[64];
+
+/* get the type of an object as stored in the shared metadata */
+static unsigned short get_shm_type( struct object *obj )
+{
+    unsigned int hash = ((unsigned long)obj->ops >> 4) % (sizeof(type_cache) / sizeof(type_cache[0]));
+    struct object_type *type;
+
+    if (type_cache[hash].ops != obj->ops)
+    {
+        /* the type only depends on the object ops */
+        type = obj->ops->get_type( obj );
+        type_cache[hash].ops  = obj->ops;
+        type_cache[hash].type = type ? type_get_index( type ) + 1 : 0;
+    }
+    return type_cache[hash].type;
+}
+
+/* update the shared metadata of a handle table entry */
+static void update_shm_entry( struct handle_table *table, int index )
+{
+    struct handle_entry *entry = table->entries + index;
+    handle_shm_entry_t *shm;
+
+    if (!table->shm || index < 0 || index > table->last || index >= HANDLE_SHM_ENTRIES) return;
+    shm = table->shm + index;
+    if (!entry->ptr)
+    {
+        __atomic_store_n( &shm->flags, 0, __ATOMIC_RELEASE );
+        shm->access = 0;
+        shm->type   = 0;
+        return;
+    }
+    shm->access = entry->access & ~RESERVED_ALL;
+    shm->type   = get_shm_type( entry->ptr );
+    /* the flags are written last, the client reads them first */
+    __atomic_store_n( &shm->flags, HANDLE_SHM_VALID | ((entry->access & RESERVED_ALL) >> RESERVED_SHIFT),
+                      __ATOMIC_RELEASE );
+}
+
 /* grab an object and increment its handle count */
 static struct object *grab_object_for_handle( struct object *obj )
 {
@@ -188,6 +236,7 @@ static void handle_table_destroy( struct object *obj )
         if (obj) release_object_from_handle( obj );
     }
     free( table->entries );
+    release_shared_memory( table->shm_fd, table->shm, HANDLE_SHM_ENTRIES * sizeof(*table->shm) );
 }
 
 /* close all the process handles and free the handle table */
@@ -211,6 +260,8 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     table->count   = count;
     table->last    = -1;
     table->free    = 0;
+    table->shm     = NULL;
+    table->shm_fd  = -1;
     if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
     release_object( table );
     return NULL;
@@ -250,6 +301,7 @@ static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned
     table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    update_shm_entry( table, i );
     return index_to_handle(i);
 }
 
@@ -397,6 +449,7 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
+    update_shm_entry( table, entry - table->entries );
     if (entry < table->entries + table->free) table->free = entry - table->entries;
     if (entry == table->entries + table->last) shrink_handle_table( table );
     release_object_from_handle( obj );
@@ -530,6 +583,7 @@ static int set_handle_flags( struct process *process, obj_handle_t handle, int m
     mask  = (mask << RESERVED_SHIFT) & RESERVED_ALL;
     flags = (flags << RESERVED_SHIFT) & mask;
     entry->access = (entry->access & ~mask) | flags;
+    if (!handle_is_global( handle )) update_shm_entry( process->handles, entry - process->handles->entries );
     return (old_access & RESERVED_ALL) >> RESERVED_SHIFT;
 }
 
@@ -571,6 +625,8 @@ obj_handle_t duplicate_handle( struct process *src, obj_handle_t src_handle, str
         {
             if (attr & OBJ_INHERIT) access |= RESERVED_INHERIT;
             entry->access = access;
+            if (!handle_is_global( src_handle ))
+                update_shm_entry( src->handles, entry - src->handles->entries );
             res = src_handle;
         }
         else
@@ -844,3 +900,27 @@ DECL_HANDLER(get_system_handles)
         enum_processes( enum_handles, &info );
     }
 }
+
+/* get the shared handle table metadata of the current process */
+DECL_HANDLER(get_handle_table_shm)
+{
+    struct handle_table *table = current->process->handles;
+    int i;
+
+    if (!table)
+    {
+        set_error( STATUS_PROCESS_IS_TERMINATING );
+        return;
+    }
+    if (!table->shm)
+    {
+        if (!allocate_shared_memory( &table->shm_fd, (void **)&table->shm,
+                                     HANDLE_SHM_ENTRIES * sizeof(*table->shm) ))
+        {
+            set_error( STATUS_NOT_SUPPORTED );
+            return;
+        }
+        for (i = 0; i <= table->last; i++) update_shm_entry( table, i );
+    }
+    send_client_fd( current->process, table->shm_fd, 0 );
+}
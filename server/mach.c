@@ -54,7 +54,7 @@ static mach_port_t server_mach_port;
 
 void sigchld_callback(void)
 {
-    assert(0);  /* should never be called on MacOS */
+    /* only used for registry save processes, which are reaped by the registry code */
 }
 
 static void mach_set_error(kern_return_t mach_error)
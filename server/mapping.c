@@ -146,6 +146,45 @@ static const struct object_ops shared_map_ops =
 
 static struct list shared_map_list = LIST_INIT( shared_map_list );
 
+/* file holding a PE image relocated to a given base, shared between processes */
+struct reloc_map
+{
+    struct object   obj;             /* object header */
+    struct fd      *fd;              /* file descriptor of the mapped PE file */
+    struct file    *file;            /* temp file holding the relocated image */
+    client_ptr_t    base;            /* base address the image is relocated to */
+    struct list     entry;           /* entry in global reloc maps list */
+};
+
+static void reloc_map_dump( struct object *obj, int verbose );
+static void reloc_map_destroy( struct object *obj );
+
+static const struct object_ops reloc_map_ops =
+{
+    sizeof(struct reloc_map),  /* size */
+    reloc_map_dump,            /* dump */
+    no_get_type,               /* get_type */
+    no_add_queue,              /* add_queue */
+    NULL,                      /* remove_queue */
+    NULL,                      /* signaled */
+    NULL,                      /* get_esync_fd */
+    NULL,                      /* satisfied */
+    no_signal,                 /* signal */
+    no_get_fd,                 /* get_fd */
+    no_map_access,             /* map_access */
+    default_get_sd,            /* get_sd */
+    default_set_sd,            /* set_sd */
+    no_lookup_name,            /* lookup_name */
+    no_link_name,              /* link_name */
+    NULL,                      /* unlink_name */
+    no_open_file,              /* open_file */
+    no_kernel_obj_list,        /* get_kernel_obj_list */
+    no_close_handle,           /* close_handle */
+    reloc_map_destroy          /* destroy */
+};
+
+static struct list reloc_map_list = LIST_INIT( reloc_map_list );
+
 /* memory view mapped in client address space */
 struct memory_view
 {
@@ -153,6 +192,7 @@ struct memory_view
     struct fd      *fd;              /* fd for mapped file */
     struct ranges  *committed;       /* list of committed ranges in this mapping */
     struct shared_map *shared;       /* temp file for shared PE mapping */
+    struct reloc_map *reloc;         /* temp file for relocated PE mapping */
     pe_image_info_t image;           /* image info (for PE image mapping) */
     unsigned int    flags;           /* SEC_* flags */
     client_ptr_t    base;            /* view base address (in process addr space) */
@@ -169,6 +209,7 @@ struct mapping
     pe_image_info_t image;           /* image info (for PE image mapping) */
     struct ranges  *committed;       /* list of committed ranges in this mapping */
     struct shared_map *shared;       /* temp file for shared PE mapping */
+    struct reloc_map *reloc;         /* temp file for relocated PE mapping */
 };
 
 static void mapping_dump( struct object *obj, int verbose );
@@ -253,6 +294,22 @@ static void shared_map_destroy( struct object *obj )
     list_remove( &shared->entry );
 }
 
+static void reloc_map_dump( struct object *obj, int verbose )
+{
+    struct reloc_map *reloc = (struct reloc_map *)obj;
+    fprintf( stderr, "Relocated mapping fd=%p file=%p base=%x%08x\n", reloc->fd, reloc->file,
+             (unsigned int)(reloc->base >> 32), (unsigned int)reloc->base );
+}
+
+static void reloc_map_destroy( struct object *obj )
+{
+    struct reloc_map *reloc = (struct reloc_map *)obj;
+
+    release_object( reloc->fd );
+    release_object( reloc->file );
+    list_remove( &reloc->entry );
+}
+
 /* extend a file beyond the current end of file */
 static int grow_file( int unix_fd, file_pos_t new_size )
 {
@@ -395,6 +452,7 @@ static void free_memory_view( struct memory_view *view )
     if (view->fd) release_object( view->fd );
     if (view->committed) release_object( view->committed );
     if (view->shared) release_object( view->shared );
+    if (view->reloc) release_object( view->reloc );
     list_remove( &view->entry );
     free( view );
 }
@@ -604,6 +662,158 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
     return 0;
 }
 
+/* find the relocated PE mapping for a given file and base address */
+static struct reloc_map *get_reloc_file( struct fd *fd, client_ptr_t base )
+{
+    struct reloc_map *ptr;
+
+    LIST_FOR_EACH_ENTRY( ptr, &reloc_map_list, struct reloc_map, entry )
+        if (ptr->base == base && is_same_file_fd( ptr->fd, fd ))
+            return (struct reloc_map *)grab_object( ptr );
+    return NULL;
+}
+
+/* apply base relocations to an image laid out at its RVAs, the same way the client loader does */
+static int apply_relocations( char *image, mem_size_t size, unsigned int rva, unsigned int rel_size,
+                              INT64 delta, int is_64bit )
+{
+    const IMAGE_BASE_RELOCATION *rel;
+    const USHORT *relocs;
+    mem_size_t end = (mem_size_t)rva + rel_size, pos;
+    unsigned int i, count;
+
+    if (end > size) return 0;
+    while (rva + sizeof(*rel) < end)
+    {
+        rel = (const IMAGE_BASE_RELOCATION *)(image + rva);
+        if (!rel->SizeOfBlock) break;
+        if (rel->VirtualAddress >= size) return 0;
+        if (rel->SizeOfBlock < sizeof(*rel) || rel->SizeOfBlock > end - rva) return 0;
+        relocs = (const USHORT *)(rel + 1);
+        count = (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT);
+
+        for (i = 0; i < count; i++)
+        {
+            pos = rel->VirtualAddress + (relocs[i] & 0xfff);
+            switch (relocs[i] >> 12)
+            {
+            case IMAGE_REL_BASED_ABSOLUTE:
+                break;
+            case IMAGE_REL_BASED_HIGH:
+                if (pos + sizeof(short) > size) return 0;
+                *(short *)(image + pos) += HIWORD(delta);
+                break;
+            case IMAGE_REL_BASED_LOW:
+                if (pos + sizeof(short) > size) return 0;
+                *(short *)(image + pos) += LOWORD(delta);
+                break;
+            case IMAGE_REL_BASED_HIGHLOW:
+                if (pos + sizeof(int) > size) return 0;
+                *(int *)(image + pos) += delta;
+                break;
+            case IMAGE_REL_BASED_DIR64:
+                if (!is_64bit || pos + sizeof(INT64) > size) return 0;
+                *(INT64 *)(image + pos) += delta;
+                break;
+            default:  /* leave anything else to the client */
+                return 0;
+            }
+        }
+        rva += sizeof(*rel) + count * sizeof(USHORT);
+    }
+    return 1;
+}
+
+/* largest image relocated by the server; the whole image is read and relocated
+ * synchronously while handling a single request, which blocks all other clients */
+#define MAX_RELOC_MAPPING_SIZE (64 * 1024 * 1024)
+
+/* allocate and fill the temp file for a PE image mapping relocated to a given base */
+static struct reloc_map *build_reloc_mapping( struct mapping *mapping, client_ptr_t base )
+{
+    IMAGE_SECTION_HEADER sec[96];
+    IMAGE_DATA_DIRECTORY *relocs;
+    IMAGE_NT_HEADERS32 *nt32;
+    IMAGE_NT_HEADERS64 *nt64;
+    struct reloc_map *reloc;
+    struct file *file;
+    mem_size_t total_size = mapping->image.map_size;
+    size_t header_size, map_size, file_size;
+    off_t file_start;
+    unsigned int i, nb_sec, nt_pos, sec_pos;
+    char *image;
+    int unix_fd, reloc_fd, ok = 0;
+
+    if ((reloc = get_reloc_file( mapping->fd, base ))) return reloc;
+    if (total_size > MAX_RELOC_MAPPING_SIZE) return NULL;
+
+    if ((unix_fd = get_unix_fd( mapping->fd )) == -1) return NULL;
+    if ((reloc_fd = create_temp_file( total_size )) == -1) return NULL;
+    if (!(file = create_file_for_fd( reloc_fd, FILE_GENERIC_READ|FILE_GENERIC_WRITE, 0 ))) return NULL;
+
+    image = mmap( NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, reloc_fd, 0 );
+    if (image == MAP_FAILED) goto done;
+
+    /* load the headers, laid out the same way the client maps them */
+
+    header_size = min( mapping->image.header_size, mapping->image.file_size );
+    if (header_size > total_size) goto done;
+    if (pread( unix_fd, image, header_size, 0 ) != header_size) goto done;
+
+    nt_pos = ((IMAGE_DOS_HEADER *)image)->e_lfanew;
+    if (nt_pos > header_size || header_size - nt_pos < sizeof(*nt64)) goto done;
+    nt32 = (IMAGE_NT_HEADERS32 *)(image + nt_pos);
+    nt64 = (IMAGE_NT_HEADERS64 *)(image + nt_pos);
+    nb_sec = nt32->FileHeader.NumberOfSections;
+    sec_pos = nt_pos + offsetof( IMAGE_NT_HEADERS32, OptionalHeader ) + nt32->FileHeader.SizeOfOptionalHeader;
+    if (nb_sec > ARRAY_SIZE( sec ) || sec_pos + nb_sec * sizeof(*sec) > header_size) goto done;
+    memcpy( sec, image + sec_pos, nb_sec * sizeof(*sec) );
+
+    if (nt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        relocs = &nt64->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        nt64->OptionalHeader.ImageBase = base;
+    }
+    else
+    {
+        relocs = &nt32->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        nt32->OptionalHeader.ImageBase = base;
+    }
+    if (!relocs->VirtualAddress || !relocs->Size) goto done;
+
+    /* copy the sections data */
+
+    for (i = 0; i < nb_sec; i++)
+    {
+        /* leave non page-aligned sections to the per-process relocation */
+        if (sec[i].VirtualAddress & page_mask) goto done;
+        get_section_sizes( &sec[i], &map_size, &file_start, &file_size );
+        if (sec[i].VirtualAddress > total_size || map_size > total_size - sec[i].VirtualAddress) goto done;
+        if (!sec[i].PointerToRawData || !file_size) continue;
+        if (file_start >= mapping->image.file_size) goto done;
+        if (pread( unix_fd, image + sec[i].VirtualAddress, file_size, file_start ) < 0) goto done;
+        memset( image + sec[i].VirtualAddress + file_size, 0,
+                min( ROUND_SIZE( file_size ), map_size ) - file_size );
+    }
+
+    ok = apply_relocations( image, total_size, relocs->VirtualAddress, relocs->Size,
+                            base - mapping->image.base,
+                            nt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC );
+
+done:
+    if (image != MAP_FAILED) munmap( image, total_size );
+    if (!ok || !(reloc = alloc_object( &reloc_map_ops )))
+    {
+        release_object( file );
+        return NULL;
+    }
+    reloc->fd   = (struct fd *)grab_object( mapping->fd );
+    reloc->file = file;
+    reloc->base = base;
+    list_add_head( &reloc_map_list, &reloc->entry );
+    return reloc;
+}
+
 /* load the CLR header from its section */
 static int load_clr_header( IMAGE_COR20_HEADER *hdr, size_t va, size_t size, int unix_fd,
                             IMAGE_SECTION_HEADER *sec, unsigned int nb_sec )
@@ -880,6 +1090,7 @@ static struct object *create_mapping( struct object *root, const struct unicode_
     mapping->size        = size;
     mapping->fd          = NULL;
     mapping->shared      = NULL;
+    mapping->reloc       = NULL;
     mapping->committed   = NULL;
 
     if (!(mapping->flags = get_mapping_flags( handle, flags ))) goto error;
@@ -1018,6 +1229,7 @@ static void mapping_destroy( struct object *obj )
     if (mapping->fd) release_object( mapping->fd );
     if (mapping->committed) release_object( mapping->committed );
     if (mapping->shared) release_object( mapping->shared );
+    if (mapping->reloc) release_object( mapping->reloc );
 }
 
 static enum server_fd_type mapping_get_fd_type( struct fd *fd )
@@ -1104,6 +1316,36 @@ DECL_HANDLER(get_mapping_info)
     release_object( mapping );
 }
 
+/* get a file holding an image mapping relocated to a given base */
+DECL_HANDLER(get_image_reloc_file)
+{
+    struct mapping *mapping;
+    struct reloc_map *reloc;
+
+    if (!(mapping = get_mapping_obj( current->process, req->handle, req->access ))) return;
+
+    if (!(mapping->flags & SEC_IMAGE) || mapping->shared || (req->base & page_mask) ||
+        !(mapping->image.image_charact & IMAGE_FILE_DLL) ||
+        (mapping->image.image_charact & IMAGE_FILE_RELOCS_STRIPPED) ||
+        !(mapping->image.image_flags & IMAGE_FLAGS_ImageDynamicallyRelocated) ||
+        (mapping->image.image_flags & IMAGE_FLAGS_ImageMappedFlat) ||
+        req->base == mapping->image.base)
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        release_object( mapping );
+        return;
+    }
+
+    if ((reloc = build_reloc_mapping( mapping, req->base )))
+    {
+        reply->reloc_file = alloc_handle( current->process, reloc->file, GENERIC_READ, 0 );
+        if (mapping->reloc) release_object( mapping->reloc );
+        mapping->reloc = reloc;
+    }
+    else set_error( STATUS_NOT_SUPPORTED );
+    release_object( mapping );
+}
+
 /* add a memory view in the current process */
 DECL_HANDLER(map_view)
 {
@@ -1152,6 +1394,9 @@ DECL_HANDLER(map_view)
         view->fd        = !is_fd_removable( mapping->fd ) ? (struct fd *)grab_object( mapping->fd ) : NULL;
         view->committed = mapping->committed ? (struct ranges *)grab_object( mapping->committed ) : NULL;
         view->shared    = mapping->shared ? (struct shared_map *)grab_object( mapping->shared ) : NULL;
+        view->reloc     = NULL;
+        if (mapping->reloc && mapping->reloc->base == req->base)
+            view->reloc = (struct reloc_map *)grab_object( mapping->reloc );
         if (mapping->flags & SEC_IMAGE) view->image = mapping->image;
         list_add_tail( &current->process->views, &view->entry );
     }
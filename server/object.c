@@ -43,10 +43,20 @@
 #include "security.h"
 
 
+/* namespaces grow once they hold more than NAMESPACE_LOAD_FACTOR names per bucket; the
+ * buckets are then moved to the new table a few at a time on each insertion, so that no
+ * single call has to pay for a full rehash */
+#define NAMESPACE_LOAD_FACTOR  2
+#define NAMESPACE_REHASH_STEP  4
+
 struct namespace
 {
-    unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        hash_size;       /* size of hash table (power of two) */
+    unsigned int        count;           /* number of names in the namespace */
+    struct list        *names;           /* array of hash entry lists */
+    struct list        *old_names;       /* previous array while a rehash is in progress */
+    unsigned int        old_size;        /* size of the previous array */
+    unsigned int        rehash_pos;      /* first bucket of the previous array not moved yet */
 };
 
 
@@ -127,11 +137,69 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
+/* get the hash list that a given hash value currently belongs to */
+static struct list *get_namespace_list( const struct namespace *namespace, unsigned int hash )
+{
+    if (namespace->old_names)
+    {
+        unsigned int index = hash & (namespace->old_size - 1);
+        if (index >= namespace->rehash_pos) return &namespace->old_names[index];
+    }
+    return &namespace->names[hash & (namespace->hash_size - 1)];
+}
+
+/* move some buckets of the previous hash table to the current one */
+static void namespace_rehash_step( struct namespace *namespace, unsigned int count )
+{
+    struct object_name *ptr, *next;
+
+    while (count-- && namespace->rehash_pos < namespace->old_size)
+    {
+        struct list *list = &namespace->old_names[namespace->rehash_pos++];
+
+        LIST_FOR_EACH_ENTRY_SAFE( ptr, next, list, struct object_name, entry )
+        {
+            list_remove( &ptr->entry );
+            list_add_tail( &namespace->names[ptr->hash & (namespace->hash_size - 1)], &ptr->entry );
+        }
+    }
+    if (namespace->rehash_pos == namespace->old_size)
+    {
+        free( namespace->old_names );
+        namespace->old_names = NULL;
+        namespace->old_size = 0;
+    }
+}
+
+/* start growing the hash table of a namespace */
+static void namespace_grow( struct namespace *namespace )
+{
+    unsigned int i, new_size = namespace->hash_size * 2;
+    struct list *names;
+
+    /* finish any previous rehash first, there can only be two tables at a time */
+    if (namespace->old_names) namespace_rehash_step( namespace, namespace->old_size );
+
+    if (new_size < namespace->hash_size) return;
+    if (!(names = malloc( new_size * sizeof(*names) ))) return;  /* keep using the current table */
+    for (i = 0; i < new_size; i++) list_init( &names[i] );
+
+    namespace->old_names  = namespace->names;
+    namespace->old_size   = namespace->hash_size;
+    namespace->rehash_pos = 0;
+    namespace->names      = names;
+    namespace->hash_size  = new_size;
+}
+
 void namespace_add( struct namespace *namespace, struct object_name *ptr )
 {
-    unsigned int hash = hash_strW( ptr->name, ptr->len, namespace->hash_size );
+    if (namespace->count >= namespace->hash_size * NAMESPACE_LOAD_FACTOR) namespace_grow( namespace );
+    if (namespace->old_names) namespace_rehash_step( namespace, NAMESPACE_REHASH_STEP );
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+    ptr->namespace = namespace;
+    ptr->hash = hash_strW( ptr->name, ptr->len );
+    list_add_head( get_namespace_list( namespace, ptr->hash ), &ptr->entry );
+    namespace->count++;
 }
 
 /* allocate a name for an object */
@@ -142,6 +210,7 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     if ((ptr = mem_alloc( sizeof(*ptr) + name->len - sizeof(ptr->name) )))
     {
         ptr->len = name->len;
+        ptr->namespace = NULL;
         ptr->parent = NULL;
         memcpy( ptr->name, name->str, name->len );
     }
@@ -442,7 +511,7 @@ struct object *find_object( const struct namespace *namespace, const struct unic
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ hash_strW( name->str, name->len, namespace->hash_size ) ];
+    list = get_namespace_list( namespace, hash_strW( name->str, name->len ));
     LIST_FOR_EACH( p, list )
     {
         const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
@@ -464,15 +533,25 @@ struct object *find_object( const struct namespace *namespace, const struct unic
 /* find an object by its index; the refcount is incremented */
 struct object *find_object_index( const struct namespace *namespace, unsigned int index )
 {
+    const struct object_name *ptr;
     unsigned int i;
 
     /* FIXME: not efficient at all */
-    for (i = 0; i < namespace->hash_size; i++)
+    if (index < namespace->count)
     {
-        const struct object_name *ptr;
-        LIST_FOR_EACH_ENTRY( ptr, &namespace->names[i], const struct object_name, entry )
+        for (i = 0; i < namespace->hash_size; i++)
         {
-            if (!index--) return grab_object( ptr->obj );
+            LIST_FOR_EACH_ENTRY( ptr, &namespace->names[i], const struct object_name, entry )
+            {
+                if (!index--) return grab_object( ptr->obj );
+            }
+        }
+        for (i = namespace->rehash_pos; i < namespace->old_size; i++)
+        {
+            LIST_FOR_EACH_ENTRY( ptr, &namespace->old_names[i], const struct object_name, entry )
+            {
+                if (!index--) return grab_object( ptr->obj );
+            }
         }
     }
     set_error( STATUS_NO_MORE_ENTRIES );
@@ -483,17 +562,34 @@ struct object *find_object_index( const struct namespace *namespace, unsigned in
 struct namespace *create_namespace( unsigned int hash_size )
 {
     struct namespace *namespace;
-    unsigned int i;
+    unsigned int i, size = 8;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    while (size < hash_size && size < 0x10000) size *= 2;
+
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->names = mem_alloc( size * sizeof(*namespace->names) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    namespace->hash_size  = size;
+    namespace->count      = 0;
+    namespace->old_names  = NULL;
+    namespace->old_size   = 0;
+    namespace->rehash_pos = 0;
+    for (i = 0; i < size; i++) list_init( &namespace->names[i] );
     return namespace;
 }
 
+/* free a namespace */
+void free_namespace( struct namespace *namespace )
+{
+    if (!namespace) return;
+    free( namespace->old_names );
+    free( namespace->names );
+    free( namespace );
+}
+
 /* functions for unimplemented/default object operations */
 
 struct object_type *no_get_type( struct object *obj )
@@ -700,6 +796,7 @@ int no_link_name( struct object *obj, struct object_name *name, struct object *p
 void default_unlink_name( struct object *obj, struct object_name *name )
 {
     list_remove( &name->entry );
+    if (name->namespace) name->namespace->count--;
 }
 
 struct object *no_open_file( struct object *obj, unsigned int access, unsigned int sharing,
@@ -99,6 +99,7 @@ struct process
     const struct rawinput_device *rawinput_kbd;   /* rawinput keyboard device, if any */
     struct list          kernel_object;   /* list of kernel object pointers */
     int                  esync_fd;        /* esync file descriptor (signaled on exit) */
+    struct request_stats *req_stats;      /* per-request statistics, allocated on first request */
 };
 
 struct process_snapshot
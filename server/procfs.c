@@ -90,7 +90,7 @@ static int open_proc_lwpctl( struct thread *thread )
 /* handle a SIGCHLD signal */
 void sigchld_callback(void)
 {
-    assert( 0 );  /* should only be called when using ptrace */
+    /* only used for registry save processes, which are reaped by the registry code */
 }
 
 /* initialize the process tracing mechanism */
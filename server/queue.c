@@ -22,9 +22,11 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #endif
@@ -51,6 +53,10 @@
 enum message_kind { SEND_MESSAGE, POST_MESSAGE };
 #define NB_MSG_KINDS (POST_MESSAGE+1)
 
+/* posted messages are also indexed by message code and by window */
+#define POST_MSG_BUCKETS  64
+#define POST_WIN_BUCKETS  16
+
 
 struct message_result
 {
@@ -86,6 +92,18 @@ struct message
     unsigned int           data_size; /* size of message data */
     unsigned int           unique_id; /* unique id for nested hw message waits */
     struct message_result *result;    /* result in sender queue */
+    struct list            msg_entry; /* entry in message code bucket (posted messages) */
+    struct list            win_entry; /* entry in window message list (posted messages) */
+    struct post_window    *post_win;  /* window the message is indexed under (posted messages) */
+};
+
+/* posted messages of a given window */
+struct post_window
+{
+    struct list            entry;     /* entry in window bucket */
+    user_handle_t          win;       /* window handle */
+    struct list            msgs;      /* messages posted to the window */
+    unsigned int           count;     /* number of messages */
 };
 
 struct timer
@@ -139,6 +157,10 @@ struct msg_queue
     int                    exit_code;       /* exit code of pending quit message */
     int                    cursor_count;    /* per-queue cursor show count */
     struct list            msg_list[NB_MSG_KINDS];  /* lists of messages */
+    struct list            post_msgs[POST_MSG_BUCKETS];  /* posted messages hashed by message code */
+    unsigned int           post_msg_count[POST_MSG_BUCKETS];  /* number of messages per code bucket */
+    struct list            post_wins[POST_WIN_BUCKETS];  /* post_window entries hashed by window */
+    unsigned int           post_unindexed;  /* posted messages missing from the window index */
     struct list            send_result;     /* stack of sent messages waiting for result */
     struct list            callback_result; /* list of callback messages waiting for result */
     struct message_result *recv_result;     /* stack of received messages waiting for result */
@@ -346,6 +368,10 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         list_init( &queue->pending_timers );
         list_init( &queue->expired_timers );
         for (i = 0; i < NB_MSG_KINDS; i++) list_init( &queue->msg_list[i] );
+        for (i = 0; i < POST_MSG_BUCKETS; i++) list_init( &queue->post_msgs[i] );
+        for (i = 0; i < POST_WIN_BUCKETS; i++) list_init( &queue->post_wins[i] );
+        memset( queue->post_msg_count, 0, sizeof(queue->post_msg_count) );
+        queue->post_unindexed = 0;
 
         if (do_esync())
             queue->esync_fd = esync_create_fd( 0, 0 );
@@ -725,6 +751,55 @@ static void free_message( struct message *msg )
     free( msg );
 }
 
+/* add a message to the posted message list and to the indexes */
+static void add_posted_message( struct msg_queue *queue, struct message *msg )
+{
+    struct list *bucket = &queue->post_wins[(msg->win >> 1) % POST_WIN_BUCKETS];
+    struct post_window *post_win;
+
+    list_add_tail( &queue->msg_list[POST_MESSAGE], &msg->entry );
+    list_add_tail( &queue->post_msgs[msg->msg % POST_MSG_BUCKETS], &msg->msg_entry );
+    queue->post_msg_count[msg->msg % POST_MSG_BUCKETS]++;
+
+    LIST_FOR_EACH_ENTRY( post_win, bucket, struct post_window, entry )
+        if (post_win->win == msg->win) goto found;
+
+    if (!(post_win = mem_alloc( sizeof(*post_win) )))
+    {
+        /* the message is still in the main list, lookups by window fall back to it */
+        clear_error();
+        msg->post_win = NULL;
+        queue->post_unindexed++;
+        return;
+    }
+    post_win->win   = msg->win;
+    post_win->count = 0;
+    list_init( &post_win->msgs );
+    list_add_tail( bucket, &post_win->entry );
+found:
+    list_add_tail( &post_win->msgs, &msg->win_entry );
+    post_win->count++;
+    msg->post_win = post_win;
+}
+
+/* remove a message from the posted message indexes */
+static void unlink_posted_message( struct msg_queue *queue, struct message *msg )
+{
+    struct post_window *post_win = msg->post_win;
+
+    list_remove( &msg->msg_entry );
+    queue->post_msg_count[msg->msg % POST_MSG_BUCKETS]--;
+    if (!post_win)
+    {
+        queue->post_unindexed--;
+        return;
+    }
+    list_remove( &msg->win_entry );
+    if (--post_win->count) return;
+    list_remove( &post_win->entry );
+    free( post_win );
+}
+
 /* remove (and free) a message from a message list */
 static void remove_queue_message( struct msg_queue *queue, struct message *msg,
                                   enum message_kind kind )
@@ -736,6 +811,7 @@ static void remove_queue_message( struct msg_queue *queue, struct message *msg,
         if (list_empty( &queue->msg_list[kind] )) clear_queue_bits( queue, QS_SENDMESSAGE );
         break;
     case POST_MESSAGE:
+        unlink_posted_message( queue, msg );
         if (list_empty( &queue->msg_list[kind] ) && !queue->quit_message)
             clear_queue_bits( queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE );
         if (msg->msg == WM_HOTKEY && --queue->hotkey_count == 0)
@@ -895,25 +971,116 @@ static int match_window( user_handle_t win, user_handle_t msg_win )
     return is_child_window( win, msg_win );
 }
 
-/* retrieve a posted message */
-static int get_posted_message( struct msg_queue *queue, unsigned int ignore_msg, user_handle_t win,
-                               unsigned int first, unsigned int last, unsigned int flags,
-                               struct get_message_reply *reply )
+/* check if a posted message is newer than the ignore_msg limit */
+static inline int is_ignored_post( struct message *msg, unsigned int ignore_msg )
+{
+    return ignore_msg && (int)(msg->unique_id - ignore_msg) >= 0;
+}
+
+/* return the oldest of two posted messages; unique ids of posted messages are increasing */
+static inline struct message *oldest_post( struct message *msg, struct message *other )
+{
+    if (!msg) return other;
+    if (!other) return msg;
+    return (int)(other->unique_id - msg->unique_id) < 0 ? other : msg;
+}
+
+/* find a posted message through the message code buckets */
+static struct message *find_post_by_code( struct msg_queue *queue, unsigned int ignore_msg,
+                                          user_handle_t win, unsigned int first, unsigned int last )
 {
+    struct message *msg, *found = NULL;
+    unsigned int code;
+
+    for (code = first; code - first <= last - first; code++)
+    {
+        LIST_FOR_EACH_ENTRY( msg, &queue->post_msgs[code % POST_MSG_BUCKETS], struct message, msg_entry )
+        {
+            if (is_ignored_post( msg, ignore_msg )) break;  /* the following ones are newer */
+            if (msg->msg != code || !match_window( win, msg->win )) continue;
+            found = oldest_post( found, msg );
+            break;
+        }
+    }
+    return found;
+}
+
+/* find a posted message through the window index */
+static struct message *find_post_by_window( struct msg_queue *queue, unsigned int ignore_msg,
+                                            user_handle_t win, unsigned int first, unsigned int last )
+{
+    struct message *msg, *found = NULL;
+    struct post_window *post_win;
+    unsigned int i;
+
+    for (i = 0; i < POST_WIN_BUCKETS; i++)
+    {
+        LIST_FOR_EACH_ENTRY( post_win, &queue->post_wins[i], struct post_window, entry )
+        {
+            if (!match_window( win, post_win->win )) continue;
+            LIST_FOR_EACH_ENTRY( msg, &post_win->msgs, struct message, win_entry )
+            {
+                if (is_ignored_post( msg, ignore_msg )) break;  /* the following ones are newer */
+                if (!check_msg_filter( msg->msg, first, last )) continue;
+                found = oldest_post( found, msg );
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+/* estimate the number of messages to walk through the window index */
+static unsigned int count_window_posts( struct msg_queue *queue, user_handle_t win )
+{
+    struct post_window *post_win;
+    unsigned int i, count = 0;
+
+    for (i = 0; i < POST_WIN_BUCKETS; i++)
+        LIST_FOR_EACH_ENTRY( post_win, &queue->post_wins[i], struct post_window, entry )
+            count += match_window( win, post_win->win ) ? post_win->count : 1;
+    return count;
+}
+
+/* find the oldest posted message matching the filters */
+static struct message *find_posted_message( struct msg_queue *queue, unsigned int ignore_msg,
+                                            user_handle_t win, unsigned int first, unsigned int last )
+{
+    unsigned int code, code_count = UINT_MAX;
     struct message *msg;
 
-    /* check against the filters */
+    if (last - first < POST_MSG_BUCKETS)
+    {
+        for (code = first, code_count = 0; code - first <= last - first; code++)
+            code_count += queue->post_msg_count[code % POST_MSG_BUCKETS];
+    }
+    if (win && !queue->post_unindexed && count_window_posts( queue, win ) < code_count)
+        return find_post_by_window( queue, ignore_msg, win, first, last );
+    if (code_count != UINT_MAX)
+        return find_post_by_code( queue, ignore_msg, win, first, last );
+
+    /* wide filter on all windows, the first message is usually the right one */
     LIST_FOR_EACH_ENTRY( msg, &queue->msg_list[POST_MESSAGE], struct message, entry )
     {
         if (!match_window( win, msg->win )) continue;
         if (!check_msg_filter( msg->msg, first, last )) continue;
-        if (ignore_msg && (int)(msg->unique_id - ignore_msg) >= 0) continue;
-        goto found; /* found one */
+        if (is_ignored_post( msg, ignore_msg )) continue;
+        return msg;
     }
-    return 0;
+    return NULL;
+}
+
+/* retrieve a posted message */
+static int get_posted_message( struct msg_queue *queue, unsigned int ignore_msg, user_handle_t win,
+                               unsigned int first, unsigned int last, unsigned int flags,
+                               struct get_message_reply *reply )
+{
+    struct message *msg;
+
+    /* check against the filters */
+    if (!(msg = find_posted_message( queue, ignore_msg, win, first, last ))) return 0;
 
     /* return it to the app */
-found:
     reply->total = msg->data_size;
     if (msg->data_size > get_reply_max_size())
     {
@@ -1097,6 +1264,14 @@ static void msg_queue_destroy( struct object *obj )
 
     cleanup_results( queue );
     for (i = 0; i < NB_MSG_KINDS; i++) empty_msg_list( &queue->msg_list[i] );
+    for (i = 0; i < POST_WIN_BUCKETS; i++)
+    {
+        while ((ptr = list_head( &queue->post_wins[i] )))
+        {
+            list_remove( ptr );
+            free( LIST_ENTRY( ptr, struct post_window, entry ));
+        }
+    }
 
     LIST_FOR_EACH_ENTRY_SAFE( hotkey, hotkey2, &queue->input->desktop->hotkeys, struct hotkey, entry )
     {
@@ -1584,7 +1759,7 @@ found:
     msg->data      = NULL;
     msg->data_size = 0;
 
-    list_add_tail( &hotkey->queue->msg_list[POST_MESSAGE], &msg->entry );
+    add_posted_message( hotkey->queue, msg );
     set_queue_bits( hotkey->queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE|QS_HOTKEY );
     hotkey->queue->hotkey_count++;
     return 1;
@@ -2377,7 +2552,7 @@ void post_message( user_handle_t win, unsigned int message, lparam_t wparam, lpa
 
         get_message_defaults( thread->queue, &msg->x, &msg->y, &msg->time );
 
-        list_add_tail( &thread->queue->msg_list[POST_MESSAGE], &msg->entry );
+        add_posted_message( thread->queue, msg );
         set_queue_bits( thread->queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE );
         if (message == WM_HOTKEY)
         {
@@ -2622,7 +2797,7 @@ DECL_HANDLER(send_message)
             break;
         case MSG_POSTED:
             msg->unique_id = get_unique_post_id();
-            list_add_tail( &recv_queue->msg_list[POST_MESSAGE], &msg->entry );
+            add_posted_message( recv_queue, msg );
             set_queue_bits( recv_queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE );
             if (msg->msg == WM_HOTKEY)
             {
@@ -3494,6 +3669,11 @@ DECL_HANDLER(esync_msgwait)
     if (!queue) return;
     queue->esync_in_msgwait = req->in_msgwait;
 
+    /* with futexes the client can't poll the driver fd itself, so have the
+     * main loop signal the queue when driver events arrive */
+    if (do_fsync() && queue->fd)
+        set_fd_events( queue->fd, req->in_msgwait ? POLLIN : 0 );
+
     if (current->process->idle_event && !(queue->wake_mask & QS_SMRESULT))
         set_event( current->process->idle_event );
 }
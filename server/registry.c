@@ -35,6 +35,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -66,6 +72,13 @@ struct notify
     struct process   *process;  /* process in which the hkey is valid */
 };
 
+/* hash index of the subkeys or values of a large key */
+struct name_index
+{
+    unsigned int      size;        /* number of slots (power of two), 0 if there is no index */
+    unsigned int     *slots;       /* array index + 1 of each entry, 0 for a free slot */
+};
+
 /* a registry key */
 struct key
 {
@@ -74,13 +87,16 @@ struct key
     WCHAR            *class;       /* key class */
     unsigned short    namelen;     /* length of key name */
     unsigned short    classlen;    /* length of class name */
+    unsigned int      hash;        /* hash of the key name */
     struct key       *parent;      /* parent key */
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    struct name_index subkey_index; /* hash index of the subkeys */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
+    struct name_index value_index; /* hash index of the values */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
@@ -93,12 +109,15 @@ struct key
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOW64    0x0010  /* key contains a Wow6432Node subkey */
 #define KEY_WOWSHARE 0x0020  /* key is a Wow64 shared key (used for Software\Classes) */
+#define KEY_UNSORTED_SUBKEYS 0x0040  /* subkeys array needs sorting before enumeration */
+#define KEY_UNSORTED_VALUES  0x0080  /* values array needs sorting before enumeration */
 
 /* a key value */
 struct key_value
 {
     WCHAR            *name;    /* value name */
     unsigned short    namelen; /* length of value name */
+    unsigned int      hash;    /* hash of the value name */
     unsigned int      type;    /* value type */
     data_size_t       len;     /* value data length in bytes */
     void             *data;    /* pointer to value data */
@@ -107,6 +126,10 @@ struct key_value
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
 
+/* keys with at least that many subkeys or values get a hash index; new entries are then
+ * appended to the arrays, which are only sorted again when enumerated */
+#define MIN_INDEXED_ENTRIES 32
+
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
 
@@ -125,6 +148,8 @@ static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_va
 
 static void set_periodic_save_timer(void);
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void sort_subkeys( struct key *key );
+static void sort_values( struct key *key );
 
 /* information about where to save a registry branch */
 struct save_branch_info
@@ -137,6 +162,106 @@ struct save_branch_info
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
+/* child process writing a snapshot of the registry branches in the background */
+struct save_process
+{
+    struct object     obj;        /* object header */
+    struct fd        *fd;         /* pipe receiving the mask of saved branches */
+    pid_t             pid;        /* pid of the child process */
+    unsigned int      branches;   /* mask of branches being saved */
+};
+
+static void save_process_dump( struct object *obj, int verbose );
+static void save_process_destroy( struct object *obj );
+static void save_process_poll_event( struct fd *fd, int event );
+
+static const struct object_ops save_process_ops =
+{
+    sizeof(struct save_process),  /* size */
+    save_process_dump,            /* dump */
+    no_get_type,                  /* get_type */
+    no_add_queue,                 /* add_queue */
+    NULL,                         /* remove_queue */
+    NULL,                         /* signaled */
+    NULL,                         /* get_esync_fd */
+    NULL,                         /* satisfied */
+    no_signal,                    /* signal */
+    no_get_fd,                    /* get_fd */
+    no_map_access,                /* map_access */
+    default_get_sd,               /* get_sd */
+    default_set_sd,               /* set_sd */
+    no_lookup_name,               /* lookup_name */
+    no_link_name,                 /* link_name */
+    NULL,                         /* unlink_name */
+    no_open_file,                 /* open_file */
+    no_kernel_obj_list,           /* get_kernel_obj_list */
+    no_close_handle,              /* close_handle */
+    save_process_destroy          /* destroy */
+};
+
+static const struct fd_ops save_process_fd_ops =
+{
+    NULL,                         /* get_poll_events */
+    save_process_poll_event,      /* poll_event */
+    NULL,                         /* flush */
+    NULL,                         /* get_fd_type */
+    NULL,                         /* ioctl */
+    NULL,                         /* queue_async */
+    NULL                          /* reselect_async */
+};
+
+static struct save_process *save_process;  /* currently running save process */
+
+
+/* The binary registry cache holds the same key records as a saved text file, with the
+ * names and data stored raw so that they can be loaded without any parsing. It is only
+ * used if it was written for the exact same text file, which remains authoritative. */
+
+#define REG_CACHE_MAGIC   0x47455257  /* "WREG" */
+#define REG_CACHE_VERSION 1
+
+struct reg_cache_header
+{
+    unsigned int      magic;       /* REG_CACHE_MAGIC */
+    unsigned int      version;     /* REG_CACHE_VERSION */
+    unsigned int      prefix_type; /* prefix type of the text file */
+    unsigned int      reserved;
+    file_pos_t        size;        /* total size of the cache file */
+    file_pos_t        file_size;   /* size of the text file */
+    file_pos_t        file_mtime;  /* modification time of the text file in ns */
+    file_pos_t        file_ino;    /* inode of the text file */
+};
+
+/* key record, followed by the path relative to the branch, the class and the values */
+struct reg_cache_key
+{
+    unsigned int      size;        /* size of the whole record */
+    unsigned int      flags;       /* key flags (only KEY_SYMLINK) */
+    timeout_t         modif;       /* last modification time */
+    data_size_t       pathlen;     /* length of the key path */
+    data_size_t       classlen;    /* length of the key class */
+    unsigned int      nb_values;   /* number of values following the key */
+    unsigned int      reserved;
+};
+
+/* value record, followed by the name and the data */
+struct reg_cache_value
+{
+    unsigned int      namelen;     /* length of the name */
+    unsigned int      type;        /* value type */
+    data_size_t       len;         /* length of the data */
+    unsigned int      reserved;
+};
+
+#define REG_CACHE_ALIGN(len) (((len) + 7) & ~7)
+
+/* buffer used to build a registry cache */
+struct reg_cache_buffer
+{
+    char             *data;        /* buffer data */
+    size_t            size;        /* allocated size */
+    size_t            pos;         /* current write position */
+};
 
 /* information about a file being loaded */
 struct file_load_info
@@ -263,11 +388,13 @@ static void dump_value( const struct key_value *value, FILE *f )
 }
 
 /* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
+    sort_subkeys( key );
+    sort_values( key );
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
@@ -435,12 +562,14 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    free( key->value_index.slots );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_index.slots );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -499,6 +628,7 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->class       = NULL;
         key->namelen     = name->len;
         key->classlen    = 0;
+        key->hash        = hash_strW( name->str, name->len );
         key->flags       = 0;
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
@@ -506,6 +636,10 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
+        key->subkey_index.size  = 0;
+        key->subkey_index.slots = NULL;
+        key->value_index.size   = 0;
+        key->value_index.slots  = NULL;
         key->modif       = modif;
         key->parent      = NULL;
         list_init( &key->notify_list );
@@ -567,6 +701,110 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change, 0 );
 }
 
+/* add an entry to a name index */
+static inline void name_index_add( struct name_index *index, unsigned int hash, int pos )
+{
+    unsigned int i = hash & (index->size - 1);
+
+    while (index->slots[i]) i = (i + 1) & (index->size - 1);
+    index->slots[i] = pos + 1;
+}
+
+/* make sure a name index has a suitable size for count entries and clear it; return 0 on error */
+static int reset_name_index( struct name_index *index, int count )
+{
+    unsigned int size = 2 * MIN_INDEXED_ENTRIES, *slots;
+
+    while (size < 2 * count) size *= 2;
+    if (size != index->size)
+    {
+        if (!(slots = malloc( size * sizeof(*slots) ))) return 0;
+        free( index->slots );
+        index->slots = slots;
+        index->size  = size;
+    }
+    memset( index->slots, 0, index->size * sizeof(*index->slots) );
+    return 1;
+}
+
+static void free_name_index( struct name_index *index )
+{
+    free( index->slots );
+    index->slots = NULL;
+    index->size  = 0;
+}
+
+/* compare two names the way they are sorted in a key */
+static inline int compare_names( const WCHAR *name1, data_size_t len1, const WCHAR *name2, data_size_t len2 )
+{
+    int res = memicmp_strW( name1, name2, min( len1, len2 ));
+    if (!res) res = len1 - len2;
+    return res;
+}
+
+static int compare_subkeys( const void *p1, const void *p2 )
+{
+    const struct key *key1 = *(const struct key * const *)p1;
+    const struct key *key2 = *(const struct key * const *)p2;
+    return compare_names( key1->name, key1->namelen, key2->name, key2->namelen );
+}
+
+static int compare_values( const void *p1, const void *p2 )
+{
+    const struct key_value *value1 = p1;
+    const struct key_value *value2 = p2;
+    return compare_names( value1->name, value1->namelen, value2->name, value2->namelen );
+}
+
+/* rebuild the subkey index after the array has been modified; small keys don't use an
+ * index and rely on the array being sorted instead */
+static void update_subkey_index( struct key *key )
+{
+    int i, count = key->last_subkey + 1;
+
+    if (count < (key->subkey_index.size ? MIN_INDEXED_ENTRIES / 2 : MIN_INDEXED_ENTRIES) ||
+        !reset_name_index( &key->subkey_index, count ))
+    {
+        sort_subkeys( key );
+        free_name_index( &key->subkey_index );
+        return;
+    }
+    for (i = 0; i < count; i++) name_index_add( &key->subkey_index, key->subkeys[i]->hash, i );
+}
+
+/* sort the subkeys array if needed, before accessing it by index */
+static void sort_subkeys( struct key *key )
+{
+    if (!(key->flags & KEY_UNSORTED_SUBKEYS)) return;
+    key->flags &= ~KEY_UNSORTED_SUBKEYS;
+    qsort( key->subkeys, key->last_subkey + 1, sizeof(*key->subkeys), compare_subkeys );
+    if (key->subkey_index.size) update_subkey_index( key );
+}
+
+/* rebuild the value index after the array has been modified */
+static void update_value_index( struct key *key )
+{
+    int i, count = key->last_value + 1;
+
+    if (count < (key->value_index.size ? MIN_INDEXED_ENTRIES / 2 : MIN_INDEXED_ENTRIES) ||
+        !reset_name_index( &key->value_index, count ))
+    {
+        sort_values( key );
+        free_name_index( &key->value_index );
+        return;
+    }
+    for (i = 0; i < count; i++) name_index_add( &key->value_index, key->values[i].hash, i );
+}
+
+/* sort the values array if needed, before accessing it by index */
+static void sort_values( struct key *key )
+{
+    if (!(key->flags & KEY_UNSORTED_VALUES)) return;
+    key->flags &= ~KEY_UNSORTED_VALUES;
+    qsort( key->values, key->last_value + 1, sizeof(*key->values), compare_values );
+    if (key->value_index.size) update_value_index( key );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -615,6 +853,12 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (index && compare_subkeys( &parent->subkeys[index - 1], &key ) > 0)
+            parent->flags |= KEY_UNSORTED_SUBKEYS;
+        if (index == parent->last_subkey && parent->subkey_index.size > 2 * index)
+            name_index_add( &parent->subkey_index, key->hash, index );
+        else if (parent->subkey_index.size || parent->last_subkey >= MIN_INDEXED_ENTRIES - 1)
+            update_subkey_index( parent );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -637,6 +881,7 @@ static void free_subkey( struct key *parent, int index )
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
     release_object( key );
+    if (parent->subkey_index.size) update_subkey_index( parent );
 
     /* try to shrink the array */
     nb_subkeys = parent->nb_subkeys;
@@ -657,6 +902,24 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
     int i, min, max, res;
     data_size_t len;
 
+    if (key->subkey_index.size)
+    {
+        unsigned int pos, hash = hash_strW( name->str, name->len ), mask = key->subkey_index.size - 1;
+
+        for (i = hash & mask; (pos = key->subkey_index.slots[i]); i = (i + 1) & mask)
+        {
+            struct key *subkey = key->subkeys[pos - 1];
+            if (subkey->hash == hash && subkey->namelen == name->len &&
+                !memicmp_strW( subkey->name, name->str, name->len ))
+            {
+                *index = pos - 1;
+                return subkey;
+            }
+        }
+        *index = key->last_subkey + 1;  /* new subkeys are appended to indexed keys */
+        return NULL;
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -893,7 +1156,7 @@ static struct key *create_key_recursive( struct key *key, const struct unicode_s
 }
 
 /* query information about a key or a subkey */
-static void enum_key( const struct key *key, int index, int info_class,
+static void enum_key( struct key *key, int index, int info_class,
                       struct enum_key_reply *reply )
 {
     static const WCHAR backslash[] = { '\\' };
@@ -911,6 +1174,7 @@ static void enum_key( const struct key *key, int index, int info_class,
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
@@ -1003,6 +1267,7 @@ static int delete_key( struct key *key, int recurse )
 {
     int index;
     struct key *parent = key->parent;
+    struct unicode_str name;
 
     /* must find parent and index */
     if (key == root_key)
@@ -1016,9 +1281,10 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    name.str = key->name;
+    name.len = key->namelen;
+    find_subkey( parent, &name, &index );
+    assert( parent->subkeys[index] == key );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -1064,6 +1330,24 @@ static struct key_value *find_value( const struct key *key, const struct unicode
     int i, min, max, res;
     data_size_t len;
 
+    if (key->value_index.size)
+    {
+        unsigned int pos, hash = hash_strW( name->str, name->len ), mask = key->value_index.size - 1;
+
+        for (i = hash & mask; (pos = key->value_index.slots[i]); i = (i + 1) & mask)
+        {
+            struct key_value *value = &key->values[pos - 1];
+            if (value->hash == hash && value->namelen == name->len &&
+                !memicmp_strW( value->name, name->str, name->len ))
+            {
+                *index = pos - 1;
+                return value;
+            }
+        }
+        *index = key->last_value + 1;  /* new values are appended to indexed keys */
+        return NULL;
+    }
+
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1105,8 +1389,15 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     value = &key->values[index];
     value->name    = new_name;
     value->namelen = name->len;
+    value->hash    = hash_strW( name->str, name->len );
     value->len     = 0;
     value->data    = NULL;
+    if (index && compare_values( &key->values[index - 1], value ) > 0)
+        key->flags |= KEY_UNSORTED_VALUES;
+    if (index == key->last_value && key->value_index.size > 2 * index)
+        name_index_add( &key->value_index, value->hash, index );
+    else if (key->value_index.size || key->last_value >= MIN_INDEXED_ENTRIES - 1)
+        update_value_index( key );
     return value;
 }
 
@@ -1189,6 +1480,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         void *data;
         data_size_t namelen, maxlen;
 
+        sort_values( key );
         value = &key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
@@ -1245,6 +1537,7 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     free( value->data );
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
+    if (key->value_index.size) update_value_index( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
     /* try to shrink the array */
@@ -1730,20 +2023,326 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* check whether the binary registry cache is enabled */
+static int use_registry_cache(void)
+{
+    static int use_cache = -1;
+
+    if (use_cache == -1) use_cache = getenv( "WINEREGISTRYCACHE" ) && atoi( getenv( "WINEREGISTRYCACHE" ));
+    return use_cache;
+}
+
+/* return the name of the cache file for a registry file */
+static char *get_registry_cache_name( const char *filename )
+{
+    static const char suffix[] = ".cache";
+    char *ret = malloc( strlen( filename ) + sizeof(suffix) );
+
+    if (ret)
+    {
+        strcpy( ret, filename );
+        strcat( ret, suffix );
+    }
+    return ret;
+}
+
+static file_pos_t get_file_mtime( const struct stat *st )
+{
+    file_pos_t ret = (file_pos_t)st->st_mtime * 1000000000;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+/* reserve some aligned space in the cache buffer */
+static void *reg_cache_alloc( struct reg_cache_buffer *buf, size_t len )
+{
+    void *ret;
+
+    len = REG_CACHE_ALIGN( len );
+    if (!buf->data) return NULL;
+    if (buf->pos + len > buf->size)
+    {
+        size_t size = max( buf->size * 2, buf->pos + len );
+        char *new_data;
+
+        if (!(new_data = realloc( buf->data, size )))
+        {
+            free( buf->data );
+            buf->data = NULL;
+            return NULL;
+        }
+        buf->data = new_data;
+        buf->size = size;
+    }
+    ret = buf->data + buf->pos;
+    memset( ret, 0, len );
+    buf->pos += len;
+    return ret;
+}
+
+static void reg_cache_add_data( struct reg_cache_buffer *buf, const void *data, size_t len )
+{
+    void *ptr;
+
+    if (len && (ptr = reg_cache_alloc( buf, len ))) memcpy( ptr, data, len );
+}
+
+/* add the keys of a branch to the cache; keys are stored exactly as save_subkeys() would */
+static void reg_cache_add_subkeys( struct reg_cache_buffer *buf, struct key *key, const struct key *base )
+{
+    struct reg_cache_key *record;
+    const struct key *k;
+    size_t start;
+    data_size_t pathlen = 0;
+    WCHAR *path;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    sort_subkeys( key );
+    sort_values( key );
+    if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+    {
+        start = buf->pos;
+        for (k = key; k != base; k = k->parent) pathlen += k->namelen + sizeof(WCHAR);
+        if (pathlen) pathlen -= sizeof(WCHAR);
+
+        if (!(record = reg_cache_alloc( buf, sizeof(*record) ))) return;
+        record->flags     = key->flags & KEY_SYMLINK;
+        record->modif     = key->modif;
+        record->pathlen   = pathlen;
+        record->classlen  = key->classlen;
+        record->nb_values = key->last_value + 1;
+
+        if (pathlen && (path = reg_cache_alloc( buf, pathlen )))
+        {
+            data_size_t pos = pathlen;
+            for (k = key; k != base; k = k->parent)
+            {
+                pos -= k->namelen;
+                memcpy( (char *)path + pos, k->name, k->namelen );
+                if (pos) path[(pos -= sizeof(WCHAR)) / sizeof(WCHAR)] = '\\';
+            }
+        }
+        reg_cache_add_data( buf, key->class, key->classlen );
+        for (i = 0; i <= key->last_value; i++)
+        {
+            const struct key_value *value = &key->values[i];
+            struct reg_cache_value *value_record;
+
+            if (!(value_record = reg_cache_alloc( buf, sizeof(*value_record) ))) return;
+            value_record->namelen = value->namelen;
+            value_record->type    = value->type;
+            value_record->len     = value->len;
+            reg_cache_add_data( buf, value->name, value->namelen );
+            reg_cache_add_data( buf, value->data, value->len );
+        }
+        if (!buf->data) return;
+        ((struct reg_cache_key *)(buf->data + start))->size = buf->pos - start;
+    }
+    for (i = 0; i <= key->last_subkey; i++) reg_cache_add_subkeys( buf, key->subkeys[i], base );
+}
+
+/* write the binary cache of a registry branch that has just been loaded from or saved to a file */
+static void save_registry_cache( struct key *key, const char *filename, const struct stat *st )
+{
+    struct reg_cache_buffer buf;
+    struct reg_cache_header *header;
+    char *name, *tmp = NULL;
+    size_t pos;
+    ssize_t ret;
+    int fd = -1;
+
+    buf.size = 65536;
+    buf.pos  = 0;
+    if (!(buf.data = malloc( buf.size ))) return;
+    reg_cache_alloc( &buf, sizeof(*header) );
+    reg_cache_add_subkeys( &buf, key, key );
+    if (!buf.data) return;
+
+    header = (struct reg_cache_header *)buf.data;
+    header->magic       = REG_CACHE_MAGIC;
+    header->version     = REG_CACHE_VERSION;
+    header->prefix_type = prefix_type;
+    header->size        = buf.pos;
+    header->file_size   = st->st_size;
+    header->file_mtime  = get_file_mtime( st );
+    header->file_ino    = st->st_ino;
+
+    if (!(name = get_registry_cache_name( filename ))) goto done;
+    if (!(tmp = malloc( strlen( name ) + 20 ))) goto done;
+    sprintf( tmp, "%s%lx.tmp", name, (long)getpid() );
+    if ((fd = open( tmp, O_CREAT | O_TRUNC | O_WRONLY, 0666 )) == -1) goto done;
+
+    for (pos = 0; pos < buf.pos; pos += ret)
+    {
+        if ((ret = write( fd, buf.data + pos, buf.pos - pos )) > 0) continue;
+        if (ret == -1 && errno == EINTR) ret = 0;
+        else break;
+    }
+    if (close( fd ) || pos < buf.pos || rename( tmp, name )) unlink( tmp );
+    else if (debug_level > 1) fprintf( stderr, "wineserver: saved registry cache %s\n", name );
+
+done:
+    free( tmp );
+    free( name );
+    free( buf.data );
+}
+
+/* check that a cache key record is consistent, and return the total size of the record */
+static size_t check_cache_record( const char *data, size_t pos, size_t size )
+{
+    const struct reg_cache_key *record = (const struct reg_cache_key *)(data + pos);
+    size_t end, len;
+    unsigned int i;
+
+    if (size - pos < sizeof(*record)) return 0;
+    if (record->size > size - pos || record->size < sizeof(*record)) return 0;
+    end = pos + record->size;
+    pos += sizeof(*record);
+    len = REG_CACHE_ALIGN( (size_t)record->pathlen ) + REG_CACHE_ALIGN( (size_t)record->classlen );
+    if (len > end - pos || record->classlen > 0xffff) return 0;
+    pos += len;
+    for (i = 0; i < record->nb_values; i++)
+    {
+        const struct reg_cache_value *value = (const struct reg_cache_value *)(data + pos);
+
+        if (end - pos < sizeof(*value)) return 0;
+        pos += sizeof(*value);
+        len = REG_CACHE_ALIGN( (size_t)value->namelen ) + REG_CACHE_ALIGN( (size_t)value->len );
+        if (len > end - pos || value->namelen > MAX_VALUE_LEN * sizeof(WCHAR)) return 0;
+        pos += len;
+    }
+    return pos == end ? record->size : 0;
+}
+
+/* load a key record from the cache, the same way load_keys() would do it for the text */
+static void load_cache_record( struct key *base, const char *data )
+{
+    const struct reg_cache_key *record = (const struct reg_cache_key *)data;
+    struct unicode_str name;
+    struct key_value *value;
+    struct key *key;
+    unsigned int i;
+    int index;
+
+    data += sizeof(*record);
+    name.str = (const WCHAR *)data;
+    name.len = record->pathlen;
+    data += REG_CACHE_ALIGN( record->pathlen );
+
+    if (!name.len) key = (struct key *)grab_object( base );
+    else if (!(key = create_key_recursive( base, &name, 0 ))) return;
+
+    update_key_time( key, record->modif );
+    if (record->classlen)
+    {
+        free( key->class );
+        if ((key->class = memdup( data, record->classlen ))) key->classlen = record->classlen;
+        else key->classlen = 0;
+    }
+    data += REG_CACHE_ALIGN( record->classlen );
+    key->flags |= record->flags & KEY_SYMLINK;
+
+    for (i = 0; i < record->nb_values; i++)
+    {
+        const struct reg_cache_value *value_record = (const struct reg_cache_value *)data;
+        void *ptr = NULL;
+
+        data += sizeof(*value_record);
+        name.str = (const WCHAR *)data;
+        name.len = value_record->namelen;
+        data += REG_CACHE_ALIGN( value_record->namelen );
+        if (value_record->len && !(ptr = memdup( data, value_record->len ))) break;
+        data += REG_CACHE_ALIGN( value_record->len );
+
+        if (!(value = find_value( key, &name, &index )) && !(value = insert_value( key, &name, index )))
+        {
+            free( ptr );
+            break;
+        }
+        free( value->data );
+        value->data = ptr;
+        value->len  = value_record->len;
+        value->type = value_record->type;
+    }
+    release_object( key );
+}
+
+/* load a registry branch from its binary cache if it is up to date; return 0 if it can't be used */
+static int load_registry_cache( struct key *key, const char *filename, const struct stat *st )
+{
+#ifdef HAVE_SYS_MMAN_H
+    const struct reg_cache_header *header;
+    struct stat cache_st;
+    size_t pos, len;
+    char *name, *data;
+    int fd, ret = 0;
+
+    if (!(name = get_registry_cache_name( filename ))) return 0;
+    fd = open( name, O_RDONLY );
+    free( name );
+    if (fd == -1) return 0;
+    if (fstat( fd, &cache_st ) || cache_st.st_size < sizeof(*header) ||
+        (data = mmap( NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    header = (const struct reg_cache_header *)data;
+    if (header->magic != REG_CACHE_MAGIC || header->version != REG_CACHE_VERSION) goto done;
+    if (header->size != cache_st.st_size || header->file_size != st->st_size ||
+        header->file_mtime != get_file_mtime( st ) || header->file_ino != st->st_ino) goto done;
+    if (header->prefix_type != PREFIX_32BIT && header->prefix_type != PREFIX_64BIT) goto done;
+    if (prefix_type != PREFIX_UNKNOWN && header->prefix_type != prefix_type) goto done;
+
+    /* validate everything first, so that a corrupted cache doesn't leave a partial tree */
+    for (pos = sizeof(*header); pos < cache_st.st_size; pos += len)
+        if (!(len = check_cache_record( data, pos, cache_st.st_size ))) goto done;
+
+    prefix_type = header->prefix_type;
+    for (pos = sizeof(*header); pos < cache_st.st_size; pos += len)
+    {
+        len = ((const struct reg_cache_key *)(data + pos))->size;
+        load_cache_record( key, data + pos );
+    }
+    if (debug_level > 1) fprintf( stderr, "wineserver: loaded %s from cache\n", filename );
+    ret = 1;
+
+done:
+    munmap( data, cache_st.st_size );
+    return ret;
+#else
+    return 0;
+#endif
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct stat st;
     FILE *f;
 
     if ((f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
-        fclose( f );
-        if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        if (!use_registry_cache() || fstat( fileno( f ), &st ) || !load_registry_cache( key, filename, &st ))
         {
-            fprintf( stderr, "%s is not a valid registry file\n", filename );
-            return 1;
+            load_keys( key, filename, f, 0 );
+            if (get_error() == STATUS_NOT_REGISTRY_FILE)
+            {
+                fclose( f );
+                fprintf( stderr, "%s is not a valid registry file\n", filename );
+                return 1;
+            }
+            if (use_registry_cache() && !fstat( fileno( f ), &st ))
+                save_registry_cache( key, filename, &st );
         }
+        fclose( f );
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
@@ -1931,20 +2530,14 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
-/* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+/* write a registry branch to a file, going through a temp file if possible */
+static int write_branch( struct key *key, const char *path )
 {
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
     FILE *f;
 
-    if (!(key->flags & KEY_DIRTY))
-    {
-        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
-        return 1;
-    }
-
     /* test the file type */
 
     if ((fd = open( path, O_WRONLY )) != -1)
@@ -1999,12 +2592,127 @@ static int save_branch( struct key *key, const char *path )
         if (!ret) unlink( tmp );
     }
 
+    if (ret && use_registry_cache() && !stat( path, &st )) save_registry_cache( key, path, &st );
+
 done:
     free( tmp );
-    if (ret) make_clean( key );
     return ret;
 }
 
+/* save a registry branch to a file */
+static int save_branch( struct key *key, const char *path )
+{
+    if (!(key->flags & KEY_DIRTY))
+    {
+        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
+        return 1;
+    }
+    if (!write_branch( key, path )) return 0;
+    make_clean( key );
+    return 1;
+}
+
+static void save_process_dump( struct object *obj, int verbose )
+{
+    struct save_process *process = (struct save_process *)obj;
+    assert( obj->ops == &save_process_ops );
+    fprintf( stderr, "Registry save process pid=%d branches=%x\n", (int)process->pid, process->branches );
+}
+
+static void save_process_destroy( struct object *obj )
+{
+    struct save_process *process = (struct save_process *)obj;
+    assert( obj->ops == &save_process_ops );
+    if (process->fd) release_object( process->fd );
+}
+
+/* wait for the background save process to finish and collect its result */
+static void end_background_save(void)
+{
+    struct save_process *process = save_process;
+    unsigned int saved = 0;
+    int i, ret;
+
+    while ((ret = read( get_unix_fd( process->fd ), &saved, sizeof(saved) )) == -1 && errno == EINTR);
+    if (ret != sizeof(saved)) saved = 0;
+    while (waitpid( process->pid, NULL, 0 ) == -1 && errno == EINTR);
+
+    for (i = 0; i < save_branch_count; i++)
+    {
+        if (!(process->branches & (1 << i)) || (saved & (1 << i))) continue;
+        /* the branch was marked clean when the snapshot was taken */
+        fprintf( stderr, "wineserver: could not save registry branch to %s\n", save_branch_info[i].path );
+        make_dirty( save_branch_info[i].key );
+    }
+    if (debug_level > 1) fprintf( stderr, "wineserver: registry save process %d done\n", (int)process->pid );
+    save_process = NULL;
+    release_object( process );
+}
+
+static void save_process_poll_event( struct fd *fd, int event )
+{
+    assert( get_fd_user( fd ) == save_process );
+    end_background_save();
+}
+
+/* save the dirty branches from a forked child, so that the main loop doesn't have to wait
+ * for the registry to be formatted and written; return 0 if it couldn't be started */
+static int start_background_save(void)
+{
+    unsigned int branches = 0;
+    int i, fd[2];
+    pid_t pid;
+
+    for (i = 0; i < save_branch_count; i++)
+        if (save_branch_info[i].key->flags & KEY_DIRTY) branches |= 1 << i;
+    if (!branches) return 1;
+
+    if (pipe( fd ) == -1) return 0;
+    if ((pid = fork()) == -1)
+    {
+        close( fd[0] );
+        close( fd[1] );
+        return 0;
+    }
+    if (!pid)  /* child */
+    {
+        unsigned int saved = 0;
+
+        close( fd[0] );
+        for (i = 0; i < save_branch_count; i++)
+            if ((branches & (1 << i)) && write_branch( save_branch_info[i].key, save_branch_info[i].path ))
+                saved |= 1 << i;
+        write( fd[1], &saved, sizeof(saved) );
+        _exit( 0 );
+    }
+
+    close( fd[1] );
+    if (!(save_process = alloc_object( &save_process_ops )))
+    {
+        close( fd[0] );
+        goto failed;
+    }
+    save_process->pid = pid;
+    save_process->branches = branches;
+    if (!(save_process->fd = create_anonymous_fd( &save_process_fd_ops, fd[0], &save_process->obj, 0 )))
+    {
+        release_object( save_process );
+        save_process = NULL;
+        goto failed;
+    }
+    set_fd_events( save_process->fd, POLLIN );
+
+    /* the child has a snapshot, changes from now on need to be saved again */
+    for (i = 0; i < save_branch_count; i++)
+        if (branches & (1 << i)) make_clean( save_branch_info[i].key );
+    if (debug_level > 1) fprintf( stderr, "wineserver: started registry save process %d\n", (int)pid );
+    return 1;
+
+failed:
+    while (waitpid( pid, NULL, 0 ) == -1 && errno == EINTR);
+    return 0;
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -2012,8 +2720,12 @@ static void periodic_save( void *arg )
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    /* if the previous save is still running, simply try again next time */
+    if (!save_process && !start_background_save())
+    {
+        for (i = 0; i < save_branch_count; i++)
+            save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2031,6 +2743,8 @@ void flush_registry(void)
     int i;
 
     if (fchdir( config_dir_fd ) == -1) return;
+    /* wait for a background save first, it must not overwrite the files afterwards */
+    if (save_process) end_background_save();
     for (i = 0; i < save_branch_count; i++)
     {
         if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
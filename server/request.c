@@ -51,6 +51,15 @@
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
+#ifdef HAVE_STDINT_H
+# include <stdint.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+# include <sys/eventfd.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #ifdef __APPLE__
 # include <mach/mach_time.h>
 #endif
@@ -123,6 +132,19 @@ static const struct fd_ops master_socket_fd_ops =
     NULL                           /* reselect_async */
 };
 
+static void request_shm_poll_event( struct fd *fd, int event );
+
+static const struct fd_ops request_shm_fd_ops =
+{
+    NULL,                          /* get_poll_events */
+    request_shm_poll_event,        /* poll_event */
+    NULL,                          /* flush */
+    NULL,                          /* get_fd_type */
+    NULL,                          /* ioctl */
+    NULL,                          /* queue_async */
+    NULL                           /* reselect_async */
+};
+
 
 struct thread *current = NULL;  /* thread handling the current request */
 unsigned int global_error = 0;  /* global error code for when no thread is current */
@@ -134,6 +156,10 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
+static struct request_stats req_stats[REQ_NB_REQUESTS];  /* global request statistics */
+static unsigned __int64 stats_start_ticks;  /* stats ticks at startup, for calibration */
+static timeout_t stats_start_time;          /* monotonic time at startup, for calibration */
+
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
 {
@@ -252,11 +278,40 @@ void write_reply( struct thread *thread )
         fatal_protocol_error( thread, "reply write: %s\n", strerror( errno ));
 }
 
+#ifdef __linux__
+static inline void futex_wake( int *addr )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, 1, NULL, 0, 0 );
+}
+#else
+static inline void futex_wake( int *addr ) { }
+#endif
+
+/* send a reply to the current thread through its request mailbox */
+static void send_shm_reply( union generic_reply *reply )
+{
+    request_shm_t *shm = current->req_shm;
+
+    memcpy( &shm->header, reply, sizeof(*reply) );
+    if (current->reply_size) memcpy( shm->data, current->reply_data, current->reply_size );
+    free( current->reply_data );
+    current->reply_data = NULL;
+
+    __atomic_store_n( &shm->state, REQUEST_SHM_REPLY, __ATOMIC_SEQ_CST );
+    if (__atomic_load_n( &shm->waiting, __ATOMIC_SEQ_CST )) futex_wake( &shm->state );
+}
+
 /* send a reply to the current thread */
 static void send_reply( union generic_reply *reply )
 {
     int ret;
 
+    if (current->req_from_shm)
+    {
+        send_shm_reply( reply );
+        return;
+    }
+
     if (!current->reply_size)
     {
         if ((ret = write( get_unix_fd( current->reply_fd ),
@@ -294,11 +349,55 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* get the current time for request statistics; this needs to be cheap */
+static inline unsigned __int64 get_stats_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    return monotonic_counter();
+#endif
+}
+
+/* return the number of stats ticks per second */
+static unsigned __int64 get_stats_freq(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    timeout_t elapsed = monotonic_counter() - stats_start_time;
+    unsigned __int64 ticks = get_stats_ticks() - stats_start_ticks;
+
+    if (elapsed <= 0) return 0;
+    return (unsigned __int64)((double)ticks * TICKS_PER_SEC / elapsed);
+#else
+    return TICKS_PER_SEC;
+#endif
+}
+
+static inline void add_request_stats( struct request_stats *stats, unsigned __int64 ticks )
+{
+    unsigned int bucket = 0;
+
+    while (bucket < REQUEST_STATS_BUCKETS - 1 && (ticks >> (bucket + 9))) bucket++;
+    stats->count++;
+    stats->time += ticks;
+    stats->hist[bucket]++;
+}
+
+/* account the time spent in a request handler */
+static void update_request_stats( struct process *process, enum request req, unsigned __int64 ticks )
+{
+    add_request_stats( &req_stats[req], ticks );
+    if (!process->req_stats && !(process->req_stats = calloc( REQ_NB_REQUESTS, sizeof(*process->req_stats) )))
+        return;
+    add_request_stats( &process->req_stats[req], ticks );
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    unsigned __int64 start;
 
     current = thread;
     current->reply_size = 0;
@@ -308,7 +407,11 @@ static void call_req_handler( struct thread *thread )
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
+    {
+        start = get_stats_ticks();
         req_handlers[req]( &current->req, &reply );
+        update_request_stats( thread->process, req, get_stats_ticks() - start );
+    }
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
@@ -379,6 +482,71 @@ error:
         fatal_protocol_error( thread, "read: %s\n", strerror( errno ));
 }
 
+/* read a request from the shared memory mailbox of a thread */
+static void read_shm_request( struct thread *thread )
+{
+    request_shm_t *shm = thread->req_shm;
+    data_size_t size;
+    uint64_t count;
+
+    /* reset the eventfd counter, all the pending notifications are for the same request */
+    if (read( get_unix_fd( thread->req_notify_fd ), &count, sizeof(count) ) == -1 && errno != EAGAIN)
+    {
+        fatal_protocol_error( thread, "request notification read: %s\n", strerror( errno ));
+        return;
+    }
+    if (__atomic_load_n( &shm->state, __ATOMIC_ACQUIRE ) != REQUEST_SHM_REQUEST) return;
+
+    if (thread->req_toread || thread->reply_towrite)
+    {
+        fatal_protocol_error( thread, "mailbox request while a pipe request is in progress\n" );
+        return;
+    }
+    memcpy( &thread->req, &shm->header, sizeof(thread->req) );
+    if ((size = thread->req.request_header.request_size) > sizeof(shm->data) ||
+        thread->req.request_header.reply_size > sizeof(shm->data))
+    {
+        fatal_protocol_error( thread, "mailbox request %d too large\n", thread->req.request_header.req );
+        return;
+    }
+    if (size && !(thread->req_data = memdup( shm->data, size )))
+    {
+        fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                              size, thread->req.request_header.req );
+        return;
+    }
+
+    thread->req_from_shm = 1;
+    call_req_handler( thread );
+    thread->req_from_shm = 0;
+    free( thread->req_data );
+    thread->req_data = NULL;
+}
+
+static void request_shm_poll_event( struct fd *fd, int event )
+{
+    struct thread *thread = get_fd_user( fd );
+
+    grab_object( thread );
+    if (event & (POLLERR | POLLHUP)) set_fd_events( fd, -1 );
+    else if (event & POLLIN) read_shm_request( thread );
+    release_object( thread );
+}
+
+/* release the request mailbox of a dying thread, waking up the client if it's waiting on it */
+void release_request_shm( struct thread *thread )
+{
+    if (!thread->req_shm) return;
+
+    __atomic_store_n( &thread->req_shm->state, REQUEST_SHM_CLOSED, __ATOMIC_SEQ_CST );
+    futex_wake( &thread->req_shm->state );
+    if (thread->req_notify_fd) release_object( thread->req_notify_fd );
+    release_shared_memory( thread->req_shm_fd, thread->req_shm, sizeof(*thread->req_shm) );
+    thread->req_notify_fd = NULL;
+    thread->req_shm_fd = -1;
+    thread->req_shm = NULL;
+}
+
 /* receive a file descriptor on the process socket */
 int receive_fd( struct process *process )
 {
@@ -884,6 +1052,9 @@ void open_master_socket(void)
     assert( sizeof(union generic_request) == sizeof(struct request_max_size) );
     assert( sizeof(union generic_reply) == sizeof(struct request_max_size) );
 
+    stats_start_ticks = get_stats_ticks();
+    stats_start_time = monotonic_counter();
+
     /* make sure the stdio fds are open */
     fd = open( "/dev/null", O_RDWR );
     while (fd >= 0 && fd <= 2) fd = dup( fd );
@@ -964,3 +1135,104 @@ void close_master_socket( timeout_t timeout )
 
     master_timeout = add_timeout_user( timeout, close_socket_timeout, NULL );
 }
+
+static void dump_stats_line( const char *name, const struct request_stats *stats, double ticks_per_usec )
+{
+    unsigned int i;
+
+    fprintf( stderr, "%-32s %10llu %12.0f %10.2f ", name, (unsigned long long)stats->count,
+             stats->time / ticks_per_usec, stats->time / ticks_per_usec / stats->count );
+    for (i = 0; i < REQUEST_STATS_BUCKETS; i++) fprintf( stderr, " %u", stats->hist[i] );
+    fputc( '\n', stderr );
+}
+
+static int dump_process_request_stats( struct process *process, void *arg )
+{
+    double ticks_per_usec = *(double *)arg;
+    unsigned int i;
+
+    if (!process->req_stats) return 0;
+    fprintf( stderr, "process %04x:\n", process->id );
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+        if (process->req_stats[i].count)
+            dump_stats_line( get_request_name( i ), &process->req_stats[i], ticks_per_usec );
+    return 0;
+}
+
+/* dump the request statistics to stderr */
+void dump_request_stats(void)
+{
+    double ticks_per_usec = get_stats_freq() / 1000000.0;
+    unsigned int i;
+
+    if (ticks_per_usec <= 0) return;
+
+    fprintf( stderr, "wineserver: request statistics (histogram buckets are powers of 2 from %.2fus)\n",
+             512 / ticks_per_usec );
+    fprintf( stderr, "%-32s %10s %12s %10s  histogram\n", "request", "count", "total us", "avg us" );
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+        if (req_stats[i].count) dump_stats_line( get_request_name( i ), &req_stats[i], ticks_per_usec );
+
+    enum_processes( dump_process_request_stats, &ticks_per_usec );
+}
+
+/* retrieve the request statistics */
+DECL_HANDLER(get_request_stats)
+{
+    const struct request_stats *stats = req_stats;
+    data_size_t size;
+
+    /* statistics of other processes could leak what they are doing */
+    if (req->pid && req->pid != current->process->id)
+    {
+        set_error( STATUS_ACCESS_DENIED );
+        return;
+    }
+    if (req->pid) stats = current->process->req_stats;
+
+    reply->freq = get_stats_freq();
+    size = min( get_reply_max_size(), REQ_NB_REQUESTS * sizeof(*stats) );
+    if (stats) set_reply_data( stats, size );
+    else
+    {
+        void *ptr = set_reply_data_size( size );
+        if (ptr) memset( ptr, 0, size );
+    }
+}
+
+/* get the shared memory request mailbox of the current thread */
+DECL_HANDLER(get_request_shm)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    int notify_fd;
+
+    if (current->req_shm)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (!allocate_shared_memory( &current->req_shm_fd, (void **)&current->req_shm,
+                                 sizeof(*current->req_shm) ))
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    if ((notify_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK )) == -1)
+    {
+        file_set_error();
+        release_request_shm( current );
+        return;
+    }
+    if (!(current->req_notify_fd = create_anonymous_fd( &request_shm_fd_ops, notify_fd, &current->obj, 0 )))
+    {
+        release_request_shm( current );
+        return;
+    }
+    set_fd_edge_triggered( current->req_notify_fd );  /* reading resets the eventfd counter */
+    set_fd_events( current->req_notify_fd, POLLIN );
+    send_client_fd( current->process, current->req_shm_fd, 0 );
+    send_client_fd( current->process, notify_fd, 0 );
+#else
+    set_error( STATUS_NOT_SUPPORTED );
+#endif
+}
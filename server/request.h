@@ -54,6 +54,8 @@ extern int receive_fd( struct process *process );
 extern int send_client_fd( struct process *process, int fd, obj_handle_t handle );
 extern void read_request( struct thread *thread );
 extern void write_reply( struct thread *thread );
+extern void release_request_shm( struct thread *thread );
+extern void dump_request_stats(void);
 extern timeout_t monotonic_counter(void);
 extern void open_master_socket(void);
 extern void close_master_socket( timeout_t timeout );
@@ -65,6 +67,7 @@ extern int server_dir_fd, config_dir_fd;
 
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern const char *get_request_name( enum request req );
 
 /* get current tick count to return to client */
 static inline unsigned int get_tick_count(void)
@@ -167,7 +170,11 @@ DECL_HANDLER(alloc_file_handle);
 DECL_HANDLER(get_handle_unix_name);
 DECL_HANDLER(get_handle_fd);
 DECL_HANDLER(get_directory_cache_entry);
+DECL_HANDLER(get_directory_generation);
 DECL_HANDLER(get_shared_memory);
+DECL_HANDLER(get_request_shm);
+DECL_HANDLER(get_handle_table_shm);
+DECL_HANDLER(get_request_stats);
 DECL_HANDLER(flush);
 DECL_HANDLER(get_file_info);
 DECL_HANDLER(get_volume_info);
@@ -209,6 +216,7 @@ DECL_HANDLER(read_change);
 DECL_HANDLER(create_mapping);
 DECL_HANDLER(open_mapping);
 DECL_HANDLER(get_mapping_info);
+DECL_HANDLER(get_image_reloc_file);
 DECL_HANDLER(map_view);
 DECL_HANDLER(unmap_view);
 DECL_HANDLER(get_mapping_file);
@@ -488,7 +496,11 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_handle_unix_name,
     (req_handler)req_get_handle_fd,
     (req_handler)req_get_directory_cache_entry,
+    (req_handler)req_get_directory_generation,
     (req_handler)req_get_shared_memory,
+    (req_handler)req_get_request_shm,
+    (req_handler)req_get_handle_table_shm,
+    (req_handler)req_get_request_stats,
     (req_handler)req_flush,
     (req_handler)req_get_file_info,
     (req_handler)req_get_volume_info,
@@ -530,6 +542,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_create_mapping,
     (req_handler)req_open_mapping,
     (req_handler)req_get_mapping_info,
+    (req_handler)req_get_image_reloc_file,
     (req_handler)req_map_view,
     (req_handler)req_unmap_view,
     (req_handler)req_get_mapping_file,
@@ -1095,8 +1108,18 @@ C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_request, handle) == 12 )
 C_ASSERT( sizeof(struct get_directory_cache_entry_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_reply, entry) == 8 );
 C_ASSERT( sizeof(struct get_directory_cache_entry_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_directory_generation_request, fd) == 12 );
+C_ASSERT( sizeof(struct get_directory_generation_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_directory_generation_reply, gen) == 8 );
+C_ASSERT( sizeof(struct get_directory_generation_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_shared_memory_request, tid) == 12 );
 C_ASSERT( sizeof(struct get_shared_memory_request) == 16 );
+C_ASSERT( sizeof(struct get_request_shm_request) == 16 );
+C_ASSERT( sizeof(struct get_handle_table_shm_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_request, pid) == 12 );
+C_ASSERT( sizeof(struct get_request_stats_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_reply, freq) == 8 );
+C_ASSERT( sizeof(struct get_request_stats_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct flush_request, async) == 16 );
 C_ASSERT( sizeof(struct flush_request) == 56 );
 C_ASSERT( FIELD_OFFSET(struct flush_reply, event) == 8 );
@@ -1362,6 +1385,12 @@ C_ASSERT( FIELD_OFFSET(struct get_mapping_info_reply, size) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_mapping_info_reply, flags) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_mapping_info_reply, shared_file) == 20 );
 C_ASSERT( sizeof(struct get_mapping_info_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_image_reloc_file_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_image_reloc_file_request, access) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_image_reloc_file_request, base) == 24 );
+C_ASSERT( sizeof(struct get_image_reloc_file_request) == 32 );
+C_ASSERT( FIELD_OFFSET(struct get_image_reloc_file_reply, reloc_file) == 8 );
+C_ASSERT( sizeof(struct get_image_reloc_file_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct map_view_request, mapping) == 12 );
 C_ASSERT( FIELD_OFFSET(struct map_view_request, access) == 16 );
 C_ASSERT( FIELD_OFFSET(struct map_view_request, base) == 24 );
@@ -2572,6 +2601,8 @@ C_ASSERT( FIELD_OFFSET(struct get_esync_fd_reply, type) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_esync_fd_reply, shm_idx) == 12 );
 C_ASSERT( sizeof(struct get_esync_fd_reply) == 16 );
 C_ASSERT( sizeof(struct get_esync_apc_fd_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_esync_apc_fd_reply, shm_idx) == 8 );
+C_ASSERT( sizeof(struct get_esync_apc_fd_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct esync_msgwait_request, in_msgwait) == 12 );
 C_ASSERT( sizeof(struct esync_msgwait_request) == 16 );
 
@@ -248,6 +248,10 @@ static inline void init_thread_structure( struct thread *thread )
     thread->exit_poll       = NULL;
     thread->shm_fd          = -1;
     thread->shm             = NULL;
+    thread->req_shm_fd      = -1;
+    thread->req_shm         = NULL;
+    thread->req_notify_fd   = NULL;
+    thread->req_from_shm    = 0;
 
     thread->creation_time = current_time;
     thread->exit_time     = 0;
@@ -368,6 +372,7 @@ struct thread *create_thread( int fd, struct process *process, const struct secu
         thread->esync_apc_fd = esync_create_fd( 0, 0 );
     }
 
+    set_fd_edge_triggered( thread->request_fd );  /* requests are read in full on each event */
     set_fd_events( thread->request_fd, POLLIN );  /* start listening to events */
     add_process_thread( thread->process, thread );
     return thread;
@@ -412,6 +417,7 @@ static void cleanup_thread( struct thread *thread )
     if (thread->request_fd) release_object( thread->request_fd );
     if (thread->reply_fd) release_object( thread->reply_fd );
     if (thread->wait_fd) release_object( thread->wait_fd );
+    release_request_shm( thread );
     cleanup_clipboard_thread(thread);
     destroy_thread_windows( thread );
     free_msg_queue( thread );
@@ -95,6 +95,10 @@ struct thread
     struct timeout_user   *exit_poll;     /* poll if the thread/process has exited already */
     int                    shm_fd;        /* file descriptor for thread local shared memory */
     shmlocal_t            *shm;           /* thread local shared memory pointer */
+    int                    req_shm_fd;    /* file descriptor for the request mailbox */
+    request_shm_t         *req_shm;       /* shared memory request mailbox */
+    struct fd             *req_notify_fd; /* eventfd signaled when a request is in the mailbox */
+    int                    req_from_shm;  /* is the current request from the mailbox? */
 };
 
 struct thread_snapshot
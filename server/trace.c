@@ -545,6 +545,25 @@ static void dump_varargs_bytes( const char *prefix, data_size_t size )
     remove_data( size );
 }
 
+static void dump_varargs_request_stats( const char *prefix, data_size_t size )
+{
+    const struct request_stats *stats = cur_data;
+    data_size_t i, len = size / sizeof(*stats);
+    const char *sep = "";
+
+    fprintf( stderr,"%s{", prefix );
+    for (i = 0; i < len; i++)
+    {
+        if (!stats[i].count) continue;
+        fprintf( stderr, "%s%s:", sep, get_request_name( i ) );
+        dump_uint64( "", &stats[i].count );
+        dump_uint64( "/", &stats[i].time );
+        sep = ",";
+    }
+    fputc( '}', stderr );
+    remove_data( size );
+}
+
 static void dump_varargs_string( const char *prefix, data_size_t size )
 {
     fprintf( stderr, "%s\"%.*s\"", prefix, (int)size, (const char *)cur_data );
@@ -1893,11 +1912,40 @@ static void dump_get_directory_cache_entry_reply( const struct get_directory_cac
     dump_varargs_ints( ", free=", cur_size );
 }
 
+static void dump_get_directory_generation_request( const struct get_directory_generation_request *req )
+{
+    fprintf( stderr, " fd=%d", req->fd );
+}
+
+static void dump_get_directory_generation_reply( const struct get_directory_generation_reply *req )
+{
+    fprintf( stderr, " gen=%08x", req->gen );
+}
+
 static void dump_get_shared_memory_request( const struct get_shared_memory_request *req )
 {
     fprintf( stderr, " tid=%04x", req->tid );
 }
 
+static void dump_get_request_shm_request( const struct get_request_shm_request *req )
+{
+}
+
+static void dump_get_handle_table_shm_request( const struct get_handle_table_shm_request *req )
+{
+}
+
+static void dump_get_request_stats_request( const struct get_request_stats_request *req )
+{
+    fprintf( stderr, " pid=%04x", req->pid );
+}
+
+static void dump_get_request_stats_reply( const struct get_request_stats_reply *req )
+{
+    dump_uint64( " freq=", &req->freq );
+    dump_varargs_request_stats( ", stats=", cur_size );
+}
+
 static void dump_flush_request( const struct flush_request *req )
 {
     dump_async_data( " async=", &req->async );
@@ -2387,6 +2435,18 @@ static void dump_get_mapping_info_reply( const struct get_mapping_info_reply *re
     dump_varargs_pe_image_info( ", image=", cur_size );
 }
 
+static void dump_get_image_reloc_file_request( const struct get_image_reloc_file_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", access=%08x", req->access );
+    dump_uint64( ", base=", &req->base );
+}
+
+static void dump_get_image_reloc_file_reply( const struct get_image_reloc_file_reply *req )
+{
+    fprintf( stderr, " reloc_file=%04x", req->reloc_file );
+}
+
 static void dump_map_view_request( const struct map_view_request *req )
 {
     fprintf( stderr, " mapping=%04x", req->mapping );
@@ -4831,6 +4891,11 @@ static void dump_get_esync_apc_fd_request( const struct get_esync_apc_fd_request
 {
 }
 
+static void dump_get_esync_apc_fd_reply( const struct get_esync_apc_fd_reply *req )
+{
+    fprintf( stderr, " shm_idx=%08x", req->shm_idx );
+}
+
 static void dump_esync_msgwait_request( const struct esync_msgwait_request *req )
 {
     fprintf( stderr, " in_msgwait=%d", req->in_msgwait );
@@ -4885,7 +4950,11 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_unix_name_request,
     (dump_func)dump_get_handle_fd_request,
     (dump_func)dump_get_directory_cache_entry_request,
+    (dump_func)dump_get_directory_generation_request,
     (dump_func)dump_get_shared_memory_request,
+    (dump_func)dump_get_request_shm_request,
+    (dump_func)dump_get_handle_table_shm_request,
+    (dump_func)dump_get_request_stats_request,
     (dump_func)dump_flush_request,
     (dump_func)dump_get_file_info_request,
     (dump_func)dump_get_volume_info_request,
@@ -4927,6 +4996,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_mapping_request,
     (dump_func)dump_open_mapping_request,
     (dump_func)dump_get_mapping_info_request,
+    (dump_func)dump_get_image_reloc_file_request,
     (dump_func)dump_map_view_request,
     (dump_func)dump_unmap_view_request,
     (dump_func)dump_get_mapping_file_request,
@@ -5203,7 +5273,11 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_unix_name_reply,
     (dump_func)dump_get_handle_fd_reply,
     (dump_func)dump_get_directory_cache_entry_reply,
+    (dump_func)dump_get_directory_generation_reply,
+    NULL,
     NULL,
+    NULL,
+    (dump_func)dump_get_request_stats_reply,
     (dump_func)dump_flush_reply,
     (dump_func)dump_get_file_info_reply,
     (dump_func)dump_get_volume_info_reply,
@@ -5245,6 +5319,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_mapping_reply,
     (dump_func)dump_open_mapping_reply,
     (dump_func)dump_get_mapping_info_reply,
+    (dump_func)dump_get_image_reloc_file_reply,
     NULL,
     NULL,
     (dump_func)dump_get_mapping_file_reply,
@@ -5468,7 +5543,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_create_esync_reply,
     (dump_func)dump_open_esync_reply,
     (dump_func)dump_get_esync_fd_reply,
-    NULL,
+    (dump_func)dump_get_esync_apc_fd_reply,
     NULL,
 };
 
@@ -5521,7 +5596,11 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_handle_unix_name",
     "get_handle_fd",
     "get_directory_cache_entry",
+    "get_directory_generation",
     "get_shared_memory",
+    "get_request_shm",
+    "get_handle_table_shm",
+    "get_request_stats",
     "flush",
     "get_file_info",
     "get_volume_info",
@@ -5563,6 +5642,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "create_mapping",
     "open_mapping",
     "get_mapping_info",
+    "get_image_reloc_file",
     "map_view",
     "unmap_view",
     "get_mapping_file",
@@ -6019,3 +6099,9 @@ void trace_reply( enum request req, const union generic_reply *reply )
     else fprintf( stderr, "%04x: %d() = %s\n",
                   current->id, req, get_status_name(current->error) );
 }
+
+/* return the name of a request, for dumping statistics */
+const char *get_request_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "?";
+}
@@ -66,12 +66,19 @@ int memicmp_strW( const WCHAR *str1, const WCHAR *str2, data_size_t len )
     return ret;
 }
 
-unsigned int hash_strW( const WCHAR *str, data_size_t len, unsigned int hash_size )
+/* case-insensitive string hash (FNV-1a with a final avalanche step), the low bits can
+ * be used directly to index a power of two sized table */
+unsigned int hash_strW( const WCHAR *str, data_size_t len )
 {
-    unsigned int i, hash = 0;
-
-    for (i = 0; i < len / sizeof(WCHAR); i++) hash = hash * 65599 + to_lower( str[i] );
-    return hash % hash_size;
+    unsigned int i, hash = 0x811c9dc5;
+
+    for (i = 0; i < len / sizeof(WCHAR); i++) hash = (hash ^ to_lower( str[i] )) * 0x01000193;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
 }
 
 WCHAR *ascii_to_unicode_str( const char *str, struct unicode_str *ret )